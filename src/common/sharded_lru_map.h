@@ -0,0 +1,57 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_SHARDED_LRU_MAP_H
+#define CEPH_SHARDED_LRU_MAP_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "common/lru_map.h"
+
+/*
+ * An lru_map split in shards by the hash of the keys, so lookups of
+ * different keys rarely wait on the same lock. Each shard holds at most
+ * max / shards entries and evicts its own least recently used ones.
+ */
+template <class K, class V, class Hash = std::hash<K>>
+class sharded_lru_map {
+  std::vector<std::unique_ptr<lru_map<K, V>>> shards;
+
+  lru_map<K, V>& shard_of(const K& key) {
+    return *shards[Hash{}(key) % shards.size()];
+  }
+
+public:
+  sharded_lru_map(size_t max, size_t num_shards) {
+    num_shards = std::max<size_t>(num_shards, 1);
+    const size_t per_shard = std::max<size_t>(max / num_shards, 1);
+    shards.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; i++) {
+      shards.push_back(std::make_unique<lru_map<K, V>>(per_shard));
+    }
+  }
+
+  bool find(const K& key, V& value) {
+    return shard_of(key).find(key, value);
+  }
+  void add(const K& key, V& value) {
+    shard_of(key).add(key, value);
+  }
+  void erase(const K& key) {
+    shard_of(key).erase(key);
+  }
+};
+
+#endif
@@ -19,12 +19,13 @@
 #include <driver/sfs/sqlite/dbconn.h>
 #include <driver/sfs/sqlite/sqlite_buckets.h>
 #include <driver/sfs/sqlite/sqlite_multipart.h>
+#include <driver/sfs/sqlite/sqlite_stats.h>
 #include <fmt/core.h>
 
 #include <cerrno>
 #include <fstream>
-#include <limits>
 #include <string>
+#include <utility>
 
 #include "common/Formatter.h"
 #include "driver/sfs/multipart.h"
@@ -34,6 +35,7 @@
 #include "driver/sfs/sqlite/sqlite_list.h"
 #include "driver/sfs/sqlite/sqlite_versioned_objects.h"
 #include "driver/sfs/types.h"
+#include "rgw_bucket_policy_cache.h"
 #include "rgw_common.h"
 #include "rgw_sal_sfs.h"
 
@@ -199,26 +201,21 @@ int SFSBucket::list(
   }
 
   sfs::sqlite::SQLiteList list(store->db_conn);
-  std::string start_with(params.marker.name);
-  if (!params.delim.empty()) {
-    // Having a marker and delimiter means that the user wants to skip
-    // a whole common prefix. Since we compare names ASCII greater
-    // than style, append characters to make this the "greatest"
-    // prefixed name
-    auto delim_pos = start_with.find(params.delim);
-    if (delim_pos != params.delim.npos) {
-      start_with.append(
-          sfs::S3_MAX_OBJECT_NAME_BYTES - delim_pos,
-          std::numeric_limits<char>::max()
-      );
-    }
-  }
+  const std::string& start_with = params.marker.name;
 
   // Version listing on unversioned buckets is equivalent to object listing
   const bool want_list_versions =
       versioning_enabled() ? params.list_versions : false;
   const bool listing_succeeded = [&]() {
-    if (want_list_versions) {
+    if (!params.delim.empty()) {
+      // Seeks past each common prefix instead of listing every name in
+      // it. A marker inside a common prefix skips the whole prefix.
+      return list.list_delimited(
+          want_list_versions, get_bucket_id(), params.prefix, params.delim,
+          start_with, max, results.objs, results.common_prefixes,
+          &results.is_truncated
+      );
+    } else if (want_list_versions) {
       return list.versions(
           get_bucket_id(), params.prefix, start_with, max, results.objs,
           &results.is_truncated
@@ -234,52 +231,25 @@ int SFSBucket::list(
     lsfs_dout(dpp, 10) << fmt::format(
                               "list (prefix:{}, start_after:{}, "
                               "max:{}) failed.",
-                              params.prefix, start_with, max,
-                              results.objs.size(), results.next_marker,
-                              results.is_truncated
+                              params.prefix, start_with, max
                           )
                        << dendl;
     return -ERR_INTERNAL_ERROR;
   }
 
-  if (!params.delim.empty()) {
-    std::vector<rgw_bucket_dir_entry> new_results;
-    list.roll_up_common_prefixes(
-        params.prefix, params.delim, results.objs, results.common_prefixes,
-        new_results
-    );
-
-    // Is there actually more after the rolled up common prefix? We
-    // can't tell from the original object query. Ask again for
-    // anything after the prefix.
-    if (!results.common_prefixes.empty()) {
-      std::vector<rgw_bucket_dir_entry> objects_after;
-      std::string query = std::prev(results.common_prefixes.end())->first;
-      query.append(
-          sfs::S3_MAX_OBJECT_NAME_BYTES - query.size(),
-          std::numeric_limits<char>::max()
-      );
-      list.objects(get_bucket_id(), params.prefix, query, 1, objects_after);
-      results.is_truncated = objects_after.size() > 0;
-    }
-    lsfs_dout(dpp, 10) << fmt::format(
-                              "common prefix rollup #objs:{} -> #objs:{}, "
-                              "#prefix:{}, more:{}",
-                              results.objs.size(), new_results.size(),
-                              results.common_prefixes.size(),
-                              results.is_truncated
-                          )
-                       << dendl;
-
-    results.objs = new_results;
-  }
   if (results.is_truncated) {
-    if (results.common_prefixes.empty()) {
+    // The next marker is the last entry of the page, whether it is an
+    // object or a common prefix
+    const std::string* last_prefix =
+        results.common_prefixes.empty()
+            ? nullptr
+            : &std::prev(results.common_prefixes.end())->first;
+    if (results.objs.empty() ||
+        (last_prefix && *last_prefix > results.objs.back().key.name)) {
+      results.next_marker = rgw_obj_key(*last_prefix);
+    } else {
       const auto& last = results.objs.back();
       results.next_marker = rgw_obj_key(last.key.name, last.key.instance);
-    } else {
-      const std::string& last = std::prev(results.common_prefixes.end())->first;
-      results.next_marker = rgw_obj_key(last);
     }
   }
 
@@ -310,6 +280,55 @@ int SFSBucket::list(
   return 0;
 }
 
+/**
+ * Delete a batch of objects in a single transaction.
+ */
+int SFSBucket::delete_objects(
+    const DoutPrefixProvider* dpp, std::vector<DeleteObjectsEntry>& batch,
+    optional_yield y
+) {
+  if (batch.empty()) {
+    return 0;
+  }
+  const bool versioned = versioning_enabled();
+  lsfs_dout(dpp, 10) << fmt::format(
+                            "bucket: {}, versioning: {}, objects: {}",
+                            get_name(), versioned, batch.size()
+                        )
+                     << dendl;
+
+  std::vector<rgw_obj_key> keys;
+  keys.reserve(batch.size());
+  for (const auto& entry : batch) {
+    keys.push_back(entry.key);
+  }
+  std::vector<sfs::sqlite::DBDeleteObjectKey> results;
+  if (!bucket->delete_objects(keys, versioned, results, y)) {
+    lsfs_dout(dpp, -1) << fmt::format(
+                              "failed to delete {} objects in bucket {}",
+                              batch.size(), get_name()
+                          )
+                       << dendl;
+    return -ERR_INTERNAL_ERROR;
+  }
+  // as SFSObject::SFSDeleteOp::delete_obj() reports it
+  for (size_t i = 0; i < batch.size(); i++) {
+    auto& entry = batch[i];
+    const auto& result = results[i];
+    entry.ret = 0;
+    entry.delete_marker = versioned;
+    if (versioned) {
+      entry.version_id = result.delete_marker_added ? result.delete_marker_id
+                                                    : entry.key.instance;
+    } else {
+      entry.version_id.clear();
+    }
+    entry.size = result.deleted_size;
+    entry.etag = result.deleted_etag;
+  }
+  return 0;
+}
+
 int SFSBucket::remove_bucket(
     const DoutPrefixProvider* dpp, bool delete_children,
     bool /*forward_to_master*/, req_info* /*req_info*/, optional_yield y
@@ -373,10 +392,8 @@ int SFSBucket::set_acl(
   acls.encode(aclp_bl);
   attrs[RGW_ATTR_ACL] = aclp_bl;
 
-  sfs::get_meta_buckets(get_store().db_conn)
-      ->store_bucket(sfs::sqlite::DBOPBucketInfo(get_info(), get_attrs()));
-
-  store->_refresh_buckets_safe();
+  store->_update_bucket(bucket, get_info(), get_attrs());
+  RGWBucketPolicyCache::get(store->ctx()).invalidate(get_bucket_id());
   return 0;
 }
 
@@ -424,10 +441,9 @@ int SFSBucket::merge_and_store_attrs(
     }
   }
 
-  sfs::get_meta_buckets(get_store().db_conn)
-      ->store_bucket(sfs::sqlite::DBOPBucketInfo(get_info(), get_attrs()));
-
-  store->_refresh_buckets_safe();
+  store->_update_bucket(bucket, get_info(), get_attrs());
+  // drop the policy and ACL parsed from the previous attrs
+  RGWBucketPolicyCache::get(store->ctx()).invalidate(get_bucket_id());
   return 0;
 }
 
@@ -563,17 +579,65 @@ int SFSBucket::rebuild_index(const DoutPrefixProvider* dpp) {
   return -ENOTSUP;
 }
 
+/// Same checks as RGWQuotaHandler, on the SFS counters.
+static bool is_quota_exceeded(
+    const DoutPrefixProvider* dpp, const char* entity,
+    const RGWQuotaInfo& quota, const sfs::sqlite::SQLiteStats::Stats& stats,
+    uint64_t num_objs, uint64_t obj_size
+) {
+  if (!quota.enabled) {
+    return false;
+  }
+  if (quota.max_objects >= 0 &&
+      std::cmp_greater(stats.obj_count + num_objs, quota.max_objects)) {
+    ldpp_dout(dpp, 10) << fmt::format(
+                              "{} quota exceeded: objects: {}, max objects: {}",
+                              entity, stats.obj_count, quota.max_objects
+                          )
+                       << dendl;
+    return true;
+  }
+  const uint64_t cur_size =
+      quota.check_on_raw ? stats.size : stats.size_rounded;
+  const uint64_t new_size =
+      quota.check_on_raw ? obj_size : rgw_rounded_objsize(obj_size);
+  if (quota.max_size >= 0 &&
+      std::cmp_greater(cur_size + new_size, quota.max_size)) {
+    ldpp_dout(dpp, 10) << fmt::format(
+                              "{} quota exceeded: size: {}, new object size: "
+                              "{}, max size: {}",
+                              entity, cur_size, new_size, quota.max_size
+                          )
+                       << dendl;
+    return true;
+  }
+  return false;
+}
+
 int SFSBucket::check_quota(
     const DoutPrefixProvider* dpp, RGWQuota& quota, uint64_t obj_size,
-    optional_yield /*y*/, bool /*check_size_only*/
+    optional_yield /*y*/, bool check_size_only
 ) {
-  ldpp_dout(dpp, 10) << __func__
-                     << ": user(max size: " << quota.user_quota.max_size
-                     << ", max objs: " << quota.user_quota.max_objects
-                     << "), bucket(max size: " << quota.bucket_quota.max_size
-                     << ", max objs: " << quota.bucket_quota.max_objects
-                     << "), obj size: " << obj_size << dendl;
-  ldpp_dout(dpp, 10) << __func__ << ": not implemented, return okay." << dendl;
+  if (!quota.bucket_quota.enabled && !quota.user_quota.enabled) {
+    return 0;
+  }
+  // when only checking the size, the object has been accounted already
+  const uint64_t num_objs = check_size_only ? 0 : 1;
+  sfs::sqlite::SQLiteStats statsdb(store->db_conn);
+  if (quota.bucket_quota.enabled &&
+      is_quota_exceeded(
+          dpp, "bucket", quota.bucket_quota,
+          statsdb.get_bucket_stats(get_bucket_id()), num_objs, obj_size
+      )) {
+    return -ERR_QUOTA_EXCEEDED;
+  }
+  if (quota.user_quota.enabled &&
+      is_quota_exceeded(
+          dpp, "user", quota.user_quota,
+          statsdb.get_user_stats(get_info().owner.id), num_objs, obj_size
+      )) {
+    return -ERR_QUOTA_EXCEEDED;
+  }
   return 0;
 }
 
@@ -581,9 +645,16 @@ int SFSBucket::read_stats(
     const DoutPrefixProvider* /*dpp*/,
     const bucket_index_layout_generation& /*idx_layout*/, int /*shard_id*/,
     std::string* /*bucket_ver*/, std::string* /*master_ver*/,
-    std::map<RGWObjCategory, RGWStorageStats>& /*stats*/,
+    std::map<RGWObjCategory, RGWStorageStats>& stats,
     std::string* /*max_marker*/, bool* /*syncstopped*/
 ) {
+  sfs::sqlite::SQLiteStats statsdb(store->db_conn);
+  const auto bucket_stats = statsdb.get_bucket_stats(get_bucket_id());
+  auto& main = stats[RGWObjCategory::Main];
+  main.category = RGWObjCategory::Main;
+  main.size = main.size_utilized = bucket_stats.size;
+  main.size_rounded = bucket_stats.size_rounded;
+  main.num_objects = bucket_stats.obj_count;
   return 0;
 }
 int SFSBucket::read_stats_async(
@@ -597,35 +668,23 @@ int SFSBucket::read_stats_async(
 int SFSBucket::sync_user_stats(
     const DoutPrefixProvider* /*dpp*/, optional_yield /*y*/
 ) {
+  // user stats are updated in the same transaction as the bucket's
+  // objects, there is nothing to sync
   return 0;
 }
 
 int SFSBucket::update_container_stats(const DoutPrefixProvider* dpp) {
+  sfs::sqlite::SQLiteStats statsdb(store->db_conn);
+  const auto stats = statsdb.get_bucket_stats(get_bucket_id());
   lsfs_dout(dpp, 10) << fmt::format(
-                            "update bucket {} (id {}) stats", get_name(),
-                            get_bucket_id()
-                        )
-                     << dendl;
-  sfs::sqlite::SQLiteBuckets bucketdb(store->db_conn);
-  auto stats = bucketdb.get_stats(get_bucket_id());
-
-  if (!stats.has_value()) {
-    lsfs_dout(dpp, 10) << fmt::format(
-                              "unable to obtain stats for bucket {} (id {}) -- "
-                              "no such bucket!",
-                              get_name(), get_bucket_id()
-                          )
-                       << dendl;
-    return -ERR_NO_SUCH_BUCKET;
-  }
-
-  lsfs_dout(dpp, 10) << fmt::format(
-                            "bucket {} stats: size: {}, obj_cnt: {}",
-                            get_name(), stats->size, stats->obj_count
+                            "bucket {} (id {}) stats: size: {}, obj_cnt: {}",
+                            get_name(), get_bucket_id(), stats.size,
+                            stats.obj_count
                         )
                      << dendl;
-  ent.size = ent.size_rounded = stats->size;
-  ent.count = stats->obj_count;
+  ent.size = stats.size;
+  ent.size_rounded = stats.size_rounded;
+  ent.count = stats.obj_count;
   return 0;
 }
 
@@ -641,10 +700,7 @@ int SFSBucket::put_info(
     return -ERR_NOT_IMPLEMENTED;
   }
 
-  sfs::get_meta_buckets(get_store().db_conn)
-      ->store_bucket(sfs::sqlite::DBOPBucketInfo(get_info(), get_attrs()));
-
-  store->_refresh_buckets_safe();
+  store->_update_bucket(bucket, get_info(), get_attrs());
   return 0;
 }
 
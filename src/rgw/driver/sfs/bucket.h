@@ -75,6 +75,14 @@ class SFSBucket : public StoreBucket {
       const DoutPrefixProvider* dpp, ListParams&, int, ListResults&,
       optional_yield y
   ) override;
+  virtual bool supports_delete_objects() const override { return true; }
+  /**
+   * Delete a batch of objects in a single transaction.
+   */
+  virtual int delete_objects(
+      const DoutPrefixProvider* dpp, std::vector<DeleteObjectsEntry>& batch,
+      optional_yield y
+  ) override;
   /**
    * Remove this bucket.
    */
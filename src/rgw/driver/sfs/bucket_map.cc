@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "rgw/driver/sfs/bucket_map.h"
+
+#include <algorithm>
+
+namespace rgw::sal::sfs {
+
+void BucketMap::put(Shard& shard, const std::string& name, Entry entry) {
+  auto [it, inserted] = shard.buckets.try_emplace(name, std::move(entry));
+  if (!inserted) {
+    if (!it->second.bucket) {
+      --shard.negative_entries;
+    }
+    it->second = std::move(entry);
+  }
+  if (!it->second.bucket) {
+    ++shard.negative_entries;
+  }
+}
+
+void BucketMap::erase(
+    Shard& shard, std::unordered_map<std::string, Entry>::iterator it
+) {
+  if (!it->second.bucket) {
+    --shard.negative_entries;
+  }
+  shard.buckets.erase(it);
+}
+
+void BucketMap::erase_expired_negative_entries(Shard& shard) {
+  const auto now = ceph::coarse_mono_clock::now();
+  for (auto it = shard.buckets.begin(); it != shard.buckets.end();) {
+    const auto current = it++;
+    if (!current->second.bucket && current->second.expires <= now) {
+      erase(shard, current);
+    }
+  }
+}
+
+BucketRef BucketMap::get(const std::string& name) const {
+  const auto& shard = shard_for(name);
+  std::shared_lock l(shard.lock);
+  const auto it = shard.buckets.find(name);
+  if (it == shard.buckets.cend()) {
+    return nullptr;
+  }
+  return it->second.bucket;
+}
+
+bool BucketMap::find(const std::string& name, BucketRef& bucket) const {
+  const auto& shard = shard_for(name);
+  std::shared_lock l(shard.lock);
+  const auto it = shard.buckets.find(name);
+  if (it == shard.buckets.cend()) {
+    return false;
+  }
+  if (!it->second.bucket &&
+      it->second.expires <= ceph::coarse_mono_clock::now()) {
+    return false;
+  }
+  bucket = it->second.bucket;
+  return true;
+}
+
+bool BucketMap::contains(const std::string& name) const {
+  const auto& shard = shard_for(name);
+  std::shared_lock l(shard.lock);
+  const auto it = shard.buckets.find(name);
+  return it != shard.buckets.cend() && it->second.bucket;
+}
+
+bool BucketMap::add(const BucketRef& bucket, uint64_t generation) {
+  const auto name = bucket->get_name();
+  auto& shard = shard_for(name);
+  std::unique_lock l(shard.lock);
+  const auto it = shard.buckets.find(name);
+  if (it != shard.buckets.end() && it->second.generation > generation) {
+    // changed or loaded again since it was stored
+    return true;
+  }
+  if (generation < shard.uncached_generation) {
+    return false;
+  }
+  put(shard, name, {bucket, generation, {}});
+  return true;
+}
+
+BucketRef BucketMap::add_loaded(
+    const std::string& name, const BucketRef& bucket, uint64_t generation,
+    bool* kept
+) {
+  auto& shard = shard_for(name);
+  std::unique_lock l(shard.lock);
+  const auto it = shard.buckets.find(name);
+  if (it != shard.buckets.end() && it->second.generation > generation) {
+    // changed or loaded again while we were reading it
+    if (kept) {
+      *kept = true;
+    }
+    return it->second.bucket;
+  }
+  if (generation < shard.uncached_generation) {
+    // a bucket of this shard changed without an entry to record it in,
+    // this one may be among them
+    if (kept) {
+      *kept = false;
+    }
+    return bucket;
+  }
+  if (kept) {
+    *kept = true;
+  }
+  if (bucket) {
+    put(shard, name, {bucket, generation, {}});
+    return bucket;
+  }
+  if (shard.negative_entries >= MAX_NEGATIVE_ENTRIES) {
+    erase_expired_negative_entries(shard);
+    if (shard.negative_entries >= MAX_NEGATIVE_ENTRIES) {
+      return nullptr;
+    }
+  }
+  put(shard, name,
+      {nullptr, generation, ceph::coarse_mono_clock::now() + negative_ttl});
+  return nullptr;
+}
+
+void BucketMap::update(const BucketRef& bucket, uint64_t generation) {
+  const auto name = bucket->get_name();
+  auto& shard = shard_for(name);
+  std::unique_lock l(shard.lock);
+  auto it = shard.buckets.find(name);
+  if (it == shard.buckets.end() || !it->second.bucket) {
+    if (it != shard.buckets.end()) {
+      erase(shard, it);
+    }
+    shard.uncached_generation = std::max(shard.uncached_generation, generation);
+    return;
+  }
+  if (it->second.generation < generation) {
+    it->second.bucket = bucket;
+    it->second.generation = generation;
+  }
+}
+
+void BucketMap::remove(const std::string& name) {
+  const auto removed = next_generation();
+  auto& shard = shard_for(name);
+  std::unique_lock l(shard.lock);
+  auto it = shard.buckets.find(name);
+  if (it != shard.buckets.end()) {
+    erase(shard, it);
+  }
+  shard.uncached_generation = std::max(shard.uncached_generation, removed);
+}
+
+void BucketMap::reset(
+    const std::vector<BucketRef>& buckets, uint64_t generation
+) {
+  std::array<std::unordered_map<std::string, Entry>, NUM_SHARDS> fresh;
+  for (const auto& bucket : buckets) {
+    const auto name = bucket->get_name();
+    fresh[std::hash<std::string>{}(name) % NUM_SHARDS][name] =
+        Entry{bucket, generation, {}};
+  }
+  for (size_t i = 0; i < NUM_SHARDS; ++i) {
+    std::unique_lock l(shards[i].lock);
+    shards[i].buckets.swap(fresh[i]);
+    shards[i].negative_entries = 0;
+  }
+  // the replaced entries are released here, outside of the locks
+}
+
+std::vector<BucketRef> BucketMap::list() const {
+  std::vector<BucketRef> result;
+  for (const auto& shard : shards) {
+    std::shared_lock l(shard.lock);
+    for (const auto& entry : shard.buckets) {
+      if (entry.second.bucket) {
+        result.push_back(entry.second.bucket);
+      }
+    }
+  }
+  return result;
+}
+
+size_t BucketMap::size() const {
+  size_t result = 0;
+  for (const auto& shard : shards) {
+    std::shared_lock l(shard.lock);
+    result += shard.buckets.size() - shard.negative_entries;
+  }
+  return result;
+}
+
+}  // namespace rgw::sal::sfs
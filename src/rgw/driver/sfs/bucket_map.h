@@ -0,0 +1,146 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#ifndef RGW_STORE_SFS_BUCKET_MAP_H
+#define RGW_STORE_SFS_BUCKET_MAP_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/ceph_mutex.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/types.h"
+
+namespace rgw::sal::sfs {
+
+/// In-memory index of the existing buckets, by name.
+///
+/// Every request looks its bucket up here, while buckets change rarely.
+/// The map is split in shards, each guarded by its own shared mutex:
+/// lookups only take a shared lock on the shard of the name they look
+/// for, and a change to a bucket exclusively locks that shard only for as
+/// long as it takes to patch its entry. The database is read and written
+/// outside of the locks.
+///
+/// BucketRefs are never modified once published. A change publishes a
+/// new sfs::Bucket in place of the old one, and holders of the old
+/// reference keep a consistent, if stale, view of the bucket.
+///
+/// Each state is published with a generation (see next_generation()),
+/// and a state is only replaced by a newer one. Lookups of buckets that
+/// don't exist are remembered for a short while too.
+class BucketMap {
+  static constexpr size_t NUM_SHARDS = 64;
+  /// Negative entries a shard holds at most
+  static constexpr size_t MAX_NEGATIVE_ENTRIES = 64;
+
+  struct Entry {
+    /// nullptr for a bucket known not to exist
+    BucketRef bucket;
+    uint64_t generation;
+    /// when a negative entry expires
+    ceph::coarse_mono_time expires;
+  };
+
+  struct Shard {
+    mutable ceph::shared_mutex lock =
+        ceph::make_shared_mutex("sfs_bucket_map_shard");
+    std::unordered_map<std::string, Entry> buckets;
+    size_t negative_entries = 0;
+    /// Generation of the latest change that found no entry to replace
+    /// (removals included). A load started before it may have read an
+    /// older state, and isn't kept.
+    uint64_t uncached_generation = 0;
+  };
+
+  const ceph::timespan negative_ttl;
+  std::atomic<uint64_t> generation{0};
+  std::array<Shard, NUM_SHARDS> shards;
+
+  Shard& shard_for(const std::string& name) {
+    return shards[std::hash<std::string>{}(name) % NUM_SHARDS];
+  }
+  const Shard& shard_for(const std::string& name) const {
+    return shards[std::hash<std::string>{}(name) % NUM_SHARDS];
+  }
+
+  /// Sets the entry of `name` in `shard`, whose lock is held
+  static void put(Shard& shard, const std::string& name, Entry entry);
+  static void erase(
+      Shard& shard, std::unordered_map<std::string, Entry>::iterator it
+  );
+  static void erase_expired_negative_entries(Shard& shard);
+
+ public:
+  explicit BucketMap(ceph::timespan _negative_ttl = std::chrono::seconds(2))
+      : negative_ttl(_negative_ttl) {}
+  BucketMap(const BucketMap&) = delete;
+  BucketMap& operator=(const BucketMap&) = delete;
+
+  /// Orders the states of the buckets. A change takes a generation right
+  /// after it is stored, on the database writer thread, and a load takes
+  /// one before it reads the database: of two states, the one with the
+  /// higher generation is the newer.
+  uint64_t next_generation() { return ++generation; }
+
+  /// Returns the bucket named `name`, or nullptr if there is none.
+  BucketRef get(const std::string& name) const;
+  /// Like get(), but returns false if the map doesn't know whether
+  /// bucket `name` exists and it has to be loaded (see add_loaded()).
+  bool find(const std::string& name, BucketRef& bucket) const;
+  bool contains(const std::string& name) const;
+
+  /// Publishes `bucket`, just created and stored with `generation`,
+  /// unless the map has a newer state of it. Which of concurrent
+  /// creations of a name wins is up to the database. Returns false if a
+  /// change of its shard the map couldn't record, maybe a removal of the
+  /// bucket, happened since it was stored: the bucket is left to be
+  /// loaded.
+  bool add(const BucketRef& bucket, uint64_t generation);
+
+  /// Adds `bucket`, the state of bucket `name` read from the database
+  /// after taking `generation`, or nullptr if there was none. It is
+  /// only kept if it is newer than what the map has. Returns the newest
+  /// state of the bucket. If `kept` is given, it is set to whether the
+  /// map now knows the state of the bucket: false if a change the map
+  /// couldn't record happened while the bucket was read.
+  BucketRef add_loaded(
+      const std::string& name, const BucketRef& bucket, uint64_t generation,
+      bool* kept = nullptr
+  );
+
+  /// Publishes `bucket`, stored with `generation`, in place of the
+  /// bucket with the same name if that is older. A bucket that is not
+  /// in the map, or was removed in the meantime, is left to be loaded.
+  void update(const BucketRef& bucket, uint64_t generation);
+  void remove(const std::string& name);
+
+  /// Replaces all the buckets with `buckets`, read from the database
+  /// after taking `generation`. Each shard is swapped on its own,
+  /// lookups are never blocked for the whole reload.
+  void reset(const std::vector<BucketRef>& buckets, uint64_t generation);
+
+  std::vector<BucketRef> list() const;
+  size_t size() const;
+};
+
+}  // namespace rgw::sal::sfs
+
+#endif  // RGW_STORE_SFS_BUCKET_MAP_H
@@ -0,0 +1,89 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "data_copy.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+
+namespace rgw::sal::sfs {
+
+bool reflink_supported(const std::filesystem::path& dir) {
+#ifdef FICLONE
+  // anonymous files, nothing is left behind
+  const int src_fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (src_fd < 0) {
+    return false;
+  }
+  const int dst_fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (dst_fd < 0) {
+    ::close(src_fd);
+    return false;
+  }
+  const std::string block(4096, 'x');
+  const bool supported =
+      ::write(src_fd, block.data(), block.size()) ==
+          static_cast<ssize_t>(block.size()) &&
+      ::ioctl(dst_fd, FICLONE, src_fd) == 0;
+  ::close(dst_fd);
+  ::close(src_fd);
+  return supported;
+#else
+  return false;
+#endif
+}
+
+int copy_data_range(
+    int src_fd, uint64_t src_ofs, int dst_fd, uint64_t dst_ofs, uint64_t len,
+    bool reflink, bool& cloned
+) {
+  cloned = false;
+#ifdef FICLONERANGE
+  if (reflink) {
+    struct file_clone_range range = {
+        .src_fd = src_fd,
+        .src_offset = src_ofs,
+        .src_length = len,
+        .dest_offset = dst_ofs};
+    if (::ioctl(dst_fd, FICLONERANGE, &range) == 0) {
+      cloned = true;
+      return 0;
+    }
+    // most likely a range not block aligned: copy it
+  }
+#endif
+  // copy_file_range may copy less than asked for
+  loff_t src_pos = src_ofs;
+  loff_t dst_pos = dst_ofs;
+  uint64_t copied = 0;
+  while (copied < len) {
+    const ssize_t ret =
+        ::copy_file_range(src_fd, &src_pos, dst_fd, &dst_pos, len - copied, 0);
+    if (ret < 0) {
+      return -errno;
+    }
+    if (ret == 0) {
+      // unexpected end of file
+      return -EIO;
+    }
+    copied += ret;
+  }
+  return 0;
+}
+
+}  // namespace rgw::sal::sfs
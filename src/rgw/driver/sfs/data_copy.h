@@ -0,0 +1,36 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace rgw::sal::sfs {
+
+/// Whether the filesystem of `dir` clones files (FICLONE), sharing their
+/// extents copy-on-write instead of copying them. Tries it on a
+/// temporary file in `dir`.
+bool reflink_supported(const std::filesystem::path& dir);
+
+/// Copies [src_ofs, src_ofs + len) of `src_fd` to `dst_ofs` in
+/// `dst_fd`. With `reflink`, the range is cloned if the filesystem can
+/// (it must be block aligned, or end at the end of `src_fd`) and copied
+/// otherwise. Sets `cloned` to whether it was. Returns 0 or a negative
+/// errno.
+int copy_data_range(
+    int src_fd, uint64_t src_ofs, int dst_fd, uint64_t dst_ofs, uint64_t len,
+    bool reflink, bool& cloned
+);
+
+}  // namespace rgw::sal::sfs
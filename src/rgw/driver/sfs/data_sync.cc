@@ -0,0 +1,165 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "data_sync.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "common/Thread.h"
+#include "common/ceph_time.h"
+#include "common/sync_filesystem.h"
+#include "rgw_perf_counters.h"
+
+namespace rgw::sal::sfs {
+
+DataSyncer::DataSyncer(
+    Mode _mode, std::chrono::milliseconds _window, size_t _max_files
+)
+    : mode(_mode),
+      window(_window),
+      max_files(std::max<size_t>(_max_files, 1)),
+      stopping(false) {
+  flusher = make_named_thread("sfs_data_sync", &DataSyncer::flusher_main, this);
+}
+
+DataSyncer::~DataSyncer() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  flusher.join();
+}
+
+void DataSyncer::set_fault_injector(FaultInjector&& injector) {
+  std::lock_guard lock(mutex);
+  fault_injector = std::move(injector);
+}
+
+int DataSyncer::sync(int fd, optional_yield y) {
+  Request request{.fd = fd, .result = 0, .done = false, .completion = {}};
+  std::unique_lock lock(mutex);
+  queue.push_back(&request);
+  cond.notify_one();
+  if (y) {
+    auto& yield = y.get_yield_context();
+    boost::asio::async_completion<yield_context, void()> init(yield);
+    // the handler runs on the strand of the coroutine
+    request.completion = Completion::create(
+        y.get_io_context().get_executor(), std::move(init.completion_handler)
+    );
+    lock.unlock();
+    init.result.get();
+    lock.lock();
+  } else {
+    done_cond.wait(lock, [&request]() { return request.done; });
+  }
+  return request.result;
+}
+
+void DataSyncer::flusher_main() {
+  std::unique_lock lock(mutex);
+  while (true) {
+    cond.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    // Gather the files of concurrent writers until the window expires
+    // or the batch is full. Files queued while a batch is synced make
+    // up the next one.
+    if (window.count() > 0) {
+      cond.wait_until(
+          lock, std::chrono::steady_clock::now() + window,
+          [this]() { return stopping || queue.size() >= max_files; }
+      );
+    }
+    std::vector<Request*> batch;
+    while (!queue.empty() && batch.size() < max_files) {
+      batch.push_back(queue.front());
+      queue.pop_front();
+    }
+    const auto injector = fault_injector;
+    lock.unlock();
+
+    const auto start = ceph::mono_clock::now();
+    if (injector) {
+      for (auto* request : batch) {
+        request->result = injector(request->fd);
+      }
+    }
+    sync_batch(batch);
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_sfs_data_sync_batches);
+      perfcounter->inc(l_rgw_sfs_data_sync_files, batch.size());
+      perfcounter->tinc(
+          l_rgw_sfs_data_sync_batch_time, ceph::mono_clock::now() - start
+      );
+    }
+
+    lock.lock();
+    for (auto* request : batch) {
+      // the request is gone once its waiter resumes
+      request->done = true;
+      if (request->completion) {
+        ceph::async::post(std::move(request->completion));
+      }
+    }
+    done_cond.notify_all();
+  }
+}
+
+void DataSyncer::sync_batch(std::vector<Request*>& batch) {
+  switch (mode) {
+    case Mode::SYNCFS: {
+      int ret = 0;
+      for (const auto* request : batch) {
+        if (request->result < 0) {
+          // syncfs() can't tell which file failed
+          ret = request->result;
+          break;
+        }
+      }
+      if (ret == 0) {
+        ret = sync_filesystem(batch.front()->fd);
+      }
+      for (auto* request : batch) {
+        request->result = ret;
+      }
+      break;
+    }
+    case Mode::FDATASYNC: {
+#ifdef SYNC_FILE_RANGE_WRITE
+      // start writing every file back before waiting for any of them, so
+      // the device gets them together
+      for (const auto* request : batch) {
+        if (request->result == 0) {
+          ::sync_file_range(request->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+      }
+#endif
+      for (auto* request : batch) {
+        if (request->result == 0 && ::fdatasync(request->fd) < 0) {
+          request->result = -errno;
+        }
+      }
+      break;
+    }
+  }
+}
+
+}  // namespace rgw::sal::sfs
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/async/completion.h"
+#include "common/async/yield_context.h"
+
+namespace rgw::sal::sfs {
+
+/// Makes the data files of concurrent uploads durable together, instead
+/// of each writer fsyncing its own (see rgw_sfs_data_sync_mode).
+///
+/// A writer hands its file to sync() once the data is written and waits
+/// for it before committing the object's metadata, so an upload is still
+/// only acknowledged once its data is durable. A flusher thread gathers
+/// the files handed in within rgw_sfs_data_sync_window (or up to
+/// rgw_sfs_data_sync_max_files of them) and syncs them with one round of
+/// fdatasync() calls, or a single syncfs() of the data filesystem.
+/// Waiting suspends the coroutine of the request, if it has one.
+class DataSyncer {
+ public:
+  enum class Mode {
+    /// fdatasync() each file of a batch, after starting the writeback of
+    /// all of them
+    FDATASYNC,
+    /// syncfs() the filesystem of the files once per batch
+    SYNCFS,
+  };
+
+  /// Called with the fd of every file about to be synced. Returning a
+  /// negative errno fails it as if syncing it had, for tests.
+  using FaultInjector = std::function<int(int fd)>;
+
+ private:
+  using Completion = ceph::async::Completion<void()>;
+
+  struct Request {
+    const int fd;
+    /// 0 or the negative errno of the failed sync
+    int result;
+    bool done;
+    /// resumes the coroutine waiting in sync(), if any
+    std::unique_ptr<Completion> completion;
+  };
+
+  const Mode mode;
+  const std::chrono::milliseconds window;
+  const size_t max_files;
+
+  std::mutex mutex;
+  /// wakes the flusher
+  std::condition_variable cond;
+  /// wakes the threads waiting in sync() without a coroutine
+  std::condition_variable done_cond;
+  std::deque<Request*> queue;
+  bool stopping;
+  FaultInjector fault_injector;
+  std::thread flusher;
+
+  void flusher_main();
+  void sync_batch(std::vector<Request*>& batch);
+
+ public:
+  DataSyncer(Mode mode, std::chrono::milliseconds window, size_t max_files);
+  DataSyncer(const DataSyncer&) = delete;
+  DataSyncer& operator=(const DataSyncer&) = delete;
+  /// Syncs the files still queued before returning
+  ~DataSyncer();
+
+  /// Makes the data written to `fd` durable, along with the files of
+  /// the other writers waiting. Returns 0 or the negative errno of the
+  /// failed sync.
+  int sync(int fd, optional_yield y);
+
+  void set_fault_injector(FaultInjector&& injector);
+};
+
+}  // namespace rgw::sal::sfs
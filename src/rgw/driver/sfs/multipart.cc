@@ -13,8 +13,8 @@
  */
 #include "multipart.h"
 
-#include <common/random_string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -23,6 +23,7 @@
 #include "rgw/driver/sfs/fmt.h"
 #include "rgw/driver/sfs/multipart_types.h"
 #include "rgw/driver/sfs/sqlite/buckets/multipart_definitions.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
 #include "rgw_obj_manifest.h"
 #include "rgw_sal_sfs.h"
 #include "writer.h"
@@ -33,6 +34,20 @@ using namespace std;
 
 namespace rgw::sal::sfs {
 
+/// Makes the entries of `dir` durable. Returns 0 or a negative errno.
+static int fsync_directory(const std::filesystem::path& dir) {
+  const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return -errno;
+  }
+  int ret = 0;
+  if (::fsync(fd) < 0) {
+    ret = -errno;
+  }
+  ::close(fd);
+  return ret;
+}
+
 SFSMultipartUploadV2::SFSMultipartUploadV2(
     rgw::sal::SFStore* _store, SFSBucket* _bucket, sfs::BucketRef _bucketref,
     const std::string& _upload_id, const std::string& _oid, ACLOwner _owner,
@@ -177,7 +192,7 @@ int SFSMultipartUploadV2::abort(
 }
 
 int SFSMultipartUploadV2::complete(
-    const DoutPrefixProvider* dpp, optional_yield /*y*/, CephContext* cct,
+    const DoutPrefixProvider* dpp, optional_yield y, CephContext* /*cct*/,
     std::map<int, std::string>& part_etags,
     std::list<rgw_obj_index_key>& /*remove_objs*/, uint64_t& accounted_size,
     bool& /*compressed*/, RGWCompressionInfo& /*cs_info*/, off_t& /*ofs*/,
@@ -321,34 +336,8 @@ int SFSMultipartUploadV2::complete(
   res = mpdb.mark_aggregating(upload_id);
   ceph_assert(res == true);
 
-  std::string mp_combine_fn = gen_rand_alphanumeric_plain(cct, 16);
-  mp_combine_fn.append(".m");
-  std::filesystem::path objpath = store->get_data_path() /
-                                  UUIDPath(mp->path_uuid).to_path() /
-                                  mp_combine_fn;
-  std::error_code ec;
-  std::filesystem::create_directories(objpath.parent_path(), ec);
-  if (ec) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "failed to create directories for temp mp object {}: {}",
-               objpath, ec.message()
-           )
-        << dendl;
-    return -ERR_INTERNAL_ERROR;
-  }
-  int objfd = ::open(objpath.c_str(), O_WRONLY | O_BINARY | O_CREAT, 0600);
-  if (objfd < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "unable to open object file {} to write: {}",
-                              objpath, cpp_strerror(errno)
-                          )
-                       << dendl;
-    return -ERR_INTERNAL_ERROR;
-  }
-
-  size_t accounted_bytes = 0;
-
+  // check all parts before touching any of them
+  uint64_t accounted_bytes = 0;
   for (const auto& [part_num, part] : to_complete) {
     MultipartPartPath partpath(mp->path_uuid, part.id);
     std::filesystem::path path = store->get_data_path() / partpath.to_path();
@@ -363,83 +352,16 @@ int SFSMultipartUploadV2::complete(
                         << dendl;
       return -ERR_INVALID_PART;
     }
-
-    int partfd = ::open(path.c_str(), O_RDONLY | O_BINARY);
-    if (partfd < 0) {
-      lsfs_dout(dpp, -1) << fmt::format(
-                                "unable to open part file {} for reading: {}",
-                                path, cpp_strerror(errno)
-                            )
-                         << dendl;
-      return -ERR_INTERNAL_ERROR;
-    }
-    int ret = ::copy_file_range(partfd, NULL, objfd, NULL, partsize, 0);
-    if (ret < 0) {
-      // this is an unexpected error, we don't know how to recover from it.
-      lsfs_dout(dpp, -1)
-          << fmt::format(
-                 "unable to copy part {} (fd {}) to object file {} (fd {}): {}",
-                 part.part_num, partfd, objpath, objfd, cpp_strerror(errno)
-             )
-          << dendl;
-      ceph_abort_msg("Unexpected error aggregating multipart upload");
-    }
     accounted_bytes += partsize;
-    ret = ::fsync(objfd);
-    if (ret < 0) {
-      lsfs_dout(dpp, -1) << fmt::format(
-                                "failed fsync fd: {}, on obj file: {}: {}",
-                                objfd, objpath, cpp_strerror(ret)
-                            )
-                         << dendl;
-      ceph_abort_msg("Unexpected error fsync'ing obj path");
-    }
-    ret = ::close(partfd);
-    if (ret < 0) {
-      lsfs_dout(dpp, -1) << fmt::format(
-                                "failed closing fd: {}, on part file: {}: {}",
-                                partfd, path, cpp_strerror(ret)
-                            )
-                         << dendl;
-      ceph_abort_msg("Unexpected error on closing part path");
-    }
-  }
-
-  int ret = ::close(objfd);
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed closing fd: {}, on obj file: {}: {}",
-                              objfd, objpath, cpp_strerror(ret)
-                          )
-                       << dendl;
-  }
-  auto final_obj_size = std::filesystem::file_size(objpath);
-  if (accounted_bytes != final_obj_size) {
-    // this is an unexpected error, probably a bug - die.
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "BUG: expected {} bytes, found {} bytes",
-                              accounted_bytes, final_obj_size
-                          )
-                       << dendl;
-    ceph_abort_msg("BUG: on final object for multipart upload!");
   }
 
-  lsfs_dout(dpp, 10)
-      << fmt::format(
-             "finished building final object file at {}, size: {}, etag: {}",
-             objpath, final_obj_size, etag
-         )
-      << dendl;
-
-  // NOTE(jecluis): this is the annoying bit: we have the final object having
-  // been built at the path described by `mp->obj_uuid`, but we need to have it
-  // as a new version of the object of `mp->obj_name`. We will need to create a
-  // new object, or a new version, and move the file to its location as if we
-  // were writing directly to it.
-
+  // The parts are not concatenated into a single file. They are moved
+  // under the new version and become its data segments, so completing an
+  // upload is a rename per part plus a few rows in the database, however
+  // large the object is.
   ObjectRef objref;
   try {
-    objref = bucketref->create_version(target_obj->get_key());
+    objref = bucketref->create_version(target_obj->get_key(), y);
   } catch (const std::system_error& e) {
     lsfs_dout(dpp, -1)
         << fmt::format(
@@ -449,34 +371,98 @@ int SFSMultipartUploadV2::complete(
         << dendl;
     return -ERR_INTERNAL_ERROR;
   }
-  auto destpath = store->get_data_path() / objref->get_storage_path();
-  lsfs_dout(
-      dpp, 10
-  ) << fmt::format("moving final object from {} to {}", objpath, destpath)
-    << dendl;
-
-  std::filesystem::create_directories(destpath.parent_path(), ec);
-  if (ec) {
+  const std::filesystem::path partsdir =
+      store->get_data_path() / objref->get_parts_storage_path();
+  const int mkdir_ret = create_data_directories(partsdir);
+  if (mkdir_ret < 0) {
     lsfs_dout(dpp, -1)
         << fmt::format(
                "failed to create directories for destination object {}: {}",
-               destpath, ec.message()
+               partsdir, cpp_strerror(-mkdir_ret)
            )
         << dendl;
     return -ERR_INTERNAL_ERROR;
   }
 
-  ec.clear();
-  ret = ::rename(objpath.c_str(), destpath.c_str());
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed to rename object file from {} to {}: {}",
-                              objpath, destpath, cpp_strerror(errno)
+  // Parts moved so far, as (source, destination). If completing fails
+  // before the version is committed, they are moved back under the
+  // upload, so it still owns them and removing it reclaims them.
+  std::vector<std::pair<std::filesystem::path, std::filesystem::path>> moved;
+  moved.reserve(to_complete.size());
+  auto rollback_renames = [&]() {
+    for (auto it = moved.rbegin(); it != moved.rend(); ++it) {
+      const auto& [srcpath, destpath] = *it;
+      if (::rename(destpath.c_str(), srcpath.c_str()) < 0) {
+        lsfs_dout(dpp, -1)
+            << fmt::format(
+                   "failed to move part file back from {} to {}: {}",
+                   destpath, srcpath, cpp_strerror(errno)
+               )
+            << dendl;
+      }
+    }
+  };
+
+  std::vector<sqlite::DBVersionedObjectPart> segments;
+  segments.reserve(to_complete.size());
+  uint64_t segment_ofs = 0;
+  for (const auto& [part_num, part] : to_complete) {
+    MultipartPartPath partpath(mp->path_uuid, part.id);
+    std::filesystem::path srcpath = store->get_data_path() / partpath.to_path();
+    const uint32_t segment_num = segments.size();
+    std::filesystem::path destpath =
+        store->get_data_path() / objref->get_part_storage_path(segment_num);
+    lsfs_dout(dpp, 10) << fmt::format(
+                              "moving part {} from {} to {}", part_num,
+                              srcpath, destpath
                           )
                        << dendl;
-    return -ERR_INTERNAL_ERROR;
+    if (::rename(srcpath.c_str(), destpath.c_str()) < 0) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed to rename part file from {} to {}: {}",
+                                srcpath, destpath, cpp_strerror(errno)
+                            )
+                         << dendl;
+      rollback_renames();
+      return -ERR_INTERNAL_ERROR;
+    }
+    moved.emplace_back(std::move(srcpath), std::move(destpath));
+    segments.push_back(
+        {.versioned_object_id = objref->version_id,
+         .part_num = segment_num,
+         .object_offset = segment_ofs,
+         .size = part.size}
+    );
+    segment_ofs += part.size;
+  }
+  ceph_assert(segment_ofs == accounted_bytes);
+
+  // part data was synced when each part was written, only the renames
+  // need to reach the disk, on both ends
+  const std::filesystem::path uploaddir =
+      store->get_data_path() / UUIDPath(mp->path_uuid).to_path();
+  for (const auto& dir : {partsdir, uploaddir}) {
+    const int ret = fsync_directory(dir);
+    if (ret < 0) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed fsyncing dir {}: {}", dir,
+                                cpp_strerror(-ret)
+                            )
+                         << dendl;
+      rollback_renames();
+      return -ERR_INTERNAL_ERROR;
+    }
   }
 
+  lsfs_dout(dpp, 10) << fmt::format(
+                            "finished building final object at {}, size: {}, "
+                            "parts: {}, etag: {}",
+                            partsdir, accounted_bytes, segments.size(), etag
+                        )
+                     << dendl;
+  // stored in the transaction committing the version
+  objref->set_data_parts(std::move(segments));
+
   // Server-side encryption: The decryptor needs a manifest to
   // identify encrypted chunks. Each MP part corresponds to a chunk.
   if (mp->attrs.find(RGW_ATTR_CRYPT_MODE) != mp->attrs.end()) {
@@ -506,13 +492,25 @@ int SFSMultipartUploadV2::complete(
        .delete_at = ceph::real_time()}
   );
   try {
-    objref->metadata_finish(store, bucketref->get_info().versioning_enabled());
+    if (!objref->metadata_finish(
+            store, bucketref->get_info().versioning_enabled(), y
+        )) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "version {} of {} was removed while "
+                                "completing it",
+                                objref->version_id, objref->name
+                            )
+                         << dendl;
+      rollback_renames();
+      return -ERR_INTERNAL_ERROR;
+    }
   } catch (const std::system_error& e) {
     lsfs_dout(dpp, -1) << fmt::format(
                               "failed to update db object {}: {}", objref->name,
                               e.what()
                           )
                        << dendl;
+    rollback_renames();
     return -ERR_INTERNAL_ERROR;
   }
 
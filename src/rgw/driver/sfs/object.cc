@@ -13,13 +13,28 @@
  */
 #include "driver/sfs/object.h"
 
+#include <fcntl.h>
 #include <fmt/chrono.h>
 #include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+
+#include "common/deleter.h"
+#include "common/errno.h"
+#include "include/intarith.h"
+
+#include "driver/sfs/data_copy.h"
 #include "driver/sfs/multipart.h"
 #include "driver/sfs/sqlite/sqlite_versioned_objects.h"
 #include "driver/sfs/types.h"
 #include "rgw_common.h"
+#include "rgw_perf_counters.h"
 #include "rgw_sal_sfs.h"
 
 #define dout_subsys ceph_subsys_rgw
@@ -28,6 +43,24 @@ using namespace std;
 
 namespace rgw::sal {
 
+// The version whose files hold the data of `objref`: itself, or the one
+// it shares them with (see sqlite::DBSharedData). Only its storage paths
+// are meaningful.
+static std::unique_ptr<sfs::Object> get_data_version(
+    const sqlite::SQLiteVersionedObjects& db_versions,
+    const sfs::ObjectRef& objref
+) {
+  const auto shared = db_versions.get_shared_data(objref->version_id);
+  if (!shared.has_value()) {
+    return std::unique_ptr<sfs::Object>(sfs::Object::create_for_query(
+        objref->name, objref->path.get_uuid(), false, objref->version_id
+    ));
+  }
+  return std::unique_ptr<sfs::Object>(sfs::Object::create_for_query(
+      objref->name, shared->data_object_id, false, shared->data_version_id
+  ));
+}
+
 SFSObject::SFSReadOp::SFSReadOp(SFSObject* _source) : source(_source) {
   /*
     This initialization code was originally into prepare() but that
@@ -42,6 +75,218 @@ SFSObject::SFSReadOp::SFSReadOp(SFSObject* _source) : source(_source) {
   objref = source->get_object_ref();
 }
 
+SFSObject::SFSReadOp::~SFSReadOp() {
+  if (objdata_fd >= 0) {
+    ::close(objdata_fd);
+  }
+}
+
+void SFSObject::SFSReadOp::load_segments() {
+  if (!segments.empty()) {
+    return;
+  }
+  const auto data_path = source->store->get_data_path();
+  sqlite::SQLiteVersionedObjects db_versions(source->store->db_conn);
+  const auto packed_object = db_versions.get_packed_object(objref->version_id);
+  packed = packed_object.has_value();
+  if (packed) {
+    segments.push_back(
+        {source->store->packer->get_segment_path(packed_object->segment_id),
+         0, packed_object->size, packed_object->segment_offset}
+    );
+    return;
+  }
+  const auto data_version = get_data_version(db_versions, objref);
+  const auto parts = db_versions.get_versioned_object_parts(objref->version_id);
+  if (parts.empty()) {
+    // all the data is in a single file, however large it is
+    segments.push_back(
+        {data_path / data_version->get_storage_path(), 0,
+         std::numeric_limits<uint64_t>::max(), 0}
+    );
+    return;
+  }
+  segments.reserve(parts.size());
+  for (const auto& part : parts) {
+    segments.push_back(
+        {data_path / data_version->get_part_storage_path(part.part_num),
+         part.object_offset, part.size, 0}
+    );
+  }
+}
+
+int SFSObject::SFSReadOp::open_objdata(
+    const DoutPrefixProvider* dpp, size_t segment
+) {
+  if (objdata_fd >= 0) {
+    if (objdata_segment == segment) {
+      return 0;
+    }
+    ::close(objdata_fd);
+    objdata_fd = -1;
+  }
+  ceph_assert(segment < segments.size());
+  objdata_segment = segment;
+  objdata = segments[segment].path;
+  objdata_fd = ::open(objdata.c_str(), O_RDONLY | O_CLOEXEC | O_BINARY);
+  if (objdata_fd < 0) {
+    const int err = errno;
+    lsfs_dout(dpp, 10) << "object data not found at " << objdata << ": "
+                       << cpp_strerror(err) << dendl;
+    return err == ENOENT ? -ENOENT : -EIO;
+  }
+  struct stat st;
+  if (::fstat(objdata_fd, &st) < 0) {
+    const int err = errno;
+    lsfs_dout(dpp, 10) << "failed to stat object data " << objdata << ": "
+                       << cpp_strerror(err) << dendl;
+    ::close(objdata_fd);
+    objdata_fd = -1;
+    return -EIO;
+  }
+  objdata_size = st.st_size;
+  // GETs mostly stream the whole object. Let the kernel read ahead, but
+  // not through the other objects packed in the same segment.
+  if (!packed) {
+    ::posix_fadvise(objdata_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  return 0;
+}
+
+static int pread_exact(int fd, char* buf, uint64_t len, int64_t ofs) {
+  uint64_t done = 0;
+  while (done < len) {
+    const ssize_t ret = ::pread(fd, buf + done, len - done, ofs + done);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if (ret == 0) {
+      // file is shorter than the object metadata says
+      return -EIO;
+    }
+    done += ret;
+  }
+  return 0;
+}
+
+int SFSObject::SFSReadOp::read_chunk(
+    const DoutPrefixProvider* dpp, int64_t ofs, uint64_t len, bufferlist& bl
+) const {
+  const uint64_t mmap_threshold =
+      source->store->ctx()->_conf.get_val<Option::size_t>(
+          "rgw_sfs_read_mmap_threshold"
+      );
+  // never map past EOF, touching those pages raises SIGBUS
+  if (mmap_threshold > 0 && len >= mmap_threshold &&
+      ofs + len <= objdata_size) {
+    // Map the chunk and hand the pages to the consumer without copying
+    // them. The mapping is released once the last bufferlist referencing
+    // it is gone, which may be after the op itself finished.
+    const int64_t map_ofs = p2align<int64_t>(ofs, CEPH_PAGE_SIZE);
+    const uint64_t map_len = len + (ofs - map_ofs);
+    void* addr = ::mmap(
+        nullptr, map_len, PROT_READ, MAP_SHARED, objdata_fd, map_ofs
+    );
+    if (addr != MAP_FAILED) {
+      ::madvise(addr, map_len, MADV_SEQUENTIAL);
+      ::madvise(addr, map_len, MADV_WILLNEED);
+      bufferptr bp(buffer::claim_buffer(
+          map_len, static_cast<char*>(addr),
+          make_deleter([addr, map_len]() { ::munmap(addr, map_len); })
+      ));
+      bp.set_offset(ofs - map_ofs);
+      bp.set_length(len);
+      bl.append(std::move(bp));
+      if (perfcounter) {
+        perfcounter->inc(l_rgw_sfs_read_mmap_bytes, len);
+      }
+      return 0;
+    }
+    lsfs_dout(dpp, 10) << "mmap of " << objdata << " failed, reading instead: "
+                       << cpp_strerror(errno) << dendl;
+  }
+
+  bufferptr bp(buffer::create(len));
+  const int ret = pread_exact(objdata_fd, bp.c_str(), len, ofs);
+  if (ret < 0) {
+    return ret;
+  }
+  bl.append(std::move(bp));
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_sfs_read_pread_bytes, len);
+  }
+  return 0;
+}
+
+int SFSObject::SFSReadOp::read_range(
+    const DoutPrefixProvider* dpp, int64_t ofs, uint64_t len, bufferlist& bl
+) {
+  const auto& inline_data = objref->get_inline_data();
+  if (inline_data.has_value()) {
+    if (ofs + len > inline_data->length()) {
+      return -EIO;
+    }
+    bufferlist range;
+    range.substr_of(*inline_data, ofs, len);
+    bl.claim_append(range);
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_sfs_inline_read_bytes, len);
+    }
+    return 0;
+  }
+  load_segments();
+  // segments are sorted by offset and the first one starts at 0
+  auto it = std::upper_bound(
+      segments.cbegin(), segments.cend(), static_cast<uint64_t>(ofs),
+      [](uint64_t ofs, const DataSegment& s) { return ofs < s.ofs; }
+  );
+  size_t segment = std::distance(segments.cbegin(), it) - 1;
+  while (len > 0) {
+    if (segment >= segments.size()) {
+      // asked for more than the object has
+      return -EIO;
+    }
+    const auto& seg = segments[segment];
+    const uint64_t seg_ofs = ofs - seg.ofs;
+    if (seg_ofs >= seg.size) {
+      ++segment;
+      continue;
+    }
+    const uint64_t seg_len = std::min(len, seg.size - seg_ofs);
+    int ret = open_objdata(dpp, segment);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = read_chunk(dpp, seg.file_ofs + seg_ofs, seg_len, bl);
+    if (ret < 0) {
+      return ret;
+    }
+    ofs += seg_len;
+    len -= seg_len;
+    ++segment;
+  }
+  return 0;
+}
+
+void SFSObject::SFSReadOp::readahead(int64_t ofs, uint64_t len) const {
+  if (objdata_fd < 0) {
+    return;
+  }
+  // the next segment is read ahead once it's opened, see open_objdata()
+  const auto& seg = segments[objdata_segment];
+  if (static_cast<uint64_t>(ofs) < seg.ofs || ofs - seg.ofs >= seg.size) {
+    return;
+  }
+  const uint64_t seg_ofs = ofs - seg.ofs;
+  ::posix_fadvise(
+      objdata_fd, seg.file_ofs + seg_ofs, std::min(len, seg.size - seg_ofs),
+      POSIX_FADV_WILLNEED
+  );
+}
+
 // Handle conditional GET params. If-Match, If-None-Match,
 // If-Modified-Since, If-UnModified-Since. Return 0 if we are neutral.
 // Otherwise return S3/HTTP error code.
@@ -119,10 +364,19 @@ int SFSObject::SFSReadOp::prepare(
     return -ENOENT;
   }
 
-  objdata = source->store->get_data_path() / objref->get_storage_path();
-  if (!std::filesystem::exists(objdata)) {
-    lsfs_dout(dpp, 10) << "object data not found at " << objdata << dendl;
-    return -ENOENT;
+  // inline data came along with the metadata
+  if (!objref->get_inline_data().has_value()) {
+    load_segments();
+    int ret = open_objdata(dpp, 0);
+    if (ret == -ENOENT && packed) {
+      // the GC compacted the segment meanwhile and moved the object
+      segments.clear();
+      load_segments();
+      ret = open_objdata(dpp, 0);
+    }
+    if (ret < 0) {
+      return ret;
+    }
   }
 
   lsfs_dout(dpp, 10)
@@ -155,9 +409,19 @@ int SFSObject::SFSReadOp::get_attr(
   return 0;
 }
 
+void SFSObject::SFSReadOp::run_io(
+    const std::function<void()>& io, optional_yield y
+) const {
+  if (source->store->data_read_queue) {
+    source->store->data_read_queue->run(io, y);
+  } else {
+    io();
+  }
+}
+
 // sync read
 int SFSObject::SFSReadOp::read(
-    int64_t ofs, int64_t end, bufferlist& bl, optional_yield /*y*/,
+    int64_t ofs, int64_t end, bufferlist& bl, optional_yield y,
     const DoutPrefixProvider* dpp
 ) {
   // TODO bounds check, etc.
@@ -168,13 +432,17 @@ int SFSObject::SFSReadOp::read(
                      << ", offset: " << ofs << ", end: " << end
                      << ", len: " << len << dendl;
 
-  ceph_assert(std::filesystem::exists(objdata));
-
-  std::string error;
-  int ret = bl.pread_file(objdata.c_str(), ofs, len, &error);
-  if (ret < 0) {
+  if (!objref) {
+    return -ENOENT;
+  }
+  int ret;
+  run_io([&]() { ret = read_range(dpp, ofs, len, bl); }, y);
+  if (ret == -ENOENT) {
+    return ret;
+  } else if (ret < 0) {
     lsfs_dout(dpp, 10) << "failed to read object from file " << objdata
-                       << ". Returning EIO." << dendl;
+                       << ": " << cpp_strerror(ret) << ". Returning EIO."
+                       << dendl;
     return -EIO;
   }
   return len;
@@ -183,7 +451,7 @@ int SFSObject::SFSReadOp::read(
 // async read
 int SFSObject::SFSReadOp::iterate(
     const DoutPrefixProvider* dpp, int64_t ofs, int64_t end, RGWGetDataCB* cb,
-    optional_yield /*y*/
+    optional_yield y
 ) {
   // TODO bounds check, etc.
   const auto len = end + 1 - ofs;
@@ -193,19 +461,32 @@ int SFSObject::SFSReadOp::iterate(
                      << ", offset: " << ofs << ", end: " << end
                      << ", len: " << len << dendl;
 
-  ceph_assert(std::filesystem::exists(objdata));
-  std::string error;
+  if (!objref) {
+    return -ENOENT;
+  }
 
+  int ret;
   const uint64_t max_chunk_size = 10485760;  // 10MB
   uint64_t missing = len;
   while (missing > 0) {
     uint64_t size = std::min(missing, max_chunk_size);
     bufferlist bl;
-    int ret = bl.pread_file(objdata.c_str(), ofs, size, &error);
-    if (ret < 0) {
+    run_io(
+        [&]() {
+          ret = read_range(dpp, ofs, size, bl);
+          if (ret >= 0 && missing > size) {
+            // start reading the next chunk from disk while this one is sent
+            readahead(ofs + size, std::min(missing - size, max_chunk_size));
+          }
+        },
+        y
+    );
+    if (ret == -ENOENT) {
+      return ret;
+    } else if (ret < 0) {
       lsfs_dout(dpp, 0) << "failed to read object from file '" << objdata
                         << ", offset: " << ofs << ", size: " << size << ": "
-                        << error << dendl;
+                        << cpp_strerror(ret) << dendl;
       return -EIO;
     }
     missing -= size;
@@ -228,7 +509,7 @@ SFSObject::SFSDeleteOp::SFSDeleteOp(
     : source(_source), bucketref(_bucketref) {}
 
 int SFSObject::SFSDeleteOp::delete_obj(
-    const DoutPrefixProvider* dpp, optional_yield /*y*/
+    const DoutPrefixProvider* dpp, optional_yield y
 ) {
   lsfs_dout(dpp, 10) << "bucket: " << source->bucket->get_name()
                      << " bucket versioning: "
@@ -247,7 +528,7 @@ int SFSObject::SFSDeleteOp::delete_obj(
   if (source->objref) {
     bucketref->delete_object(
         *source->objref, source->get_key(),
-        source->bucket->versioning_enabled(), delete_marker_version_id
+        source->bucket->versioning_enabled(), delete_marker_version_id, y
     );
   } else if (source->bucket->versioning_enabled() && source->get_instance().empty()) {
     // create delete marker
@@ -288,13 +569,13 @@ int SFSObject::copy_object(
     ceph::real_time* /*src_mtime*/, ceph::real_time* mtime,
     const ceph::real_time* mod_ptr, const ceph::real_time* unmod_ptr,
     bool /*high_precision_time*/, const char* if_match, const char* if_nomatch,
-    AttrsMod /*attrs_mod*/, bool /*copy_if_newer*/, Attrs& /*attrs*/,
+    AttrsMod attrs_mod, bool /*copy_if_newer*/, Attrs& attrs,
     RGWObjCategory /*category*/, uint64_t /*olh_epoch*/,
     boost::optional<ceph::real_time> /*delete_at*/, std::string* /*version_id*/,
     std::string* /*tag*/, std::string* etag, void (*)(off_t, void*),
     void* /*progress_data*/
     ,
-    const DoutPrefixProvider* dpp, optional_yield /*y*/
+    const DoutPrefixProvider* dpp, optional_yield y
 ) {
   lsfs_dout(dpp, 10) << fmt::format(
                             "bucket:{} obj:{} version:{} size:{} -> bucket:{} "
@@ -323,99 +604,207 @@ int SFSObject::copy_object(
       store->get_bucket_ref(dst_bucket->get_name());
   ceph_assert(dst_bucket_ref);
 
-  const std::filesystem::path srcpath =
-      store->get_data_path() / objref->get_storage_path();
-
-  const int src_fd = ::open(srcpath.c_str(), O_RDONLY | O_BINARY);
-  if (src_fd < 0) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "unable to open src obj {} file {} for reading: {}",
-               objref->name, srcpath.string(), cpp_strerror(errno)
-           )
-        << dendl;
-    return -ERR_INTERNAL_ERROR;
+  // Versions completed from multipart uploads keep their data in one file
+  // per part, packed versions share a segment file with others and
+  // copies may share the files of another version. The copy gets the data
+  // concatenated in a single file of its own, or shares the files. Inline
+  // data has no file and is copied inline.
+  struct SrcFile {
+    std::filesystem::path path;
+    /// offset of the data in the file
+    uint64_t ofs;
+    uint64_t size;
+  };
+  std::vector<SrcFile> srcfiles;
+  sqlite::SQLiteVersionedObjects db_versions(store->db_conn);
+  const auto& src_inline = objref->get_inline_data();
+  std::optional<sqlite::DBPackedObject> src_packed;
+  if (!src_inline.has_value()) {
+    src_packed = db_versions.get_packed_object(objref->version_id);
+  }
+  if (src_packed.has_value()) {
+    srcfiles.push_back(
+        {store->packer->get_segment_path(src_packed->segment_id),
+         src_packed->segment_offset, src_packed->size}
+    );
+  } else if (!src_inline.has_value()) {
+    const auto data_version = get_data_version(db_versions, objref);
+    const auto src_parts =
+        db_versions.get_versioned_object_parts(objref->version_id);
+    if (src_parts.empty()) {
+      srcfiles.push_back(
+          {store->get_data_path() / data_version->get_storage_path(), 0,
+           objref->get_meta().size}
+      );
+    }
+    for (const auto& part : src_parts) {
+      const auto part_path = data_version->get_part_storage_path(part.part_num);
+      srcfiles.push_back(
+          {store->get_data_path() / part_path, 0, part.size}
+      );
+    }
+  }
+  for (const auto& [srcpath, srcofs, srcsize] : srcfiles) {
+    if (!std::filesystem::exists(srcpath)) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "unable to find src obj {} file {}",
+                                objref->name, srcpath.string()
+                            )
+                         << dendl;
+      return -ERR_INTERNAL_ERROR;
+    }
   }
 
   const sfs::ObjectRef dstref =
-      dst_bucket_ref->create_version(dst_object->get_key());
+      dst_bucket_ref->create_version(dst_object->get_key(), y);
   if (!dstref) {
-    ::close(src_fd);
-    return -ERR_INTERNAL_ERROR;
-  }
-  const std::filesystem::path dstpath =
-      store->get_data_path() / dstref->get_storage_path();
-  std::error_code ec;
-  std::filesystem::create_directories(dstpath.parent_path(), ec);
-  if (ec) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "failed to create directory hierarchy {} for {}: {}",
-               dstpath.parent_path().string(), dstref->name, ec.message()
-           )
-        << dendl;
-    ::close(src_fd);
-    return -ERR_INTERNAL_ERROR;
-  }
-  // Open O_CREAT+O_EXCL as dstref is always a new version without a
-  // file yet
-  const int dst_fd =
-      ::open(dstpath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0600);
-  if (dst_fd < 0) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "unable to open dst obj {} file {} for writing: {}",
-               dstref->name, dstpath.string(), cpp_strerror(errno)
-           )
-        << dendl;
-    ::close(src_fd);
     return -ERR_INTERNAL_ERROR;
   }
 
-  lsfs_dout(dpp, 10) << fmt::format(
-                            "copying {} fd:{} -> {} fd:{}", srcpath.string(),
-                            src_fd, dstpath.string(), dst_fd
-                        )
-                     << dendl;
+  // A clone costs no more than sharing the files and needs no reference
+  // counting. Packed data is small enough to be copied.
+  const bool share_data =
+      !store->reflink && !src_inline.has_value() && !src_packed.has_value() &&
+      store->ctx()->_conf.get_val<bool>("rgw_sfs_copy_share_data");
+  if (src_inline.has_value()) {
+    // committed along with the metadata below
+    dstref->set_inline_data(*src_inline);
+  } else if (share_data) {
+    // committed along with the metadata below, unless the source is
+    // removed before
+    dstref->set_shared_data(objref->version_id);
+  } else {
+    const std::filesystem::path dstpath =
+        store->get_data_path() / dstref->get_storage_path();
+    // Open O_CREAT+O_EXCL as dstref is always a new version without a
+    // file yet
+    const int dst_fd = open_data_file(
+        dstpath, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0600
+    );
+    if (dst_fd < 0) {
+      lsfs_dout(dpp, -1)
+          << fmt::format(
+                 "unable to open dst obj {} file {} for writing: {}",
+                 dstref->name, dstpath.string(), cpp_strerror(-dst_fd)
+             )
+          << dendl;
+      return -ERR_INTERNAL_ERROR;
+    }
 
-  int ret = ::copy_file_range(
-      src_fd, nullptr, dst_fd, nullptr, objref->get_meta().size, 0
-  );
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed to copy file from {} to {}: {}",
-                              srcpath.string(), dstpath.string(),
-                              cpp_strerror(errno)
-                          )
-                       << dendl;
-    ::close(src_fd);
-    ::close(dst_fd);
-    return -ERR_INTERNAL_ERROR;
-  }
-  ret = ::close(src_fd);
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed closing src fd:{} fn:{}: {}", src_fd,
-                              srcpath.string(), cpp_strerror(ret)
-                          )
-                       << dendl;
+    uint64_t dst_ofs = 0;
+    uint64_t copied = 0;
+    for (const auto& [srcpath, srcofs, srcsize] : srcfiles) {
+      const int src_fd = ::open(srcpath.c_str(), O_RDONLY | O_BINARY);
+      if (src_fd < 0) {
+        lsfs_dout(dpp, -1)
+            << fmt::format(
+                   "unable to open src obj {} file {} for reading: {}",
+                   objref->name, srcpath.string(), cpp_strerror(errno)
+               )
+            << dendl;
+        ::close(dst_fd);
+        return -ERR_INTERNAL_ERROR;
+      }
+      lsfs_dout(dpp, 10) << fmt::format(
+                                "copying {} fd:{} -> {} fd:{} at {}",
+                                srcpath.string(), src_fd, dstpath.string(),
+                                dst_fd, dst_ofs
+                            )
+                         << dendl;
+
+      bool cloned = false;
+      const int ret = sfs::copy_data_range(
+          src_fd, srcofs, dst_fd, dst_ofs, srcsize, store->reflink, cloned
+      );
+      if (ret < 0) {
+        lsfs_dout(dpp, -1) << fmt::format(
+                                  "failed to copy file from {} to {}: {}",
+                                  srcpath.string(), dstpath.string(),
+                                  cpp_strerror(ret)
+                              )
+                           << dendl;
+        ::close(src_fd);
+        ::close(dst_fd);
+        return -ERR_INTERNAL_ERROR;
+      }
+      if (!cloned) {
+        copied += srcsize;
+      }
+      dst_ofs += srcsize;
+      if (::close(src_fd) < 0) {
+        lsfs_dout(dpp, -1) << fmt::format(
+                                  "failed closing src fd:{} fn:{}: {}", src_fd,
+                                  srcpath.string(), cpp_strerror(errno)
+                              )
+                           << dendl;
+      }
+    }
+    if (::close(dst_fd) < 0) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed closing dst fd:{} fn:{}: {}", dst_fd,
+                                dstpath.string(), cpp_strerror(errno)
+                            )
+                         << dendl;
+    }
+    if (perfcounter) {
+      if (copied == 0) {
+        perfcounter->inc(l_rgw_sfs_copy_reflink_objects);
+      }
+      perfcounter->inc(l_rgw_sfs_copy_bytes, copied);
+    }
   }
-  ret = ::close(dst_fd);
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed closing dst fd:{} fn:{}: {}", dst_fd,
-                              dstpath.string(), cpp_strerror(ret)
-                          )
-                       << dendl;
+
+  // the attributes of the copy, as RGWRados::copy_obj() sets them:
+  // MetadataDirective COPY keeps the ones of the source, REPLACE takes
+  // the ones of the request
+  Attrs dest_attrs = objref->get_attrs();
+  switch (attrs_mod) {
+    case ATTRSMOD_REPLACE: {
+      const Attrs src_attrs = std::move(dest_attrs);
+      dest_attrs = attrs;
+      const auto src_etag = src_attrs.find(RGW_ATTR_ETAG);
+      if (src_etag != src_attrs.end()) {
+        dest_attrs.emplace(RGW_ATTR_ETAG, src_etag->second);
+      }
+      break;
+    }
+    case ATTRSMOD_MERGE:
+      for (const auto& [name, value] : attrs) {
+        dest_attrs[name] = value;
+      }
+      break;
+    case ATTRSMOD_NONE:
+    default:
+      break;
   }
 
   auto dest_meta = objref->get_meta();
   dest_meta.mtime = ceph::real_clock::now();
-  dstref->update_attrs(objref->get_attrs());
+  dstref->update_attrs(dest_attrs);
   dstref->update_meta(dest_meta);
-  dstref->metadata_finish(
-      store, dst_bucket_ref->get_info().versioning_enabled()
+  const bool committed = dstref->metadata_finish(
+      store, dst_bucket_ref->get_info().versioning_enabled(), y
   );
+  if (share_data) {
+    if (!committed) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "src obj {} version {} was removed while "
+                                "copying it",
+                                objref->name, objref->version_id
+                            )
+                         << dendl;
+      return -ERR_INTERNAL_ERROR;
+    }
+    lsfs_dout(dpp, 10) << fmt::format(
+                              "{} version {} shares the data of version {}",
+                              dstref->name, dstref->version_id,
+                              objref->version_id
+                          )
+                       << dendl;
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_sfs_copy_shared_objects);
+    }
+  }
 
   // return values for CopyObjectResult response
   if (etag != nullptr) {
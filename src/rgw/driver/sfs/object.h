@@ -15,6 +15,8 @@
 #define RGW_STORE_SFS_OBJECT_H
 
 #include <filesystem>
+#include <functional>
+#include <vector>
 
 #include "rgw/driver/sfs/bucket.h"
 #include "rgw/driver/sfs/types.h"
@@ -47,13 +49,55 @@ class SFSObject : public StoreObject {
    */
   struct SFSReadOp : public ReadOp {
    private:
+    /// A range of the object stored in one data file. Objects written in
+    /// one go have a single segment, completed multipart uploads have one
+    /// per part.
+    struct DataSegment {
+      std::filesystem::path path;
+      /// offset of the segment in the object
+      uint64_t ofs;
+      uint64_t size;
+      /// offset of the segment in the data file, where packed objects
+      /// start (see sfs::SegmentPacker)
+      uint64_t file_ofs;
+    };
+
     SFSObject* source;
     sfs::ObjectRef objref;
+    std::vector<DataSegment> segments;
+    /// the object data is packed in a segment file shared with others
+    bool packed{false};
+    /// segment whose data file is open in objdata_fd
+    size_t objdata_segment{0};
     std::filesystem::path objdata;
+    /// data file of the segment being read. The first one is opened in
+    /// prepare() and kept until the op moves on to another segment.
+    int objdata_fd{-1};
+    uint64_t objdata_size{0};
     int handle_conditionals(const DoutPrefixProvider* dpp) const;
+    void load_segments();
+    int open_objdata(const DoutPrefixProvider* dpp, size_t segment);
+    /// Reads [ofs, ofs + len) of the open data file into bl. Large reads
+    /// are served from mmap-backed buffers, small ones with a single pread.
+    int read_chunk(
+        const DoutPrefixProvider* dpp, int64_t ofs, uint64_t len,
+        bufferlist& bl
+    ) const;
+    /// Reads [ofs, ofs + len) of the object into bl, across segments.
+    int read_range(
+        const DoutPrefixProvider* dpp, int64_t ofs, uint64_t len,
+        bufferlist& bl
+    );
+    /// Hints the kernel to read [ofs, ofs + len) of the object ahead of
+    /// time, as far as it is in the open data file.
+    void readahead(int64_t ofs, uint64_t len) const;
+    /// Runs the blocking file I/O `io` on the read threads of the store,
+    /// suspending the coroutine of the request meanwhile if it has one.
+    void run_io(const std::function<void()>& io, optional_yield y) const;
 
    public:
     SFSReadOp(SFSObject* _source);
+    virtual ~SFSReadOp() override;
 
     virtual int prepare(optional_yield y, const DoutPrefixProvider* dpp)
         override;
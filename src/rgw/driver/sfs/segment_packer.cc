@@ -0,0 +1,252 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "segment_packer.h"
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+
+namespace fs = std::filesystem;
+
+namespace rgw::sal::sfs {
+
+static constexpr std::string_view SEGMENTS_DIR = "segments";
+static constexpr std::string_view SEGMENT_SUFFIX = ".seg";
+
+/// Parses the id out of a segment file name. Returns 0 (never a segment
+/// id) for anything else.
+static uint64_t parse_segment_id(const std::string& name) {
+  if (name.size() != 16 + SEGMENT_SUFFIX.size() ||
+      !name.ends_with(SEGMENT_SUFFIX)) {
+    return 0;
+  }
+  try {
+    return std::stoull(name.substr(0, 16), nullptr, 16);
+  } catch (const std::exception&) {
+    return 0;
+  }
+}
+
+SegmentPacker::Segment::~Segment() {
+  ::close(fd);
+}
+
+SegmentPacker::SegmentPacker(
+    const fs::path& data_path, uint64_t _max_segment_size
+)
+    : segments_path(data_path / SEGMENTS_DIR),
+      max_segment_size(_max_segment_size),
+      next_segment_id(1) {
+  fs::create_directories(segments_path);
+  for (const auto& entry : fs::directory_iterator(segments_path)) {
+    const uint64_t id = parse_segment_id(entry.path().filename().string());
+    next_segment_id = std::max(next_segment_id, id + 1);
+  }
+}
+
+fs::path SegmentPacker::get_segment_path(uint64_t id) const {
+  return segments_path / fmt::format("{:016x}{}", id, SEGMENT_SUFFIX);
+}
+
+int SegmentPacker::reserve(
+    uint64_t len, std::shared_ptr<Segment>* segment, uint64_t* offset
+) {
+  std::lock_guard l(lock);
+  if (!active || (active_size > 0 && active_size + len > max_segment_size)) {
+    const uint64_t id = next_segment_id++;
+    const auto path = get_segment_path(id);
+    const int fd = ::open(
+        path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644
+    );
+    if (fd < 0) {
+      return -errno;
+    }
+    // make the new file itself durable, its appends only sync its data
+    const int dir_fd = ::open(segments_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+      ::fsync(dir_fd);
+      ::close(dir_fd);
+    }
+    active = std::shared_ptr<Segment>(new Segment{id, fd});
+    active_size = 0;
+  }
+  *segment = active;
+  *offset = active_size;
+  active_size += len;
+  pending[active->id]++;
+  return 0;
+}
+
+int SegmentPacker::append(
+    const bufferlist& data, uint64_t* segment_id, uint64_t* segment_offset
+) {
+  std::shared_ptr<Segment> segment;
+  uint64_t offset;
+  int ret = reserve(data.length(), &segment, &offset);
+  if (ret < 0) {
+    return ret;
+  }
+  // the bytes are reserved, appends write concurrently
+  ret = data.write_fd(segment->fd, offset);
+  if (ret == 0 && ::fdatasync(segment->fd) < 0) {
+    ret = -errno;
+  }
+  if (ret < 0) {
+    release(segment->id);
+    return ret;
+  }
+  *segment_id = segment->id;
+  *segment_offset = offset;
+  return 0;
+}
+
+void SegmentPacker::release(uint64_t segment_id) {
+  std::lock_guard l(lock);
+  auto it = pending.find(segment_id);
+  if (it != pending.end() && --it->second == 0) {
+    pending.erase(it);
+  }
+}
+
+std::vector<uint64_t> SegmentPacker::idle_segments() const {
+  std::set<uint64_t> ids;
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(segments_path, ec)) {
+    const uint64_t id = parse_segment_id(entry.path().filename().string());
+    if (id > 0) {
+      ids.insert(id);
+    }
+  }
+  std::lock_guard l(lock);
+  if (active) {
+    ids.erase(active->id);
+  }
+  for (const auto& [id, count] : pending) {
+    ids.erase(id);
+  }
+  return {ids.begin(), ids.end()};
+}
+
+void SegmentPacker::remove_segment_file(
+    uint64_t id, uint64_t size, CompactStats& stats
+) const {
+  if (::unlink(get_segment_path(id).c_str()) == 0) {
+    stats.segments++;
+    stats.bytes += size;
+  }
+}
+
+/// Reads `len` bytes at `ofs` of `fd` into `bl`
+static int pread_into(int fd, uint64_t ofs, uint64_t len, bufferlist& bl) {
+  bufferptr bp(buffer::create(len));
+  uint64_t done = 0;
+  while (done < len) {
+    const ssize_t ret = ::pread(fd, bp.c_str() + done, len - done, ofs + done);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if (ret == 0) {
+      return -EIO;
+    }
+    done += ret;
+  }
+  bl.append(std::move(bp));
+  return 0;
+}
+
+CompactStats SegmentPacker::compact(
+    sqlite::DBConnRef conn, double garbage_ratio,
+    const std::function<bool()>& should_stop
+) {
+  CompactStats stats;
+  sqlite::SQLiteVersionedObjects db_versions(conn);
+  std::map<uint64_t, sqlite::DBPackedSegment> usage;
+  for (const auto& segment : db_versions.get_packed_segments()) {
+    usage.emplace(segment.id, segment);
+  }
+
+  for (const uint64_t id : idle_segments()) {
+    if (should_stop()) {
+      break;
+    }
+    const auto path = get_segment_path(id);
+    struct stat st;
+    if (::stat(path.c_str(), &st) < 0) {
+      continue;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    const auto it = usage.find(id);
+    const bool unused = it == usage.end() || it->second.live_count <= 0;
+    if (unused) {
+      if (db_versions.remove_packed_segment_if_unused(id)) {
+        remove_segment_file(id, size, stats);
+      }
+      continue;
+    }
+    const uint64_t live = static_cast<uint64_t>(it->second.live_size);
+    if (size == 0 || size - std::min(live, size) < garbage_ratio * size) {
+      continue;
+    }
+
+    // move the live objects to the active segment, the segment is removed
+    // once none is left
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    for (const auto& packed : db_versions.get_packed_objects(id)) {
+      if (should_stop()) {
+        break;
+      }
+      bufferlist bl;
+      if (pread_into(fd, packed.segment_offset, packed.size, bl) < 0) {
+        break;
+      }
+      uint64_t new_id;
+      uint64_t new_offset;
+      if (append(bl, &new_id, &new_offset) < 0) {
+        break;
+      }
+      // the object may have been deleted meanwhile, leaving its copy
+      // as garbage of the active segment
+      if (db_versions.relocate_packed_object(packed, new_id, new_offset)) {
+        stats.moved_objects++;
+        stats.moved_bytes += packed.size;
+      }
+      release(new_id);
+    }
+    ::close(fd);
+    if (db_versions.remove_packed_segment_if_unused(id)) {
+      // readers holding the file open keep reading it, the others look
+      // their object up again
+      remove_segment_file(id, size, stats);
+    }
+  }
+  return stats;
+}
+
+}  // namespace rgw::sal::sfs
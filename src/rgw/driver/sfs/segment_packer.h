@@ -0,0 +1,109 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "common/ceph_mutex.h"
+#include "include/buffer.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+
+namespace rgw::sal::sfs {
+
+struct CompactStats {
+  /// segment files removed
+  uint64_t segments = 0;
+  /// bytes of the removed segment files
+  uint64_t bytes = 0;
+  /// live objects copied out of segments being compacted
+  uint64_t moved_objects = 0;
+  uint64_t moved_bytes = 0;
+};
+
+/// Packs the data of small objects in large append-only segment files,
+/// so that storing one costs a write and a sync to an existing file
+/// instead of creating (and later removing) a file and its directories.
+/// Where an object is packed is recorded in sqlite::DBPackedObject.
+///
+/// Objects are appended to a single active segment until it reaches
+/// rgw_sfs_pack_segment_size. A new active segment is started then, and
+/// on every startup: earlier segments are never appended to again.
+///
+/// Deleted versions leave garbage in their segment. compact() copies the
+/// live objects out of segments holding too much of it and removes the
+/// segment files no object references anymore.
+class SegmentPacker {
+  /// A segment file open for appending. Kept alive by the appends in
+  /// progress once another segment became the active one.
+  struct Segment {
+    uint64_t id;
+    int fd;
+    ~Segment();
+  };
+
+  const std::filesystem::path segments_path;
+  const uint64_t max_segment_size;
+
+  mutable ceph::mutex lock = ceph::make_mutex("sfs_segment_packer");
+  uint64_t next_segment_id;
+  std::shared_ptr<Segment> active;
+  uint64_t active_size{0};
+  /// appends to a segment not released yet, per segment
+  std::map<uint64_t, size_t> pending;
+
+  /// Returns the active segment with `len` bytes reserved at `*offset`,
+  /// starting a new segment if it's full.
+  int reserve(
+      uint64_t len, std::shared_ptr<Segment>* segment, uint64_t* offset
+  );
+  /// Ids of the segment files with no appends to come, by listing them
+  std::vector<uint64_t> idle_segments() const;
+  void remove_segment_file(
+      uint64_t id, uint64_t size, CompactStats& stats
+  ) const;
+
+ public:
+  SegmentPacker(
+      const std::filesystem::path& data_path, uint64_t max_segment_size
+  );
+  SegmentPacker(const SegmentPacker&) = delete;
+  SegmentPacker& operator=(const SegmentPacker&) = delete;
+
+  std::filesystem::path get_segment_path(uint64_t id) const;
+
+  /// Appends `data` to the active segment and syncs it. Returns 0 and
+  /// where it was written, or a negative error code. The segment is not
+  /// compacted until release() is called for the append, once its
+  /// location is committed (or abandoned).
+  int append(
+      const bufferlist& data, uint64_t* segment_id, uint64_t* segment_offset
+  );
+  void release(uint64_t segment_id);
+
+  /// Removes the segments with no live objects left and compacts the
+  /// ones where at least `garbage_ratio` of the bytes are garbage. Stops
+  /// moving objects once `should_stop` returns true, the segment being
+  /// compacted is finished by a later call.
+  CompactStats compact(
+      sqlite::DBConnRef conn, double garbage_ratio,
+      const std::function<bool()>& should_stop
+  );
+};
+
+}  // namespace rgw::sal::sfs
@@ -32,12 +32,10 @@ int SFStore::get_bucket(
     ,
     const RGWBucketInfo& i, std::unique_ptr<Bucket>* result
 ) {
-  std::lock_guard l(buckets_map_lock);
-  auto it = buckets.find(i.bucket.name);
-  if (it == buckets.end()) {
+  auto bucketref = get_bucket_ref(i.bucket.name);
+  if (!bucketref) {
     return -ENOENT;
   }
-  auto bucketref = it->second;
 
   auto bucket = make_unique<SFSBucket>(this, bucketref);
   result->reset(bucket.release());
@@ -48,12 +46,10 @@ int SFStore::get_bucket(
     const DoutPrefixProvider* dpp, User* /*u*/, const rgw_bucket& b,
     std::unique_ptr<Bucket>* result, optional_yield /*y*/
 ) {
-  std::lock_guard l(buckets_map_lock);
-  auto it = buckets.find(b.name);
-  if (it == buckets.end()) {
+  auto bucketref = get_bucket_ref(b.name);
+  if (!bucketref) {
     return -ENOENT;
   }
-  auto bucketref = it->second;
 
   auto bucket = make_unique<SFSBucket>(this, bucketref);
   ldpp_dout(dpp, 10) << __func__ << ": bucket: " << bucket->get_name() << dendl;
@@ -67,12 +63,10 @@ int SFStore::get_bucket(
     optional_yield /*y*/
 ) {
   ldpp_dout(dpp, 10) << __func__ << ": get_bucket by name: " << name << dendl;
-  std::lock_guard l(buckets_map_lock);
-  auto it = buckets.find(name);
-  if (it == buckets.end()) {
+  auto bucketref = get_bucket_ref(name);
+  if (!bucketref) {
     return -ENOENT;
   }
-  auto bucketref = it->second;
 
   auto b = make_unique<SFSBucket>(this, bucketref);
   ldpp_dout(dpp, 10) << __func__ << ": bucket: " << b->get_name() << dendl;
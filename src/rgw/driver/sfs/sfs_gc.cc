@@ -16,9 +16,13 @@
 #include <common/perf_counters.h>
 #include <driver/sfs/sqlite/buckets/multipart_definitions.h>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <string>
 
 #include "common/Clock.h"
+#include "common/ceph_time.h"
 #include "driver/sfs/types.h"
 #include "multipart_types.h"
 #include "rgw/driver/sfs/sqlite/sqlite_multipart.h"
@@ -31,7 +35,13 @@
 
 namespace rgw::sal::sfs {
 
-SFSGC::SFSGC(CephContext* _cctx, SFStore* _store) : cct(_cctx), store(_store) {
+SFSGC::SFSGC(CephContext* _cctx, SFStore* _store)
+    : cct(_cctx),
+      store(_store),
+      reclaimer(
+          store->get_data_path(),
+          cct->_conf.get_val<uint64_t>("rgw_sfs_gc_reclaim_threads")
+      ) {
   worker = std::make_unique<GCWorker>(this, cct, this);
 }
 
@@ -48,9 +58,21 @@ int SFSGC::process() {
   initial_process_time = ceph_clock_now();
   perfcounter->inc(l_rgw_sfs_gc_count);
 
+  // first mark the versions left open by a previous run deleted, so the
+  // steps below collect them
+  auto time_to_process_more = process_stale_open_versions();
+  if (!time_to_process_more) {
+    perfcounter->set(
+        l_rgw_sfs_gc_process_exit,
+        static_cast<uint64_t>(
+            sfs_gc_process_exit_state::process_stale_open_versions
+        )
+    );
+    return 0;
+  }
   // start by deleting possible pending objects data in the filesystem
   // this could be stopped in a previous execution due to max exec time elapsed
-  auto time_to_process_more = delete_pending_objects_data();
+  time_to_process_more = delete_pending_objects_data();
   if (!time_to_process_more) {
     perfcounter->set(
         l_rgw_sfs_gc_process_exit,
@@ -94,6 +116,10 @@ int SFSGC::process() {
 
   // process done or aborted multiparts
   time_to_process_more = process_done_and_aborted_multiparts();
+  if (time_to_process_more) {
+    // the versions deleted above left their packed data as garbage
+    compact_packed_segments();
+  }
   perfcounter->set(
       l_rgw_sfs_gc_process_exit,
       static_cast<uint64_t>(sfs_gc_process_exit_state::finished)
@@ -101,6 +127,10 @@ int SFSGC::process() {
   return 0;
 }
 
+void SFSGC::set_stale_open_versions(uint max_id) {
+  stale_open_versions_max_id = max_id;
+}
+
 bool SFSGC::going_down() {
   return down_flag;
 }
@@ -138,6 +168,39 @@ std::ostream& SFSGC::gen_prefix(std::ostream& out) const {
   return out << "garbage collection: ";
 }
 
+bool SFSGC::process_stale_open_versions() {
+  // Versions are checked in ranges of ids rather than with a single
+  // update, which would hold the write lock for as long as it takes to
+  // scan the whole versions table. New versions get higher ids than any
+  // existing one and are never touched.
+  const uint max_id = stale_open_versions_max_id;
+  if (stale_open_versions_next_id > max_id) {
+    return true;
+  }
+  sqlite::SQLiteVersionedObjects db_versions(store->db_conn);
+  uint num_deleted = 0;
+  while (stale_open_versions_next_id <= max_id) {
+    const uint last_id = std::min<uint64_t>(
+        max_id,
+        uint64_t(stale_open_versions_next_id) + STALE_OPEN_VERSIONS_BATCH - 1
+    );
+    num_deleted += db_versions.set_open_versions_to_deleted(
+        stale_open_versions_next_id, last_id
+    );
+    stale_open_versions_next_id = last_id + 1;
+    if (process_time_elapsed()) {
+      break;
+    }
+  }
+  lsfs_dout(this, 10) << fmt::format(
+                             "marked {} stale open versions deleted, next "
+                             "id {} of {}",
+                             num_deleted, stale_open_versions_next_id, max_id
+                         )
+                      << dendl;
+  return stale_open_versions_next_id > max_id;
+}
+
 bool SFSGC::process_deleted_buckets() {
   common::PerfGuard elapsed(perfcounter, l_rgw_sfs_gc_deleted_buckets_elapsed);
   // permanently delete removed buckets and their objects and versions
@@ -187,11 +250,13 @@ bool SFSGC::process_deleted_objects() {
 bool SFSGC::process_deleted_objects_batch(bool& more_objects) {
   more_objects = true;
   sqlite::SQLiteVersionedObjects db_versions(store->db_conn);
-  pending_objects_to_delete = db_versions.remove_deleted_versions_transact(
-      max_objects_to_delete_per_iteration
-  );
-  if (pending_objects_to_delete.has_value() &&
-      (*pending_objects_to_delete).empty()) {
+  // versions sharing their data may leave nothing to reclaim
+  size_t num_removed = 0;
+  pending_objects_to_delete =
+      to_reclaim_items(db_versions.remove_deleted_versions_transact(
+          max_objects_to_delete_per_iteration, &num_removed
+      ));
+  if (pending_objects_to_delete.has_value() && num_removed == 0) {
     more_objects = false;
   }
   return delete_pending_objects_data();
@@ -215,9 +280,9 @@ bool SFSGC::process_done_and_aborted_multiparts_batch(bool& all_parts_deleted) {
   all_parts_deleted = false;
   sqlite::SQLiteMultipart db_multipart(store->db_conn);
   pending_multiparts_to_delete =
-      db_multipart.remove_done_or_aborted_multiparts_transact(
+      to_reclaim_items(db_multipart.remove_done_or_aborted_multiparts_transact(
           max_objects_to_delete_per_iteration
-      );
+      ));
   if (pending_multiparts_to_delete.has_value() &&
       (*pending_multiparts_to_delete).empty()) {
     all_parts_deleted = true;
@@ -229,51 +294,115 @@ bool SFSGC::delete_pending_objects_data() {
   common::PerfGuard elapsed(
       perfcounter, l_rgw_sfs_gc_pending_objects_data_elapsed
   );
-  // delete objects in a loop and check if the max process time has reached
-  // for every object.
-  if (pending_objects_to_delete.has_value()) {
-    for (auto it = (*pending_objects_to_delete).begin();
-         it != (*pending_objects_to_delete).end();) {
-      Object::delete_version_data(
-          store, sqlite::get_uuid((*it)), sqlite::get_version_id((*it))
-      );
-      it = (*pending_objects_to_delete).erase(it);
-      if (process_time_elapsed()) {
-        lsfs_dout(this, 10) << "Exit due to max process time reached." << dendl;
-        return false;  // had no time to delete everything
-      }
-    }
-  }
-  return true;  // all objects were successfully deleted
+  return reclaim_pending_data(pending_objects_to_delete);
 }
 
 bool SFSGC::delete_pending_multiparts_data() {
   common::PerfGuard elapsed(
       perfcounter, l_rgw_sfs_gc_pending_multiparts_data_elapsed
   );
-  if (pending_multiparts_to_delete.has_value()) {
-    // delete multiparts in a loop and check if the max process time has reached
-    // for every part.
-    for (auto it = (*pending_multiparts_to_delete).begin();
-         it != (*pending_multiparts_to_delete).end();) {
-      MultipartPartPath pp(
-          sqlite::get_path_uuid((*it)), sqlite::get_part_id((*it))
-      );
-      auto p = store->get_data_path() / pp.to_path();
-      if (std::filesystem::exists(p)) {
-        std::filesystem::remove(p);
-      }
-      it = (*pending_multiparts_to_delete).erase(it);
-      // check that we didn't exceed the max before keep going
-      if (process_time_elapsed()) {
-        lsfs_dout(this, 10) << "Exit due to max process time reached." << dendl;
-        return false;  // had no time to delete everything
-      }
-    }
+  return reclaim_pending_data(pending_multiparts_to_delete);
+}
+
+bool SFSGC::reclaim_pending_data(
+    std::optional<std::vector<ReclaimItem>>& pending
+) {
+  if (!pending.has_value() || pending->empty()) {
+    return true;
+  }
+  const auto start = ceph::mono_clock::now();
+  const ReclaimStats stats =
+      reclaimer.reclaim(*pending, [this]() { return process_time_elapsed(); });
+  const std::chrono::duration<double> elapsed =
+      ceph::mono_clock::now() - start;
+  const double secs = elapsed.count();
+  pending->erase(pending->begin(), pending->begin() + stats.items);
+
+  perfcounter->inc(l_rgw_sfs_gc_reclaimed_files, stats.files);
+  perfcounter->inc(l_rgw_sfs_gc_reclaimed_bytes, stats.bytes);
+  perfcounter->inc(l_rgw_sfs_gc_reclaimed_dirs, stats.dirs);
+  if (secs > 0) {
+    perfcounter->set(
+        l_rgw_sfs_gc_reclaim_files_rate, static_cast<uint64_t>(stats.files / secs)
+    );
+    perfcounter->set(
+        l_rgw_sfs_gc_reclaim_bytes_rate, static_cast<uint64_t>(stats.bytes / secs)
+    );
+  }
+  lsfs_dout(this, 10) << fmt::format(
+                             "reclaimed {} files, {} bytes and {} directories "
+                             "in {:.3f}s, {} items left",
+                             stats.files, stats.bytes, stats.dirs, secs,
+                             pending->size()
+                         )
+                      << dendl;
+  if (!pending->empty()) {
+    lsfs_dout(this, 10) << "Exit due to max process time reached." << dendl;
+    return false;  // had no time to delete everything
   }
   return true;  // all objects were successfully deleted
 }
 
+void SFSGC::compact_packed_segments() {
+  const CompactStats stats = store->packer->compact(
+      store->db_conn,
+      cct->_conf.get_val<double>("rgw_sfs_pack_compact_garbage_ratio"),
+      [this]() { return process_time_elapsed(); }
+  );
+  perfcounter->inc(l_rgw_sfs_pack_removed_segments, stats.segments);
+  perfcounter->inc(l_rgw_sfs_pack_removed_bytes, stats.bytes);
+  perfcounter->inc(l_rgw_sfs_pack_moved_bytes, stats.moved_bytes);
+  lsfs_dout(this, 10) << fmt::format(
+                             "removed {} segments of {} bytes, moved {} "
+                             "packed objects of {} bytes",
+                             stats.segments, stats.bytes, stats.moved_objects,
+                             stats.moved_bytes
+                         )
+                      << dendl;
+}
+
+std::optional<std::vector<ReclaimItem>> SFSGC::to_reclaim_items(
+    const std::optional<sqlite::DBDeletedObjectItems>& objects
+) {
+  if (!objects.has_value()) {
+    return std::nullopt;
+  }
+  // the files Object::delete_object_data() removes
+  std::vector<ReclaimItem> result;
+  result.reserve(objects->size());
+  for (const auto& item : *objects) {
+    const auto version_id = std::to_string(sqlite::get_version_id(item));
+    result.push_back(
+        {.dir = UUIDPath(sqlite::get_uuid(item)).to_path(),
+         .file = version_id + ".v",
+         .subdir = version_id + ".parts"}
+    );
+  }
+  return result;
+}
+
+std::optional<std::vector<ReclaimItem>> SFSGC::to_reclaim_items(
+    const std::optional<sqlite::DBDeletedMultipartItems>& parts
+) {
+  if (!parts.has_value()) {
+    return std::nullopt;
+  }
+  std::vector<ReclaimItem> result;
+  result.reserve(parts->size());
+  for (const auto& item : *parts) {
+    const MultipartPartPath part_path(
+        sqlite::get_path_uuid(item), sqlite::get_part_id(item)
+    );
+    const auto path = part_path.to_path();
+    result.push_back(
+        {.dir = path.parent_path(),
+         .file = path.filename().string(),
+         .subdir = ""}
+    );
+  }
+  return result;
+}
+
 bool SFSGC::abort_bucket_multiparts(const std::string& bucket_id) {
   common::PerfGuard elapsed(
       perfcounter, l_rgw_sfs_gc_abort_bucket_multiparts_elapsed
@@ -294,9 +423,10 @@ bool SFSGC::delete_bucket_multiparts(
     const std::string& bucket_id, bool& all_parts_deleted
 ) {
   sqlite::SQLiteMultipart db_mp(store->db_conn);
-  pending_multiparts_to_delete = db_mp.remove_multiparts_by_bucket_id_transact(
-      bucket_id, max_objects_to_delete_per_iteration
-  );
+  pending_multiparts_to_delete =
+      to_reclaim_items(db_mp.remove_multiparts_by_bucket_id_transact(
+          bucket_id, max_objects_to_delete_per_iteration
+      ));
   all_parts_deleted = pending_multiparts_to_delete.has_value() &&
                       (*pending_multiparts_to_delete).empty();
   return delete_pending_multiparts_data();
@@ -308,9 +438,9 @@ bool SFSGC::delete_bucket(const std::string& bucket_id, bool& bucket_deleted) {
   // transaction.
   // The call return the objects (and versions) that need to be deleted from
   // the filesystem
-  pending_objects_to_delete = db_buckets.delete_bucket_transact(
+  pending_objects_to_delete = to_reclaim_items(db_buckets.delete_bucket_transact(
       bucket_id, max_objects_to_delete_per_iteration, bucket_deleted
-  );
+  ));
   return delete_pending_objects_data();
 }
 
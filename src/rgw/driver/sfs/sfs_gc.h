@@ -14,7 +14,10 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <vector>
 
+#include "rgw/driver/sfs/sfs_gc_reclaim.h"
 #include "rgw_sal.h"
 #include "rgw_sal_sfs.h"
 
@@ -48,6 +51,17 @@ class SFSGC : public DoutPrefixProvider {
   };
 
   std::unique_ptr<GCWorker> worker = nullptr;
+  DataReclaimer reclaimer;
+
+  /// Versions with ids up to this one were written before the store
+  /// started, the ones still open were abandoned by writers of a
+  /// previous run (see process_stale_open_versions())
+  std::atomic<uint> stale_open_versions_max_id = {0};
+  /// The version ids process_stale_open_versions() checks per update,
+  /// a range of the primary key and cheap to look up
+  static constexpr uint STALE_OPEN_VERSIONS_BATCH = 50000;
+  /// The first version id process_stale_open_versions() has yet to check
+  uint stale_open_versions_next_id = 1;
 
  public:
   SFSGC(CephContext*, SFStore*);
@@ -55,6 +69,10 @@ class SFSGC : public DoutPrefixProvider {
 
   int process();
 
+  /// Marks the versions left open by a previous run, those with ids up
+  /// to `max_id`, deleted in the background. Done on startup.
+  void set_stale_open_versions(uint max_id);
+
   bool going_down();
   void initialize();
   bool suspended();
@@ -71,6 +89,7 @@ class SFSGC : public DoutPrefixProvider {
  private:
   // Return false if it was forced to exit because max process time was met
   // which means there are still objects to be deleted
+  bool process_stale_open_versions();
   bool process_deleted_buckets();
   bool process_deleted_objects();
   bool delete_pending_objects_data();
@@ -84,9 +103,22 @@ class SFSGC : public DoutPrefixProvider {
   bool process_done_and_aborted_multiparts_batch(bool& all_parts_deleted);
   bool delete_bucket(const std::string& bucket_id, bool& bucket_deleted);
   bool process_time_elapsed() const;
+  /// Compacts the segment files packing small objects (see
+  /// SegmentPacker::compact())
+  void compact_packed_segments();
+  /// Reclaims `pending` until done or out of time. Returns false if
+  /// there is data left to reclaim.
+  bool reclaim_pending_data(std::optional<std::vector<ReclaimItem>>& pending);
+
+  static std::optional<std::vector<ReclaimItem>> to_reclaim_items(
+      const std::optional<sqlite::DBDeletedObjectItems>& objects
+  );
+  static std::optional<std::vector<ReclaimItem>> to_reclaim_items(
+      const std::optional<sqlite::DBDeletedMultipartItems>& parts
+  );
 
-  std::optional<sqlite::DBDeletedObjectItems> pending_objects_to_delete;
-  std::optional<sqlite::DBDeletedMultipartItems> pending_multiparts_to_delete;
+  std::optional<std::vector<ReclaimItem>> pending_objects_to_delete;
+  std::optional<std::vector<ReclaimItem>> pending_multiparts_to_delete;
 };
 
 }  //  namespace rgw::sal::sfs
@@ -0,0 +1,182 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "sfs_gc_reclaim.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+#include "common/Thread.h"
+
+namespace fs = std::filesystem;
+
+namespace rgw::sal::sfs {
+
+bool ReclaimItem::operator<(const ReclaimItem& other) const {
+  return std::tie(dir, file, subdir) <
+         std::tie(other.dir, other.file, other.subdir);
+}
+
+DataReclaimer::DataReclaimer(
+    const fs::path& _data_path, size_t _num_threads, size_t _chunk_size
+)
+    : data_path(_data_path),
+      num_threads(std::max<size_t>(_num_threads, 1)),
+      chunk_size(std::max<size_t>(_chunk_size, 1)) {}
+
+/// Unlinks `name` in `dir_fd`, if it exists
+static void unlink_file(int dir_fd, const char* name, ReclaimStats& stats) {
+  struct stat st;
+  if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return;
+  }
+  if (::unlinkat(dir_fd, name, 0) == 0) {
+    stats.files++;
+    stats.bytes += static_cast<uint64_t>(st.st_size);
+  }
+}
+
+/// Removes directory `name` in `dir_fd` and the files in it
+static void remove_subdir(int dir_fd, const char* name, ReclaimStats& stats) {
+  const int fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  DIR* dir = ::fdopendir(fd);
+  if (dir == nullptr) {
+    ::close(fd);
+    return;
+  }
+  std::vector<std::string> names;
+  while (const struct dirent* entry = ::readdir(dir)) {
+    if (std::strcmp(entry->d_name, ".") != 0 &&
+        std::strcmp(entry->d_name, "..") != 0) {
+      names.emplace_back(entry->d_name);
+    }
+  }
+  for (const auto& entry_name : names) {
+    unlink_file(::dirfd(dir), entry_name.c_str(), stats);
+  }
+  ::closedir(dir);
+  if (::unlinkat(dir_fd, name, AT_REMOVEDIR) == 0) {
+    stats.dirs++;
+  }
+}
+
+/// Removes `dir` and its parents below the data path, as long as they
+/// are empty. Writers recreate them (see open_data_file()).
+static void remove_empty_dirs(
+    const fs::path& data_path, fs::path dir, ReclaimStats& stats
+) {
+  for (; !dir.empty(); dir = dir.parent_path()) {
+    if (::rmdir((data_path / dir).c_str()) != 0) {
+      return;
+    }
+    stats.dirs++;
+  }
+}
+
+static void reclaim_chunk(
+    const fs::path& data_path, std::vector<ReclaimItem>::const_iterator begin,
+    std::vector<ReclaimItem>::const_iterator end, ReclaimStats& stats
+) {
+  while (begin != end) {
+    const fs::path& dir = begin->dir;
+    const int dir_fd = ::open(
+        (data_path / dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC
+    );
+    for (; begin != end && begin->dir == dir; ++begin) {
+      if (dir_fd < 0) {
+        continue;
+      }
+      if (!begin->file.empty()) {
+        unlink_file(dir_fd, begin->file.c_str(), stats);
+      }
+      if (!begin->subdir.empty()) {
+        remove_subdir(dir_fd, begin->subdir.c_str(), stats);
+      }
+    }
+    if (dir_fd >= 0) {
+      ::close(dir_fd);
+      remove_empty_dirs(data_path, dir, stats);
+    }
+  }
+}
+
+ReclaimStats DataReclaimer::reclaim(
+    std::vector<ReclaimItem>& items, const std::function<bool()>& should_stop
+) const {
+  std::sort(items.begin(), items.end());
+
+  // chunk ends, each at a directory boundary
+  std::vector<size_t> chunk_ends;
+  for (size_t i = 0, chunk_begin = 0; i < items.size(); i++) {
+    const bool last = i + 1 == items.size();
+    if (last || (i + 1 - chunk_begin >= chunk_size &&
+                 items[i + 1].dir != items[i].dir)) {
+      chunk_ends.push_back(i + 1);
+      chunk_begin = i + 1;
+    }
+  }
+
+  std::atomic<size_t> next_chunk{0};
+  std::mutex stats_lock;
+  ReclaimStats result;
+  const auto work = [&]() {
+    ReclaimStats stats;
+    // the first chunk is always reclaimed, so every call makes progress
+    while (next_chunk == 0 || !should_stop()) {
+      const size_t chunk = next_chunk++;
+      if (chunk >= chunk_ends.size()) {
+        break;
+      }
+      const size_t begin = chunk == 0 ? 0 : chunk_ends[chunk - 1];
+      reclaim_chunk(
+          data_path, items.cbegin() + begin, items.cbegin() + chunk_ends[chunk],
+          stats
+      );
+    }
+    std::lock_guard l(stats_lock);
+    result.files += stats.files;
+    result.bytes += stats.bytes;
+    result.dirs += stats.dirs;
+  };
+
+  std::vector<std::thread> threads;
+  // the calling thread is one of them
+  const size_t extra_threads =
+      chunk_ends.empty() ? 0 : std::min(num_threads, chunk_ends.size()) - 1;
+  for (size_t i = 0; i < extra_threads; i++) {
+    threads.emplace_back(make_named_thread("sfs_gc_reclaim", work));
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // chunks are taken in order and always finished
+  const size_t chunks_done = std::min(next_chunk.load(), chunk_ends.size());
+  result.items = chunks_done == 0 ? 0 : chunk_ends[chunks_done - 1];
+  return result;
+}
+
+}  // namespace rgw::sal::sfs
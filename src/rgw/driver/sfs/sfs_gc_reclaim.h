@@ -0,0 +1,74 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rgw::sal::sfs {
+
+/// The data of a deleted object version or multipart part, in a
+/// UUIDPath directory (see uuid_path.h).
+struct ReclaimItem {
+  /// directory holding the data, relative to the data path
+  std::filesystem::path dir;
+  /// file in `dir` to remove, if it exists
+  std::string file;
+  /// directory in `dir` to remove with the files in it, if it exists
+  std::string subdir;
+
+  bool operator<(const ReclaimItem& other) const;
+};
+
+struct ReclaimStats {
+  /// number of items handled: the first ones of the sorted input
+  size_t items = 0;
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  /// directories removed, UUIDPath fan-out directories included
+  uint64_t dirs = 0;
+};
+
+/// Removes the data of deleted object versions and multipart parts.
+///
+/// Items are sorted by directory and split in chunks of whole
+/// directories, which `num_threads` threads take in order. A directory
+/// is handled by a single thread: it unlinks the files relative to the
+/// open directory, while its entries are still cached, then removes the
+/// directory and the UUIDPath fan-out directories above it as they are
+/// left empty.
+class DataReclaimer {
+  const std::filesystem::path data_path;
+  const size_t num_threads;
+  const size_t chunk_size;
+
+ public:
+  DataReclaimer(
+      const std::filesystem::path& data_path, size_t num_threads,
+      size_t chunk_size = 16
+  );
+
+  /// Sorts and reclaims `items`. No new chunk but the first is started
+  /// once `should_stop` (called from all the threads) returns true: the
+  /// first `ReclaimStats::items` of `items` are done, the others are left
+  /// for another call.
+  ReclaimStats reclaim(
+      std::vector<ReclaimItem>& items, const std::function<bool()>& should_stop
+  ) const;
+};
+
+}  // namespace rgw::sal::sfs
@@ -14,9 +14,11 @@
 #include "sfs_lc.h"
 
 #include <common/dout.h>
+#include <fmt/format.h>
 
 #include <vector>
 
+#include "rgw/rgw_perf_counters.h"
 #include "sqlite/sqlite_lifecycle.h"
 
 #define dout_subsys ceph_subsys_rgw
@@ -116,4 +118,139 @@ std::unique_ptr<LCSerializer> SFSLifecycle::get_serializer(
   );
 }
 
+/// Returns the ids of the versions of a window matching the tag filter of
+/// `op`, as the LC workers check it.
+static std::vector<uint> get_tagged_versions(
+    const sqlite::SQLiteLifecycle& sqlite_lc,
+    const sqlite::DBOPLCExpiration& expiration,
+    const sqlite::DBOPLCWindow& window, const lc_op& op
+) {
+  std::vector<uint> result;
+  const auto versions = sqlite_lc.get_window_versions(expiration, window);
+  for (const auto& [id, attrs] : versions) {
+    auto tags_it = attrs.find(RGW_ATTR_TAGS);
+    if (tags_it == attrs.end()) {
+      continue;
+    }
+    RGWObjTags tags;
+    try {
+      auto iter = tags_it->second.cbegin();
+      tags.decode(iter);
+    } catch (const buffer::error&) {
+      continue;
+    }
+    if (rgw::lc::has_all_tags(op, tags)) {
+      result.push_back(id);
+    }
+  }
+  return result;
+}
+
+int SFSLifecycle::process_bucket_expiration(
+    const DoutPrefixProvider* dpp, const std::string& entry_bucket,
+    Bucket* bucket, RGWLifecycleConfiguration& config,
+    const std::function<bool()>& should_stop
+) {
+  CephContext* cct = store->ctx();
+  if (!cct->_conf.get_val<bool>("rgw_sfs_lc_expiration")) {
+    return -ENOTSUP;
+  }
+  // object lock retention is checked for every version and transitions
+  // move its data: both need the objects processed one at a time
+  if (bucket->get_info().obj_lock_enabled()) {
+    return -ENOTSUP;
+  }
+  auto& prefix_map = config.get_prefix_map();
+  for (const auto& [prefix, op] : prefix_map) {
+    if (op.status && (!op.transitions.empty() ||
+                      !op.noncur_transitions.empty() || op.rule_flags != 0)) {
+      return -ENOTSUP;
+    }
+  }
+
+  const auto max_objects =
+      cct->_conf.get_val<uint64_t>("rgw_sfs_lc_expiration_batch");
+  sqlite::SQLiteLifecycle sqlite_lc(store->db_conn);
+  sqlite::DBOPLCEntry counts{"", entry_bucket, 0, 0};
+  try {
+    for (const auto& [prefix, op] : prefix_map) {
+      if (!op.status) {
+        continue;
+      }
+      sqlite::DBOPLCExpiration expiration;
+      expiration.bucket_id = bucket->get_bucket_id();
+      expiration.prefix = prefix;
+      if (op.expiration > 0) {
+        expiration.current_before =
+            rgw::lc::expiration_cutoff(cct, op.expiration);
+      } else if (op.expiration_date &&
+                 ceph::real_clock::now() >= *op.expiration_date) {
+        expiration.current_before = ceph::real_clock::now();
+      }
+      expiration.versioned = bucket->versioning_enabled();
+      if (op.noncur_expiration > 0) {
+        expiration.noncurrent_before =
+            rgw::lc::expiration_cutoff(cct, op.noncur_expiration);
+      }
+      // as the LC workers, expiring current versions expires the delete
+      // markers left alone too
+      expiration.delete_markers =
+          op.dm_expiration || op.expiration > 0 || op.expiration_date;
+
+      if (op.mp_expiration > 0) {
+        counts.aborted_multiparts += sqlite_lc.abort_multiparts(
+            expiration.bucket_id, prefix,
+            rgw::lc::expiration_cutoff(cct, op.mp_expiration)
+        );
+      }
+      if (!expiration.current_before && !expiration.noncurrent_before &&
+          !expiration.delete_markers) {
+        continue;
+      }
+
+      sqlite::DBOPLCWindow window;
+      while (!should_stop()) {
+        auto last_name = sqlite_lc.get_window_end(
+            expiration.bucket_id, prefix, window.after_name, max_objects
+        );
+        if (!last_name) {
+          break;
+        }
+        window.last_name = std::move(*last_name);
+        if (op.obj_tags) {
+          window.version_ids =
+              get_tagged_versions(sqlite_lc, expiration, window, op);
+        }
+        sqlite_lc.expire(expiration, window, counts);
+        window.after_name = window.last_name;
+      }
+    }
+  } catch (const std::system_error& e) {
+    lsfs_dout(dpp, -1) << fmt::format(
+                              "error expiring objects of bucket {}: {}",
+                              bucket->get_name(), e.what()
+                          )
+                       << dendl;
+    return -EIO;
+  }
+
+  lsfs_dout(dpp, 10) << fmt::format(
+                            "bucket: {}, expired current: {}, noncurrent: {}, "
+                            "delete markers: {}, aborted multiparts: {}",
+                            bucket->get_name(), counts.expired_current,
+                            counts.expired_noncurrent,
+                            counts.expired_delete_markers,
+                            counts.aborted_multiparts
+                        )
+                     << dendl;
+  sqlite_lc.store_entry_counts(counts);
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_lc_expire_current, counts.expired_current);
+    perfcounter->inc(l_rgw_lc_expire_noncurrent, counts.expired_noncurrent);
+    perfcounter->inc(l_rgw_lc_expire_dm, counts.expired_delete_markers);
+    perfcounter->inc(l_rgw_lc_abort_mpu, counts.aborted_multiparts);
+  }
+  return 0;
+}
+
 }  // namespace rgw::sal::sfs
@@ -14,6 +14,7 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <mutex>
 
 #include "rgw_lc.h"
@@ -49,6 +50,8 @@ class SFSLifecycle : public StoreLifecycle {
  public:
   SFSLifecycle(SFStore* _st);
 
+  std::string get_cls_name() const { return "lifecycle"; }
+
   using StoreLifecycle::get_entry;
   virtual int get_entry(
       const std::string& oid, const std::string& marker,
@@ -71,6 +74,15 @@ class SFSLifecycle : public StoreLifecycle {
       const std::string& lock_name, const std::string& oid,
       const std::string& cookie
   ) override;
+  /// Expires the versions of a bucket with bulk updates of the database
+  /// (see SQLiteLifecycle::expire()), a window of objects at a time,
+  /// and stores what it expired in the entries of the bucket. The
+  /// garbage collector reclaims the versions expired.
+  virtual int process_bucket_expiration(
+      const DoutPrefixProvider* dpp, const std::string& entry_bucket,
+      Bucket* bucket, RGWLifecycleConfiguration& config,
+      const std::function<bool()>& should_stop
+  ) override;
 };
 
 }  // namespace rgw::sal::sfs
@@ -0,0 +1,93 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "multipart_registry.h"
+
+#include <algorithm>
+
+namespace rgw::sal::sfs::sqlite {
+
+static constexpr size_t MULTIPART_REGISTRY_MIN_SWEEP = 64;
+
+MultipartRegistry::MultipartRegistry()
+    : next_sweep(MULTIPART_REGISTRY_MIN_SWEEP) {}
+
+std::shared_ptr<MultipartUploadState> MultipartRegistry::find_locked(
+    const std::string& upload_id
+) {
+  const auto it = uploads.find(upload_id);
+  if (it == uploads.end()) {
+    return nullptr;
+  }
+  return it->second.lock();
+}
+
+std::shared_ptr<MultipartUploadState> MultipartRegistry::add(
+    const DBMultipart& mp, MultipartState state, uint64_t read_generation
+) {
+  std::lock_guard l(lock);
+  auto upload = find_locked(mp.upload_id);
+  if (upload) {
+    return upload;
+  }
+  if (read_generation != generation) {
+    state = MultipartState::NONE;
+  }
+  upload = std::make_shared<MultipartUploadState>(mp, state);
+  uploads[mp.upload_id] = upload;
+  if (uploads.size() >= next_sweep) {
+    std::erase_if(uploads, [](const auto& entry) {
+      return entry.second.expired();
+    });
+    next_sweep = std::max(MULTIPART_REGISTRY_MIN_SWEEP, 2 * uploads.size());
+  }
+  return upload;
+}
+
+void MultipartRegistry::refresh(
+    MultipartUploadState& upload, MultipartState state, uint64_t read_generation
+) {
+  std::lock_guard l(lock);
+  if (read_generation == generation) {
+    upload.state = state;
+  }
+}
+
+void MultipartRegistry::publish(
+    const std::string& upload_id, MultipartState state
+) {
+  std::lock_guard l(lock);
+  generation++;
+  auto upload = find_locked(upload_id);
+  if (upload) {
+    upload->state = state;
+  }
+}
+
+void MultipartRegistry::invalidate_bucket(const std::string& bucket_id) {
+  std::lock_guard l(lock);
+  generation++;
+  for (const auto& [upload_id, entry] : uploads) {
+    auto upload = entry.lock();
+    if (upload && upload->bucket_id == bucket_id) {
+      upload->state = MultipartState::NONE;
+    }
+  }
+}
+
+size_t MultipartRegistry::size() {
+  std::lock_guard l(lock);
+  return uploads.size();
+}
+
+}  // namespace rgw::sal::sfs::sqlite
@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "multipart_definitions.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+/// The state of a multipart upload as its part writers see it
+struct MultipartUploadState {
+  const std::string upload_id;
+  const std::string bucket_id;
+  const uuid_d path_uuid;
+  /// NONE if unknown: to be read from the database again
+  std::atomic<MultipartState> state;
+
+  MultipartUploadState(const DBMultipart& mp, MultipartState _state)
+      : upload_id(mp.upload_id),
+        bucket_id(mp.bucket_id),
+        path_uuid(mp.path_uuid),
+        state(_state) {}
+};
+
+/// The multipart uploads with parts being written, so that part writers
+/// check their upload is still in progress without querying the
+/// database for every chunk they write. SQLiteMultipart registers an
+/// upload when a part of it is created and publishes every state change
+/// of a registered upload.
+///
+/// Uploads stay registered as long as a writer holds their state.
+/// Changes racing with a registration are caught by a generation bumped
+/// on every publication, as in ObjectMetaCache: an upload registered with
+/// a state read before one gets an unknown state instead.
+class MultipartRegistry {
+  std::mutex lock;
+  std::unordered_map<std::string, std::weak_ptr<MultipartUploadState>>
+      uploads;
+  /// uploads size to drop the expired ones at
+  size_t next_sweep;
+  std::atomic<uint64_t> generation{0};
+
+  std::shared_ptr<MultipartUploadState> find_locked(
+      const std::string& upload_id
+  );
+
+ public:
+  MultipartRegistry();
+  MultipartRegistry(const MultipartRegistry&) = delete;
+  MultipartRegistry& operator=(const MultipartRegistry&) = delete;
+
+  /// The generation to add() or refresh() a state read from the database
+  /// at. Must be taken before reading it.
+  uint64_t get_generation() const { return generation; }
+
+  /// Registers upload `mp` in state `state`, or returns its registered
+  /// state if it's registered already
+  std::shared_ptr<MultipartUploadState> add(
+      const DBMultipart& mp, MultipartState state, uint64_t read_generation
+  );
+  /// Sets the unknown state of `upload` to `state`, read from the database
+  void refresh(
+      MultipartUploadState& upload, MultipartState state,
+      uint64_t read_generation
+  );
+
+  /// To be called after changing the state of upload `upload_id`
+  void publish(const std::string& upload_id, MultipartState state);
+  /// To be called after changing the state of any upload of bucket
+  /// `bucket_id`, or removing it
+  void invalidate_bucket(const std::string& bucket_id);
+
+  size_t size();
+};
+
+}  // namespace rgw::sal::sfs::sqlite
@@ -128,9 +128,9 @@ void assign_db_value(const SOURCE& source, std::vector<char>& dest) {
   dest = blob_vector;
 }
 
-template <typename COL>
-sqlite_orm::internal::like_t<COL, std::basic_string<char>, const char*>
-prefix_to_like(COL col, const std::string& prefix) {
+/// LIKE pattern matching the strings starting with `prefix`, with '\a'
+/// as the escape character
+inline std::string prefix_like_pattern(const std::string& prefix) {
   std::string like_expr;
   like_expr.reserve(prefix.length() + 10);
   for (const char c : prefix) {
@@ -143,7 +143,13 @@ prefix_to_like(COL col, const std::string& prefix) {
     }
   }
   like_expr.push_back('%');
-  return sqlite_orm::like(col, like_expr, "\a");
+  return like_expr;
+}
+
+template <typename COL>
+sqlite_orm::internal::like_t<COL, std::basic_string<char>, const char*>
+prefix_to_like(COL col, const std::string& prefix) {
+  return sqlite_orm::like(col, prefix_like_pattern(prefix), "\a");
 }
 
 }  // namespace rgw::sal::sfs::sqlite
@@ -15,9 +15,12 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <system_error>
 
+#include "common/Thread.h"
 #include "common/dout.h"
 
 #define dout_subsys ceph_subsys_rgw
@@ -114,9 +117,33 @@ static int sqlite_profile_callback(
 
 DBConn::DBConn(CephContext* _cct)
     : storage(_make_storage(getDBPath(_cct))),
+      pool(std::make_shared<ConnectionPool>(
+          std::max<uint64_t>(
+              1,
+              _cct->_conf.get_val<uint64_t>("rgw_sfs_sqlite_max_connections")
+          ),
+          _cct->_conf.get_val<uint64_t>("rgw_sfs_sqlite_idle_connections"),
+          _cct->_conf.get_val<std::chrono::milliseconds>(
+              "rgw_sfs_sqlite_connection_wait_timeout"
+          )
+      )),
+      group_commit_window(_cct->_conf.get_val<std::chrono::milliseconds>(
+          "rgw_sfs_sqlite_group_commit_window"
+      )),
+      group_commit_max_ops(std::max<uint64_t>(
+          1,
+          _cct->_conf.get_val<uint64_t>("rgw_sfs_sqlite_group_commit_max_ops")
+      )),
       first_sqlite_conn(nullptr),
       cct(_cct),
-      profile_enabled(_cct->_conf.get_val<bool>("rgw_sfs_sqlite_profile")) {
+      profile_enabled(_cct->_conf.get_val<bool>("rgw_sfs_sqlite_profile")),
+      prepared_statements_enabled(
+          _cct->_conf.get_val<bool>("rgw_sfs_sqlite_prepared_statements")
+      ),
+      user_cache(_cct->_conf.get_val<uint64_t>("rgw_sfs_user_cache_size")),
+      object_meta_cache(
+          _cct->_conf.get_val<uint64_t>("rgw_sfs_object_meta_cache_size")
+      ) {
   sqlite3_config(SQLITE_CONFIG_LOG, &sqlite_error_callback, cct);
   storage.on_open = [this](sqlite3* db) {
     if (first_sqlite_conn == nullptr) {
@@ -154,65 +181,326 @@ DBConn::DBConn(CephContext* _cct)
   maybe_upgrade_metadata();
   check_metadata_is_compatible();
   storage.sync_schema();
+  create_stats_triggers();
+  create_latest_version_triggers();
+  create_packed_segment_triggers();
+
+  writer_storage = std::make_unique<Storage>(storage);
+  writer_storage->on_open = [this, on_open = storage.on_open](sqlite3* db) {
+    on_open(db);
+    writer_db = db;
+  };
+  writer_storage->open_forever();
+  writer_storage->busy_timeout(5000);
+  writer_thread =
+      make_named_thread("sfs_sqlite_wr", &DBConn::writer_loop, this);
 }
 
-void DBConn::check_metadata_is_compatible() const {
-  bool sync_error = false;
-  std::string result_message;
-  std::string temporary_db_path(get_temporary_db_path(cct));
-  // create a copy of the actual metadata
-  sqlite3* temporary_db;
-  int rc = sqlite3_open(temporary_db_path.c_str(), &temporary_db);
-  if (rc == SQLITE_OK) {
-    sqlite3_backup* backup =
-        sqlite3_backup_init(temporary_db, "main", first_sqlite_conn, "main");
-    if (backup) {
-      sqlite3_backup_step(backup, -1);
-      sqlite3_backup_finish(backup);
+DBConn::~DBConn() {
+  {
+    std::lock_guard l(writer_mutex);
+    writer_stop = true;
+  }
+  writer_cond.notify_all();
+  if (writer_thread.joinable()) {
+    writer_thread.join();
+  }
+}
+
+DBConn::PooledConnection* DBConn::ConnectionPool::acquire(
+    const Storage& storage, CephContext* cct
+) {
+  std::unique_lock l(mutex);
+  const auto available = [this] {
+    return !idle.empty() || num_open < max_connections;
+  };
+  if (!available()) {
+    lsubdout(cct, rgw, 1) << "[SQLITE] all " << max_connections
+                          << " pooled connections in use, waiting for one"
+                          << dendl;
+    if (!cond.wait_for(l, wait_timeout, available)) {
+      lsubdout(cct, rgw, 1)
+          << "[SQLITE] no pooled connection given back within "
+          << wait_timeout.count() << "ms" << dendl;
+      throw std::system_error(
+          std::make_error_code(std::errc::device_or_resource_busy),
+          "no pooled SQLite connection available"
+      );
     }
-    rc = sqlite3_errcode(temporary_db);
-    sqlite3_close(temporary_db);
-  }
-  if (rc == SQLITE_OK) {
-    // try to sync the storage based on the temporary db
-    // in case something goes wrong show possible errors and return
-    auto test_storage = _make_storage(temporary_db_path);
-    test_storage.open_forever();
-    test_storage.busy_timeout(5000);
-    try {
-      auto sync_res = test_storage.sync_schema();
-      std::vector<std::string> non_compatible_tables;
-      for (auto const& [table_name, sync_result] : sync_res) {
-        if (sync_result == orm::sync_schema_result::dropped_and_recreated) {
-          // this result is aggressive as it drops the table and
-          // recreates it.
-          // Data loss is expected and we should warn the user and
-          // stop the final sync in the real database.
-          result_message +=
-              "Table: [" + table_name + "] is no longer compatible. ";
-          non_compatible_tables.push_back(table_name);
-        }
+  }
+  if (!idle.empty()) {
+    auto conn = idle.back();
+    idle.pop_back();
+    return conn;
+  }
+
+  // open a new connection outside the lock, SQLite's on_open pragmas may
+  // take a while.
+  num_open++;
+  l.unlock();
+  std::unique_ptr<PooledConnection> conn;
+  try {
+    conn = std::make_unique<PooledConnection>(storage);
+    // writes go through the writer connection only
+    conn->storage.on_open = [on_open = storage.on_open](sqlite3* db) {
+      on_open(db);
+      sqlite3_exec(db, "PRAGMA query_only = ON;", 0, 0, 0);
+    };
+    conn->storage.open_forever();
+    conn->storage.busy_timeout(5000);
+  } catch (...) {
+    l.lock();
+    num_open--;
+    cond.notify_one();
+    throw;
+  }
+  l.lock();
+  connections.emplace_back(std::move(conn));
+  if (perfcounter) {
+    perfcounter->set(l_rgw_sfs_sqlite_pool_size, num_open);
+  }
+  return connections.back().get();
+}
+
+void DBConn::ConnectionPool::release(PooledConnection* conn) {
+  std::unique_ptr<PooledConnection> closing;
+  {
+    std::lock_guard l(mutex);
+    if (idle.size() < max_idle) {
+      idle.push_back(conn);
+    } else {
+      auto it = std::find_if(
+          connections.begin(), connections.end(),
+          [conn](const auto& c) { return c.get() == conn; }
+      );
+      ceph_assert(it != connections.end());
+      closing = std::move(*it);
+      connections.erase(it);
+      num_open--;
+      if (perfcounter) {
+        perfcounter->set(l_rgw_sfs_sqlite_pool_size, num_open);
+      }
+    }
+  }
+  cond.notify_one();
+  // closed outside the lock
+}
+
+DBConn::ConnectionLease::~ConnectionLease() {
+  if (auto p = pool.lock()) {
+    p->release(conn);
+  }
+}
+
+std::vector<std::unique_ptr<DBConn::ConnectionLease>>& DBConn::thread_leases(
+) {
+  static thread_local std::vector<std::unique_ptr<ConnectionLease>> leases;
+  return leases;
+}
+
+DBConn::PooledConnection* DBConn::thread_connection() const {
+  auto& leases = thread_leases();
+  for (auto it = leases.begin(); it != leases.end();) {
+    if ((*it)->pool.expired()) {
+      // of a DBConn destroyed since, its connection closed with it
+      it = leases.erase(it);
+    } else if ((*it)->pool_id == pool.get()) {
+      return (*it)->conn;
+    } else {
+      ++it;
+    }
+  }
+  return nullptr;
+}
+
+Storage& DBConn::get_storage() const {
+  if (auto conn = thread_connection()) {
+    return conn->storage;
+  }
+  const auto start = ceph::mono_clock::now();
+  auto conn = pool->acquire(storage, cct);
+  thread_leases().emplace_back(
+      std::make_unique<ConnectionLease>(pool, pool.get(), conn)
+  );
+  if (perfcounter) {
+    perfcounter->tinc(
+        l_rgw_sfs_sqlite_pool_wait, ceph::mono_clock::now() - start
+    );
+  }
+  return conn->storage;
+}
+
+PreparedStatements& DBConn::get_prepared_statements(const Storage& conn
+) const {
+  if (&conn == writer_storage.get()) {
+    ceph_assert(std::this_thread::get_id() == writer_thread.get_id());
+    return writer_statements;
+  }
+  auto pooled = thread_connection();
+  ceph_assert(pooled != nullptr && &pooled->storage == &conn);
+  return pooled->statements;
+}
+
+size_t DBConn::storage_pool_size() const {
+  std::lock_guard l(pool->mutex);
+  return pool->num_open;
+}
+
+void DBConn::enqueue_writer_task(WriterTask&& task) {
+  {
+    std::lock_guard l(writer_mutex);
+    writer_queue.emplace_back(std::move(task));
+    if (perfcounter) {
+      perfcounter->set(
+          l_rgw_sfs_sqlite_writer_queue_depth, writer_queue.size()
+      );
+    }
+  }
+  writer_cond.notify_one();
+}
+
+void DBConn::writer_loop() {
+  std::unique_lock l(writer_mutex);
+  const auto has_work = [this] {
+    return writer_stop || !writer_queue.empty();
+  };
+  while (true) {
+    writer_cond.wait(l, has_work);
+    if (writer_queue.empty()) {
+      // writer_stop and nothing left to drain
+      break;
+    }
+
+    if (!writer_queue.front().finish) {
+      auto task = std::move(writer_queue.front());
+      writer_queue.pop_front();
+      if (perfcounter) {
+        perfcounter->set(
+            l_rgw_sfs_sqlite_writer_queue_depth, writer_queue.size()
+        );
       }
-      if (non_compatible_tables.size() > 0) {
-        sync_error = true;
-        result_message = "Tables: [ ";
-        for (auto const& table : non_compatible_tables) {
-          result_message += table + " ";
+      l.unlock();
+      // packaged_task captures exceptions into the caller's future
+      task.run();
+      l.lock();
+      continue;
+    }
+
+    // Gather batched tasks until the group commit window expires, the
+    // batch is full or the next task can't be batched.
+    std::vector<WriterTask> batch;
+    const auto deadline =
+        std::chrono::steady_clock::now() + group_commit_window;
+    while (batch.size() < group_commit_max_ops) {
+      if (writer_queue.empty()) {
+        if (writer_stop || !writer_cond.wait_until(l, deadline, has_work)) {
+          break;
         }
-        result_message += "] are no longer compatible.";
+        continue;
+      }
+      if (!writer_queue.front().finish) {
+        break;
+      }
+      batch.emplace_back(std::move(writer_queue.front()));
+      writer_queue.pop_front();
+    }
+    if (perfcounter) {
+      perfcounter->set(
+          l_rgw_sfs_sqlite_writer_queue_depth, writer_queue.size()
+      );
+    }
+    l.unlock();
+    run_writer_batch(batch);
+    l.lock();
+  }
+}
+
+static void writer_exec(sqlite3* db, const char* sql) {
+  const int rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    throw std::system_error(
+        rc, orm::get_sqlite_error_category(), sqlite3_errmsg(db)
+    );
+  }
+}
+
+void DBConn::run_writer_batch(std::vector<WriterTask>& batch) {
+  const auto start = ceph::mono_clock::now();
+  std::exception_ptr commit_error;
+  writer_in_batch = true;
+  try {
+    writer_storage->begin_transaction();
+    for (auto& task : batch) {
+      writer_exec(writer_db, "SAVEPOINT sfs_group_commit");
+      if (!task.run()) {
+        // drop only the changes of the failed task, the caller gets its
+        // exception once the batch completes
+        writer_exec(writer_db, "ROLLBACK TO sfs_group_commit");
+      }
+      writer_exec(writer_db, "RELEASE sfs_group_commit");
+    }
+    writer_storage->commit();
+  } catch (...) {
+    commit_error = std::current_exception();
+    try {
+      writer_storage->rollback();
+    } catch (const std::system_error& e) {
+      lsubdout(cct, rgw, 1)
+          << "[SQLITE] group commit rollback failed: " << e.what() << dendl;
+    }
+  }
+  writer_in_batch = false;
+
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_sfs_sqlite_group_commit_batches);
+    perfcounter->hinc(
+        l_rgw_sfs_sqlite_group_commit_batch_size, batch.size(), 1
+    );
+    perfcounter->tinc(
+        l_rgw_sfs_sqlite_group_commit_time, ceph::mono_clock::now() - start
+    );
+  }
+  for (auto& task : batch) {
+    task.finish(commit_error);
+  }
+}
+
+void DBConn::check_metadata_is_compatible() {
+  // databases checked by older versions may have left their copy behind
+  std::error_code ec;
+  fs::remove(get_temporary_db_path(cct), ec);
+
+  // simulate syncing the schema, which only compares the schema of the
+  // database (sqlite_master and the table_info pragma) with ours and
+  // doesn't touch its data
+  bool sync_error = false;
+  std::string result_message;
+  try {
+    auto sync_res = storage.sync_schema_simulate();
+    std::vector<std::string> non_compatible_tables;
+    for (auto const& [table_name, sync_result] : sync_res) {
+      if (sync_result == orm::sync_schema_result::dropped_and_recreated) {
+        // this result is aggressive as it drops the table and
+        // recreates it.
+        // Data loss is expected and we should warn the user and
+        // stop the final sync in the real database.
+        non_compatible_tables.push_back(table_name);
       }
-    } catch (std::exception& e) {
-      // check for any other errors (foreign keys constrains, etc...)
-      result_message =
-          "Metadata database might be corrupted or is no longer compatible";
+    }
+    if (non_compatible_tables.size() > 0) {
       sync_error = true;
+      result_message = "Tables: [ ";
+      for (auto const& table : non_compatible_tables) {
+        result_message += table + " ";
+      }
+      result_message += "] are no longer compatible.";
     }
-  } else {
+  } catch (std::exception& e) {
+    // check for any other errors (corrupted schema, etc...)
+    result_message =
+        "Metadata database might be corrupted or is no longer compatible";
     sync_error = true;
-    result_message = sqlite3_errstr(rc);
   }
-  // remove the temporary db
-  fs::remove(temporary_db_path);
 
   // if there was a sync issue, throw an exception
   if (sync_error) {
@@ -222,6 +510,196 @@ void DBConn::check_metadata_is_compatible() const {
   }
 }
 
+/// SQL expression rounding `size` up to 4KiB, as rgw_rounded_objsize()
+static std::string rounded_size_sql(const std::string& size) {
+  return fmt::format("((({} + 4095) / 4096) * 4096)", size);
+}
+
+/// SQL statements adding the given deltas to the stats of the bucket
+/// holding the version in `row` (NEW or OLD), and of the bucket owner.
+static std::string stats_delta_sql(
+    const std::string& row, const std::string& size_delta,
+    const std::string& size_rounded_delta, const std::string& count_delta
+) {
+  return fmt::format(
+      "INSERT INTO {0} (bucket_id, size, size_rounded, obj_count) "
+      "SELECT o.bucket_id, {4}, {5}, {6} FROM {2} o "
+      "WHERE o.uuid = {7}.object_id "
+      "ON CONFLICT (bucket_id) DO UPDATE SET size = size + excluded.size, "
+      "size_rounded = size_rounded + excluded.size_rounded, "
+      "obj_count = obj_count + excluded.obj_count;"
+      "INSERT INTO {1} (user_id, size, size_rounded, obj_count) "
+      "SELECT b.owner_id, {4}, {5}, {6} FROM {2} o "
+      "INNER JOIN {3} b ON b.bucket_id = o.bucket_id "
+      "WHERE o.uuid = {7}.object_id "
+      "ON CONFLICT (user_id) DO UPDATE SET size = size + excluded.size, "
+      "size_rounded = size_rounded + excluded.size_rounded, "
+      "obj_count = obj_count + excluded.obj_count;",
+      BUCKET_STATS_TABLE, USER_STATS_TABLE, OBJECTS_TABLE, BUCKETS_TABLE,
+      size_delta, size_rounded_delta, count_delta, row
+  );
+}
+
+void DBConn::create_stats_triggers() {
+  // Only committed regular versions are accounted: delete markers carry
+  // the size of the version they hide. Running the bookkeeping in
+  // triggers puts it in the same transaction as the change to the
+  // version, whichever path commits, deletes or garbage collects it.
+  const auto committed = static_cast<int>(ObjectState::COMMITTED);
+  const auto regular = static_cast<int>(VersionType::REGULAR);
+  const auto is_new = fmt::format(
+      "(NEW.object_state = {} AND NEW.version_type = {})", committed, regular
+  );
+  const auto was_old = fmt::format(
+      "(OLD.object_state = {} AND OLD.version_type = {})", committed, regular
+  );
+  const auto sql = fmt::format(
+      "CREATE TRIGGER IF NOT EXISTS sfs_stats_version_insert "
+      "AFTER INSERT ON {0} WHEN {1} BEGIN {3} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_stats_version_delete "
+      "AFTER DELETE ON {0} WHEN {2} BEGIN {4} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_stats_version_update "
+      "AFTER UPDATE OF object_state, version_type, size ON {0} "
+      "WHEN {1} != {2} OR ({1} AND NEW.size != OLD.size) BEGIN {5} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_stats_bucket_delete "
+      "AFTER DELETE ON {6} BEGIN "
+      "DELETE FROM {8} WHERE bucket_id = OLD.bucket_id; END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_stats_user_delete "
+      "AFTER DELETE ON {7} BEGIN "
+      "DELETE FROM {9} WHERE user_id = OLD.user_id; END;",
+      VERSIONED_OBJECTS_TABLE, is_new, was_old,
+      stats_delta_sql(
+          "NEW", "NEW.size", rounded_size_sql("NEW.size"), "1"
+      ),
+      stats_delta_sql(
+          "OLD", "-OLD.size", "-" + rounded_size_sql("OLD.size"), "-1"
+      ),
+      stats_delta_sql(
+          "NEW",
+          fmt::format("{} * NEW.size - {} * OLD.size", is_new, was_old),
+          fmt::format(
+              "{} * {} - {} * {}", is_new, rounded_size_sql("NEW.size"),
+              was_old, rounded_size_sql("OLD.size")
+          ),
+          fmt::format("{} - {}", is_new, was_old)
+      ),
+      BUCKETS_TABLE, USERS_TABLE, BUCKET_STATS_TABLE, USER_STATS_TABLE
+  );
+  char* errmsg = nullptr;
+  const auto rc =
+      sqlite3_exec(first_sqlite_conn, sql.c_str(), nullptr, nullptr, &errmsg);
+  if (rc != SQLITE_OK) {
+    const auto err = fmt::format(
+        "Error creating the stats triggers: {}",
+        errmsg ? errmsg : sqlite3_errstr(rc)
+    );
+    sqlite3_free(errmsg);
+    lsubdout(cct, rgw, -1) << err << dendl;
+    throw sqlite_sync_exception(err);
+  }
+}
+
+/// SQL statements recomputing the latest_versions row of the object
+/// with uuid `object_id`: its committed version with the newest commit
+/// time (and highest id among equal ones), or no row if it has none.
+static std::string latest_version_refresh_sql(const std::string& object_id) {
+  return fmt::format(
+      "DELETE FROM {0} WHERE object_id = {3};"
+      "INSERT INTO {0} (object_id, bucket_id, name, version_id, version_type) "
+      "SELECT o.uuid, o.bucket_id, o.name, v.id, v.version_type "
+      "FROM {1} o INNER JOIN {2} v ON v.object_id = o.uuid "
+      "WHERE o.uuid = {3} AND v.object_state = {4} "
+      "ORDER BY v.commit_time DESC, v.id DESC LIMIT 1;",
+      LATEST_VERSIONS_TABLE, OBJECTS_TABLE, VERSIONED_OBJECTS_TABLE, object_id,
+      static_cast<int>(ObjectState::COMMITTED)
+  );
+}
+
+void DBConn::create_latest_version_triggers() {
+  // As with the stats, triggers keep the latest version in the same
+  // transaction as the commit, delete marker or version deletion that
+  // changes it. Objects are stored with REPLACE, which runs no DELETE
+  // triggers: the insert trigger drops the row of an object it
+  // replaced under the same name.
+  const auto committed = static_cast<int>(ObjectState::COMMITTED);
+  const auto sql = fmt::format(
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_insert "
+      "AFTER INSERT ON {0} WHEN NEW.object_state = {2} BEGIN {3} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_delete "
+      "AFTER DELETE ON {0} WHEN OLD.object_state = {2} BEGIN {4} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_update "
+      "AFTER UPDATE OF object_state, commit_time, version_type ON {0} "
+      "WHEN NEW.object_state = {2} OR OLD.object_state = {2} "
+      "BEGIN {3} END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_object_insert "
+      "AFTER INSERT ON {1} BEGIN "
+      "DELETE FROM {5} WHERE bucket_id = NEW.bucket_id AND name = NEW.name "
+      "AND object_id != NEW.uuid;"
+      "UPDATE {5} SET bucket_id = NEW.bucket_id, name = NEW.name "
+      "WHERE object_id = NEW.uuid; END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_object_update "
+      "AFTER UPDATE OF bucket_id, name ON {1} BEGIN "
+      "UPDATE {5} SET bucket_id = NEW.bucket_id, name = NEW.name "
+      "WHERE object_id = NEW.uuid; END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_latest_version_object_delete "
+      "AFTER DELETE ON {1} BEGIN "
+      "DELETE FROM {5} WHERE object_id = OLD.uuid; END;",
+      VERSIONED_OBJECTS_TABLE, OBJECTS_TABLE, committed,
+      latest_version_refresh_sql("NEW.object_id"),
+      latest_version_refresh_sql("OLD.object_id"), LATEST_VERSIONS_TABLE
+  );
+  char* errmsg = nullptr;
+  const auto rc =
+      sqlite3_exec(first_sqlite_conn, sql.c_str(), nullptr, nullptr, &errmsg);
+  if (rc != SQLITE_OK) {
+    const auto err = fmt::format(
+        "Error creating the latest version triggers: {}",
+        errmsg ? errmsg : sqlite3_errstr(rc)
+    );
+    sqlite3_free(errmsg);
+    lsubdout(cct, rgw, -1) << err << dendl;
+    throw sqlite_sync_exception(err);
+  }
+}
+
+void DBConn::create_packed_segment_triggers() {
+  // Packed objects are removed along with their version, by the foreign
+  // key cascade, which runs these triggers too.
+  const auto sql = fmt::format(
+      "CREATE TRIGGER IF NOT EXISTS sfs_packed_segment_insert "
+      "AFTER INSERT ON {0} BEGIN "
+      "INSERT INTO {1} (id, live_size, live_count) "
+      "VALUES (NEW.segment_id, NEW.size, 1) "
+      "ON CONFLICT (id) DO UPDATE SET live_size = live_size + NEW.size, "
+      "live_count = live_count + 1; END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_packed_segment_delete "
+      "AFTER DELETE ON {0} BEGIN "
+      "UPDATE {1} SET live_size = live_size - OLD.size, "
+      "live_count = live_count - 1 WHERE id = OLD.segment_id; END;"
+      "CREATE TRIGGER IF NOT EXISTS sfs_packed_segment_update "
+      "AFTER UPDATE OF segment_id, size ON {0} BEGIN "
+      "UPDATE {1} SET live_size = live_size - OLD.size, "
+      "live_count = live_count - 1 WHERE id = OLD.segment_id;"
+      "INSERT INTO {1} (id, live_size, live_count) "
+      "VALUES (NEW.segment_id, NEW.size, 1) "
+      "ON CONFLICT (id) DO UPDATE SET live_size = live_size + NEW.size, "
+      "live_count = live_count + 1; END;",
+      PACKED_OBJECTS_TABLE, PACKED_SEGMENTS_TABLE
+  );
+  char* errmsg = nullptr;
+  const auto rc =
+      sqlite3_exec(first_sqlite_conn, sql.c_str(), nullptr, nullptr, &errmsg);
+  if (rc != SQLITE_OK) {
+    const auto err = fmt::format(
+        "Error creating the packed segment triggers: {}",
+        errmsg ? errmsg : sqlite3_errstr(rc)
+    );
+    sqlite3_free(errmsg);
+    lsubdout(cct, rgw, -1) << err << dendl;
+    throw sqlite_sync_exception(err);
+  }
+}
+
 static int get_version(
     CephContext* cct, rgw::sal::sfs::sqlite::Storage& storage
 ) {
@@ -323,6 +801,261 @@ static int upgrade_metadata_from_v2(sqlite3* db, std::string* errmsg) {
   return 0;
 }
 
+static int upgrade_metadata_from_v4(sqlite3* db, std::string* errmsg) {
+  // Versions written before this table existed keep their data in a
+  // single file and have no parts. They are read as before.
+  auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "CREATE TABLE '{}' ("
+          "'versioned_object_id' INTEGER NOT NULL,"
+          "'part_num' INTEGER NOT NULL,"
+          "'object_offset' INTEGER NOT NULL,"
+          "'size' INTEGER NOT NULL,"
+          "PRIMARY KEY('versioned_object_id', 'part_num'),"
+          "FOREIGN KEY('versioned_object_id') REFERENCES '{}'('id') "
+          "ON DELETE CASCADE"
+          ")",
+          VERSIONED_OBJECT_PARTS_TABLE, VERSIONED_OBJECTS_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error creating '{}' table: {}", VERSIONED_OBJECT_PARTS_TABLE,
+          sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
+int fill_stats_tables(sqlite3* db, std::string* errmsg) {
+  const auto committed = static_cast<int>(ObjectState::COMMITTED);
+  const auto regular = static_cast<int>(VersionType::REGULAR);
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "INSERT INTO {0} SELECT o.bucket_id, SUM(v.size), SUM({5}), "
+          "COUNT(v.id) FROM {2} v "
+          "INNER JOIN {3} o ON o.uuid = v.object_id "
+          "WHERE v.object_state = {6} AND v.version_type = {7} "
+          "GROUP BY o.bucket_id;"
+          "INSERT INTO {1} SELECT b.owner_id, SUM(v.size), SUM({5}), "
+          "COUNT(v.id) FROM {2} v "
+          "INNER JOIN {3} o ON o.uuid = v.object_id "
+          "INNER JOIN {4} b ON b.bucket_id = o.bucket_id "
+          "WHERE v.object_state = {6} AND v.version_type = {7} "
+          "GROUP BY b.owner_id;",
+          BUCKET_STATS_TABLE, USER_STATS_TABLE, VERSIONED_OBJECTS_TABLE,
+          OBJECTS_TABLE, BUCKETS_TABLE, rounded_size_sql("v.size"), committed,
+          regular
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK && errmsg != nullptr) {
+    *errmsg = fmt::format(
+        "Error filling the '{}' and '{}' tables: {}", BUCKET_STATS_TABLE,
+        USER_STATS_TABLE, sqlite3_errmsg(db)
+    );
+  }
+  return rc;
+}
+
+static int upgrade_metadata_from_v5(sqlite3* db, std::string* errmsg) {
+  // The triggers keeping the stats up to date are created on startup,
+  // after the upgrade.
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "CREATE TABLE '{}' ("
+          "'bucket_id' TEXT PRIMARY KEY NOT NULL,"
+          "'size' INTEGER NOT NULL,"
+          "'size_rounded' INTEGER NOT NULL,"
+          "'obj_count' INTEGER NOT NULL"
+          ");"
+          "CREATE TABLE '{}' ("
+          "'user_id' TEXT PRIMARY KEY NOT NULL,"
+          "'size' INTEGER NOT NULL,"
+          "'size_rounded' INTEGER NOT NULL,"
+          "'obj_count' INTEGER NOT NULL"
+          ")",
+          BUCKET_STATS_TABLE, USER_STATS_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error creating the '{}' and '{}' tables: {}", BUCKET_STATS_TABLE,
+          USER_STATS_TABLE, sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return fill_stats_tables(db, errmsg) == SQLITE_OK ? 0 : -1;
+}
+
+static int upgrade_metadata_from_v6(sqlite3* db, std::string* errmsg) {
+  // The triggers maintaining the table and its (bucket_id, name) index
+  // are created on startup, after the upgrade.
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "CREATE TABLE '{0}' ("
+          "'object_id' TEXT PRIMARY KEY NOT NULL,"
+          "'bucket_id' TEXT NOT NULL,"
+          "'name' TEXT NOT NULL,"
+          "'version_id' INTEGER NOT NULL,"
+          "'version_type' INTEGER NOT NULL"
+          ");"
+          "INSERT INTO {0} SELECT o.uuid, o.bucket_id, o.name, v.id, "
+          "v.version_type FROM {1} o INNER JOIN {2} v ON v.id = ("
+          "SELECT l.id FROM {2} l WHERE l.object_id = o.uuid "
+          "AND l.object_state = {3} "
+          "ORDER BY l.commit_time DESC, l.id DESC LIMIT 1);",
+          LATEST_VERSIONS_TABLE, OBJECTS_TABLE, VERSIONED_OBJECTS_TABLE,
+          static_cast<int>(ObjectState::COMMITTED)
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error creating the '{}' table: {}", LATEST_VERSIONS_TABLE,
+          sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static int upgrade_metadata_from_v7(sqlite3* db, std::string* errmsg) {
+  // Nothing was packed before: all versions keep their data in files of
+  // their own and are read as before.
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "CREATE TABLE '{0}' ("
+          "'versioned_object_id' INTEGER PRIMARY KEY NOT NULL,"
+          "'segment_id' INTEGER NOT NULL,"
+          "'segment_offset' INTEGER NOT NULL,"
+          "'size' INTEGER NOT NULL,"
+          "FOREIGN KEY('versioned_object_id') REFERENCES '{2}'('id') "
+          "ON DELETE CASCADE"
+          ");"
+          "CREATE TABLE '{1}' ("
+          "'id' INTEGER PRIMARY KEY NOT NULL,"
+          "'live_size' INTEGER NOT NULL,"
+          "'live_count' INTEGER NOT NULL"
+          ")",
+          PACKED_OBJECTS_TABLE, PACKED_SEGMENTS_TABLE, VERSIONED_OBJECTS_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error creating the '{}' and '{}' tables: {}", PACKED_OBJECTS_TABLE,
+          PACKED_SEGMENTS_TABLE, sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static int upgrade_metadata_from_v8(sqlite3* db, std::string* errmsg) {
+  // Entries of earlier runs expired nothing through the SFS lifecycle.
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "ALTER TABLE '{0}' ADD COLUMN 'expired_current' "
+          "INTEGER NOT NULL DEFAULT 0;"
+          "ALTER TABLE '{0}' ADD COLUMN 'expired_noncurrent' "
+          "INTEGER NOT NULL DEFAULT 0;"
+          "ALTER TABLE '{0}' ADD COLUMN 'expired_delete_markers' "
+          "INTEGER NOT NULL DEFAULT 0;"
+          "ALTER TABLE '{0}' ADD COLUMN 'aborted_multiparts' "
+          "INTEGER NOT NULL DEFAULT 0;",
+          LC_ENTRIES_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error adding the expiration counts to the '{}' table: {}",
+          LC_ENTRIES_TABLE, sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static int upgrade_metadata_from_v9(sqlite3* db, std::string* errmsg) {
+  // Nothing was shared before: all versions have data files of their own.
+  // The index on data_version_id is created by sync_schema().
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "CREATE TABLE '{0}' ("
+          "'versioned_object_id' INTEGER PRIMARY KEY NOT NULL,"
+          "'data_version_id' INTEGER NOT NULL,"
+          "'data_object_id' TEXT NOT NULL,"
+          "FOREIGN KEY('versioned_object_id') REFERENCES '{1}'('id') "
+          "ON DELETE CASCADE"
+          ")",
+          SHARED_DATA_TABLE, VERSIONED_OBJECTS_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error creating the '{}' table: {}", SHARED_DATA_TABLE,
+          sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
+static int upgrade_metadata_from_v10(sqlite3* db, std::string* errmsg) {
+  // all existing versions have their data in files
+  const auto rc = sqlite3_exec(
+      db,
+      fmt::format(
+          "ALTER TABLE '{}' ADD COLUMN 'inline_data' BLOB;",
+          VERSIONED_OBJECTS_TABLE
+      )
+          .c_str(),
+      nullptr, nullptr, nullptr
+  );
+  if (rc != SQLITE_OK) {
+    if (errmsg != nullptr) {
+      *errmsg = fmt::format(
+          "Error adding the inline data to the '{}' table: {}",
+          VERSIONED_OBJECTS_TABLE, sqlite3_errmsg(db)
+      );
+    }
+    return -1;
+  }
+  return 0;
+}
+
 static void upgrade_metadata(
     CephContext* cct, rgw::sal::sfs::sqlite::Storage& storage, sqlite3* db
 ) {
@@ -340,6 +1073,20 @@ static void upgrade_metadata(
       rc = upgrade_metadata_from_v1(db, &errmsg);
     } else if (cur_version == 2) {
       rc = upgrade_metadata_from_v2(db, &errmsg);
+    } else if (cur_version == 4) {
+      rc = upgrade_metadata_from_v4(db, &errmsg);
+    } else if (cur_version == 5) {
+      rc = upgrade_metadata_from_v5(db, &errmsg);
+    } else if (cur_version == 6) {
+      rc = upgrade_metadata_from_v6(db, &errmsg);
+    } else if (cur_version == 7) {
+      rc = upgrade_metadata_from_v7(db, &errmsg);
+    } else if (cur_version == 8) {
+      rc = upgrade_metadata_from_v8(db, &errmsg);
+    } else if (cur_version == 9) {
+      rc = upgrade_metadata_from_v9(db, &errmsg);
+    } else if (cur_version == 10) {
+      rc = upgrade_metadata_from_v10(db, &errmsg);
     }
 
     if (rc < 0) {
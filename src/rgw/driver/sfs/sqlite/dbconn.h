@@ -17,25 +17,44 @@
 #include <sqlite3.h>
 #include <utime.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <ios>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "buckets/bucket_definitions.h"
 #include "buckets/multipart_definitions.h"
+#include "buckets/multipart_registry.h"
+#include "common/async/completion.h"
+#include "common/async/yield_context.h"
 #include "common/ceph_mutex.h"
 #include "common/dout.h"
+#include "include/scope_guard.h"
 #include "lifecycle/lifecycle_definitions.h"
 #include "objects/object_definitions.h"
+#include "prepared_statements.h"
 #include "rgw/rgw_perf_counters.h"
 #include "sqlite_orm.h"
+#include "stats/stats_definitions.h"
+#include "users/user_cache.h"
 #include "users/users_definitions.h"
+#include "versioned_object/object_meta_cache.h"
 #include "versioned_object/versioned_object_definitions.h"
 
 namespace rgw::sal::sfs::sqlite {
 
 /// current db version.
-constexpr int SFS_METADATA_VERSION = 4;
+constexpr int SFS_METADATA_VERSION = 11;
 /// minimum required version to upgrade db.
 constexpr int SFS_METADATA_MIN_VERSION = 4;
 
@@ -45,11 +64,19 @@ constexpr std::string_view USERS_TABLE = "users";
 constexpr std::string_view BUCKETS_TABLE = "buckets";
 constexpr std::string_view OBJECTS_TABLE = "objects";
 constexpr std::string_view VERSIONED_OBJECTS_TABLE = "versioned_objects";
+constexpr std::string_view VERSIONED_OBJECT_PARTS_TABLE =
+    "versioned_object_parts";
 constexpr std::string_view ACCESS_KEYS = "access_keys";
 constexpr std::string_view LC_HEAD_TABLE = "lc_head";
 constexpr std::string_view LC_ENTRIES_TABLE = "lc_entries";
 constexpr std::string_view MULTIPARTS_TABLE = "multiparts";
 constexpr std::string_view MULTIPARTS_PARTS_TABLE = "multiparts_parts";
+constexpr std::string_view BUCKET_STATS_TABLE = "bucket_stats";
+constexpr std::string_view USER_STATS_TABLE = "user_stats";
+constexpr std::string_view LATEST_VERSIONS_TABLE = "latest_versions";
+constexpr std::string_view PACKED_OBJECTS_TABLE = "packed_objects";
+constexpr std::string_view PACKED_SEGMENTS_TABLE = "packed_segments";
+constexpr std::string_view SHARED_DATA_TABLE = "shared_data";
 
 class sqlite_sync_exception : public std::exception {
   std::string _message;
@@ -71,6 +98,16 @@ inline auto _make_storage(const std::string& path) {
       sqlite_orm::make_unique_index(
           "object_bucketid_name", &DBObject::bucket_id, &DBObject::name
       ),
+      sqlite_orm::make_unique_index(
+          "latest_versions_bucketid_name", &DBLatestVersion::bucket_id,
+          &DBLatestVersion::name
+      ),
+      sqlite_orm::make_index(
+          "packed_objects_segment_idx", &DBPackedObject::segment_id
+      ),
+      sqlite_orm::make_index(
+          "shared_data_data_version_idx", &DBSharedData::data_version_id
+      ),
       sqlite_orm::make_index("bucket_ownerid_idx", &DBBucket::owner_id),
       sqlite_orm::make_index("bucket_name_idx", &DBBucket::bucket_name),
       sqlite_orm::make_index("objects_bucketid_idx", &DBObject::bucket_id),
@@ -176,9 +213,30 @@ inline auto _make_storage(const std::string& path) {
           sqlite_orm::make_column(
               "version_type", &DBVersionedObject::version_type
           ),
+          sqlite_orm::make_column(
+              "inline_data", &DBVersionedObject::inline_data
+          ),
           sqlite_orm::foreign_key(&DBVersionedObject::object_id)
               .references(&DBObject::uuid)
       ),
+      sqlite_orm::make_table(
+          std::string(VERSIONED_OBJECT_PARTS_TABLE),
+          sqlite_orm::make_column(
+              "versioned_object_id", &DBVersionedObjectPart::versioned_object_id
+          ),
+          sqlite_orm::make_column("part_num", &DBVersionedObjectPart::part_num),
+          sqlite_orm::make_column(
+              "object_offset", &DBVersionedObjectPart::object_offset
+          ),
+          sqlite_orm::make_column("size", &DBVersionedObjectPart::size),
+          sqlite_orm::primary_key(
+              &DBVersionedObjectPart::versioned_object_id,
+              &DBVersionedObjectPart::part_num
+          ),
+          sqlite_orm::foreign_key(&DBVersionedObjectPart::versioned_object_id)
+              .references(&DBVersionedObject::id)
+              .on_delete.cascade()
+      ),
       sqlite_orm::make_table(
           std::string(ACCESS_KEYS),
           sqlite_orm::make_column(
@@ -204,6 +262,22 @@ inline auto _make_storage(const std::string& path) {
           sqlite_orm::make_column("bucket_name", &DBOPLCEntry::bucket_name),
           sqlite_orm::make_column("start_time", &DBOPLCEntry::start_time),
           sqlite_orm::make_column("status", &DBOPLCEntry::status),
+          sqlite_orm::make_column(
+              "expired_current", &DBOPLCEntry::expired_current,
+              sqlite_orm::default_value(0)
+          ),
+          sqlite_orm::make_column(
+              "expired_noncurrent", &DBOPLCEntry::expired_noncurrent,
+              sqlite_orm::default_value(0)
+          ),
+          sqlite_orm::make_column(
+              "expired_delete_markers", &DBOPLCEntry::expired_delete_markers,
+              sqlite_orm::default_value(0)
+          ),
+          sqlite_orm::make_column(
+              "aborted_multiparts", &DBOPLCEntry::aborted_multiparts,
+              sqlite_orm::default_value(0)
+          ),
           sqlite_orm::primary_key(
               &DBOPLCEntry::lc_index, &DBOPLCEntry::bucket_name
           )
@@ -249,28 +323,421 @@ inline auto _make_storage(const std::string& path) {
           ),
           sqlite_orm::foreign_key(&DBMultipartPart::upload_id)
               .references(&DBMultipart::upload_id)
+      ),
+      sqlite_orm::make_table(
+          std::string(BUCKET_STATS_TABLE),
+          sqlite_orm::make_column(
+              "bucket_id", &DBBucketStats::bucket_id, sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column("size", &DBBucketStats::size),
+          sqlite_orm::make_column(
+              "size_rounded", &DBBucketStats::size_rounded
+          ),
+          sqlite_orm::make_column("obj_count", &DBBucketStats::obj_count)
+      ),
+      sqlite_orm::make_table(
+          std::string(USER_STATS_TABLE),
+          sqlite_orm::make_column(
+              "user_id", &DBUserStats::user_id, sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column("size", &DBUserStats::size),
+          sqlite_orm::make_column("size_rounded", &DBUserStats::size_rounded),
+          sqlite_orm::make_column("obj_count", &DBUserStats::obj_count)
+      ),
+      sqlite_orm::make_table(
+          std::string(LATEST_VERSIONS_TABLE),
+          sqlite_orm::make_column(
+              "object_id", &DBLatestVersion::object_id,
+              sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column("bucket_id", &DBLatestVersion::bucket_id),
+          sqlite_orm::make_column("name", &DBLatestVersion::name),
+          sqlite_orm::make_column("version_id", &DBLatestVersion::version_id),
+          sqlite_orm::make_column(
+              "version_type", &DBLatestVersion::version_type
+          )
+      ),
+      sqlite_orm::make_table(
+          std::string(PACKED_OBJECTS_TABLE),
+          sqlite_orm::make_column(
+              "versioned_object_id", &DBPackedObject::versioned_object_id,
+              sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column("segment_id", &DBPackedObject::segment_id),
+          sqlite_orm::make_column(
+              "segment_offset", &DBPackedObject::segment_offset
+          ),
+          sqlite_orm::make_column("size", &DBPackedObject::size),
+          sqlite_orm::foreign_key(&DBPackedObject::versioned_object_id)
+              .references(&DBVersionedObject::id)
+              .on_delete.cascade()
+      ),
+      sqlite_orm::make_table(
+          std::string(PACKED_SEGMENTS_TABLE),
+          sqlite_orm::make_column(
+              "id", &DBPackedSegment::id, sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column("live_size", &DBPackedSegment::live_size),
+          sqlite_orm::make_column("live_count", &DBPackedSegment::live_count)
+      ),
+      sqlite_orm::make_table(
+          std::string(SHARED_DATA_TABLE),
+          sqlite_orm::make_column(
+              "versioned_object_id", &DBSharedData::versioned_object_id,
+              sqlite_orm::primary_key()
+          ),
+          sqlite_orm::make_column(
+              "data_version_id", &DBSharedData::data_version_id
+          ),
+          sqlite_orm::make_column(
+              "data_object_id", &DBSharedData::data_object_id
+          ),
+          sqlite_orm::foreign_key(&DBSharedData::versioned_object_id)
+              .references(&DBVersionedObject::id)
+              .on_delete.cascade()
       )
   );
 }
 
 using Storage = decltype(_make_storage(""));
 
+/// DBConn owns the SQLite connections used by the SFS driver.
+///
+/// Every thread calling `get_storage()` gets its own connection from a
+/// pool, on first use, and holds it until it exits. This lets readers on
+/// different frontend threads run concurrently against the WAL instead
+/// of serializing on a single connection. The connections of threads
+/// that exited are kept for new ones, up to
+/// rgw_sfs_sqlite_idle_connections of them, and at most
+/// rgw_sfs_sqlite_max_connections are open at a time. A thread finding
+/// none available waits up to rgw_sfs_sqlite_connection_wait_timeout
+/// for one and fails with EBUSY after that.
+///
+/// Pooled connections are read only (PRAGMA query_only). All writes are
+/// funneled through a single writer thread (see `run_on_writer()`) that
+/// owns a dedicated connection. This keeps at most one writer contending
+/// for the WAL write lock and avoids SQLITE_BUSY retries between
+/// concurrent writers.
+///
+/// Writes submitted with `run_batched()` are group committed: the writer
+/// thread coalesces the ones arriving within
+/// rgw_sfs_sqlite_group_commit_window (or up to
+/// rgw_sfs_sqlite_group_commit_max_ops of them) into a single
+/// transaction, so concurrent PUTs share one WAL commit.
+///
+/// Hot queries run through `execute_prepared()`, which keeps their
+/// compiled statements with the connection they were prepared on.
 class DBConn {
  private:
+  /// A unit of work for the writer thread.
+  using Completion = ceph::async::Completion<void()>;
+
+  struct WriterTask {
+    /// Runs the task on the writer connection. Returns false if the task
+    /// failed and its changes must be rolled back.
+    std::function<bool()> run;
+    /// Set for batched tasks only. Publishes the task result once the
+    /// batch is committed, or `commit_error` if the commit failed.
+    std::function<void(std::exception_ptr commit_error)> finish;
+  };
+
+  /// A pooled connection and the statements prepared on it
+  struct PooledConnection {
+    Storage storage;
+    /// declared after storage: statements are finalized before it closes
+    PreparedStatements statements;
+
+    explicit PooledConnection(const Storage& _storage) : storage(_storage) {}
+  };
+
+  /// The connections handed out by get_storage(). Shared with the
+  /// threads holding one, which give it back when they exit, even after
+  /// the DBConn is gone.
+  struct ConnectionPool {
+    const size_t max_connections;
+    const size_t max_idle;
+    const std::chrono::milliseconds wait_timeout;
+    std::mutex mutex;
+    /// signaled when a connection is given back or closed
+    std::condition_variable cond;
+    /// every open connection, held by a thread or idle
+    std::vector<std::unique_ptr<PooledConnection>> connections;
+    /// connections of threads that exited, handed to new ones first
+    std::vector<PooledConnection*> idle;
+    /// open connections, including the ones being opened
+    size_t num_open = 0;
+
+    ConnectionPool(
+        size_t _max_connections, size_t _max_idle,
+        std::chrono::milliseconds _wait_timeout
+    )
+        : max_connections(_max_connections),
+          max_idle(_max_idle),
+          wait_timeout(_wait_timeout) {}
+
+    /// An idle connection, or a new read only one copied from `storage`.
+    /// Waits up to wait_timeout for a connection to be given back if
+    /// max_connections are open, then throws std::system_error with
+    /// EBUSY.
+    PooledConnection* acquire(const Storage& storage, CephContext* cct);
+    /// Gives back `conn`, closing it if max_idle connections are idle
+    void release(PooledConnection* conn);
+  };
+
+  /// A connection held by a thread, given back when the thread exits
+  struct ConnectionLease {
+    std::weak_ptr<ConnectionPool> pool;
+    /// only compared, the pool may be gone
+    const ConnectionPool* pool_id;
+    PooledConnection* conn;
+
+    ~ConnectionLease();
+  };
+
   Storage storage;
+  const std::shared_ptr<ConnectionPool> pool;
+
+  const std::chrono::milliseconds group_commit_window;
+  const uint64_t group_commit_max_ops;
+
+  std::mutex writer_mutex;
+  std::condition_variable writer_cond;
+  std::deque<WriterTask> writer_queue;
+  bool writer_stop = false;
+  std::unique_ptr<Storage> writer_storage;
+  mutable PreparedStatements writer_statements;
+  sqlite3* writer_db = nullptr;
+  bool writer_in_batch = false;
+  std::thread writer_thread;
+
+  void writer_loop();
+  void run_writer_batch(std::vector<WriterTask>& batch);
+  void enqueue_writer_task(WriterTask&& task);
+
+  /// The statements prepared on `storage`, which must be the connection
+  /// of the calling thread
+  PreparedStatements& get_prepared_statements(const Storage& storage) const;
+  /// The connection the calling thread holds from `pool`, if any
+  PooledConnection* thread_connection() const;
+  /// The connections held by the calling thread, one per DBConn
+  static std::vector<std::unique_ptr<ConnectionLease>>& thread_leases();
 
  public:
   sqlite3* first_sqlite_conn;
   CephContext* const cct;
   const bool profile_enabled;
+  const bool prepared_statements_enabled;
+  /// Users by access key, kept up to date by SQLiteUsers
+  UserCache user_cache;
+  /// Committed versions of hot objects, kept up to date by their writers
+  ObjectMetaCache object_meta_cache;
+  /// Multipart uploads with parts being written, kept up to date by
+  /// SQLiteMultipart
+  MultipartRegistry multipart_registry;
 
   DBConn(CephContext* _cct);
-  virtual ~DBConn() = default;
+  virtual ~DBConn();
 
   DBConn(const DBConn&) = delete;
   DBConn& operator=(const DBConn&) = delete;
 
-  inline auto get_storage() const { return storage; }
+  /// Returns the connection held by the calling thread, taking one from
+  /// the pool on first use. The reference stays valid until the thread
+  /// exits or the DBConn is destroyed. The connection is read only,
+  /// writes go through `run_on_writer()` or `run_batched()`.
+  Storage& get_storage() const;
+
+  /// Number of pooled connections currently open, held by a thread or
+  /// idle.
+  size_t storage_pool_size() const;
+
+  /// Runs the sqlite_orm statement `expression` on `storage`, the
+  /// connection of the calling thread, and returns what
+  /// `storage.execute()` returns for it.
+  ///
+  /// The statement is compiled on the first call with `name` on this
+  /// connection and reused by the following ones, bound to their values.
+  /// `name` identifies the query and must be a string literal; queries
+  /// whose SQL text depends on their values (IN lists) also pass
+  /// `variant`. With rgw_sfs_sqlite_prepared_statements disabled every
+  /// call prepares the statement anew.
+  template <typename Expression>
+  auto execute_prepared(
+      Storage& storage, std::string_view name, Expression&& expression,
+      size_t variant = 0
+  ) const {
+    if (!prepared_statements_enabled) {
+      return storage.execute(
+          storage.prepare(std::forward<Expression>(expression))
+      );
+    }
+    auto& statement = get_prepared_statements(storage).get(
+        storage, name, variant, std::forward<Expression>(expression)
+    );
+    // a statement not stepped to completion (get_pointer) keeps its read
+    // transaction open and the connection would miss later commits
+    auto reset = make_scope_guard([&statement] {
+      sqlite3_reset(statement.stmt);
+    });
+    return storage.execute(statement);
+  }
+
+  /// Raw handle of the writer connection, for the few statements
+  /// sqlite_orm can't express. Only to be used by tasks running on the
+  /// writer thread.
+  sqlite3* get_writer_db() const { return writer_db; }
+
+  /// Runs `func(Storage&)` on the writer thread using the writer
+  /// connection and returns its result (or rethrows its exception).
+  /// The coroutine of `y` is suspended until the task completes; without
+  /// one the calling thread blocks. Calls made from the writer thread
+  /// itself run inline.
+  template <typename Func>
+  auto run_on_writer(Func&& func, optional_yield y = null_yield)
+      -> std::invoke_result_t<Func, Storage&> {
+    using Result = std::invoke_result_t<Func, Storage&>;
+    if (std::this_thread::get_id() == writer_thread.get_id()) {
+      return func(*writer_storage);
+    }
+    const auto enqueued = ceph::mono_clock::now();
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        [this, enqueued, func = std::forward<Func>(func)]() mutable {
+          if (perfcounter) {
+            perfcounter->tinc(
+                l_rgw_sfs_sqlite_writer_queue_wait,
+                ceph::mono_clock::now() - enqueued
+            );
+          }
+          return func(*writer_storage);
+        }
+    );
+    auto result = task->get_future();
+    if (!y) {
+      enqueue_writer_task({[task]() {
+                             (*task)();
+                             return true;
+                           },
+                           nullptr});
+      return result.get();
+    }
+    auto& yield = y.get_yield_context();
+    boost::asio::async_completion<yield_context, void()> init(yield);
+    // the handler runs on the strand of the coroutine. Tasks are
+    // copyable, so the completion is held by its raw pointer.
+    auto completion = Completion::create(
+        y.get_io_context().get_executor(), std::move(init.completion_handler)
+    );
+    enqueue_writer_task({[task, completion = completion.release()]() {
+                           (*task)();
+                           ceph::async::post(
+                               std::unique_ptr<Completion>(completion)
+                           );
+                           return true;
+                         },
+                         nullptr});
+    init.result.get();
+    return result.get();
+  }
+
+  /// Runs `func(Storage&)` on the writer thread as part of a group
+  /// commit and returns its result once the batch holding it has been
+  /// committed. `func` must not open its own transaction; it runs inside
+  /// a savepoint of the batch transaction and throwing rolls back only
+  /// its own changes. A failed batch commit is rethrown to every caller
+  /// in the batch.
+  ///
+  /// With group commit disabled (window set to 0) each call runs in its
+  /// own transaction on the writer thread.
+  ///
+  /// The coroutine of `y` is suspended until the batch is committed;
+  /// without one the calling thread blocks.
+  template <typename Func>
+  auto run_batched(Func&& func, optional_yield y = null_yield)
+      -> std::invoke_result_t<Func, Storage&> {
+    using Result = std::invoke_result_t<Func, Storage&>;
+    if constexpr (std::is_void_v<Result>) {
+      run_batched(
+          [&func](Storage& storage) {
+            func(storage);
+            return true;
+          },
+          y
+      );
+      return;
+    } else {
+      if (group_commit_window.count() == 0 ||
+          std::this_thread::get_id() == writer_thread.get_id()) {
+        return run_on_writer(
+            [this, &func](Storage& storage) {
+              if (writer_in_batch) {
+                // nested in a batch we are already running: share its
+                // transaction
+                return func(storage);
+              }
+              auto transaction = storage.transaction_guard();
+              auto result = func(storage);
+              transaction.commit();
+              return result;
+            },
+            y
+        );
+      }
+
+      struct State {
+        std::promise<Result> promise;
+        std::optional<Result> value;
+        std::exception_ptr error;
+        /// resumes the waiting coroutine, if any
+        std::unique_ptr<Completion> completion;
+      };
+      auto state = std::make_shared<State>();
+      auto result = state->promise.get_future();
+      std::optional<boost::asio::async_completion<yield_context, void()>>
+          init;
+      if (y) {
+        init.emplace(y.get_yield_context());
+        // the handler runs on the strand of the coroutine
+        state->completion = Completion::create(
+            y.get_io_context().get_executor(),
+            std::move(init->completion_handler)
+        );
+      }
+      const auto enqueued = ceph::mono_clock::now();
+      enqueue_writer_task(
+          {[this, state, enqueued, func = std::forward<Func>(func)]() mutable {
+             if (perfcounter) {
+               perfcounter->tinc(
+                   l_rgw_sfs_sqlite_writer_queue_wait,
+                   ceph::mono_clock::now() - enqueued
+               );
+             }
+             try {
+               state->value.emplace(func(*writer_storage));
+               return true;
+             } catch (...) {
+               state->error = std::current_exception();
+               return false;
+             }
+           },
+           [state](std::exception_ptr commit_error) {
+             if (commit_error) {
+               state->promise.set_exception(commit_error);
+             } else if (state->error) {
+               state->promise.set_exception(state->error);
+             } else {
+               state->promise.set_value(std::move(*state->value));
+             }
+             if (state->completion) {
+               ceph::async::post(std::move(state->completion));
+             }
+           }}
+      );
+      if (init) {
+        init->result.get();
+      }
+      return result.get();
+    }
+  }
 
   static std::string getDBPath(CephContext* cct) {
     auto rgw_sfs_path = cct->_conf.get_val<std::string>("rgw_sfs_data_path");
@@ -279,10 +746,24 @@ class DBConn {
     return db_path.string();
   }
 
-  void check_metadata_is_compatible() const;
+  void check_metadata_is_compatible();
   void maybe_upgrade_metadata();
+  /// Creates the triggers keeping the bucket_stats and user_stats
+  /// tables up to date with the committed versions.
+  void create_stats_triggers();
+  /// Creates the triggers keeping the latest_versions table up to date
+  /// with the objects and their committed versions.
+  void create_latest_version_triggers();
+  /// Creates the triggers keeping the packed_segments table up to date
+  /// with the packed objects.
+  void create_packed_segment_triggers();
 };
 
 using DBConnRef = std::shared_ptr<DBConn>;
 
+/// Fills the (empty) bucket_stats and user_stats tables from the
+/// committed versions. Returns an SQLite result code and sets `errmsg`
+/// on failure.
+int fill_stats_tables(sqlite3* db, std::string* errmsg);
+
 }  // namespace rgw::sal::sfs::sqlite
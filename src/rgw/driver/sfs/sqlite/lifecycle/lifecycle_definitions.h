@@ -13,8 +13,11 @@
  */
 #pragma once
 
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "common/ceph_time.h"
 #include "rgw_common.h"
 
 namespace rgw::sal::sfs::sqlite {
@@ -30,6 +33,37 @@ struct DBOPLCEntry {
   std::string bucket_name;  // composite primary key
   uint64_t start_time;
   uint32_t status;
+  // what the last run expired in the bucket (see SFSLifecycle)
+  uint64_t expired_current = 0;
+  uint64_t expired_noncurrent = 0;
+  uint64_t expired_delete_markers = 0;
+  uint64_t aborted_multiparts = 0;
+};
+
+/// The expiration actions of a lifecycle rule on the objects under a
+/// prefix of a bucket (see SQLiteLifecycle::expire())
+struct DBOPLCExpiration {
+  std::string bucket_id;
+  std::string prefix;
+  /// current versions last modified before this time expire, if set
+  std::optional<ceph::real_time> current_before;
+  /// current versions get a delete marker instead of being deleted
+  bool versioned = false;
+  /// noncurrent versions expire if they became noncurrent before this
+  /// time, if set
+  std::optional<ceph::real_time> noncurrent_before;
+  /// delete markers left without any other version expire
+  bool delete_markers = false;
+};
+
+/// Objects of a bucket an expiration applies to in one transaction: the
+/// ones named after `after_name` up to `last_name`
+struct DBOPLCWindow {
+  std::string after_name;
+  std::string last_name;
+  /// if set, the only regular versions that may expire, the others not
+  /// matching the tag filter of the rule
+  std::optional<std::vector<uint>> version_ids;
 };
 
 }  // namespace rgw::sal::sfs::sqlite
@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+
+#include "include/ceph_assert.h"
+#include "rgw/rgw_perf_counters.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+/// The statements prepared on one SQLite connection, compiled on their
+/// first use and reused afterwards.
+///
+/// Statements are looked up by a name unique to the query they run.
+/// sqlite_orm binds the values of a statement from its expression every
+/// time it runs, so reusing one only takes replacing its expression
+/// with one holding the new values. Queries whose SQL depends on their
+/// values, like the length of an IN list, pass that as `variant`.
+///
+/// Not thread safe: a connection and its statements are only used by
+/// the thread owning them (see DBConn).
+class PreparedStatements {
+  struct Key {
+    std::string_view name;
+    size_t variant;
+    bool operator==(const Key& other) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<std::string_view>{}(key.name) ^ key.variant;
+    }
+  };
+  struct Entry {
+    std::shared_ptr<void> statement;
+    std::type_index type;
+  };
+
+  std::unordered_map<Key, Entry, KeyHash> statements;
+
+ public:
+  PreparedStatements() = default;
+  PreparedStatements(const PreparedStatements&) = delete;
+  PreparedStatements& operator=(const PreparedStatements&) = delete;
+
+  /// Returns the statement `name` prepared on `storage`, bound to the
+  /// values in `expression`. `name` must outlive the registry, string
+  /// literals are expected.
+  template <typename StorageT, typename Expression>
+  auto& get(
+      StorageT& storage, std::string_view name, size_t variant,
+      Expression&& expression
+  ) {
+    using Statement =
+        decltype(storage.prepare(std::forward<Expression>(expression)));
+    auto it = statements.find(Key{name, variant});
+    if (it != statements.end()) {
+      // the same name must always be used for the same query
+      ceph_assert(it->second.type == std::type_index(typeid(Statement)));
+      auto& statement = *static_cast<Statement*>(it->second.statement.get());
+      statement.expression = std::forward<Expression>(expression);
+      if (perfcounter) perfcounter->inc(l_rgw_sfs_sqlite_stmt_cache_hit);
+      return statement;
+    }
+    if (perfcounter) perfcounter->inc(l_rgw_sfs_sqlite_stmt_cache_miss);
+    auto statement = std::make_shared<Statement>(
+        storage.prepare(std::forward<Expression>(expression))
+    );
+    auto& ret = *statement;
+    statements.emplace(
+        Key{name, variant},
+        Entry{std::move(statement), std::type_index(typeid(Statement))}
+    );
+    return ret;
+  }
+
+  size_t size() const { return statements.size(); }
+};
+
+}  // namespace rgw::sal::sfs::sqlite
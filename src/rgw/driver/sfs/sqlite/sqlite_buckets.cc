@@ -18,6 +18,7 @@
 
 #include "objects/object_definitions.h"
 #include "retry.h"
+#include "sqlite_versioned_objects.h"
 #include "versioned_object/versioned_object_definitions.h"
 
 using namespace sqlite_orm;
@@ -40,8 +41,10 @@ std::vector<DBOPBucketInfo> get_rgw_buckets(
 std::optional<DBOPBucketInfo> SQLiteBuckets::get_bucket(
     const std::string& bucket_id
 ) const {
-  auto storage = conn->get_storage();
-  auto bucket = storage.get_pointer<DBBucket>(bucket_id);
+  auto& storage = conn->get_storage();
+  auto bucket = conn->execute_prepared(
+      storage, "buckets.get", get_pointer<DBBucket>(bucket_id)
+  );
   std::optional<DBOPBucketInfo> ret_value;
   if (bucket) {
     ret_value = get_rgw_bucket(*bucket);
@@ -52,7 +55,7 @@ std::optional<DBOPBucketInfo> SQLiteBuckets::get_bucket(
 std::optional<std::pair<std::string, std::string>> SQLiteBuckets::get_owner(
     const std::string& bucket_id
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   const auto rows = storage.select(
       columns(&DBUser::user_id, &DBUser::display_name),
       inner_join<DBUser>(on(is_equal(&DBBucket::owner_id, &DBUser::user_id))),
@@ -68,60 +71,87 @@ std::optional<std::pair<std::string, std::string>> SQLiteBuckets::get_owner(
 std::vector<DBOPBucketInfo> SQLiteBuckets::get_bucket_by_name(
     const std::string& bucket_name
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return get_rgw_buckets(
       storage.get_all<DBBucket>(where(c(&DBBucket::bucket_name) = bucket_name))
   );
 }
 
-void SQLiteBuckets::store_bucket(const DBOPBucketInfo& bucket) const {
-  auto storage = conn->get_storage();
+void SQLiteBuckets::store_bucket(
+    const DBOPBucketInfo& bucket, const std::function<void()>& on_stored
+) const {
   auto db_bucket = get_db_bucket(bucket);
-  storage.replace(db_bucket);
+  conn->run_on_writer([&](Storage& storage) {
+    storage.replace(db_bucket);
+    if (on_stored) {
+      on_stored();
+    }
+  });
+}
+
+bool SQLiteBuckets::create_bucket(
+    const DBOPBucketInfo& bucket, const std::function<void()>& on_stored
+) const {
+  auto db_bucket = get_db_bucket(bucket);
+  return conn->run_on_writer([&](Storage& storage) {
+    const auto existing = storage.count<DBBucket>(where(
+        is_equal(&DBBucket::bucket_name, db_bucket.bucket_name) and
+        is_equal(&DBBucket::deleted, false)
+    ));
+    if (existing > 0) {
+      return false;
+    }
+    storage.replace(db_bucket);
+    if (on_stored) {
+      on_stored();
+    }
+    return true;
+  });
 }
 
 void SQLiteBuckets::remove_bucket(const std::string& bucket_name) const {
-  auto storage = conn->get_storage();
-  storage.remove<DBBucket>(bucket_name);
+  conn->run_on_writer([&](Storage& storage) {
+    storage.remove<DBBucket>(bucket_name);
+  });
 }
 
 std::vector<std::string> SQLiteBuckets::get_bucket_ids() const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return storage.select(&DBBucket::bucket_name);
 }
 
 std::vector<std::string> SQLiteBuckets::get_bucket_ids(
     const std::string& user_id
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return storage.select(
       &DBBucket::bucket_name, where(c(&DBBucket::owner_id) = user_id)
   );
 }
 
 std::vector<DBOPBucketInfo> SQLiteBuckets::get_buckets() const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return get_rgw_buckets(storage.get_all<DBBucket>());
 }
 
 std::vector<DBOPBucketInfo> SQLiteBuckets::get_buckets(
     const std::string& user_id
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return get_rgw_buckets(
       storage.get_all<DBBucket>(where(c(&DBBucket::owner_id) = user_id))
   );
 }
 
 std::vector<std::string> SQLiteBuckets::get_deleted_buckets_ids() const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return storage.select(
       &DBBucket::bucket_id, where(c(&DBBucket::deleted) = true)
   );
 }
 
 bool SQLiteBuckets::bucket_empty(const std::string& bucket_id) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto num_ids = storage.count<DBVersionedObject>(
       inner_join<DBObject>(
           on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
@@ -138,83 +168,53 @@ bool SQLiteBuckets::bucket_empty(const std::string& bucket_id) const {
 std::optional<DBDeletedObjectItems> SQLiteBuckets::delete_bucket_transact(
     const std::string& bucket_id, uint max_objects, bool& bucket_deleted
 ) const {
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<DBDeletedObjectItems> retry([&]() {
-    bucket_deleted = false;
-    DBDeletedObjectItems ret_values;
-    storage.begin_transaction();
-    // first get all the objects and versions for that bucket
-    ret_values = storage.select(
-        columns(&DBObject::uuid, &DBVersionedObject::id),
-        inner_join<DBObject>(
-            on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-        ),
-        where(is_equal(&DBObject::bucket_id, bucket_id)),
-        order_by(&DBVersionedObject::size).desc(), limit(max_objects)
-    );
-    for (auto const& uuid_version : ret_values) {
-      // remove the versions first
-      storage.remove<DBVersionedObject>(std::get<1>(uuid_version));
-      // try to delete the object (it will throw an exception if it's not
-      // empty yet)
-      // possible errors when object is not empty are:
-      // SQLITE_CONSTRAINT: legacy sqlite error
-      // SQLITE_CONSTRAINT_FOREIGNKEY: extended sqlite error
+    return conn->run_on_writer([&](Storage& storage) {
+      bucket_deleted = false;
+      DBDeletedObjectItems ret_values;
+      auto transaction = storage.transaction_guard();
+      // first get all the objects and versions for that bucket
+      ret_values = storage.select(
+          columns(&DBObject::uuid, &DBVersionedObject::id),
+          inner_join<DBObject>(
+              on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
+          ),
+          where(is_equal(&DBObject::bucket_id, bucket_id)),
+          order_by(&DBVersionedObject::size).desc(), limit(max_objects)
+      );
+      auto to_reclaim = release_shared_data(storage, ret_values);
+      for (auto const& uuid_version : ret_values) {
+        // remove the versions first
+        storage.remove<DBVersionedObject>(std::get<1>(uuid_version));
+        // try to delete the object (it will throw an exception if it's not
+        // empty yet)
+        // possible errors when object is not empty are:
+        // SQLITE_CONSTRAINT: legacy sqlite error
+        // SQLITE_CONSTRAINT_FOREIGNKEY: extended sqlite error
+        try {
+          storage.remove<DBObject>(std::get<0>(uuid_version));
+        } catch (const std::system_error& e) {
+          if (e.code().value() != SQLITE_CONSTRAINT_FOREIGNKEY &&
+              e.code().value() != SQLITE_CONSTRAINT) {
+            throw(e);
+          }
+        }
+      }
+      // try to delete the bucket
       try {
-        storage.remove<DBObject>(std::get<0>(uuid_version));
+        storage.remove<DBBucket>(bucket_id);
+        bucket_deleted = true;
       } catch (const std::system_error& e) {
         if (e.code().value() != SQLITE_CONSTRAINT_FOREIGNKEY &&
             e.code().value() != SQLITE_CONSTRAINT) {
           throw(e);
         }
       }
-    }
-    // try to delete the bucket
-    try {
-      storage.remove<DBBucket>(bucket_id);
-      bucket_deleted = true;
-    } catch (const std::system_error& e) {
-      if (e.code().value() != SQLITE_CONSTRAINT_FOREIGNKEY &&
-          e.code().value() != SQLITE_CONSTRAINT) {
-        throw(e);
-      }
-    }
-    storage.commit();
-    return ret_values;
+      transaction.commit();
+      return to_reclaim;
+    });
   });
   return retry.run();
 }
 
-const std::optional<SQLiteBuckets::Stats> SQLiteBuckets::get_stats(
-    const std::string& bucket_id
-) const {
-  auto storage = conn->get_storage();
-  std::optional<SQLiteBuckets::Stats> stats;
-
-  auto res = storage.select(
-      columns(
-          count(&DBVersionedObject::object_id), sum(&DBVersionedObject::size)
-      ),
-      inner_join<DBObject>(
-          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-      ),
-      where(
-          is_equal(&DBObject::bucket_id, bucket_id) and
-          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED)
-      )
-  );
-
-  if (res.size() > 0) {
-    ceph_assert(res.size() == 1);
-    stats = SQLiteBuckets::Stats();
-    stats->obj_count = std::get<0>(res[0]);
-    // We get a unique_ptr for SUM(), likely because of the underlying type of 'size'.
-    // Therefore we need to check whether it's a nullptr or not.
-    auto size = std::get<1>(res[0]).get();
-    stats->size = (size ? *size : 0);
-  }
-
-  return stats;
-}
-
 }  // namespace rgw::sal::sfs::sqlite
@@ -13,6 +13,8 @@
  */
 #pragma once
 
+#include <functional>
+
 #include "buckets/bucket_conversions.h"
 #include "dbconn.h"
 
@@ -28,11 +30,6 @@ class SQLiteBuckets {
   SQLiteBuckets(const SQLiteBuckets&) = delete;
   SQLiteBuckets& operator=(const SQLiteBuckets&) = delete;
 
-  struct Stats {
-    size_t size;
-    uint64_t obj_count;
-  };
-
   std::optional<DBOPBucketInfo> get_bucket(const std::string& bucket_id) const;
   std::vector<DBOPBucketInfo> get_bucket_by_name(const std::string& bucket_name
   ) const;
@@ -42,7 +39,22 @@ class SQLiteBuckets {
       const std::string& bucket_id
   ) const;
 
-  void store_bucket(const DBOPBucketInfo& bucket) const;
+  /// Stores `bucket`. `on_stored`, if set, runs right after on the
+  /// writer thread, so its calls are in the order the buckets were
+  /// stored.
+  void store_bucket(
+      const DBOPBucketInfo& bucket,
+      const std::function<void()>& on_stored = nullptr
+  ) const;
+  /// Stores the new `bucket` unless a bucket with its name, not deleted,
+  /// exists. The check and the store are one task of the writer thread,
+  /// so of concurrent creations of a name only one stores a bucket.
+  /// `on_stored` runs as for store_bucket(). Returns whether `bucket` was
+  /// stored.
+  bool create_bucket(
+      const DBOPBucketInfo& bucket,
+      const std::function<void()>& on_stored = nullptr
+  ) const;
   void remove_bucket(const std::string& bucket_id) const;
 
   std::vector<std::string> get_bucket_ids() const;
@@ -57,9 +69,6 @@ class SQLiteBuckets {
   std::optional<DBDeletedObjectItems> delete_bucket_transact(
       const std::string& bucket_id, uint max_objects, bool& bucket_deleted
   ) const;
-  const std::optional<SQLiteBuckets::Stats> get_stats(
-      const std::string& bucket_id
-  ) const;
 };
 
 }  // namespace rgw::sal::sfs::sqlite
@@ -13,42 +13,106 @@
  */
 #include "sqlite_lifecycle.h"
 
+#include <fmt/format.h>
+
+#include <memory>
+#include <system_error>
+
+#include "conversion_utils.h"
+
 using namespace sqlite_orm;
 namespace rgw::sal::sfs::sqlite {
 
+/// Runs a statement of an expiration on the writer connection, with the
+/// window and times bound to its :bucket_id, :prefix, :after_name,
+/// :last_name, :before and :now parameters. Returns the number of rows
+/// it changed.
+static uint64_t run_expiration_sql(
+    sqlite3* db, const std::string& sql, const DBOPLCExpiration& expiration,
+    const DBOPLCWindow& window, ceph::real_time before, ceph::real_time now
+) {
+  sqlite3_stmt* raw_stmt = nullptr;
+  int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &raw_stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    throw std::system_error(
+        rc, get_sqlite_error_category(), sqlite3_errmsg(db)
+    );
+  }
+  std::unique_ptr<sqlite3_stmt, decltype(&sqlite3_finalize)> stmt(
+      raw_stmt, sqlite3_finalize
+  );
+  const auto bind_text = [&](const char* name, const std::string& value) {
+    const int index = sqlite3_bind_parameter_index(stmt.get(), name);
+    if (index > 0 && rc == SQLITE_OK) {
+      rc = sqlite3_bind_text(
+          stmt.get(), index, value.c_str(), value.length(), SQLITE_TRANSIENT
+      );
+    }
+  };
+  const auto bind_time = [&](const char* name, ceph::real_time value) {
+    const int index = sqlite3_bind_parameter_index(stmt.get(), name);
+    if (index > 0 && rc == SQLITE_OK) {
+      rc = sqlite3_bind_int64(stmt.get(), index, time_point_to_int64(value));
+    }
+  };
+  bind_text(":bucket_id", expiration.bucket_id);
+  bind_text(":prefix", prefix_like_pattern(expiration.prefix));
+  bind_text(":after_name", window.after_name);
+  bind_text(":last_name", window.last_name);
+  bind_time(":before", before);
+  bind_time(":now", now);
+  if (rc != SQLITE_OK) {
+    throw std::system_error(
+        rc, get_sqlite_error_category(), sqlite3_errmsg(db)
+    );
+  }
+  rc = sqlite3_step(stmt.get());
+  if (rc != SQLITE_DONE) {
+    throw std::system_error(
+        rc, get_sqlite_error_category(), sqlite3_errmsg(db)
+    );
+  }
+  return sqlite3_changes(db);
+}
+
 SQLiteLifecycle::SQLiteLifecycle(DBConnRef _conn) : conn(_conn) {}
 
 DBOPLCHead SQLiteLifecycle::get_head(const std::string& oid) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto head = storage.get_pointer<DBOPLCHead>(oid);
-  DBOPLCHead ret_value;
   if (head) {
-    ret_value = *head;
-  } else {
-    // there's still no head.
-    // LC was not executed yet.
-    // create an empty entry
-    DBOPLCHead new_head{oid, "", 0};
-    storage.replace(new_head);
-    ret_value = new_head;
+    return *head;
   }
-  return ret_value;
+  // there's still no head.
+  // LC was not executed yet.
+  // create an empty entry, unless another thread did in the meantime
+  return conn->run_on_writer([&](Storage& writer_storage) {
+    auto transaction = writer_storage.transaction_guard();
+    auto existing = writer_storage.get_pointer<DBOPLCHead>(oid);
+    if (existing) {
+      return *existing;
+    }
+    DBOPLCHead new_head{oid, "", 0};
+    writer_storage.replace(new_head);
+    transaction.commit();
+    return new_head;
+  });
 }
 
 void SQLiteLifecycle::store_head(const DBOPLCHead& head) const {
-  auto storage = conn->get_storage();
-  storage.replace(head);
+  conn->run_on_writer([&](Storage& storage) { storage.replace(head); });
 }
 
 void SQLiteLifecycle::remove_head(const std::string& oid) const {
-  auto storage = conn->get_storage();
-  storage.remove<DBOPLCHead>(oid);
+  conn->run_on_writer([&](Storage& storage) {
+    storage.remove<DBOPLCHead>(oid);
+  });
 }
 
 std::optional<DBOPLCEntry> SQLiteLifecycle::get_entry(
     const std::string& oid, const std::string& marker
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto db_entry = storage.get_pointer<DBOPLCEntry>(oid, marker);
   std::optional<DBOPLCEntry> ret_value;
   if (db_entry) {
@@ -60,7 +124,7 @@ std::optional<DBOPLCEntry> SQLiteLifecycle::get_entry(
 std::optional<DBOPLCEntry> SQLiteLifecycle::get_next_entry(
     const std::string& oid, const std::string& marker
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto db_entries = storage.get_all<DBOPLCEntry>(
       where(
           is_equal(&DBOPLCEntry::lc_index, oid) and
@@ -77,21 +141,51 @@ std::optional<DBOPLCEntry> SQLiteLifecycle::get_next_entry(
 }
 
 void SQLiteLifecycle::store_entry(const DBOPLCEntry& entry) const {
-  auto storage = conn->get_storage();
-  storage.replace(entry);
+  // the entries RGWLC stores have no expiration counts: keep the ones of
+  // the last run
+  conn->run_on_writer([&](Storage& storage) {
+    storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBOPLCEntry::start_time) = entry.start_time,
+              c(&DBOPLCEntry::status) = entry.status),
+          where(
+              is_equal(&DBOPLCEntry::lc_index, entry.lc_index) and
+              is_equal(&DBOPLCEntry::bucket_name, entry.bucket_name)
+          )
+      );
+      if (storage.changes() == 0) {
+        storage.replace(entry);
+      }
+      return true;
+    });
+  });
+}
+
+void SQLiteLifecycle::store_entry_counts(const DBOPLCEntry& entry) const {
+  conn->run_on_writer([&](Storage& storage) {
+    storage.update_all(
+        set(c(&DBOPLCEntry::expired_current) = entry.expired_current,
+            c(&DBOPLCEntry::expired_noncurrent) = entry.expired_noncurrent,
+            c(&DBOPLCEntry::expired_delete_markers) =
+                entry.expired_delete_markers,
+            c(&DBOPLCEntry::aborted_multiparts) = entry.aborted_multiparts),
+        where(is_equal(&DBOPLCEntry::bucket_name, entry.bucket_name))
+    );
+  });
 }
 
 void SQLiteLifecycle::remove_entry(
     const std::string& oid, const std::string& marker
 ) const {
-  auto storage = conn->get_storage();
-  storage.remove<DBOPLCEntry>(oid, marker);
+  conn->run_on_writer([&](Storage& storage) {
+    storage.remove<DBOPLCEntry>(oid, marker);
+  });
 }
 
 std::vector<DBOPLCEntry> SQLiteLifecycle::list_entries(
     const std::string& oid, const std::string& marker, uint32_t max_entries
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return storage.get_all<DBOPLCEntry>(
       where(
           is_equal(&DBOPLCEntry::lc_index, oid) and
@@ -101,4 +195,177 @@ std::vector<DBOPLCEntry> SQLiteLifecycle::list_entries(
   );
 }
 
+std::optional<std::string> SQLiteLifecycle::get_window_end(
+    const std::string& bucket_id, const std::string& prefix,
+    const std::string& after_name, size_t max_objects
+) const {
+  auto& storage = conn->get_storage();
+  auto names = storage.select(
+      &DBObject::name,
+      where(
+          is_equal(&DBObject::bucket_id, bucket_id) and
+          greater_than(&DBObject::name, after_name) and
+          prefix_to_like(&DBObject::name, prefix)
+      ),
+      order_by(&DBObject::name), limit(max_objects)
+  );
+  if (names.empty()) {
+    return std::nullopt;
+  }
+  return names.back();
+}
+
+std::vector<std::pair<uint, rgw::sal::Attrs>>
+SQLiteLifecycle::get_window_versions(
+    const DBOPLCExpiration& expiration, const DBOPLCWindow& window
+) const {
+  auto& storage = conn->get_storage();
+  auto rows = storage.select(
+      columns(&DBVersionedObject::id, &DBVersionedObject::attrs),
+      inner_join<DBVersionedObject>(
+          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
+      ),
+      where(
+          is_equal(&DBObject::bucket_id, expiration.bucket_id) and
+          greater_than(&DBObject::name, window.after_name) and
+          lesser_or_equal(&DBObject::name, window.last_name) and
+          prefix_to_like(&DBObject::name, expiration.prefix) and
+          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED) and
+          is_equal(&DBVersionedObject::version_type, VersionType::REGULAR)
+      )
+  );
+  std::vector<std::pair<uint, rgw::sal::Attrs>> result;
+  result.reserve(rows.size());
+  for (auto& row : rows) {
+    result.emplace_back(std::get<0>(row), std::move(std::get<1>(row)));
+  }
+  return result;
+}
+
+void SQLiteLifecycle::expire(
+    const DBOPLCExpiration& expiration, const DBOPLCWindow& window,
+    DBOPLCEntry& entry
+) const {
+  const auto committed = static_cast<int>(ObjectState::COMMITTED);
+  const auto deleted = static_cast<int>(ObjectState::DELETED);
+  const auto regular = static_cast<int>(VersionType::REGULAR);
+  const auto delete_marker = static_cast<int>(VersionType::DELETE_MARKER);
+  // objects of the window, as `o`
+  const std::string in_window =
+      "o.bucket_id = :bucket_id AND o.name > :after_name AND "
+      "o.name <= :last_name AND o.name LIKE :prefix ESCAPE '\a'";
+  // versions `v` not rejected by the tag filter, delete markers included
+  std::string tag_filter;
+  if (window.version_ids) {
+    tag_filter = fmt::format(
+        "AND (v.version_type = {} OR v.id IN ({}))", delete_marker,
+        fmt::join(*window.version_ids, ",")
+    );
+  }
+  // the latest versions `v` of the objects of the window
+  const auto latest = fmt::format(
+      "FROM {0} o INNER JOIN {1} l ON l.object_id = o.uuid "
+      "INNER JOIN {2} v ON v.id = l.version_id WHERE {3} {4}",
+      OBJECTS_TABLE, LATEST_VERSIONS_TABLE, VERSIONED_OBJECTS_TABLE,
+      in_window, tag_filter
+  );
+
+  const auto now = ceph::real_clock::now();
+  conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    sqlite3* db = conn->get_writer_db();
+    if (expiration.noncurrent_before) {
+      // a version becomes noncurrent when the next one is committed
+      entry.expired_noncurrent += run_expiration_sql(
+          db,
+          fmt::format(
+              "UPDATE {0} SET object_state = {1}, delete_time = :now, "
+              "mtime = :now WHERE id IN (SELECT v.id FROM {2} o "
+              "INNER JOIN {3} l ON l.object_id = o.uuid "
+              "INNER JOIN {0} v ON v.object_id = o.uuid "
+              "WHERE {4} {5} AND v.object_state = {6} "
+              "AND v.id != l.version_id AND ("
+              "SELECT n.mtime FROM {0} n WHERE n.object_id = v.object_id "
+              "AND n.object_state = {6} AND (n.commit_time > v.commit_time "
+              "OR (n.commit_time = v.commit_time AND n.id > v.id)) "
+              "ORDER BY n.commit_time, n.id LIMIT 1) < :before)",
+              VERSIONED_OBJECTS_TABLE, deleted, OBJECTS_TABLE,
+              LATEST_VERSIONS_TABLE, in_window, tag_filter, committed
+          ),
+          expiration, window, *expiration.noncurrent_before, now
+      );
+    }
+    if (expiration.current_before) {
+      if (expiration.versioned) {
+        // like Bucket::delete_object() without a version id
+        entry.expired_current += run_expiration_sql(
+            db,
+            fmt::format(
+                "INSERT INTO {0} (object_id, checksum, size, create_time, "
+                "delete_time, commit_time, mtime, object_state, version_id, "
+                "etag, attrs, version_type) SELECT v.object_id, v.checksum, "
+                "v.size, v.create_time, :now, :now, :now, {1}, "
+                "lower(hex(randomblob(16))), v.etag, v.attrs, {2} {3} "
+                "AND v.version_type = {4} AND v.mtime < :before",
+                VERSIONED_OBJECTS_TABLE, committed, delete_marker, latest,
+                regular
+            ),
+            expiration, window, *expiration.current_before, now
+        );
+      } else {
+        entry.expired_current += run_expiration_sql(
+            db,
+            fmt::format(
+                "UPDATE {0} SET object_state = {1}, delete_time = :now, "
+                "mtime = :now WHERE id IN (SELECT v.id {2} "
+                "AND v.version_type = {3} AND v.mtime < :before)",
+                VERSIONED_OBJECTS_TABLE, deleted, latest, regular
+            ),
+            expiration, window, *expiration.current_before, now
+        );
+      }
+    }
+    if (expiration.delete_markers) {
+      entry.expired_delete_markers += run_expiration_sql(
+          db,
+          fmt::format(
+              "UPDATE {0} SET object_state = {1}, delete_time = :now, "
+              "mtime = :now WHERE id IN (SELECT v.id {2} "
+              "AND v.version_type = {3} AND NOT EXISTS ("
+              "SELECT 1 FROM {0} n WHERE n.object_id = v.object_id "
+              "AND n.object_state = {4} AND n.id != v.id))",
+              VERSIONED_OBJECTS_TABLE, deleted, latest, delete_marker,
+              committed
+          ),
+          expiration, window, now, now
+      );
+    }
+    transaction.commit();
+  });
+  // too many objects may have changed to invalidate them one by one
+  conn->object_meta_cache.invalidate_all();
+}
+
+uint64_t SQLiteLifecycle::abort_multiparts(
+    const std::string& bucket_id, const std::string& prefix,
+    ceph::real_time before
+) const {
+  const auto num_aborted = conn->run_on_writer([&](Storage& storage) {
+    storage.update_all(
+        set(c(&DBMultipart::state) = MultipartState::ABORTED,
+            c(&DBMultipart::state_change_time) = ceph::real_clock::now()),
+        where(
+            is_equal(&DBMultipart::bucket_id, bucket_id) and
+            prefix_to_like(&DBMultipart::object_name, prefix) and
+            lesser_than(&DBMultipart::mtime, before) and
+            greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
+            lesser_than(&DBMultipart::state, MultipartState::COMPLETE)
+        )
+    );
+    return static_cast<uint64_t>(storage.changes());
+  });
+  conn->multipart_registry.invalidate_bucket(bucket_id);
+  return num_aborted;
+}
+
 }  // namespace rgw::sal::sfs::sqlite
@@ -44,6 +44,37 @@ class SQLiteLifecycle {
   std::vector<DBOPLCEntry> list_entries(
       const std::string& oid, const std::string& marker, uint32_t max_entries
   ) const;
+  /// Stores the expiration counts of `entry` in the entries of its
+  /// bucket, whatever their index
+  void store_entry_counts(const DBOPLCEntry& entry) const;
+
+  /// Returns the name of the last of the next `max_objects` objects of
+  /// a bucket named after `after_name` and starting with `prefix`, or
+  /// nothing if there are no more.
+  std::optional<std::string> get_window_end(
+      const std::string& bucket_id, const std::string& prefix,
+      const std::string& after_name, size_t max_objects
+  ) const;
+  /// Returns the ids and attributes of the committed regular versions of
+  /// the objects of a window, for the tag filter of a rule.
+  std::vector<std::pair<uint, rgw::sal::Attrs>> get_window_versions(
+      const DBOPLCExpiration& expiration, const DBOPLCWindow& window
+  ) const;
+  /// Applies `expiration` to the objects of `window` with a few bulk
+  /// statements in one transaction: expired versions are marked deleted
+  /// for the garbage collector to reclaim. Adds what it expired to the
+  /// counts of `entry`.
+  void expire(
+      const DBOPLCExpiration& expiration, const DBOPLCWindow& window,
+      DBOPLCEntry& entry
+  ) const;
+  /// Aborts the multipart uploads in progress in a bucket for objects
+  /// starting with `prefix` that were initiated before `before`.
+  /// Returns the number aborted.
+  uint64_t abort_multiparts(
+      const std::string& bucket_id, const std::string& prefix,
+      ceph::real_time before
+  ) const;
 };
 
 }  // namespace rgw::sal::sfs::sqlite
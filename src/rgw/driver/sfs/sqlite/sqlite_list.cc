@@ -11,6 +11,7 @@
  */
 #include "sqlite_list.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "rgw/driver/sfs/sqlite/conversion_utils.h"
@@ -39,27 +40,27 @@ bool SQLiteList::objects(
 
   // ListBucket does not care about versions/instances. don't populate
   // key.instance
-  auto storage = conn->get_storage();
-  auto rows = storage.select(
-      columns(
-          &DBObject::name, &DBVersionedObject::mtime, &DBVersionedObject::etag,
-          sum(&DBVersionedObject::size)
-      ),
-      inner_join<DBVersionedObject>(
-          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-      ),
-      where(
-          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED) and
-          is_equal(&DBObject::bucket_id, bucket_id) and
-          greater_than(&DBObject::name, start_after_object_name) and
-          prefix_to_like(&DBObject::name, prefix)
-      ),
-      group_by(&DBVersionedObject::object_id),
-      having(is_equal(
-          sqlite_orm::max(&DBVersionedObject::version_type),
-          VersionType::REGULAR
-      )),
-      order_by(&DBObject::name), limit(query_limit)
+  //
+  // Objects whose latest version is a delete marker are not listed.
+  auto& storage = conn->get_storage();
+  auto rows = conn->execute_prepared(
+      storage, "list.objects",
+      select(
+          columns(
+              &DBLatestVersion::name, &DBVersionedObject::mtime,
+              &DBVersionedObject::etag, &DBVersionedObject::size
+          ),
+          inner_join<DBVersionedObject>(
+              on(is_equal(&DBLatestVersion::version_id, &DBVersionedObject::id))
+          ),
+          where(
+              is_equal(&DBLatestVersion::bucket_id, bucket_id) and
+              greater_than(&DBLatestVersion::name, start_after_object_name) and
+              prefix_to_like(&DBLatestVersion::name, prefix) and
+              is_equal(&DBLatestVersion::version_type, VersionType::REGULAR)
+          ),
+          order_by(&DBLatestVersion::name), limit(query_limit)
+      )
   );
   ceph_assert(rows.size() <= static_cast<size_t>(query_limit));
   const size_t return_limit = std::min(max, rows.size());
@@ -70,7 +71,7 @@ bool SQLiteList::objects(
     e.key.name = std::get<0>(row);
     e.meta.mtime = std::get<1>(row);
     e.meta.etag = std::get<2>(row);
-    e.meta.size = static_cast<uint64_t>(*std::get<3>(row));
+    e.meta.size = std::get<3>(row);
     e.meta.accounted_size = e.meta.size;
     out.emplace_back(e);
   }
@@ -103,55 +104,44 @@ bool SQLiteList::versions(
   ceph_assert(max < std::numeric_limits<size_t>::max());
   const size_t query_limit = max + 1;
 
-  auto storage = conn->get_storage();
-  auto rows = storage.select(
-      columns(
-          &DBObject::name, &DBVersionedObject::version_id,
-          &DBVersionedObject::mtime, &DBVersionedObject::etag,
-          &DBVersionedObject::size, &DBVersionedObject::version_type,
-          is_equal(
-              // IsLatest logic
-              // - Use the id as secondary condition if multiple version
-              // with same max(commit_time) exists
-              sqlite_orm::select(
-                  &DBVersionedObject::id, from<DBVersionedObject>(),
-                  where(
-                      is_equal(
-                          &DBObject::uuid, &DBVersionedObject::object_id
-                      ) and
-                      is_equal(
-                          &DBVersionedObject::object_state,
-                          ObjectState::COMMITTED
-                      )
-                  ),
-                  multi_order_by(
-                      order_by(&DBVersionedObject::commit_time).desc(),
-                      order_by(&DBVersionedObject::id).desc()
-                  ),
-                  limit(1)
-              ),
-              &DBVersionedObject::id
-          )
-      ),
-      inner_join<DBVersionedObject>(
-          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-      ),
-      where(
-          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED) and
-          is_equal(&DBObject::bucket_id, bucket_id) and
-          greater_than(&DBObject::name, start_after_object_name) and
-          prefix_to_like(&DBObject::name, prefix)
-      ),
-      // Sort:
-      // names a-Z
-      // first delete markers, then versions - (See: LC CurrentExpiration)
-      // newest to oldest version
-      multi_order_by(
-          order_by(&DBObject::name).asc(),
-          order_by(&DBVersionedObject::commit_time).desc(),
-          order_by(&DBVersionedObject::id).desc()
-      ),
-      limit(query_limit)
+  auto& storage = conn->get_storage();
+  auto rows = conn->execute_prepared(
+      storage, "list.versions",
+      select(
+          columns(
+              &DBObject::name, &DBVersionedObject::version_id,
+              &DBVersionedObject::mtime, &DBVersionedObject::etag,
+              &DBVersionedObject::size, &DBVersionedObject::version_type,
+              is_equal(&DBLatestVersion::version_id, &DBVersionedObject::id)
+          ),
+          inner_join<DBVersionedObject>(
+              on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
+          ),
+          // every object with a committed version has a latest version.
+          // IsLatest is one row lookup rather than a subquery over the
+          // versions of the object.
+          inner_join<DBLatestVersion>(
+              on(is_equal(&DBObject::uuid, &DBLatestVersion::object_id))
+          ),
+          where(
+              is_equal(
+                  &DBVersionedObject::object_state, ObjectState::COMMITTED
+              ) and
+              is_equal(&DBObject::bucket_id, bucket_id) and
+              greater_than(&DBObject::name, start_after_object_name) and
+              prefix_to_like(&DBObject::name, prefix)
+          ),
+          // Sort:
+          // names a-Z
+          // first delete markers, then versions - (See: LC CurrentExpiration)
+          // newest to oldest version
+          multi_order_by(
+              order_by(&DBObject::name).asc(),
+              order_by(&DBVersionedObject::commit_time).desc(),
+              order_by(&DBVersionedObject::id).desc()
+          ),
+          limit(query_limit)
+      )
   );
 
   ceph_assert(rows.size() <= static_cast<size_t>(query_limit));
@@ -175,38 +165,114 @@ bool SQLiteList::versions(
   return true;
 }
 
-void SQLiteList::roll_up_common_prefixes(
-    const std::string& find_after_prefix, const std::string& delimiter,
-    const std::vector<rgw_bucket_dir_entry>& objects,
-    std::map<std::string, bool>& out_common_prefixes,
-    std::vector<rgw_bucket_dir_entry>& out_objects
+/// Returns the common prefix `name` rolls up to, or an empty string if
+/// it has no `delimiter` after `prefix`.
+static std::string common_prefix_of(
+    const std::string& name, const std::string& prefix,
+    const std::string& delimiter
+) {
+  if (!name.starts_with(prefix)) {
+    return {};
+  }
+  const auto delim_pos = name.find(delimiter, prefix.length());
+  if (delim_pos == name.npos) {
+    return {};
+  }
+  return name.substr(0, delim_pos + delimiter.length());
+}
+
+/// Returns a name greater than any object name starting with
+/// `common_prefix`: listing after it seeks past the whole prefix. Names
+/// are UTF-8 and compared bytewise, and 0xff never occurs in UTF-8.
+static std::string past_common_prefix(const std::string& common_prefix) {
+  return common_prefix + static_cast<char>(0xff);
+}
+
+bool SQLiteList::list_delimited(
+    bool list_versions, const std::string& bucket_id,
+    const std::string& prefix, const std::string& delimiter,
+    const std::string& marker, size_t max,
+    std::vector<rgw_bucket_dir_entry>& out_objects,
+    std::map<std::string, bool>& out_common_prefixes, bool* out_more_available
 ) const {
-  const size_t find_after_pos = find_after_prefix.length();
-  const size_t delim_len = delimiter.length();
-  if (delimiter.empty()) {
-    out_objects = objects;
-    return;
+  ceph_assert(!delimiter.empty());
+  // Rows are fetched in batches that start small, as a batch is wasted
+  // past the first common prefix in it, and grow over runs of plain
+  // objects.
+  constexpr size_t min_batch = 16;
+  constexpr size_t max_batch = 1000;
+
+  const auto list = [&](const std::string& start_after, size_t limit,
+                        std::vector<rgw_bucket_dir_entry>& rows, bool* more) {
+    return list_versions ? versions(
+                               bucket_id, prefix, start_after, limit, rows, more
+                           )
+                         : objects(
+                               bucket_id, prefix, start_after, limit, rows, more
+                           );
+  };
+
+  std::string start_after = marker;
+  if (const auto cp = common_prefix_of(marker, prefix, delimiter);
+      !cp.empty()) {
+    start_after = past_common_prefix(cp);
   }
-  const std::string* prefix{nullptr};  // Last added prefix
-  for (size_t i = 0; i < objects.size(); i++) {
-    const std::string& name = objects[i].key.name;
-    // Same prefix -> skip
-    if (prefix != nullptr && name.starts_with(*prefix)) {
-      continue;
+
+  size_t entries = 0;
+  size_t batch = min_batch;
+  while (entries < max) {
+    const size_t limit = std::min(batch, max - entries);
+    std::vector<rgw_bucket_dir_entry> rows;
+    bool more = false;
+    if (!list(start_after, limit, rows, &more)) {
+      return false;
     }
-    if (name.starts_with(find_after_prefix)) {
-      // Found delim -> add, remember prefix
-      auto delim_pos = name.find(delimiter, find_after_pos);
-      if (delim_pos != name.npos) {
-        prefix = &out_common_prefixes
-                      .emplace(name.substr(0, delim_pos + delim_len), true)
-                      .first->first;
+    if (more && list_versions && limit < max - entries) {
+      // Batches continue after a name. Don't split the versions of the
+      // last object between two of them.
+      const std::string last = rows.back().key.name;
+      while (!rows.empty() && rows.back().key.name == last) {
+        rows.pop_back();
+      }
+      if (rows.empty()) {
+        batch *= 2;
         continue;
       }
     }
-    // Not found -> next
-    out_objects.push_back(objects[i]);
+
+    bool seek = false;
+    for (size_t i = 0; i < rows.size() && !seek; i++) {
+      const std::string cp =
+          common_prefix_of(rows[i].key.name, prefix, delimiter);
+      if (cp.empty()) {
+        start_after = rows[i].key.name;
+        out_objects.emplace_back(std::move(rows[i]));
+        entries++;
+        continue;
+      }
+      out_common_prefixes.emplace(cp, true);
+      entries++;
+      start_after = past_common_prefix(cp);
+      // more names in this prefix: skip them all with a new query
+      seek = i + 1 < rows.size() && rows[i + 1].key.name.starts_with(cp);
+    }
+    if (!seek && !more) {
+      if (out_more_available) {
+        *out_more_available = false;
+      }
+      return true;
+    }
+    batch = seek ? min_batch : std::min(batch * 2, max_batch);
   }
+
+  // The page is full. Is there anything after it?
+  if (out_more_available) {
+    std::vector<rgw_bucket_dir_entry> rows;
+    if (!list(start_after, 0, rows, out_more_available)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 }  // namespace rgw::sal::sfs::sqlite
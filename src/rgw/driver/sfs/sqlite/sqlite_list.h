@@ -43,20 +43,23 @@ class SQLiteList {
       std::vector<rgw_bucket_dir_entry>& out, bool* out_more_available = nullptr
   ) const;
 
-  // roll_up_common_prefixes performs S3 common prefix compression to
-  // objects and common_prefixes.
-  //
-  // Add a (`prefix` -> true) entry in `out_common_prefixes`, for
-  // every object that starts with `find_after_prefix` and has a
-  // `delimiter` in the string after that. `prefix` is the string 0 to
-  // `delimiter` position.
-  //
-  // Copy all other `objects` to `out_objects`.
-  void roll_up_common_prefixes(
-      const std::string& find_after_prefix, const std::string& delimiter,
-      const std::vector<rgw_bucket_dir_entry>& objects,
+  /// list_delimited lists like objects() (or versions() if
+  /// `list_versions` is set), rolling the names that have `delimiter`
+  /// after `prefix` up into `out_common_prefixes`. Objects and common
+  /// prefixes together are at most `max`.
+  ///
+  /// Rather than listing every name in a common prefix, it seeks past
+  /// the prefix in the (bucket_id, name) index as soon as it finds one,
+  /// so a page costs about one index seek per returned entry, however
+  /// many names the prefixes hold. A `marker` inside a common prefix
+  /// continues after that whole prefix.
+  bool list_delimited(
+      bool list_versions, const std::string& bucket_id,
+      const std::string& prefix, const std::string& delimiter,
+      const std::string& marker, size_t max,
+      std::vector<rgw_bucket_dir_entry>& out_objects,
       std::map<std::string, bool>& out_common_prefixes,
-      std::vector<rgw_bucket_dir_entry>& out_objects
+      bool* out_more_available = nullptr
   ) const;
 };
 }  // namespace rgw::sal::sfs::sqlite
@@ -35,7 +35,7 @@ std::optional<std::vector<DBMultipart>> SQLiteMultipart::list_multiparts(
     const std::string& marker, const std::string& delim, const int& max_uploads,
     bool* is_truncated
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
 
   auto bucket_entries = storage.get_all<DBBucket>(
       where(is_equal(&DBBucket::bucket_name, bucket_name))
@@ -56,7 +56,7 @@ std::vector<DBMultipart> SQLiteMultipart::list_multiparts_by_bucket_id(
     const std::string& marker, const std::string& /*delim*/,
     const int& max_uploads, bool* is_truncated, bool get_all
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
 
   auto start_state = get_all ? MultipartState::NONE : MultipartState::INIT;
   auto end_state =
@@ -90,27 +90,30 @@ std::vector<DBMultipart> SQLiteMultipart::list_multiparts_by_bucket_id(
 
 int SQLiteMultipart::abort_multiparts_by_bucket_id(const std::string& bucket_id
 ) const {
-  auto storage = conn->get_storage();
   uint64_t num_changes = 0;
-  storage.transaction([&]() mutable {
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::ABORTED,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::bucket_id, bucket_id) and
-            greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
-            lesser_than(&DBMultipart::state, MultipartState::COMPLETE)
-        )
-    );
-    num_changes = storage.changes();
-    return true;
+  conn->run_on_writer([&](Storage& storage) {
+    storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBMultipart::state) = MultipartState::ABORTED,
+              c(&DBMultipart::state_change_time) =
+                  ceph::real_time::clock::now()),
+          where(
+              is_equal(&DBMultipart::bucket_id, bucket_id) and
+              greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
+              lesser_than(&DBMultipart::state, MultipartState::COMPLETE)
+          )
+      );
+      num_changes = storage.changes();
+      return true;
+    });
   });
+  conn->multipart_registry.invalidate_bucket(bucket_id);
 
   return num_changes;
 }
 
 int SQLiteMultipart::abort_multiparts(const std::string& bucket_name) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto bucket_ids_vec = storage.select(
       &DBBucket::bucket_id,
       where(
@@ -133,7 +136,7 @@ std::optional<DBMultipart> SQLiteMultipart::get_multipart(
     return std::nullopt;
   }
 
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto entries = storage.get_all<DBMultipart>(
       where(is_equal(&DBMultipart::upload_id, upload_id))
   );
@@ -147,7 +150,7 @@ std::optional<DBMultipart> SQLiteMultipart::get_multipart(
 
 std::optional<DBMultipart> SQLiteMultipart::get_multipart(int id) const {
   ceph_assert(id >= 0);
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto entries =
       storage.get_all<DBMultipart>(where(is_equal(&DBMultipart::id, id)));
   ceph_assert(entries.size() <= 1);  // primary key
@@ -159,15 +162,16 @@ std::optional<DBMultipart> SQLiteMultipart::get_multipart(int id) const {
 }
 
 uint SQLiteMultipart::insert(const DBMultipart& mp) const {
-  auto storage = conn->get_storage();
-  return storage.insert(mp);
+  return conn->run_on_writer([&](Storage& storage) {
+    return storage.insert(mp);
+  });
 }
 
 std::vector<DBMultipartPart> SQLiteMultipart::list_parts(
     const std::string& upload_id, int num_parts, int marker, int* next_marker,
     bool* truncated
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   std::vector<DBMultipartPart> db_entries;
   db_entries = storage.get_all<DBMultipartPart>(
       where(
@@ -198,7 +202,7 @@ std::vector<DBMultipartPart> SQLiteMultipart::list_parts(
 std::vector<DBMultipartPart> SQLiteMultipart::get_parts(
     const std::string& upload_id
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto db_entries = storage.get_all<DBMultipartPart>(
       where(is_equal(&DBMultipartPart::upload_id, upload_id)),
       order_by(&DBMultipartPart::part_num)
@@ -209,7 +213,7 @@ std::vector<DBMultipartPart> SQLiteMultipart::get_parts(
 std::optional<DBMultipartPart> SQLiteMultipart::get_part(
     const std::string& upload_id, uint32_t part_num
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto entries = storage.get_all<DBMultipartPart>(where(
       is_equal(&DBMultipartPart::upload_id, upload_id) and
       is_equal(&DBMultipartPart::part_num, part_num)
@@ -222,94 +226,102 @@ std::optional<DBMultipartPart> SQLiteMultipart::get_part(
 }
 
 std::optional<DBMultipartPart> SQLiteMultipart::create_or_reset_part(
-    const std::string& upload_id, uint32_t part_num, std::string* error_str
+    const std::string& upload_id, uint32_t part_num, std::string* error_str,
+    std::shared_ptr<MultipartUploadState>* upload
 ) const {
-  auto storage = conn->get_storage();
-
+  std::optional<DBMultipart> mp;
+  uint64_t generation = 0;
   RetrySQLiteBusy<std::optional<DBMultipartPart>> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    std::optional<DBMultipartPart> entry = std::nullopt;
-    auto cnt = storage.count<DBMultipart>(where(
-        is_equal(&DBMultipart::upload_id, upload_id) and
-        (is_equal(&DBMultipart::state, MultipartState::INPROGRESS) or
-         is_equal(&DBMultipart::state, MultipartState::INIT))
-    ));
-    if (cnt != 1) {
-      if (error_str) {
-        *error_str = "could not find upload";
-      }
-      return entry;
-    }
-
-    // set multipart upload as being in progress
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::INPROGRESS,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::upload_id, upload_id) and
-            is_equal(&DBMultipart::state, MultipartState::INIT)
-        )
-    );
+    generation = conn->multipart_registry.get_generation();
+    // group committed with the metadata of concurrent uploads. A failed
+    // replace or insert throws and rolls back the state change.
+    return conn->run_batched(
+        [&](Storage& storage) -> std::optional<DBMultipartPart> {
+          auto mps = storage.get_all<DBMultipart>(where(
+              is_equal(&DBMultipart::upload_id, upload_id) and
+              (is_equal(&DBMultipart::state, MultipartState::INPROGRESS) or
+               is_equal(&DBMultipart::state, MultipartState::INIT))
+          ));
+          if (mps.size() != 1) {
+            if (error_str) {
+              *error_str = "could not find upload";
+            }
+            return std::nullopt;
+          }
+          mp = mps.front();
+
+          // set multipart upload as being in progress
+          storage.update_all(
+              set(c(&DBMultipart::state) = MultipartState::INPROGRESS,
+                  c(&DBMultipart::state_change_time) =
+                      ceph::real_time::clock::now()),
+              where(
+                  is_equal(&DBMultipart::upload_id, upload_id) and
+                  is_equal(&DBMultipart::state, MultipartState::INIT)
+              )
+          );
 
-    // find if there's already a part with said upload_id/part_num combination
-    auto parts = storage.get_all<DBMultipartPart>(where(
-        is_equal(&DBMultipartPart::upload_id, upload_id) and
-        is_equal(&DBMultipartPart::part_num, part_num)
-    ));
-    DBMultipartPart part;
-
-    if (parts.size() > 0) {
-      ceph_assert(parts.size() == 1);
-      // reset part entry
-      part = parts.front();
-      part.size = 0;
-      part.etag = std::nullopt;
-      part.mtime = std::nullopt;
-      try {
-        storage.replace(part);
-      } catch (const std::system_error& e) {
-        if (error_str) {
-          *error_str = e.what();
-        }
-        return entry;
-      }
-    } else {
-      part = DBMultipartPart{
-          .id = -1 /* ignored by insert */,
-          .upload_id = upload_id,
-          .part_num = part_num,
-          .size = 0,
-          .etag = std::nullopt,
-          .mtime = std::nullopt,
-      };
-      try {
-        part.id = storage.insert(part);
-      } catch (const std::system_error& e) {
-        if (error_str) {
-          *error_str = e.what();
+          // find if there's already a part with said upload_id/part_num
+          // combination
+          auto parts = storage.get_all<DBMultipartPart>(where(
+              is_equal(&DBMultipartPart::upload_id, upload_id) and
+              is_equal(&DBMultipartPart::part_num, part_num)
+          ));
+          DBMultipartPart part;
+
+          if (parts.size() > 0) {
+            ceph_assert(parts.size() == 1);
+            // reset part entry
+            part = parts.front();
+            part.size = 0;
+            part.etag = std::nullopt;
+            part.mtime = std::nullopt;
+            storage.replace(part);
+          } else {
+            part = DBMultipartPart{
+                .id = -1 /* ignored by insert */,
+                .upload_id = upload_id,
+                .part_num = part_num,
+                .size = 0,
+                .etag = std::nullopt,
+                .mtime = std::nullopt,
+            };
+            part.id = storage.insert(part);
+          }
+          return part;
         }
-        return entry;
-      }
-    }
-
-    entry = part;
-    transaction.commit();
-    return entry;
+    );
   });
 
-  auto val = retry.run();
-  return val.has_value() ? *val : std::nullopt;
+  std::optional<std::optional<DBMultipartPart>> val;
+  try {
+    val = retry.run();
+  } catch (const std::system_error& e) {
+    if (error_str) {
+      *error_str = e.what();
+    }
+    return std::nullopt;
+  }
+  if (!val.has_value() || !val->has_value()) {
+    return std::nullopt;
+  }
+  if (upload) {
+    *upload = conn->multipart_registry.add(
+        *mp, MultipartState::INPROGRESS, generation
+    );
+  }
+  return *val;
 }
 
 bool SQLiteMultipart::finish_part(
     const std::string& upload_id, uint32_t part_num, const std::string& etag,
-    uint64_t bytes_written
+    uint64_t bytes_written, ceph::real_time* mtime
 ) const {
-  auto storage = conn->get_storage();
-  bool committed = storage.transaction([&]() mutable {
+  const auto now = ceph::real_time::clock::now();
+  const bool committed = conn->run_batched([&](Storage& storage) {
     storage.update_all(
         set(c(&DBMultipartPart::etag) = etag,
-            c(&DBMultipartPart::mtime) = ceph::real_time::clock::now(),
+            c(&DBMultipartPart::mtime) = now,
             c(&DBMultipartPart::size) = bytes_written),
         where(
             is_equal(&DBMultipartPart::upload_id, upload_id) and
@@ -317,33 +329,39 @@ bool SQLiteMultipart::finish_part(
             is_null(&DBMultipartPart::etag)
         )
     );
-    if (storage.changes() != 1) {
-      return false;
-    }
-    return true;
+    // (upload_id, part_num) is unique, nothing to roll back otherwise
+    return storage.changes() == 1;
   });
+  if (committed && mtime) {
+    *mtime = now;
+  }
   return committed;
 }
 
 bool SQLiteMultipart::abort(const std::string& upload_id) const {
-  auto storage = conn->get_storage();
-  auto committed = storage.transaction([&]() mutable {
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::ABORTED,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::upload_id, upload_id) and
-            greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
-            lesser_than(&DBMultipart::state, MultipartState::COMPLETE)
-        )
-    );
-    auto num_aborted = storage.changes();
-    if (num_aborted == 0) {
-      return false;
-    }
-    ceph_assert(num_aborted == 1);
-    return true;
+  auto committed = conn->run_on_writer([&](Storage& storage) {
+    return storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBMultipart::state) = MultipartState::ABORTED,
+              c(&DBMultipart::state_change_time) =
+                  ceph::real_time::clock::now()),
+          where(
+              is_equal(&DBMultipart::upload_id, upload_id) and
+              greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
+              lesser_than(&DBMultipart::state, MultipartState::COMPLETE)
+          )
+      );
+      auto num_aborted = storage.changes();
+      if (num_aborted == 0) {
+        return false;
+      }
+      ceph_assert(num_aborted == 1);
+      return true;
+    });
   });
+  if (committed) {
+    conn->multipart_registry.publish(upload_id, MultipartState::ABORTED);
+  }
 
   return committed;
 }
@@ -352,90 +370,109 @@ bool SQLiteMultipart::mark_complete(
     const std::string& upload_id, bool* duplicate
 ) const {
   ceph_assert(duplicate != nullptr);
-  auto storage = conn->get_storage();
-  auto committed = storage.transaction([&]() mutable {
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::COMPLETE,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::upload_id, upload_id) and
-            greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
-            lesser_or_equal(&DBMultipart::state, MultipartState::INPROGRESS)
-        )
-    );
-    if (storage.changes() == 0) {
-      const auto state = storage.select(
-          columns(&DBMultipart::state),
-          where(is_equal(&DBMultipart::upload_id, upload_id))
+  auto committed = conn->run_on_writer([&](Storage& storage) {
+    return storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBMultipart::state) = MultipartState::COMPLETE,
+              c(&DBMultipart::state_change_time) =
+                  ceph::real_time::clock::now()),
+          where(
+              is_equal(&DBMultipart::upload_id, upload_id) and
+              greater_or_equal(&DBMultipart::state, MultipartState::INIT) and
+              lesser_or_equal(&DBMultipart::state, MultipartState::INPROGRESS)
+          )
       );
-      if (state.size() == 0) {
-        return false;
+      if (storage.changes() == 0) {
+        const auto state = storage.select(
+            columns(&DBMultipart::state),
+            where(is_equal(&DBMultipart::upload_id, upload_id))
+        );
+        if (state.size() == 0) {
+          return false;
+        }
+        *duplicate = (std::get<0>(state[0]) >= MultipartState::COMPLETE);
+      } else {
+        *duplicate = false;
       }
-      *duplicate = (std::get<0>(state[0]) >= MultipartState::COMPLETE);
-    } else {
-      *duplicate = false;
-    }
-    return true;
+      return true;
+    });
   });
+  if (committed && !*duplicate) {
+    conn->multipart_registry.publish(upload_id, MultipartState::COMPLETE);
+  }
   return committed;
 }
 
 bool SQLiteMultipart::mark_aggregating(const std::string& upload_id) const {
-  auto storage = conn->get_storage();
-  auto committed = storage.transaction([&]() mutable {
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::AGGREGATING,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::upload_id, upload_id) and
-            is_equal(&DBMultipart::state, MultipartState::COMPLETE)
-        )
-    );
-    auto num_changed = storage.changes();
-    if (num_changed == 0) {
-      return false;
-    }
-    ceph_assert(num_changed == 1);
-    return true;
+  auto committed = conn->run_on_writer([&](Storage& storage) {
+    return storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBMultipart::state) = MultipartState::AGGREGATING,
+              c(&DBMultipart::state_change_time) =
+                  ceph::real_time::clock::now()),
+          where(
+              is_equal(&DBMultipart::upload_id, upload_id) and
+              is_equal(&DBMultipart::state, MultipartState::COMPLETE)
+          )
+      );
+      auto num_changed = storage.changes();
+      if (num_changed == 0) {
+        return false;
+      }
+      ceph_assert(num_changed == 1);
+      return true;
+    });
   });
+  if (committed) {
+    conn->multipart_registry.publish(upload_id, MultipartState::AGGREGATING);
+  }
 
   return committed;
 }
 
 bool SQLiteMultipart::mark_done(const std::string& upload_id) const {
-  auto storage = conn->get_storage();
-  auto committed = storage.transaction([&]() mutable {
-    storage.update_all(
-        set(c(&DBMultipart::state) = MultipartState::DONE,
-            c(&DBMultipart::state_change_time) = ceph::real_time::clock::now()),
-        where(
-            is_equal(&DBMultipart::upload_id, upload_id) and
-            is_equal(&DBMultipart::state, MultipartState::AGGREGATING)
-        )
-    );
-    auto num_changed = storage.changes();
-    if (num_changed == 0) {
-      return false;
-    }
-    ceph_assert(num_changed == 1);
-    return true;
+  auto committed = conn->run_on_writer([&](Storage& storage) {
+    return storage.transaction([&]() mutable {
+      storage.update_all(
+          set(c(&DBMultipart::state) = MultipartState::DONE,
+              c(&DBMultipart::state_change_time) =
+                  ceph::real_time::clock::now()),
+          where(
+              is_equal(&DBMultipart::upload_id, upload_id) and
+              is_equal(&DBMultipart::state, MultipartState::AGGREGATING)
+          )
+      );
+      auto num_changed = storage.changes();
+      if (num_changed == 0) {
+        return false;
+      }
+      ceph_assert(num_changed == 1);
+      return true;
+    });
   });
+  if (committed) {
+    conn->multipart_registry.publish(upload_id, MultipartState::DONE);
+  }
   return committed;
 }
 
 void SQLiteMultipart::remove_parts(const std::string& upload_id) const {
-  auto storage = conn->get_storage();
-  storage.remove_all<DBMultipartPart>(
-      where(c(&DBMultipartPart::upload_id) = upload_id)
-  );
+  conn->run_on_writer([&](Storage& storage) {
+    storage.remove_all<DBMultipartPart>(
+        where(c(&DBMultipartPart::upload_id) = upload_id)
+    );
+  });
 }
 
 void SQLiteMultipart::remove_multiparts_by_bucket_id(
     const std::string& bucket_id
 ) const {
-  auto storage = conn->get_storage();
-  storage.remove_all<DBMultipart>(where(c(&DBMultipart::bucket_id) = bucket_id)
-  );
+  conn->run_on_writer([&](Storage& storage) {
+    storage.remove_all<DBMultipart>(
+        where(c(&DBMultipart::bucket_id) = bucket_id)
+    );
+  });
+  conn->multipart_registry.invalidate_bucket(bucket_id);
 }
 
 std::optional<DBDeletedMultipartItems>
@@ -443,64 +480,65 @@ SQLiteMultipart::remove_multiparts_by_bucket_id_transact(
     const std::string& bucket_id, uint max_items
 ) const {
   DBDeletedMultipartItems ret_parts;
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<DBDeletedMultipartItems> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    // get first the list of parts to be deleted up to max_items
-    ret_parts = storage.select(
-        columns(
-            &DBMultipart::upload_id, &DBMultipart::path_uuid,
-            &DBMultipartPart::id
-        ),
-        inner_join<DBMultipart>(
-            on(is_equal(&DBMultipart::upload_id, &DBMultipartPart::upload_id))
-        ),
-        where(is_equal(&DBMultipart::bucket_id, bucket_id)),
-        order_by(&DBMultipartPart::id), limit(max_items)
-    );
-    // extract the ids from the query.
-    // we'll use the ids to delete them with remove_all where in.
-    std::vector<int> ids;
-    ids.reserve(ret_parts.size());
-    std::ranges::transform(
-        ret_parts, std::back_inserter(ids),
-        [](DBDeletedMultipartItem item) -> int { return get_part_id(item); }
-    );
-    ceph_assert(ids.size() == ret_parts.size());
-    if (ret_parts.size() == 0) {
-      // there are no pending parts for this bucket
-      // we can safely delete all multiparts in it.
-      // This will take care of multiparts that had 0 parts initially
-      storage.remove_all<DBMultipart>(
-          where(is_equal(&DBMultipart::bucket_id, bucket_id))
+    return conn->run_on_writer([&](Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      // get first the list of parts to be deleted up to max_items
+      ret_parts = storage.select(
+          columns(
+              &DBMultipart::upload_id, &DBMultipart::path_uuid,
+              &DBMultipartPart::id
+          ),
+          inner_join<DBMultipart>(
+              on(is_equal(&DBMultipart::upload_id, &DBMultipartPart::upload_id))
+          ),
+          where(is_equal(&DBMultipart::bucket_id, bucket_id)),
+          order_by(&DBMultipartPart::id), limit(max_items)
       );
-      transaction.commit();
-      return ret_parts;
-    }
-    // remove the parts selected
-    storage.remove_all<DBMultipartPart>(where(in(&DBMultipartPart::id, ids)));
-
-    // now check if the multipart holding the part is empty
-    std::map<std::string, bool> already_checked_mp;
-    for (auto const& part : ret_parts) {
-      auto upload_id = get_upload_id(part);
-      if (already_checked_mp.find(upload_id) == already_checked_mp.end()) {
-        already_checked_mp[upload_id] = true;
-
-        auto nb_parts = storage.count(
-            &DBMultipartPart::id,
-            where(is_equal(&DBMultipartPart::upload_id, upload_id))
+      // extract the ids from the query.
+      // we'll use the ids to delete them with remove_all where in.
+      std::vector<int> ids;
+      ids.reserve(ret_parts.size());
+      std::ranges::transform(
+          ret_parts, std::back_inserter(ids),
+          [](DBDeletedMultipartItem item) -> int { return get_part_id(item); }
+      );
+      ceph_assert(ids.size() == ret_parts.size());
+      if (ret_parts.size() == 0) {
+        // there are no pending parts for this bucket
+        // we can safely delete all multiparts in it.
+        // This will take care of multiparts that had 0 parts initially
+        storage.remove_all<DBMultipart>(
+            where(is_equal(&DBMultipart::bucket_id, bucket_id))
         );
-        if (nb_parts == 0) {
-          // delete this multipart as it has no parts
-          storage.remove_all<DBMultipart>(
-              where(is_equal(&DBMultipart::upload_id, upload_id))
+        transaction.commit();
+        return ret_parts;
+      }
+      // remove the parts selected
+      storage.remove_all<DBMultipartPart>(where(in(&DBMultipartPart::id, ids)));
+
+      // now check if the multipart holding the part is empty
+      std::map<std::string, bool> already_checked_mp;
+      for (auto const& part : ret_parts) {
+        auto upload_id = get_upload_id(part);
+        if (already_checked_mp.find(upload_id) == already_checked_mp.end()) {
+          already_checked_mp[upload_id] = true;
+
+          auto nb_parts = storage.count(
+              &DBMultipartPart::id,
+              where(is_equal(&DBMultipartPart::upload_id, upload_id))
           );
+          if (nb_parts == 0) {
+            // delete this multipart as it has no parts
+            storage.remove_all<DBMultipart>(
+                where(is_equal(&DBMultipart::upload_id, upload_id))
+            );
+          }
         }
       }
-    }
-    transaction.commit();
-    return ret_parts;
+      transaction.commit();
+      return ret_parts;
+    });
   });
   return retry.run();
 }
@@ -509,68 +547,69 @@ std::optional<DBDeletedMultipartItems>
 SQLiteMultipart::remove_done_or_aborted_multiparts_transact(uint max_items
 ) const {
   DBDeletedMultipartItems ret_parts;
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<DBDeletedMultipartItems> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    // get first the list of parts to be deleted up to max_items
-    ret_parts = storage.select(
-        columns(
-            &DBMultipart::upload_id, &DBMultipart::path_uuid,
-            &DBMultipartPart::id
-        ),
-        inner_join<DBMultipart>(
-            on(is_equal(&DBMultipart::upload_id, &DBMultipartPart::upload_id))
-        ),
-        where(
+    return conn->run_on_writer([&](Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      // get first the list of parts to be deleted up to max_items
+      ret_parts = storage.select(
+          columns(
+              &DBMultipart::upload_id, &DBMultipart::path_uuid,
+              &DBMultipartPart::id
+          ),
+          inner_join<DBMultipart>(
+              on(is_equal(&DBMultipart::upload_id, &DBMultipartPart::upload_id))
+          ),
+          where(
+              is_equal(&DBMultipart::state, MultipartState::DONE) or
+              is_equal(&DBMultipart::state, MultipartState::ABORTED)
+          ),
+          order_by(&DBMultipartPart::id), limit(max_items)
+      );
+      // extract the ids from the query.
+      // we'll use the ids to delete them with remove_all where in.
+      std::vector<int> ids;
+      ids.reserve(ret_parts.size());
+      std::ranges::transform(
+          ret_parts, std::back_inserter(ids),
+          [](DBDeletedMultipartItem item) -> int { return get_part_id(item); }
+      );
+      ceph_assert(ids.size() == ret_parts.size());
+      if (ret_parts.size() == 0) {
+        // there are no pending parts for this bucket
+        // we can safely delete all multiparts in it.
+        // This will take care of multiparts that had 0 parts initially
+        storage.remove_all<DBMultipart>(where(
             is_equal(&DBMultipart::state, MultipartState::DONE) or
             is_equal(&DBMultipart::state, MultipartState::ABORTED)
-        ),
-        order_by(&DBMultipartPart::id), limit(max_items)
-    );
-    // extract the ids from the query.
-    // we'll use the ids to delete them with remove_all where in.
-    std::vector<int> ids;
-    ids.reserve(ret_parts.size());
-    std::ranges::transform(
-        ret_parts, std::back_inserter(ids),
-        [](DBDeletedMultipartItem item) -> int { return get_part_id(item); }
-    );
-    ceph_assert(ids.size() == ret_parts.size());
-    if (ret_parts.size() == 0) {
-      // there are no pending parts for this bucket
-      // we can safely delete all multiparts in it.
-      // This will take care of multiparts that had 0 parts initially
-      storage.remove_all<DBMultipart>(where(
-          is_equal(&DBMultipart::state, MultipartState::DONE) or
-          is_equal(&DBMultipart::state, MultipartState::ABORTED)
-      ));
-      transaction.commit();
-      return ret_parts;
-    }
-    // remove the parts selected
-    storage.remove_all<DBMultipartPart>(where(in(&DBMultipartPart::id, ids)));
-
-    // now check if the multipart holding the part is empty
-    std::map<std::string, bool> already_checked_mp;
-    for (auto const& part : ret_parts) {
-      auto upload_id = get_upload_id(part);
-      if (already_checked_mp.find(upload_id) == already_checked_mp.end()) {
-        already_checked_mp[upload_id] = true;
-
-        auto nb_parts = storage.count(
-            &DBMultipartPart::id,
-            where(is_equal(&DBMultipartPart::upload_id, upload_id))
-        );
-        if (nb_parts == 0) {
-          // delete this multipart as it has no parts
-          storage.remove_all<DBMultipart>(
-              where(is_equal(&DBMultipart::upload_id, upload_id))
+        ));
+        transaction.commit();
+        return ret_parts;
+      }
+      // remove the parts selected
+      storage.remove_all<DBMultipartPart>(where(in(&DBMultipartPart::id, ids)));
+
+      // now check if the multipart holding the part is empty
+      std::map<std::string, bool> already_checked_mp;
+      for (auto const& part : ret_parts) {
+        auto upload_id = get_upload_id(part);
+        if (already_checked_mp.find(upload_id) == already_checked_mp.end()) {
+          already_checked_mp[upload_id] = true;
+
+          auto nb_parts = storage.count(
+              &DBMultipartPart::id,
+              where(is_equal(&DBMultipartPart::upload_id, upload_id))
           );
+          if (nb_parts == 0) {
+            // delete this multipart as it has no parts
+            storage.remove_all<DBMultipart>(
+                where(is_equal(&DBMultipart::upload_id, upload_id))
+            );
+          }
         }
       }
-    }
-    transaction.commit();
-    return ret_parts;
+      transaction.commit();
+      return ret_parts;
+    });
   });
   return retry.run();
 }
@@ -147,10 +147,13 @@ class SQLiteMultipart {
    *
    * @param upload_id The upload ID.
    * @param part_num The part's number.
+   * @param upload If set, the upload's state in DBConn::multipart_registry,
+   * where the upload is registered.
    * @return std::optional<DBMultipartPart>
    */
   std::optional<DBMultipartPart> create_or_reset_part(
-      const std::string& upload_id, uint32_t part_num, std::string* error_str
+      const std::string& upload_id, uint32_t part_num, std::string* error_str,
+      std::shared_ptr<MultipartUploadState>* upload = nullptr
   ) const;
 
   /**
@@ -160,12 +163,13 @@ class SQLiteMultipart {
    * @param part_num The part's number.
    * @param etag The part's etag.
    * @param bytes_written Number of bytes written during this part's upload.
+   * @param mtime If set, the part's modification time.
    * @return true The database was properly updated with this information.
    * @return false The database was not updated.
    */
   bool finish_part(
       const std::string& upload_id, uint32_t part_num, const std::string& etag,
-      uint64_t bytes_written
+      uint64_t bytes_written, ceph::real_time* mtime = nullptr
   ) const;
 
   /**
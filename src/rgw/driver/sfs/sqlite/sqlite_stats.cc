@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "sqlite_stats.h"
+
+#include <algorithm>
+#include <map>
+#include <system_error>
+#include <tuple>
+
+using namespace sqlite_orm;
+
+namespace rgw::sal::sfs::sqlite {
+
+SQLiteStats::SQLiteStats(DBConnRef _conn) : conn(_conn) {}
+
+template <typename T>
+static SQLiteStats::Stats to_stats(const std::unique_ptr<T>& row) {
+  SQLiteStats::Stats stats;
+  if (row) {
+    // never report a negative value, even for broken counters
+    stats.size = std::max<int64_t>(row->size, 0);
+    stats.size_rounded = std::max<int64_t>(row->size_rounded, 0);
+    stats.obj_count = std::max<int64_t>(row->obj_count, 0);
+  }
+  return stats;
+}
+
+SQLiteStats::Stats SQLiteStats::get_bucket_stats(const std::string& bucket_id
+) const {
+  auto& storage = conn->get_storage();
+  return to_stats(storage.get_pointer<DBBucketStats>(bucket_id));
+}
+
+SQLiteStats::Stats SQLiteStats::get_user_stats(const std::string& user_id
+) const {
+  auto& storage = conn->get_storage();
+  return to_stats(storage.get_pointer<DBUserStats>(user_id));
+}
+
+/// Number of entries in `after` that differ from, or are missing in,
+/// `before`, plus the entries of `before` that are gone.
+template <typename T>
+static size_t count_changed(
+    const std::vector<T>& before, const std::vector<T>& after,
+    std::string T::*key
+) {
+  using Counters = std::tuple<int64_t, int64_t, int64_t>;
+  std::map<std::string, Counters> old_counters;
+  for (const auto& row : before) {
+    old_counters[row.*key] = {row.size, row.size_rounded, row.obj_count};
+  }
+  size_t changed = 0;
+  for (const auto& row : after) {
+    auto it = old_counters.find(row.*key);
+    if (it == old_counters.end()) {
+      changed++;
+      continue;
+    }
+    if (it->second != Counters{row.size, row.size_rounded, row.obj_count}) {
+      changed++;
+    }
+    old_counters.erase(it);
+  }
+  // rows left had no committed version anymore, unless they were zero
+  for (const auto& entry : old_counters) {
+    if (entry.second != Counters{0, 0, 0}) {
+      changed++;
+    }
+  }
+  return changed;
+}
+
+SQLiteStats::RebuildResult SQLiteStats::rebuild() const {
+  return conn->run_on_writer([this](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    const auto old_buckets = storage.get_all<DBBucketStats>();
+    const auto old_users = storage.get_all<DBUserStats>();
+    storage.remove_all<DBBucketStats>();
+    storage.remove_all<DBUserStats>();
+    std::string errmsg;
+    const auto rc = fill_stats_tables(conn->get_writer_db(), &errmsg);
+    if (rc != SQLITE_OK) {
+      throw std::system_error(rc, get_sqlite_error_category(), errmsg);
+    }
+    const auto new_buckets = storage.get_all<DBBucketStats>();
+    const auto new_users = storage.get_all<DBUserStats>();
+    transaction.commit();
+
+    RebuildResult result;
+    result.buckets = new_buckets.size();
+    result.users = new_users.size();
+    result.buckets_fixed =
+        count_changed(old_buckets, new_buckets, &DBBucketStats::bucket_id);
+    result.users_fixed =
+        count_changed(old_users, new_users, &DBUserStats::user_id);
+    return result;
+  });
+}
+
+}  // namespace rgw::sal::sfs::sqlite
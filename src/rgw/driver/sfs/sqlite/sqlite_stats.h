@@ -0,0 +1,60 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include "dbconn.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+/// Usage counters of buckets and users.
+///
+/// The counters are kept up to date by triggers on the versioned objects
+/// table, so reading them is a primary key lookup instead of an
+/// aggregate over all the versions.
+class SQLiteStats {
+  DBConnRef conn;
+
+ public:
+  explicit SQLiteStats(DBConnRef _conn);
+  virtual ~SQLiteStats() = default;
+
+  SQLiteStats(const SQLiteStats&) = delete;
+  SQLiteStats& operator=(const SQLiteStats&) = delete;
+
+  struct Stats {
+    uint64_t size{0};
+    uint64_t size_rounded{0};
+    uint64_t obj_count{0};
+  };
+
+  struct RebuildResult {
+    size_t buckets{0};
+    size_t users{0};
+    /// number of buckets and users whose counters were wrong
+    size_t buckets_fixed{0};
+    size_t users_fixed{0};
+  };
+
+  /// Stats of a bucket or user. Those without any committed version have
+  /// no row and all their counters are 0.
+  Stats get_bucket_stats(const std::string& bucket_id) const;
+  Stats get_user_stats(const std::string& user_id) const;
+
+  /// Recomputes every counter from the committed versions, in a single
+  /// transaction. Only needed if the counters went out of sync, e.g.
+  /// after editing the database by hand.
+  RebuildResult rebuild() const;
+};
+
+}  // namespace rgw::sal::sfs::sqlite
@@ -26,7 +26,7 @@ SQLiteUsers::SQLiteUsers(DBConnRef _conn) : conn(_conn) {}
 
 std::optional<DBOPUserInfo> SQLiteUsers::get_user(const std::string& userid
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto user = storage.get_pointer<DBUser>(userid);
   std::optional<DBOPUserInfo> ret_value;
   if (user) {
@@ -49,40 +49,56 @@ std::optional<DBOPUserInfo> SQLiteUsers::get_user_by_email(
 std::optional<DBOPUserInfo> SQLiteUsers::get_user_by_access_key(
     const std::string& key
 ) const {
-  auto storage = conn->get_storage();
+  auto cached = conn->user_cache.find(key);
+  if (cached.has_value()) {
+    return cached;
+  }
+  const auto generation = conn->user_cache.get_generation();
+  auto& storage = conn->get_storage();
   auto user_id = _get_user_id_by_access_key(storage, key);
   std::optional<DBOPUserInfo> ret_value;
   if (user_id.has_value()) {
-    auto user = storage.get_pointer<DBUser>(user_id);
+    auto user = conn->execute_prepared(
+        storage, "users.get", get_pointer<DBUser>(*user_id)
+    );
     if (user) {
       ret_value = get_rgw_user(*user);
+      conn->user_cache.add(key, *ret_value, generation);
     }
   }
   return ret_value;
 }
 
 std::vector<std::string> SQLiteUsers::get_user_ids() const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   return storage.select(&DBUser::user_id);
 }
 
 void SQLiteUsers::store_user(const DBOPUserInfo& user) const {
-  auto storage = conn->get_storage();
   auto db_user = get_db_user(user);
-  storage.replace(db_user);
-  _store_access_keys(storage, user);
+  conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    storage.replace(db_user);
+    _store_access_keys(storage, user);
+    transaction.commit();
+  });
+  conn->user_cache.invalidate();
 }
 
 void SQLiteUsers::remove_user(const std::string& userid) const {
-  auto storage = conn->get_storage();
-  _remove_access_keys(storage, userid);
-  storage.remove<DBUser>(userid);
+  conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    _remove_access_keys(storage, userid);
+    storage.remove<DBUser>(userid);
+    transaction.commit();
+  });
+  conn->user_cache.invalidate();
 }
 
 template <class... Args>
 std::vector<DBOPUserInfo> SQLiteUsers::get_users_by(Args... args) const {
   std::vector<DBOPUserInfo> users_return;
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto users = storage.get_all<DBUser>(args...);
   for (auto& user : users) {
     users_return.push_back(get_rgw_user(user));
@@ -91,7 +107,7 @@ std::vector<DBOPUserInfo> SQLiteUsers::get_users_by(Args... args) const {
 }
 
 void SQLiteUsers::_store_access_keys(
-    rgw::sal::sfs::sqlite::Storage storage, const DBOPUserInfo& user
+    rgw::sal::sfs::sqlite::Storage& storage, const DBOPUserInfo& user
 ) const {
   // remove existing keys for the user (in case any of them had changed)
   _remove_access_keys(storage, user.uinfo.user_id.id);
@@ -104,16 +120,18 @@ void SQLiteUsers::_store_access_keys(
 }
 
 void SQLiteUsers::_remove_access_keys(
-    rgw::sal::sfs::sqlite::Storage storage, const std::string& userid
+    rgw::sal::sfs::sqlite::Storage& storage, const std::string& userid
 ) const {
   storage.remove_all<DBAccessKey>(where(c(&DBAccessKey::user_id) = userid));
 }
 
 std::optional<std::string> SQLiteUsers::_get_user_id_by_access_key(
-    rgw::sal::sfs::sqlite::Storage storage, const std::string& key
+    rgw::sal::sfs::sqlite::Storage& storage, const std::string& key
 ) const {
-  auto keys =
-      storage.get_all<DBAccessKey>(where(c(&DBAccessKey::access_key) = key));
+  auto keys = conn->execute_prepared(
+      storage, "users.access_keys_by_key",
+      get_all<DBAccessKey>(where(c(&DBAccessKey::access_key) = key))
+  );
   std::optional<std::string> ret_value;
   if (keys.size() > 0) {
     // in case we have 2 keys that are equal in different users we return
@@ -41,13 +41,13 @@ class SQLiteUsers {
   std::vector<DBOPUserInfo> get_users_by(Args... args) const;
 
   void _store_access_keys(
-      rgw::sal::sfs::sqlite::Storage storage, const DBOPUserInfo& user
+      rgw::sal::sfs::sqlite::Storage& storage, const DBOPUserInfo& user
   ) const;
   void _remove_access_keys(
-      rgw::sal::sfs::sqlite::Storage storage, const std::string& userid
+      rgw::sal::sfs::sqlite::Storage& storage, const std::string& userid
   ) const;
   std::optional<std::string> _get_user_id_by_access_key(
-      rgw::sal::sfs::sqlite::Storage storage, const std::string& key
+      rgw::sal::sfs::sqlite::Storage& storage, const std::string& key
   ) const;
 };
 
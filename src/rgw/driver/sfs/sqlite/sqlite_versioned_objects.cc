@@ -15,7 +15,11 @@
 
 #include <sqlite_orm/sqlite_orm.h>
 
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <optional>
+#include <set>
 #include <stdexcept>
 #include <system_error>
 
@@ -31,10 +35,123 @@ namespace rgw::sal::sfs::sqlite {
 
 SQLiteVersionedObjects::SQLiteVersionedObjects(DBConnRef _conn) : conn(_conn) {}
 
+/// Values bound to a single statement. SQLite builds take at least 999.
+static constexpr size_t MAX_STATEMENT_VALUES = 500;
+
+/// Calls `func` with consecutive chunks of `values`, each short enough
+/// to be bound to a single statement
+template <typename T, typename Func>
+static void for_each_chunk(const std::vector<T>& values, Func&& func) {
+  for (size_t begin = 0; begin < values.size();
+       begin += MAX_STATEMENT_VALUES) {
+    const auto end = std::min(values.size(), begin + MAX_STATEMENT_VALUES);
+    func(std::vector<T>(values.begin() + begin, values.begin() + end));
+  }
+}
+
+/// Updates version `object` if it is in one of `allowed_states`
+static auto update_versioned_object_if_state(
+    const DBVersionedObject& object,
+    const std::vector<ObjectState>& allowed_states
+) {
+  return update_all(
+        set(c(&DBVersionedObject::object_id) = object.object_id,
+            c(&DBVersionedObject::checksum) = object.checksum,
+            c(&DBVersionedObject::size) = object.size,
+            c(&DBVersionedObject::create_time) = object.create_time,
+            c(&DBVersionedObject::delete_time) = object.delete_time,
+            c(&DBVersionedObject::commit_time) = object.commit_time,
+            c(&DBVersionedObject::mtime) = object.mtime,
+            c(&DBVersionedObject::object_state) = object.object_state,
+            c(&DBVersionedObject::version_id) = object.version_id,
+            c(&DBVersionedObject::etag) = object.etag,
+            c(&DBVersionedObject::attrs) = object.attrs,
+            c(&DBVersionedObject::version_type) = object.version_type,
+            c(&DBVersionedObject::inline_data) = object.inline_data),
+        where(
+            is_equal(&DBVersionedObject::id, object.id) and
+            in(&DBVersionedObject::object_state, allowed_states)
+        )
+  );
+}
+
+/// The DBSharedData a copy of version `src_id` shares the data files
+/// of: the one of `src_id`, as a copy of a copy shares the data of the
+/// original. Returns nullopt if `src_id` was removed.
+static std::optional<DBSharedData> get_data_to_share(
+    Storage& storage, uint src_id
+) {
+  auto data = storage.get_pointer<DBSharedData>(src_id);
+  if (data) {
+    return *data;
+  }
+  auto src = storage.get_pointer<DBVersionedObject>(src_id);
+  if (!src) {
+    return std::nullopt;
+  }
+  return DBSharedData{src->id, src->id, src->object_id};
+}
+
+/// Makes version `dst_id` share `data`, the data of version `src_id`, and
+/// the parts it is stored in, instead of having files of its own
+static void share_data(
+    Storage& storage, uint src_id, uint dst_id, const DBSharedData& data
+) {
+  storage.replace(data);
+  storage.replace(
+      DBSharedData{dst_id, data.data_version_id, data.data_object_id}
+  );
+  auto parts = storage.get_all<DBVersionedObjectPart>(
+      where(is_equal(&DBVersionedObjectPart::versioned_object_id, src_id))
+  );
+  for (auto& part : parts) {
+    part.versioned_object_id = dst_id;
+    storage.replace(part);
+  }
+}
+
+/// Stores `object` if it is in one of `allowed_states`, along with
+/// `db_object` and `data` if set. Returns false if it didn't.
+static bool store_versioned_object_if_state(
+    const DBConn& conn, Storage& storage, const DBVersionedObject& object,
+    const std::vector<ObjectState>& allowed_states, const DBObject* db_object,
+    const DBVersionData* data
+) {
+  // read before anything is written, nothing to roll back if it's gone
+  std::optional<DBSharedData> shared;
+  if (data && data->shared_data_of.has_value()) {
+    shared = get_data_to_share(storage, *data->shared_data_of);
+    if (!shared.has_value()) {
+      return false;
+    }
+  }
+  if (db_object) {
+    storage.replace(*db_object);
+  }
+  conn.execute_prepared(
+      storage, "versioned_objects.update_if_state",
+      update_versioned_object_if_state(object, allowed_states),
+      allowed_states.size()
+  );
+  if (storage.changes() == 0) {
+    return false;
+  }
+  if (data && !data->parts.empty()) {
+    storage.replace_range(data->parts.begin(), data->parts.end());
+  }
+  if (data && data->packed.has_value()) {
+    storage.replace(*data->packed);
+  }
+  if (shared.has_value()) {
+    share_data(storage, *data->shared_data_of, object.id, *shared);
+  }
+  return true;
+}
+
 std::optional<DBVersionedObject> SQLiteVersionedObjects::get_versioned_object(
     uint id, bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto object = storage.get_pointer<DBVersionedObject>(id);
   std::optional<DBVersionedObject> ret_value;
   if (object) {
@@ -48,7 +165,7 @@ std::optional<DBVersionedObject> SQLiteVersionedObjects::get_versioned_object(
 std::optional<DBVersionedObject> SQLiteVersionedObjects::get_versioned_object(
     const std::string& version_id, bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto versioned_objects = storage.get_all<DBVersionedObject>(
       where(c(&DBVersionedObject::version_id) = version_id)
   );
@@ -79,7 +196,7 @@ SQLiteVersionedObjects::get_committed_versioned_object(
 DBObjectsListItems SQLiteVersionedObjects::list_last_versioned_objects(
     const std::string& bucket_id
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto results = storage.select(
       columns(
           &DBObject::uuid, &DBObject::name, &DBVersionedObject::version_id,
@@ -104,102 +221,177 @@ DBObjectsListItems SQLiteVersionedObjects::list_last_versioned_objects(
 uint SQLiteVersionedObjects::insert_versioned_object(
     const DBVersionedObject& object
 ) const {
-  auto storage = conn->get_storage();
-  return storage.insert(object);
+  return conn->run_batched([&](Storage& storage) {
+    return storage.insert(object);
+  });
 }
 
 void SQLiteVersionedObjects::store_versioned_object(
     const DBVersionedObject& object
 ) const {
-  auto storage = conn->get_storage();
-  storage.update(object);
+  conn->run_batched([&](Storage& storage) { storage.update(object); });
 }
 
 bool SQLiteVersionedObjects::store_versioned_object_if_state(
-    const DBVersionedObject& object, std::vector<ObjectState> allowed_states
+    const DBVersionedObject& object, std::vector<ObjectState> allowed_states,
+    const DBObject* db_object, const DBVersionData* data, optional_yield y
 ) const {
-  auto storage = conn->get_storage();
-  auto transaction = storage.transaction_guard();
-  transaction.commit_on_destroy = true;
-  storage.update_all(
-      set(c(&DBVersionedObject::object_id) = object.object_id,
-          c(&DBVersionedObject::checksum) = object.checksum,
-          c(&DBVersionedObject::size) = object.size,
-          c(&DBVersionedObject::create_time) = object.create_time,
-          c(&DBVersionedObject::delete_time) = object.delete_time,
-          c(&DBVersionedObject::commit_time) = object.commit_time,
-          c(&DBVersionedObject::mtime) = object.mtime,
-          c(&DBVersionedObject::object_state) = object.object_state,
-          c(&DBVersionedObject::version_id) = object.version_id,
-          c(&DBVersionedObject::etag) = object.etag,
-          c(&DBVersionedObject::attrs) = object.attrs,
-          c(&DBVersionedObject::version_type) = object.version_type),
-      where(
-          is_equal(&DBVersionedObject::id, object.id) and
-          in(&DBVersionedObject::object_state, allowed_states)
-      )
+  return conn->run_batched(
+      [&](Storage& storage) {
+        return sqlite::store_versioned_object_if_state(
+            *conn, storage, object, allowed_states, db_object, data
+        );
+      },
+      y
   );
-  return storage.changes() > 0;
 }
 
 bool SQLiteVersionedObjects::
     store_versioned_object_delete_committed_transact_if_state(
-        const DBVersionedObject& object, std::vector<ObjectState> allowed_states
+        const DBVersionedObject& object, std::vector<ObjectState> allowed_states,
+        const DBObject* db_object, const DBVersionData* data, optional_yield y
     ) const {
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<bool> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    storage.update_all(
-        set(c(&DBVersionedObject::object_id) = object.object_id,
-            c(&DBVersionedObject::checksum) = object.checksum,
-            c(&DBVersionedObject::size) = object.size,
-            c(&DBVersionedObject::create_time) = object.create_time,
-            c(&DBVersionedObject::delete_time) = object.delete_time,
-            c(&DBVersionedObject::commit_time) = object.commit_time,
-            c(&DBVersionedObject::mtime) = object.mtime,
-            c(&DBVersionedObject::object_state) = object.object_state,
-            c(&DBVersionedObject::version_id) = object.version_id,
-            c(&DBVersionedObject::etag) = object.etag,
-            c(&DBVersionedObject::attrs) = object.attrs,
-            c(&DBVersionedObject::version_type) = object.version_type),
-        where(
-            is_equal(&DBVersionedObject::id, object.id) and
-            in(&DBVersionedObject::object_state, allowed_states)
-        )
+    return conn->run_batched(
+        [&](Storage& storage) {
+          if (!sqlite::store_versioned_object_if_state(
+                  *conn, storage, object, allowed_states, db_object, data
+              )) {
+            return false;
+          }
+
+          // soft delete all other _COMMITTED_ versions. Leave OPEN versions
+          // alone, as they may be an in progress write racing us.
+          storage.update_all(
+              set(c(&DBVersionedObject::object_state) = ObjectState::DELETED),
+              where(
+                  is_equal(&DBVersionedObject::object_id, object.object_id) and
+                  is_equal(
+                      &DBVersionedObject::object_state, ObjectState::COMMITTED
+                  ) and
+                  is_not_equal(&DBVersionedObject::id, object.id)
+              )
+          );
+          return true;
+        },
+        y
     );
-    if (storage.changes() == 0) {
-      transaction.rollback();
-      return false;
-    }
+  });
+  const auto result = retry.run();
+  return result.has_value() ? result.value() : false;
+}
+
+void SQLiteVersionedObjects::remove_versioned_object(uint id) const {
+  conn->run_batched([&](Storage& storage) {
+    storage.remove<DBVersionedObject>(id);
+  });
+}
 
-    // soft delete all other _COMMITTED_ versions. Leave OPEN versions
-    // alone, as they may be an in progress write racing us.
+std::vector<DBVersionedObjectPart>
+SQLiteVersionedObjects::get_versioned_object_parts(uint id) const {
+  auto& storage = conn->get_storage();
+  return storage.get_all<DBVersionedObjectPart>(
+      where(is_equal(&DBVersionedObjectPart::versioned_object_id, id)),
+      order_by(&DBVersionedObjectPart::object_offset)
+  );
+}
+
+void SQLiteVersionedObjects::store_versioned_object_parts(
+    const std::vector<DBVersionedObjectPart>& parts
+) const {
+  if (parts.empty()) {
+    return;
+  }
+  conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    storage.replace_range(parts.begin(), parts.end());
+    transaction.commit();
+  });
+}
+
+std::optional<DBPackedObject> SQLiteVersionedObjects::get_packed_object(uint id
+) const {
+  auto& storage = conn->get_storage();
+  auto packed = storage.get_pointer<DBPackedObject>(id);
+  if (!packed) {
+    return std::nullopt;
+  }
+  return *packed;
+}
+
+void SQLiteVersionedObjects::store_packed_object(const DBPackedObject& packed
+) const {
+  conn->run_batched([&](Storage& storage) { storage.replace(packed); });
+}
+
+std::vector<DBPackedObject> SQLiteVersionedObjects::get_packed_objects(
+    uint64_t segment_id
+) const {
+  auto& storage = conn->get_storage();
+  return storage.get_all<DBPackedObject>(
+      where(is_equal(&DBPackedObject::segment_id, segment_id)),
+      order_by(&DBPackedObject::segment_offset)
+  );
+}
+
+std::optional<DBSharedData> SQLiteVersionedObjects::get_shared_data(uint id
+) const {
+  auto& storage = conn->get_storage();
+  auto shared = storage.get_pointer<DBSharedData>(id);
+  if (!shared) {
+    return std::nullopt;
+  }
+  return *shared;
+}
+
+bool SQLiteVersionedObjects::relocate_packed_object(
+    const DBPackedObject& packed, uint64_t segment_id, uint64_t segment_offset
+) const {
+  return conn->run_batched([&](Storage& storage) {
     storage.update_all(
-        set(c(&DBVersionedObject::object_state) = ObjectState::DELETED),
+        set(c(&DBPackedObject::segment_id) = segment_id,
+            c(&DBPackedObject::segment_offset) = segment_offset),
         where(
-            is_equal(&DBVersionedObject::object_id, object.object_id) and
             is_equal(
-                &DBVersionedObject::object_state, ObjectState::COMMITTED
+                &DBPackedObject::versioned_object_id,
+                packed.versioned_object_id
             ) and
-            is_not_equal(&DBVersionedObject::id, object.id)
+            is_equal(&DBPackedObject::segment_id, packed.segment_id) and
+            is_equal(&DBPackedObject::segment_offset, packed.segment_offset)
         )
     );
-    transaction.commit();
-    return true;
+    return storage.changes() > 0;
   });
-  const auto result = retry.run();
-  return result.has_value() ? result.value() : false;
 }
 
-void SQLiteVersionedObjects::remove_versioned_object(uint id) const {
-  auto storage = conn->get_storage();
-  storage.remove<DBVersionedObject>(id);
+std::vector<DBPackedSegment> SQLiteVersionedObjects::get_packed_segments(
+) const {
+  auto& storage = conn->get_storage();
+  return storage.get_all<DBPackedSegment>(order_by(&DBPackedSegment::id));
+}
+
+bool SQLiteVersionedObjects::remove_packed_segment_if_unused(uint64_t id
+) const {
+  return conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    const auto used = storage.count<DBPackedObject>(
+        where(is_equal(&DBPackedObject::segment_id, id))
+    );
+    if (used > 0) {
+      return false;
+    }
+    storage.remove_all<DBPackedSegment>(
+        where(is_equal(&DBPackedSegment::id, id))
+    );
+    transaction.commit();
+    return true;
+  });
 }
 
 std::vector<uint> SQLiteVersionedObjects::get_versioned_object_ids(
     bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   if (filter_deleted) {
     return storage.select(
         &DBVersionedObject::id,
@@ -214,7 +406,7 @@ std::vector<uint> SQLiteVersionedObjects::get_versioned_object_ids(
 std::vector<uint> SQLiteVersionedObjects::get_versioned_object_ids(
     const uuid_d& object_id, bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto uuid = object_id.to_string();
   if (filter_deleted) {
     return storage.select(
@@ -233,7 +425,7 @@ std::vector<uint> SQLiteVersionedObjects::get_versioned_object_ids(
 std::vector<DBVersionedObject> SQLiteVersionedObjects::get_versioned_objects(
     const uuid_d& object_id, bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto uuid = object_id.to_string();
   if (filter_deleted) {
     return storage.get_all<DBVersionedObject>(
@@ -253,7 +445,7 @@ std::optional<DBVersionedObject>
 SQLiteVersionedObjects::get_last_versioned_object(
     const uuid_d& object_id, bool filter_deleted
 ) const {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   std::vector<std::tuple<uint, std::unique_ptr<ceph::real_time>>>
       max_commit_time_ids;
   // we are looking for the ids that match the object_id with the highest
@@ -298,31 +490,30 @@ SQLiteVersionedObjects::delete_version_and_get_previous_transact(
     const uuid_d& object_id, uint id
 ) const {
   try {
-    auto storage = conn->get_storage();
-    auto transaction = storage.transaction_guard();
-    std::optional<DBVersionedObject> ret_value = std::nullopt;
-    storage.remove<DBVersionedObject>(id);
-    if (storage.changes()) {
-      // get the last version of the object now
-      auto last_version_select = storage.get_all<DBVersionedObject>(
-          where(
-              is_equal(&DBVersionedObject::object_id, object_id) and
-              is_not_equal(
-                  &DBVersionedObject::object_state, ObjectState::DELETED
-              )
-          ),
-          multi_order_by(
-              order_by(&DBVersionedObject::commit_time).desc(),
-              order_by(&DBVersionedObject::id).desc()
-          ),
-          limit(1)
-      );
-      if (!last_version_select.empty()) {
-        ret_value = last_version_select[0];
+    return conn->run_batched([&](Storage& storage) {
+      std::optional<DBVersionedObject> ret_value = std::nullopt;
+      storage.remove<DBVersionedObject>(id);
+      if (storage.changes()) {
+        // get the last version of the object now
+        auto last_version_select = storage.get_all<DBVersionedObject>(
+            where(
+                is_equal(&DBVersionedObject::object_id, object_id) and
+                is_not_equal(
+                    &DBVersionedObject::object_state, ObjectState::DELETED
+                )
+            ),
+            multi_order_by(
+                order_by(&DBVersionedObject::commit_time).desc(),
+                order_by(&DBVersionedObject::id).desc()
+            ),
+            limit(1)
+        );
+        if (!last_version_select.empty()) {
+          ret_value = last_version_select[0];
+        }
       }
-      transaction.commit();
-    }
-    return ret_value;
+      return ret_value;
+    });
   } catch (const std::system_error& e) {
     // throw exception (will be caught later in the sfs logic)
     // TODO revisit this when error handling is defined
@@ -331,44 +522,47 @@ SQLiteVersionedObjects::delete_version_and_get_previous_transact(
 }
 
 uint SQLiteVersionedObjects::add_delete_marker_transact(
-    const uuid_d& object_id, const std::string& delete_marker_id, bool& added
+    const uuid_d& object_id, const std::string& delete_marker_id, bool& added,
+    optional_yield y
 ) const {
   uint ret_id{0};
   added = false;
   try {
-    auto storage = conn->get_storage();
-    auto transaction = storage.transaction_guard();
-    auto last_version_select = storage.get_all<DBVersionedObject>(
-        where(
-            is_equal(&DBVersionedObject::object_id, object_id) and
-            is_not_equal(&DBVersionedObject::object_state, ObjectState::DELETED)
-        ),
-        multi_order_by(
-            order_by(&DBVersionedObject::commit_time).desc(),
-            order_by(&DBVersionedObject::id).desc()
-        ),
-        limit(1)
-    );
+    conn->run_batched(
+        [&](Storage& storage) {
+          auto last_version_select = storage.get_all<DBVersionedObject>(
+              where(
+                  is_equal(&DBVersionedObject::object_id, object_id) and
+                  is_not_equal(
+                      &DBVersionedObject::object_state, ObjectState::DELETED
+                  )
+              ),
+              multi_order_by(
+                  order_by(&DBVersionedObject::commit_time).desc(),
+                  order_by(&DBVersionedObject::id).desc()
+              ),
+              limit(1)
+          );
 
-    if (!last_version_select.empty()) {
-      auto last_version = last_version_select[0];
-      if ((last_version.object_state == ObjectState::COMMITTED ||
-           last_version.object_state == ObjectState::OPEN) &&
-          last_version.version_type == VersionType::REGULAR) {
-        auto now = ceph::real_clock::now();
-        last_version.version_type = VersionType::DELETE_MARKER;
-        last_version.object_state = ObjectState::COMMITTED;
-        last_version.commit_time = now;
-        last_version.delete_time = now;
-        last_version.mtime = now;
-        last_version.version_id = delete_marker_id;
-        ret_id = storage.insert(last_version);
-        added = true;
-        // only commit if the delete maker was indeed inserted.
-        // the rest of calls in this transaction are read operations
-        transaction.commit();
-      }
-    }
+          if (!last_version_select.empty()) {
+            auto last_version = last_version_select[0];
+            if ((last_version.object_state == ObjectState::COMMITTED ||
+                 last_version.object_state == ObjectState::OPEN) &&
+                last_version.version_type == VersionType::REGULAR) {
+              auto now = ceph::real_clock::now();
+              last_version.version_type = VersionType::DELETE_MARKER;
+              last_version.object_state = ObjectState::COMMITTED;
+              last_version.commit_time = now;
+              last_version.delete_time = now;
+              last_version.mtime = now;
+              last_version.version_id = delete_marker_id;
+              ret_id = storage.insert(last_version);
+              added = true;
+            }
+          }
+        },
+        y
+    );
   } catch (const std::system_error& e) {
     // throw exception (will be caught later in the sfs logic)
     // TODO revisit this when error handling is defined
@@ -377,22 +571,199 @@ uint SQLiteVersionedObjects::add_delete_marker_transact(
   return ret_id;
 }
 
+bool SQLiteVersionedObjects::delete_objects_transact(
+    const std::string& bucket_id, bool versioned,
+    std::vector<DBDeleteObjectKey>& keys, optional_yield y
+) const {
+  // What deleting a key does depends on what the keys before it did to
+  // the same object. The live (not deleted) versions of all objects are
+  // read at once and updated in memory, key by key, collecting the
+  // changes to write with a few statements at the end.
+  struct ObjectVersions {
+    std::optional<uuid_d> uuid;
+    /// latest first, as add_delete_marker_transact() orders them
+    std::vector<DBVersionedObject> live;
+  };
+  RetrySQLiteBusy<bool> retry([&]() {
+    return conn->run_batched(
+        [&](Storage& storage) {
+          std::vector<std::string> names;
+          names.reserve(keys.size());
+          for (const auto& key : keys) {
+            names.push_back(key.name);
+          }
+          std::sort(names.begin(), names.end());
+          names.erase(std::unique(names.begin(), names.end()), names.end());
+
+          std::map<std::string, ObjectVersions> objects;
+          std::map<uuid_d, ObjectVersions*> by_uuid;
+          for_each_chunk(names, [&](const std::vector<std::string>& chunk) {
+            const auto rows = storage.select(
+                columns(&DBObject::uuid, &DBObject::name),
+                where(
+                    is_equal(&DBObject::bucket_id, bucket_id) and
+                    in(&DBObject::name, chunk)
+                )
+            );
+            for (const auto& [uuid, name] : rows) {
+              auto& object = objects[name];
+              object.uuid = uuid;
+              by_uuid[uuid] = &object;
+            }
+            const auto versions = storage.get_all<DBVersionedObject>(
+                where(
+                    in(&DBVersionedObject::object_id,
+                       select(
+                           &DBObject::uuid,
+                           where(
+                               is_equal(&DBObject::bucket_id, bucket_id) and
+                               in(&DBObject::name, chunk)
+                           )
+                       )) and
+                    is_not_equal(
+                        &DBVersionedObject::object_state, ObjectState::DELETED
+                    )
+                ),
+                multi_order_by(
+                    order_by(&DBVersionedObject::commit_time).desc(),
+                    order_by(&DBVersionedObject::id).desc()
+                )
+            );
+            for (const auto& version : versions) {
+              by_uuid.at(version.object_id)->live.push_back(version);
+            }
+          });
+
+          const auto now = ceph::real_clock::now();
+          std::vector<DBObject> new_objects;
+          std::vector<DBVersionedObject> new_markers;
+          std::vector<uint> deleted_ids;
+          std::vector<uint> removed_marker_ids;
+          for (auto& key : keys) {
+            key.delete_marker_added = false;
+            key.deleted_size = 0;
+            key.deleted_etag.clear();
+            auto& object = objects[key.name];
+            auto& live = object.live;
+            // the version a lookup of the key finds, see
+            // get_committed_versioned_object()
+            const auto found = std::find_if(
+                live.begin(), live.end(),
+                [&key](const DBVersionedObject& version) {
+                  return version.object_state == ObjectState::COMMITTED &&
+                         (key.version_id.empty() ||
+                          version.version_id == key.version_id);
+                }
+            );
+            if (!versioned || !key.version_id.empty()) {
+              // markers added by this batch have no id yet, and can't be
+              // found by their version id before it returned
+              if (found == live.end() || found->id == 0) {
+                continue;
+              }
+              if (versioned &&
+                  found->version_type == VersionType::DELETE_MARKER) {
+                removed_marker_ids.push_back(found->id);
+              } else {
+                deleted_ids.push_back(found->id);
+                key.deleted_size = found->size;
+                key.deleted_etag = found->etag;
+              }
+              live.erase(found);
+              continue;
+            }
+
+            DBVersionedObject marker{};
+            if (found != live.end()) {
+              if (live.front().version_type != VersionType::REGULAR) {
+                // deleted already
+                continue;
+              }
+              // the version the marker hides
+              key.deleted_size = found->size;
+              key.deleted_etag = found->etag;
+              marker = live.front();
+            } else {
+              if (!object.uuid.has_value()) {
+                DBObject db_object;
+                db_object.uuid.generate_random();
+                db_object.bucket_id = bucket_id;
+                db_object.name = key.name;
+                object.uuid = db_object.uuid;
+                new_objects.push_back(std::move(db_object));
+              }
+              marker.object_id = *object.uuid;
+            }
+            marker.id = 0;
+            marker.version_type = VersionType::DELETE_MARKER;
+            marker.object_state = ObjectState::COMMITTED;
+            marker.commit_time = now;
+            marker.delete_time = now;
+            marker.mtime = now;
+            marker.version_id = key.delete_marker_id;
+            live.insert(live.begin(), marker);
+            new_markers.push_back(std::move(marker));
+            key.delete_marker_added = true;
+          }
+
+          for (const auto& db_object : new_objects) {
+            conn->execute_prepared(
+                storage, "objects.replace", replace(db_object)
+            );
+          }
+          for (const auto& marker : new_markers) {
+            conn->execute_prepared(
+                storage, "versioned_objects.insert", insert(marker)
+            );
+          }
+          for_each_chunk(deleted_ids, [&](const std::vector<uint>& ids) {
+            storage.update_all(
+                set(c(&DBVersionedObject::object_state) = ObjectState::DELETED,
+                    c(&DBVersionedObject::delete_time) = now,
+                    c(&DBVersionedObject::mtime) = now),
+                where(
+                    in(&DBVersionedObject::id, ids) and
+                    is_equal(
+                        &DBVersionedObject::object_state, ObjectState::COMMITTED
+                    )
+                )
+            );
+          });
+          for_each_chunk(removed_marker_ids, [&](const std::vector<uint>& ids) {
+            storage.remove_all<DBVersionedObject>(
+                where(in(&DBVersionedObject::id, ids))
+            );
+          });
+          return true;
+        },
+        y
+    );
+  });
+  const auto result = retry.run();
+  return result.has_value() ? result.value() : false;
+}
+
 std::optional<DBVersionedObject>
 SQLiteVersionedObjects::get_committed_versioned_object_specific_version(
     const std::string& bucket_id, const std::string& object_name,
     const std::string& version_id
 ) const {
-  auto storage = conn->get_storage();
-  auto ids = storage.select(
-      &DBVersionedObject::id,
-      inner_join<DBObject>(
-          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-      ),
-      where(
-          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED) and
-          is_equal(&DBObject::bucket_id, bucket_id) and
-          is_equal(&DBObject::name, object_name) and
-          is_equal(&DBVersionedObject::version_id, version_id)
+  auto& storage = conn->get_storage();
+  auto ids = conn->execute_prepared(
+      storage, "versioned_objects.committed_version_id",
+      select(
+          &DBVersionedObject::id,
+          inner_join<DBObject>(
+              on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
+          ),
+          where(
+              is_equal(
+                  &DBVersionedObject::object_state, ObjectState::COMMITTED
+              ) and
+              is_equal(&DBObject::bucket_id, bucket_id) and
+              is_equal(&DBObject::name, object_name) and
+              is_equal(&DBVersionedObject::version_id, version_id)
+          )
       )
   );
   // TODO return an error if this returns more than 1 version?
@@ -401,7 +772,9 @@ SQLiteVersionedObjects::get_committed_versioned_object_specific_version(
   ceph_assert(ids.size() <= 1);
   std::optional<DBVersionedObject> ret_value;
   if (ids.size() > 0) {
-    auto version = storage.get_pointer<DBVersionedObject>(ids[0]);
+    auto version = conn->execute_prepared(
+        storage, "versioned_objects.get", get_pointer<DBVersionedObject>(ids[0])
+    );
     if (version != nullptr) {
       ret_value = *version;
     }
@@ -415,27 +788,34 @@ SQLiteVersionedObjects::get_committed_versioned_object_last_version(
 ) const {
   // we don't have a version_id, so return the last available one that is
   // committed
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   std::optional<DBVersionedObject> ret_value = std::nullopt;
-  auto last_version_id = storage.select(
-      &DBVersionedObject::id,
-      inner_join<DBObject>(
-          on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
-      ),
-      where(
-          is_equal(&DBObject::bucket_id, bucket_id) and
-          is_equal(&DBObject::name, object_name) and
-          is_equal(&DBVersionedObject::object_state, ObjectState::COMMITTED)
-      ),
-      multi_order_by(
-          order_by(&DBVersionedObject::commit_time).desc(),
-          order_by(&DBVersionedObject::id).desc()
-      ),
-      limit(1)
+  auto last_version_id = conn->execute_prepared(
+      storage, "versioned_objects.committed_last_version_id",
+      select(
+          &DBVersionedObject::id,
+          inner_join<DBObject>(
+              on(is_equal(&DBObject::uuid, &DBVersionedObject::object_id))
+          ),
+          where(
+              is_equal(&DBObject::bucket_id, bucket_id) and
+              is_equal(&DBObject::name, object_name) and
+              is_equal(
+                  &DBVersionedObject::object_state, ObjectState::COMMITTED
+              )
+          ),
+          multi_order_by(
+              order_by(&DBVersionedObject::commit_time).desc(),
+              order_by(&DBVersionedObject::id).desc()
+          ),
+          limit(1)
+      )
   );
   if (!last_version_id.empty()) {
-    auto last_version =
-        storage.get_pointer<DBVersionedObject>(last_version_id[0]);
+    auto last_version = conn->execute_prepared(
+        storage, "versioned_objects.get",
+        get_pointer<DBVersionedObject>(last_version_id[0])
+    );
     if (last_version) {
       ret_value = *last_version;
     }
@@ -446,94 +826,117 @@ SQLiteVersionedObjects::get_committed_versioned_object_last_version(
 std::optional<DBVersionedObject>
 SQLiteVersionedObjects::create_new_versioned_object_transact(
     const std::string& bucket_id, const std::string& object_name,
-    const std::string& version_id
+    const std::string& version_id, optional_yield y
 ) const {
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<DBVersionedObject> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    auto objs = storage.select(
-        columns(&DBObject::uuid),
-        where(
-            is_equal(&DBObject::bucket_id, bucket_id) and
-            is_equal(&DBObject::name, object_name)
-        )
+    return conn->run_batched(
+        [&](Storage& storage) {
+          auto objs = conn->execute_prepared(
+              storage, "objects.uuid_by_name",
+              select(
+                  columns(&DBObject::uuid),
+                  where(
+                      is_equal(&DBObject::bucket_id, bucket_id) and
+                      is_equal(&DBObject::name, object_name)
+                  )
+              )
+          );
+          // should return none or 1
+          // TODO revisit this ceph_assert after error handling is defined
+          ceph_assert(objs.size() <= 1);
+          DBObject obj;
+          obj.name = object_name;
+          obj.bucket_id = bucket_id;
+          if (objs.size() == 0) {
+            // object does not exist
+            // create it
+            obj.uuid.generate_random();
+            conn->execute_prepared(storage, "objects.replace", replace(obj));
+          } else {
+            obj.uuid = std::get<0>(objs[0]);
+          }
+          // create the version now
+          DBVersionedObject version;
+          version.object_id = obj.uuid;
+          version.object_state = ObjectState::OPEN;
+          version.version_type = VersionType::REGULAR;
+          version.version_id = version_id;
+          version.create_time = ceph::real_clock::now();
+          version.id = conn->execute_prepared(
+              storage, "versioned_objects.insert", insert(version)
+          );
+          return version;
+        },
+        y
     );
-    // should return none or 1
-    // TODO revisit this ceph_assert after error handling is defined
-    ceph_assert(objs.size() <= 1);
-    DBObject obj;
-    obj.name = object_name;
-    obj.bucket_id = bucket_id;
-    if (objs.size() == 0) {
-      // object does not exist
-      // create it
-      obj.uuid.generate_random();
-      storage.replace(obj);
-    } else {
-      obj.uuid = std::get<0>(objs[0]);
-    }
-    // create the version now
-    DBVersionedObject version;
-    version.object_id = obj.uuid;
-    version.object_state = ObjectState::OPEN;
-    version.version_type = VersionType::REGULAR;
-    version.version_id = version_id;
-    version.create_time = ceph::real_clock::now();
-    version.id = storage.insert(version);
-    transaction.commit();
-    return version;
   });
   return retry.run();
 }
 
 std::optional<DBDeletedObjectItems>
-SQLiteVersionedObjects::remove_deleted_versions_transact(uint max_objects
+SQLiteVersionedObjects::remove_deleted_versions_transact(
+    uint max_objects, size_t* num_removed
 ) const {
   DBDeletedObjectItems ret_objs;
-  auto storage = conn->get_storage();
   RetrySQLiteBusy<DBDeletedObjectItems> retry([&]() {
-    auto transaction = storage.transaction_guard();
-    // get first the list of objects to be deleted up to max_objects
-    // order by size so when we delete the versions data we are more efficient
-    ret_objs = storage.select(
-        columns(&DBVersionedObject::object_id, &DBVersionedObject::id),
-        where(is_equal(&DBVersionedObject::object_state, ObjectState::DELETED)),
-        order_by(&DBVersionedObject::size).desc(), limit(max_objects)
-    );
-    if (ret_objs.size() == 0) {
-      // nothing to be deleted. We can return now
-      // no need to commit the transaction as nothing was changed
-      return ret_objs;
-    }
-    // remove all deleted versions up to max_objects
-    storage.remove_all<DBVersionedObject>(
-        where(is_equal(&DBVersionedObject::object_state, ObjectState::DELETED)),
-        order_by(&DBVersionedObject::size).desc(), limit(max_objects)
-    );
-    // now check if the object is empty
-    for (auto const& obj : ret_objs) {
-      auto nb_versions = storage.count(
-          &DBVersionedObject::id,
+    return conn->run_on_writer([&](Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      // get first the list of objects to be deleted up to max_objects
+      // order by size so when we delete the versions data we are more
+      // efficient
+      ret_objs = storage.select(
+          columns(&DBVersionedObject::object_id, &DBVersionedObject::id),
           where(
+              is_equal(&DBVersionedObject::object_state, ObjectState::DELETED)
+          ),
+          order_by(&DBVersionedObject::size).desc(), limit(max_objects)
+      );
+      if (num_removed != nullptr) {
+        *num_removed = ret_objs.size();
+      }
+      if (ret_objs.size() == 0) {
+        // nothing to be deleted. We can return now
+        // no need to commit the transaction as nothing was changed
+        return ret_objs;
+      }
+      auto to_reclaim = release_shared_data(storage, ret_objs);
+      // remove the versions selected, by id: another query ordered by
+      // size could pick other versions among those of equal size
+      std::vector<uint> removed_ids;
+      removed_ids.reserve(ret_objs.size());
+      for (const auto& obj : ret_objs) {
+        removed_ids.push_back(get_version_id(obj));
+      }
+      for_each_chunk(removed_ids, [&](const std::vector<uint>& ids) {
+        storage.remove_all<DBVersionedObject>(
+            where(in(&DBVersionedObject::id, ids))
+        );
+      });
+      // now check if the object is empty
+      for (auto const& obj : ret_objs) {
+        auto nb_versions = storage.count(
+            &DBVersionedObject::id,
+            where(
+                is_equal(
+                    &DBVersionedObject::version_type, VersionType::REGULAR
+                ) and
+                is_equal(&DBVersionedObject::object_id, std::get<0>(obj))
+            )
+        );
+        if (nb_versions == 0) {
+          // delete possible delete marker first
+          storage.remove_all<DBVersionedObject>(where(
               is_equal(
-                  &DBVersionedObject::version_type, VersionType::REGULAR
+                  &DBVersionedObject::version_type, VersionType::DELETE_MARKER
               ) and
               is_equal(&DBVersionedObject::object_id, std::get<0>(obj))
-          )
-      );
-      if (nb_versions == 0) {
-        // delete possible delete marker first
-        storage.remove_all<DBVersionedObject>(where(
-            is_equal(
-                &DBVersionedObject::version_type, VersionType::DELETE_MARKER
-            ) and
-            is_equal(&DBVersionedObject::object_id, std::get<0>(obj))
-        ));
-        storage.remove<DBObject>(std::get<0>(obj));
+          ));
+          storage.remove<DBObject>(std::get<0>(obj));
+        }
       }
-    }
-    transaction.commit();
-    return ret_objs;
+      transaction.commit();
+      return to_reclaim;
+    });
   });
   return retry.run();
 }
@@ -541,16 +944,82 @@ SQLiteVersionedObjects::remove_deleted_versions_transact(uint max_objects
 int SQLiteVersionedObjects::set_all_open_versions_to_deleted() const {
   // This function is only for use when we want to deliberately garbage
   // collect open versions on startup.
-  auto storage = conn->get_storage();
-  auto transaction = storage.transaction_guard();
-  transaction.commit_on_destroy = true;
-  auto now = ceph::real_clock::now();
-  storage.update_all(
-      set(c(&DBVersionedObject::delete_time) = now,
-          c(&DBVersionedObject::object_state) = ObjectState::DELETED),
-      where(is_equal(&DBVersionedObject::object_state, ObjectState::OPEN))
+  return conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    transaction.commit_on_destroy = true;
+    auto now = ceph::real_clock::now();
+    storage.update_all(
+        set(c(&DBVersionedObject::delete_time) = now,
+            c(&DBVersionedObject::object_state) = ObjectState::DELETED),
+        where(is_equal(&DBVersionedObject::object_state, ObjectState::OPEN))
+    );
+    return storage.changes();
+  });
+}
+
+uint SQLiteVersionedObjects::get_max_version_id() const {
+  auto& storage = conn->get_storage();
+  // the max of the rowid, no table scan
+  const auto max_id = storage.max(&DBVersionedObject::id);
+  return max_id ? *max_id : 0;
+}
+
+uint SQLiteVersionedObjects::set_open_versions_to_deleted(
+    uint first_id, uint last_id
+) const {
+  return conn->run_on_writer([&](Storage& storage) {
+    storage.update_all(
+        set(c(&DBVersionedObject::delete_time) = ceph::real_clock::now(),
+            c(&DBVersionedObject::object_state) = ObjectState::DELETED),
+        where(
+            between(&DBVersionedObject::id, first_id, last_id) and
+            is_equal(&DBVersionedObject::object_state, ObjectState::OPEN)
+        )
+    );
+    return static_cast<uint>(storage.changes());
+  });
+}
+
+DBDeletedObjectItems release_shared_data(
+    Storage& storage, const DBDeletedObjectItems& items
+) {
+  std::vector<uint> ids;
+  ids.reserve(items.size());
+  for (const auto& item : items) {
+    ids.push_back(get_version_id(item));
+  }
+  // inline versions have no file, their data goes away with their row
+  const auto inline_ids = storage.select(
+      &DBVersionedObject::id,
+      where(
+          in(&DBVersionedObject::id, ids) and
+          is_not_null(&DBVersionedObject::inline_data)
+      )
   );
-  return storage.changes();
+  const std::set<uint> inlined(inline_ids.begin(), inline_ids.end());
+
+  DBDeletedObjectItems result;
+  result.reserve(items.size());
+  for (const auto& item : items) {
+    if (inlined.contains(get_version_id(item))) {
+      continue;
+    }
+    auto shared = storage.get_pointer<DBSharedData>(get_version_id(item));
+    if (!shared) {
+      result.push_back(item);
+      continue;
+    }
+    storage.remove<DBSharedData>(shared->versioned_object_id);
+    const auto refs = storage.count(
+        &DBSharedData::versioned_object_id,
+        where(is_equal(&DBSharedData::data_version_id, shared->data_version_id)
+        )
+    );
+    if (refs == 0) {
+      result.emplace_back(shared->data_object_id, shared->data_version_id);
+    }
+  }
+  return result;
 }
 
 }  // namespace rgw::sal::sfs::sqlite
@@ -18,6 +18,34 @@
 
 namespace rgw::sal::sfs::sqlite {
 
+/// A key of SQLiteVersionedObjects::delete_objects_transact()
+struct DBDeleteObjectKey {
+  std::string name;
+  /// the version to delete, empty for the latest one
+  std::string version_id;
+  /// version id of the delete marker to add, if one is added
+  std::string delete_marker_id;
+  /// set if a delete marker was added for this key
+  bool delete_marker_added = false;
+  /// size and etag of the version deleted or hidden by the delete marker,
+  /// 0 and empty if there was none
+  uint64_t deleted_size = 0;
+  std::string deleted_etag;
+};
+
+/// Where the data of a version is, when not in files of its own. Stored
+/// in the transaction committing the version (see
+/// SQLiteVersionedObjects::store_versioned_object_if_state()).
+struct DBVersionData {
+  /// data segments the version is stored in (see DBVersionedObjectPart)
+  std::vector<DBVersionedObjectPart> parts;
+  /// the version whose data files, and the parts they are split in, the
+  /// version shares (see DBSharedData)
+  std::optional<uint> shared_data_of;
+  /// where in a segment file of the packer the version is stored
+  std::optional<DBPackedObject> packed;
+};
+
 class SQLiteVersionedObjects {
   DBConnRef conn;
 
@@ -43,14 +71,49 @@ class SQLiteVersionedObjects {
 
   uint insert_versioned_object(const DBVersionedObject& object) const;
   void store_versioned_object(const DBVersionedObject& object) const;
+  /// Stores `object` if its state is one of `allowed_states`. `db_object`
+  /// and `data`, if set, are stored in the same transaction. Returns
+  /// false, storing nothing, if the version whose data it shares was
+  /// removed. The coroutine of `y` is suspended until it is committed.
   bool store_versioned_object_if_state(
-      const DBVersionedObject& object, std::vector<ObjectState> allowed_states
+      const DBVersionedObject& object, std::vector<ObjectState> allowed_states,
+      const DBObject* db_object = nullptr, const DBVersionData* data = nullptr,
+      optional_yield y = null_yield
   ) const;
   void remove_versioned_object(uint id) const;
   bool store_versioned_object_delete_committed_transact_if_state(
-      const DBVersionedObject& object, std::vector<ObjectState> allowed_states
+      const DBVersionedObject& object, std::vector<ObjectState> allowed_states,
+      const DBObject* db_object = nullptr, const DBVersionData* data = nullptr,
+      optional_yield y = null_yield
   ) const;
 
+  /// Data segments of version `id`, ordered by their offset in the
+  /// object. Empty if all the version data is in a single file.
+  std::vector<DBVersionedObjectPart> get_versioned_object_parts(uint id
+  ) const;
+  void store_versioned_object_parts(
+      const std::vector<DBVersionedObjectPart>& parts
+  ) const;
+
+  /// Where version `id` is packed, if it is (see DBPackedObject).
+  std::optional<DBPackedObject> get_packed_object(uint id) const;
+  void store_packed_object(const DBPackedObject& packed) const;
+  std::vector<DBPackedObject> get_packed_objects(uint64_t segment_id) const;
+  /// Moves `packed` to `segment_offset` in segment `segment_id`, unless
+  /// it was moved or removed since it was read. Returns if it was moved.
+  bool relocate_packed_object(
+      const DBPackedObject& packed, uint64_t segment_id,
+      uint64_t segment_offset
+  ) const;
+  std::vector<DBPackedSegment> get_packed_segments() const;
+  /// Forgets segment `id` if no object is packed in it anymore. Returns
+  /// if it did.
+  bool remove_packed_segment_if_unused(uint64_t id) const;
+
+  /// The data version whose files version `id` shares, if it does (see
+  /// DBSharedData).
+  std::optional<DBSharedData> get_shared_data(uint id) const;
+
   std::vector<uint> get_versioned_object_ids(bool filter_deleted = true) const;
   std::vector<uint> get_versioned_object_ids(
       const uuid_d& object_id, bool filter_deleted = true
@@ -69,19 +132,42 @@ class SQLiteVersionedObjects {
 
   std::optional<DBVersionedObject> create_new_versioned_object_transact(
       const std::string& bucket_id, const std::string& object_name,
-      const std::string& version_id
+      const std::string& version_id, optional_yield y = null_yield
   ) const;
 
   uint add_delete_marker_transact(
-      const uuid_d& object_id, const std::string& delete_marker_id, bool& added
+      const uuid_d& object_id, const std::string& delete_marker_id, bool& added,
+      optional_yield y = null_yield
   ) const;
 
+  /// Deletes the committed versions `keys` refer to in bucket `bucket_id`
+  /// in a single transaction, in the order of `keys`. Versions that
+  /// aren't committed are left alone, as Bucket::delete_object() does.
+  /// In a `versioned` bucket, deleting the latest version adds a delete
+  /// marker (even for objects that don't exist) unless it is one already,
+  /// and deleting a delete marker removes it. Otherwise the version is
+  /// marked deleted. Returns false if the transaction failed.
+  bool delete_objects_transact(
+      const std::string& bucket_id, bool versioned,
+      std::vector<DBDeleteObjectKey>& keys, optional_yield y = null_yield
+  ) const;
+
+  /// Removes up to `max_objects` deleted versions and returns the data
+  /// to reclaim, which is less than what was removed if some of it is
+  /// still shared or inline (see release_shared_data()). Sets
+  /// `num_removed` to the number of versions removed.
   std::optional<DBDeletedObjectItems> remove_deleted_versions_transact(
-      uint max_objects
+      uint max_objects, size_t* num_removed = nullptr
   ) const;
 
   int set_all_open_versions_to_deleted() const;
 
+  /// The highest id of any version, 0 if there are none
+  uint get_max_version_id() const;
+  /// Marks the open versions with ids in [first_id, last_id] deleted, as
+  /// set_all_open_versions_to_deleted() does. Returns how many it marked.
+  uint set_open_versions_to_deleted(uint first_id, uint last_id) const;
+
  private:
   std::optional<DBVersionedObject>
   get_committed_versioned_object_specific_version(
@@ -94,4 +180,13 @@ class SQLiteVersionedObjects {
   ) const;
 };
 
+/// Drops the references of the versions in `items` to the data they
+/// share, before they are removed in the current transaction of
+/// `storage`. Returns the data to reclaim: that of the versions with
+/// files of their own, and the shared data they were the last to use.
+/// Inline versions have nothing to reclaim.
+DBDeletedObjectItems release_shared_data(
+    Storage& storage, const DBDeletedObjectItems& items
+);
+
 }  // namespace rgw::sal::sfs::sqlite
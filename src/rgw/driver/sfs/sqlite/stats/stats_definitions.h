@@ -0,0 +1,38 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace rgw::sal::sfs::sqlite {
+
+// Usage counters of the committed versions in a bucket, maintained by
+// triggers on the versioned objects table (see DBConn).
+struct DBBucketStats {
+  std::string bucket_id;  // primary key
+  int64_t size;
+  int64_t size_rounded;
+  int64_t obj_count;
+};
+
+// Same as DBBucketStats, for all the buckets owned by a user.
+struct DBUserStats {
+  std::string user_id;  // primary key
+  int64_t size;
+  int64_t size_rounded;
+  int64_t obj_count;
+};
+
+}  // namespace rgw::sal::sfs::sqlite
@@ -0,0 +1,49 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "user_cache.h"
+
+#include "rgw/rgw_perf_counters.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+static constexpr size_t USER_CACHE_SHARDS = 16;
+
+UserCache::UserCache(size_t max_size)
+    : enabled(max_size > 0), entries(max_size, USER_CACHE_SHARDS) {}
+
+std::optional<DBOPUserInfo> UserCache::find(const std::string& access_key) {
+  if (!enabled) {
+    return std::nullopt;
+  }
+  Entry entry;
+  if (!entries.find(access_key, entry) || entry.generation != generation) {
+    if (perfcounter) perfcounter->inc(l_rgw_sfs_user_cache_miss);
+    return std::nullopt;
+  }
+  if (perfcounter) perfcounter->inc(l_rgw_sfs_user_cache_hit);
+  return *entry.user;
+}
+
+void UserCache::add(
+    const std::string& access_key, const DBOPUserInfo& user,
+    uint64_t read_generation
+) {
+  if (!enabled || read_generation != generation) {
+    return;
+  }
+  Entry entry{std::make_shared<const DBOPUserInfo>(user), read_generation};
+  entries.add(access_key, entry);
+}
+
+}  // namespace rgw::sal::sfs::sqlite
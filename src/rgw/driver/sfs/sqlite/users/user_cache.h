@@ -0,0 +1,61 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "common/sharded_lru_map.h"
+#include "users_definitions.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+/// Users by access key, so that authenticating a request doesn't query
+/// the database. SQLiteUsers fills it and invalidates it whenever it
+/// modifies a user.
+///
+/// Invalidation bumps a generation instead of looking for the entries of
+/// the user, whose access keys may have changed: entries added before are
+/// ignored from then on. Users are modified rarely.
+class UserCache {
+  struct Entry {
+    std::shared_ptr<const DBOPUserInfo> user;
+    uint64_t generation = 0;
+  };
+
+  const bool enabled;
+  sharded_lru_map<std::string, Entry> entries;
+  std::atomic<uint64_t> generation{0};
+
+ public:
+  explicit UserCache(size_t max_size);
+  UserCache(const UserCache&) = delete;
+  UserCache& operator=(const UserCache&) = delete;
+
+  /// The generation to add() a user read from the database at. Must be
+  /// taken before reading it, so a concurrent modification isn't missed.
+  uint64_t get_generation() const { return generation; }
+
+  std::optional<DBOPUserInfo> find(const std::string& access_key);
+  void add(
+      const std::string& access_key, const DBOPUserInfo& user,
+      uint64_t read_generation
+  );
+  /// To be called after modifying users
+  void invalidate() { generation++; }
+};
+
+}  // namespace rgw::sal::sfs::sqlite
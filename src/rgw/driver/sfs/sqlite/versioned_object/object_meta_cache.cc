@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "object_meta_cache.h"
+
+#include "rgw/rgw_perf_counters.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+// versions of a single object kept, most objects are only read latest
+static constexpr size_t OBJECT_META_CACHE_MAX_VERSIONS = 8;
+
+ObjectMetaCache::ObjectMetaCache(size_t max_size)
+    : enabled(max_size > 0), entries(max_size, NUM_SHARDS) {}
+
+std::string ObjectMetaCache::make_key(
+    const std::string& bucket_id, const std::string& name
+) {
+  // object names can't contain a NUL character
+  std::string key;
+  key.reserve(bucket_id.size() + 1 + name.size());
+  key.append(bucket_id);
+  key.push_back('\0');
+  key.append(name);
+  return key;
+}
+
+ObjectMetaCache::Shard& ObjectMetaCache::shard_of(const std::string& key) {
+  return shards[std::hash<std::string>{}(key) % shards.size()];
+}
+
+uint64_t ObjectMetaCache::get_generation(
+    const std::string& bucket_id, const std::string& name
+) {
+  return shard_of(make_key(bucket_id, name)).generation;
+}
+
+std::optional<DBVersionedObject> ObjectMetaCache::find(
+    const std::string& bucket_id, const std::string& name,
+    const std::string& version_id
+) {
+  if (!enabled) {
+    return std::nullopt;
+  }
+  const auto key = make_key(bucket_id, name);
+  Entry entry;
+  if (entries.find(key, entry) &&
+      entry.generation >= shard_of(key).cleared_generation) {
+    const auto version = entry.versions->find(version_id);
+    if (version != entry.versions->end()) {
+      if (perfcounter) perfcounter->inc(l_rgw_sfs_object_meta_cache_hit);
+      return version->second;
+    }
+  }
+  if (perfcounter) perfcounter->inc(l_rgw_sfs_object_meta_cache_miss);
+  return std::nullopt;
+}
+
+void ObjectMetaCache::add(
+    const std::string& bucket_id, const std::string& name,
+    const std::string& version_id, const DBVersionedObject& version,
+    uint64_t read_generation
+) {
+  if (!enabled) {
+    return;
+  }
+  const auto key = make_key(bucket_id, name);
+  auto& shard = shard_of(key);
+  std::lock_guard l(shard.modify_lock);
+  if (read_generation != shard.generation) {
+    return;
+  }
+  // copy on write, find() hands out the versions without a lock
+  auto versions = std::make_shared<Versions>();
+  Entry entry;
+  if (entries.find(key, entry) &&
+      entry.generation >= shard.cleared_generation &&
+      entry.versions->size() < OBJECT_META_CACHE_MAX_VERSIONS) {
+    *versions = *entry.versions;
+  }
+  (*versions)[version_id] = version;
+  entry.versions = std::move(versions);
+  entry.generation = read_generation;
+  entries.add(key, entry);
+}
+
+void ObjectMetaCache::invalidate(
+    const std::string& bucket_id, const std::string& name
+) {
+  if (!enabled) {
+    return;
+  }
+  const auto key = make_key(bucket_id, name);
+  auto& shard = shard_of(key);
+  std::lock_guard l(shard.modify_lock);
+  shard.generation++;
+  entries.erase(key);
+}
+
+void ObjectMetaCache::invalidate_all() {
+  if (!enabled) {
+    return;
+  }
+  for (auto& shard : shards) {
+    std::lock_guard l(shard.modify_lock);
+    shard.cleared_generation = ++shard.generation;
+  }
+}
+
+}  // namespace rgw::sal::sfs::sqlite
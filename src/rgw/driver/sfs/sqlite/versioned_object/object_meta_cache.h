@@ -0,0 +1,93 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "common/sharded_lru_map.h"
+#include "versioned_object_definitions.h"
+
+namespace rgw::sal::sfs::sqlite {
+
+/// Committed versions by bucket, object name and requested version id
+/// (empty for the latest one), with their attributes decoded, so that
+/// HEAD and GET of hot objects don't query the database.
+///
+/// Entries hold the versions of an object looked up so far, so committing
+/// or deleting a version of an object invalidates all of them at once.
+/// Modifications racing with a lookup are caught by a generation bumped
+/// on every invalidation: a lookup that read the database before it
+/// doesn't cache what it read. Generations and the lock serializing the
+/// modifications are per shard of the entries, so a modification only
+/// turns away the lookups of objects in its shard.
+class ObjectMetaCache {
+  using Versions = std::map<std::string, DBVersionedObject>;
+  struct Entry {
+    std::shared_ptr<const Versions> versions;
+    uint64_t generation = 0;
+  };
+  struct Shard {
+    /// serializes add() and the invalidations, find() doesn't take it
+    std::mutex modify_lock;
+    std::atomic<uint64_t> generation{0};
+    /// entries added before this generation are stale
+    std::atomic<uint64_t> cleared_generation{0};
+  };
+  static constexpr size_t NUM_SHARDS = 16;
+
+  const bool enabled;
+  /// sharded like `shards`, by the hash of the key
+  sharded_lru_map<std::string, Entry> entries;
+  std::array<Shard, NUM_SHARDS> shards;
+
+  static std::string make_key(
+      const std::string& bucket_id, const std::string& name
+  );
+  Shard& shard_of(const std::string& key);
+
+ public:
+  explicit ObjectMetaCache(size_t max_size);
+  ObjectMetaCache(const ObjectMetaCache&) = delete;
+  ObjectMetaCache& operator=(const ObjectMetaCache&) = delete;
+
+  /// The generation to add() a version of object `name` read from the
+  /// database at. Must be taken before reading it, so a concurrent
+  /// modification isn't missed.
+  uint64_t get_generation(
+      const std::string& bucket_id, const std::string& name
+  );
+
+  std::optional<DBVersionedObject> find(
+      const std::string& bucket_id, const std::string& name,
+      const std::string& version_id
+  );
+  void add(
+      const std::string& bucket_id, const std::string& name,
+      const std::string& version_id, const DBVersionedObject& version,
+      uint64_t read_generation
+  );
+  /// To be called after committing, deleting or modifying a version of
+  /// object `name`
+  void invalidate(const std::string& bucket_id, const std::string& name);
+  /// To be called after modifying versions of many objects at once
+  void invalidate_all();
+};
+
+}  // namespace rgw::sal::sfs::sqlite
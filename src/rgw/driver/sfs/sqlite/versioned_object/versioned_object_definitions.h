@@ -13,8 +13,10 @@
  */
 #pragma once
 
+#include <optional>
 #include <ranges>
 #include <string>
+#include <vector>
 
 #include "common/iso_8601.h"
 #include "rgw/driver/sfs/object_state.h"
@@ -46,6 +48,64 @@ struct DBVersionedObject {
   std::string etag;
   rgw::sal::Attrs attrs;
   VersionType version_type = rgw::sal::sfs::VersionType::REGULAR;
+  /// The data of tiny versions, stored here instead of in a file (see
+  /// rgw_sfs_inline_threshold). Empty for the others.
+  std::optional<std::vector<char>> inline_data;
+};
+
+/// A data segment of a versioned object stored in its own file.
+/// Versions without segments keep all their data in a single file.
+struct DBVersionedObjectPart {
+  uint versioned_object_id;
+  uint32_t part_num;
+  /// offset of the segment's first byte in the object
+  uint64_t object_offset;
+  uint64_t size;
+};
+
+/// Data of a small versioned object packed in a segment file instead of
+/// a file of its own (see SegmentPacker). Versions packed have no parts.
+struct DBPackedObject {
+  uint versioned_object_id;  // primary key
+  uint64_t segment_id;
+  /// offset of the object data in the segment file
+  uint64_t segment_offset;
+  uint64_t size;
+};
+
+/// Bytes and number of the objects still referenced in a segment file,
+/// maintained by triggers on the packed objects table (see DBConn).
+/// Whatever else the file holds is garbage left by deleted versions.
+struct DBPackedSegment {
+  uint64_t id;  // primary key
+  int64_t live_size;
+  int64_t live_count;
+};
+
+/// A versioned object sharing the data files of another version, its
+/// data version, instead of having files of its own. Server side copies
+/// share the data of their source this way. Once shared, the data
+/// version has a row of its own too: the data files are reclaimed when
+/// the last version referencing them is removed.
+struct DBSharedData {
+  uint versioned_object_id;  // primary key
+  /// DBVersionedObject::id of the version the data files were written for
+  uint data_version_id;
+  /// object of the data version, whose directory holds the data files
+  uuid_d data_object_id;
+};
+
+/// The latest committed version of an object, whether a regular version
+/// or a delete marker. Maintained by triggers on the objects and
+/// versioned objects tables (see DBConn), so listings read it with an
+/// index range scan on (bucket_id, name) instead of grouping versions.
+struct DBLatestVersion {
+  uuid_d object_id;  // primary key
+  std::string bucket_id;
+  std::string name;
+  /// DBVersionedObject::id of the version
+  uint version_id;
+  VersionType version_type;
 };
 
 using DBObjectsListItem = std::tuple<
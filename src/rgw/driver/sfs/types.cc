@@ -14,11 +14,17 @@
 
 #include "rgw/driver/sfs/types.h"
 
+#include <fcntl.h>
+
+#include <cerrno>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <string>
 #include <system_error>
+#include <vector>
 
+#include "include/scope_guard.h"
 #include "rgw/driver/sfs/object_state.h"
 #include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
 #include "rgw/driver/sfs/sqlite/sqlite_objects.h"
@@ -31,6 +37,39 @@
 #define dout_subsys ceph_subsys_rgw
 namespace rgw::sal::sfs {
 
+// A directory can only be removed by the GC again after it unlinked a
+// file in it: a few attempts are plenty.
+static constexpr int DATA_DIRECTORY_ATTEMPTS = 5;
+
+int open_data_file(const std::filesystem::path& path, int flags, mode_t mode) {
+  for (int attempt = 1;; attempt++) {
+    const int ret = create_data_directories(path.parent_path());
+    if (ret < 0) {
+      return ret;
+    }
+    const int fd = ::open(path.c_str(), flags, mode);
+    if (fd >= 0) {
+      return fd;
+    }
+    if (errno != ENOENT || attempt == DATA_DIRECTORY_ATTEMPTS) {
+      return -errno;
+    }
+  }
+}
+
+int create_data_directories(const std::filesystem::path& dir) {
+  for (int attempt = 1;; attempt++) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (!ec) {
+      return 0;
+    }
+    if (ec.value() != ENOENT || attempt == DATA_DIRECTORY_ATTEMPTS) {
+      return -ec.value();
+    }
+  }
+}
+
 std::string generate_new_version_id(CephContext* ceph_context) {
 #define OBJ_INSTANCE_LEN 32
   char buf[OBJ_INSTANCE_LEN + 1];
@@ -38,6 +77,28 @@ std::string generate_new_version_id(CephContext* ceph_context) {
   return std::string(buf);
 }
 
+static std::optional<bufferlist> to_inline_data(
+    const std::optional<std::vector<char>>& blob
+) {
+  if (!blob.has_value()) {
+    return std::nullopt;
+  }
+  bufferlist data;
+  data.append(blob->data(), blob->size());
+  return data;
+}
+
+static std::optional<std::vector<char>> to_inline_blob(
+    const std::optional<bufferlist>& data
+) {
+  if (!data.has_value()) {
+    return std::nullopt;
+  }
+  std::vector<char> blob(data->length());
+  data->begin().copy(blob.size(), blob.data());
+  return blob;
+}
+
 Object::Object(const rgw_obj_key& _key, const uuid_d& _uuid)
     : name(_key.name), instance(_key.instance), path(_uuid), deleted(false) {}
 
@@ -88,6 +149,7 @@ Object* Object::create_from_db_version(
       .mtime = version.mtime,
       .delete_at = version.delete_time};
   result->attrs = version.attrs;
+  result->inline_data = to_inline_data(version.inline_data);
   return result;
 }
 
@@ -140,13 +202,19 @@ Object* Object::try_fetch_from_database(
     // non versioned bucket and versionId = null --> ignore versionId
     version_id_query = "";
   }
-  sqlite::SQLiteVersionedObjects objs_versions(store->db_conn);
-  // if version_id is empty it will get the last version for that object
-  auto version = objs_versions.get_committed_versioned_object(
-      bucket_id, name, version_id_query
-  );
+  auto& cache = store->db_conn->object_meta_cache;
+  auto version = cache.find(bucket_id, name, version_id_query);
   if (!version.has_value()) {
-    return nullptr;
+    const auto generation = cache.get_generation(bucket_id, name);
+    sqlite::SQLiteVersionedObjects objs_versions(store->db_conn);
+    // if version_id is empty it will get the last version for that object
+    version = objs_versions.get_committed_versioned_object(
+        bucket_id, name, version_id_query
+    );
+    if (!version.has_value()) {
+      return nullptr;
+    }
+    cache.add(bucket_id, name, version_id_query, *version, generation);
   }
 
   // don't return the version_id if versioning is not enabled
@@ -165,6 +233,7 @@ Object* Object::try_fetch_from_database(
       .mtime = version->mtime,
       .delete_at = version->delete_time};
   result->attrs = version->attrs;
+  result->inline_data = to_inline_data(version->inline_data);
 
   return result;
 }
@@ -175,6 +244,18 @@ std::filesystem::path Object::get_storage_path() const {
   return path.to_path() / filename;
 }
 
+std::filesystem::path Object::get_parts_storage_path() const {
+  std::string dirname = std::to_string(version_id);
+  dirname.append(".parts");
+  return path.to_path() / dirname;
+}
+
+std::filesystem::path Object::get_part_storage_path(uint32_t part_num) const {
+  std::string filename = std::to_string(part_num);
+  filename.append(".p");
+  return get_parts_storage_path() / filename;
+}
+
 const Object::Meta Object::get_meta() const {
   return Object::Meta(meta);
 }
@@ -218,14 +299,21 @@ void Object::metadata_flush_attrs(SFStore* store) const {
   ceph_assert(versioned_object.has_value());
   versioned_object->attrs = get_attrs();
   db_versioned_objs.store_versioned_object(*versioned_object);
+
+  sqlite::SQLiteObjects dbobjs(store->db_conn);
+  const auto db_object = dbobjs.get_object(path.get_uuid());
+  if (db_object.has_value()) {
+    store->db_conn->object_meta_cache.invalidate(db_object->bucket_id, name);
+  }
 }
 
-bool Object::metadata_finish(SFStore* store, bool versioning_enabled) const {
+bool Object::metadata_finish(
+    SFStore* store, bool versioning_enabled, optional_yield y
+) const {
   sqlite::SQLiteObjects dbobjs(store->db_conn);
   auto db_object = dbobjs.get_object(path.get_uuid());
   ceph_assert(db_object.has_value());
   db_object->name = name;
-  dbobjs.store_object(*db_object);
 
   sqlite::SQLiteVersionedObjects db_versioned_objs(store->db_conn);
   // get the object, even if it was deleted.
@@ -243,17 +331,26 @@ bool Object::metadata_finish(SFStore* store, bool versioning_enabled) const {
   db_versioned_object->commit_time = ceph::real_clock::now();
   db_versioned_object->etag = meta.etag;
   db_versioned_object->attrs = get_attrs();
+  db_versioned_object->inline_data = to_inline_blob(inline_data);
+  // the object, and where the data is, are stored in the transaction
+  // committing the version
+  bool committed;
   if (versioning_enabled) {
-    return db_versioned_objs.store_versioned_object_if_state(
-        *db_versioned_object, {ObjectState::OPEN}
+    committed = db_versioned_objs.store_versioned_object_if_state(
+        *db_versioned_object, {ObjectState::OPEN}, &*db_object,
+        &version_data, y
     );
 
   } else {
-    return db_versioned_objs
-        .store_versioned_object_delete_committed_transact_if_state(
-            *db_versioned_object, {ObjectState::OPEN}
-        );
+    committed =
+        db_versioned_objs
+            .store_versioned_object_delete_committed_transact_if_state(
+                *db_versioned_object, {ObjectState::OPEN}, &*db_object,
+                &version_data, y
+            );
   }
+  store->db_conn->object_meta_cache.invalidate(db_object->bucket_id, name);
+  return committed;
 }
 
 int Object::delete_object_version(SFStore* store) const {
@@ -272,6 +369,11 @@ void Object::delete_object_metadata(SFStore* store) const {
 void Object::delete_object_data(SFStore* store) const {
   // remove object version data
   std::filesystem::remove(store->get_data_path() / get_storage_path());
+  // versions stored in several files keep them in a directory of their own
+  std::error_code delete_parts_error;
+  std::filesystem::remove_all(
+      store->get_data_path() / get_parts_storage_path(), delete_parts_error
+  );
   auto folder_path = store->get_data_path() / path.to_path();
   // try to delete the parent folder
   // it won't be deleted if it's not empty.
@@ -280,7 +382,9 @@ void Object::delete_object_data(SFStore* store) const {
   std::filesystem::remove(folder_path, delete_folder_error);
 }
 
-ObjectRef Bucket::create_version(const rgw_obj_key& key) const {
+ObjectRef Bucket::create_version(
+    const rgw_obj_key& key, optional_yield y
+) const {
   // even if a specific version was not asked we generate one
   // non-versioned bucket objects will also have a version_id
   auto version_id = key.instance;
@@ -293,7 +397,7 @@ ObjectRef Bucket::create_version(const rgw_obj_key& key) const {
   // That way threads trying to create the same object in parallel will be
   // synchronised by the database without using extra mutexes.
   auto new_version = objs_versions.create_new_versioned_object_transact(
-      info.bucket.bucket_id, key.name, version_id
+      info.bucket.bucket_id, key.name, version_id, y
   );
   if (new_version.has_value()) {
     result.reset(Object::create_from_db_version(key.name, *new_version));
@@ -333,28 +437,38 @@ std::vector<ObjectRef> Bucket::get_all() const {
 
 bool Bucket::delete_object(
     const Object& obj, const rgw_obj_key& key, bool versioned_bucket,
-    std::string& out_delete_marker_version_id
+    std::string& out_delete_marker_version_id, optional_yield y
 ) const {
   out_delete_marker_version_id = "";
   sqlite::SQLiteVersionedObjects db_versioned_objs(store->db_conn);
+  // invalidated when done, whatever the outcome
+  const auto invalidate_cache = make_scope_guard([&] {
+    store->db_conn->object_meta_cache.invalidate(
+        info.bucket.bucket_id, obj.name
+    );
+  });
 
   if (!versioned_bucket) {
-    return _delete_object_non_versioned(obj, key, db_versioned_objs);
+    return _delete_object_non_versioned(obj, key, db_versioned_objs, y);
   } else {
     if (key.instance.empty()) {
       out_delete_marker_version_id =
-          _add_delete_marker(obj, key, db_versioned_objs);
+          _add_delete_marker(obj, key, db_versioned_objs, y);
       return true;
     } else {
-      // we have a version id (instance)
-      auto version_to_delete =
-          db_versioned_objs.get_versioned_object(key.instance);
+      // we have a version id (instance). Only committed versions of this
+      // object are deleted, as delete_objects() does.
+      auto version_to_delete = db_versioned_objs.get_committed_versioned_object(
+          info.bucket.bucket_id, obj.name, key.instance
+      );
       if (version_to_delete.has_value()) {
         if (version_to_delete->version_type == VersionType::DELETE_MARKER) {
           _undelete_object(key, db_versioned_objs, *version_to_delete);
           return true;
         } else {
-          return _delete_object_version(db_versioned_objs, *version_to_delete);
+          return _delete_object_version(
+              db_versioned_objs, *version_to_delete, y
+          );
         }
       }
       return false;
@@ -362,6 +476,40 @@ bool Bucket::delete_object(
   }
 }
 
+bool Bucket::delete_objects(
+    const std::vector<rgw_obj_key>& keys, bool versioned_bucket,
+    std::vector<sqlite::DBDeleteObjectKey>& out_results, optional_yield y
+) const {
+  auto& db_keys = out_results;
+  db_keys.clear();
+  db_keys.reserve(keys.size());
+  for (const auto& key : keys) {
+    sqlite::DBDeleteObjectKey db_key;
+    db_key.name = key.name;
+    if (versioned_bucket) {
+      db_key.version_id = key.instance;
+      if (key.instance.empty()) {
+        db_key.delete_marker_id =
+            generate_new_version_id(store->ceph_context());
+      }
+    }
+    db_keys.push_back(std::move(db_key));
+  }
+
+  sqlite::SQLiteVersionedObjects db_versioned_objs(store->db_conn);
+  // invalidated when done, whatever the outcome
+  const auto invalidate_cache = make_scope_guard([&] {
+    for (const auto& key : keys) {
+      store->db_conn->object_meta_cache.invalidate(
+          info.bucket.bucket_id, key.name
+      );
+    }
+  });
+  return db_versioned_objs.delete_objects_transact(
+      info.bucket.bucket_id, versioned_bucket, db_keys, y
+  );
+}
+
 std::string Bucket::create_non_existing_object_delete_marker(
     const rgw_obj_key& key
 ) const {
@@ -379,6 +527,9 @@ std::string Bucket::create_non_existing_object_delete_marker(
   version_info.delete_time = ceph::real_clock::now();
   sqlite::SQLiteVersionedObjects db_versioned_objs(store->db_conn);
   obj->version_id = db_versioned_objs.insert_versioned_object(version_info);
+  store->db_conn->object_meta_cache.invalidate(
+      info.bucket.bucket_id, key.name
+  );
 
   return new_version_id;
 }
@@ -403,16 +554,20 @@ bool Bucket::_undelete_object(
 
 bool Bucket::_delete_object_non_versioned(
     const Object& obj, const rgw_obj_key& /*key*/,
-    const sqlite::SQLiteVersionedObjects& db_versioned_objs
+    const sqlite::SQLiteVersionedObjects& db_versioned_objs, optional_yield y
 ) const {
-  auto version_to_delete =
-      db_versioned_objs.get_last_versioned_object(obj.path.get_uuid());
-  return _delete_object_version(db_versioned_objs, *version_to_delete);
+  auto version_to_delete = db_versioned_objs.get_committed_versioned_object(
+      info.bucket.bucket_id, obj.name, ""
+  );
+  if (!version_to_delete.has_value()) {
+    return false;
+  }
+  return _delete_object_version(db_versioned_objs, *version_to_delete, y);
 }
 
 bool Bucket::_delete_object_version(
     const sqlite::SQLiteVersionedObjects& db_versioned_objs,
-    const sqlite::DBVersionedObject& version
+    const sqlite::DBVersionedObject& version, optional_yield y
 ) const {
   auto now = ceph::real_clock::now();
   sqlite::DBVersionedObject to_delete(version);
@@ -420,19 +575,19 @@ bool Bucket::_delete_object_version(
   to_delete.mtime = now;
   to_delete.object_state = ObjectState::DELETED;
   const bool ret = db_versioned_objs.store_versioned_object_if_state(
-      to_delete, {ObjectState::OPEN, ObjectState::COMMITTED}
+      to_delete, {ObjectState::COMMITTED}, nullptr, nullptr, y
   );
   return ret;
 }
 
 std::string Bucket::_add_delete_marker(
     const Object& obj, const rgw_obj_key& /*key*/,
-    const sqlite::SQLiteVersionedObjects& db_versioned_objs
+    const sqlite::SQLiteVersionedObjects& db_versioned_objs, optional_yield y
 ) const {
   std::string delete_marker_id = generate_new_version_id(store->ceph_context());
   bool added;
   db_versioned_objs.add_delete_marker_transact(
-      obj.path.get_uuid(), delete_marker_id, added
+      obj.path.get_uuid(), delete_marker_id, added, y
   );
   if (added) {
     return delete_marker_id;
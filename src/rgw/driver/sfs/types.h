@@ -14,9 +14,13 @@
 #ifndef RGW_STORE_SFS_TYPES_H
 #define RGW_STORE_SFS_TYPES_H
 
+#include <sys/types.h>
+
 #include <exception>
+#include <filesystem>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 
@@ -41,6 +45,16 @@ constexpr size_t S3_MAX_OBJECT_NAME_BYTES = 1024;
 
 struct UnknownObjectException : public std::exception {};
 
+/// Opens the data file `path` with `flags` (including O_CREAT), creating
+/// the directories leading to it. The GC removes data directories once
+/// they are empty: one removed between its creation and the open is
+/// created again. Returns the file descriptor or a negative error code.
+int open_data_file(const std::filesystem::path& path, int flags, mode_t mode);
+
+/// Creates the data directory `dir`, retrying like open_data_file().
+/// Returns 0 or a negative error code.
+int create_data_directories(const std::filesystem::path& dir);
+
 class Object {
  public:
   struct Meta {
@@ -59,6 +73,12 @@ class Object {
  private:
   Meta meta;
   std::map<std::string, bufferlist> attrs;
+  /// the data of inline versions (see
+  /// sqlite::DBVersionedObject::inline_data)
+  std::optional<bufferlist> inline_data;
+  /// where the data is when not in files of its own, committed with the
+  /// metadata
+  sqlite::DBVersionData version_data;
 
  protected:
   Object(const rgw_obj_key& _key, const uuid_d& _uuid);
@@ -110,13 +130,50 @@ class Object {
   Attrs get_attrs() const;
   void update_attrs(const Attrs& update);
 
+  const std::optional<bufferlist>& get_inline_data() const {
+    return inline_data;
+  }
+  /// Stores `data` in the database with the metadata, committed by
+  /// metadata_finish(), instead of in a file
+  void set_inline_data(const bufferlist& data) { inline_data = data; }
+  /// Stores the version in the data segments `parts` instead of a single
+  /// file, from metadata_finish() on
+  void set_data_parts(std::vector<sqlite::DBVersionedObjectPart> parts) {
+    version_data.parts = std::move(parts);
+  }
+  /// Makes the version share the data files of version `src_version_id`
+  /// instead of having files of its own, from metadata_finish() on
+  void set_shared_data(uint src_version_id) {
+    version_data.shared_data_of = src_version_id;
+  }
+  /// Stores the version in segment file `segment_id` of the packer, at
+  /// `segment_offset`, from metadata_finish() on
+  void set_packed_data(
+      uint64_t segment_id, uint64_t segment_offset, uint64_t size
+  ) {
+    version_data.packed = sqlite::DBPackedObject{
+        .versioned_object_id = version_id,
+        .segment_id = segment_id,
+        .segment_offset = segment_offset,
+        .size = size};
+  }
+
   std::filesystem::path get_storage_path() const;
+  /// Directory holding the data segments of versions stored in several
+  /// files (see sqlite::DBVersionedObjectPart), eg. completed multiparts.
+  std::filesystem::path get_parts_storage_path() const;
+  std::filesystem::path get_part_storage_path(uint32_t part_num) const;
 
   /// Commit all object state to database
   // Including meta and attrs
   // Sets obj version state to COMMITTED
   // For unversioned buckets it set the other versions state to DELETED
-  bool metadata_finish(SFStore* store, bool versioning_enabled) const;
+  // Returns false if nothing was committed, eg. the version whose data
+  // it shares (set_shared_data()) was removed
+  // The coroutine of `y` is suspended while the commit is written
+  bool metadata_finish(
+      SFStore* store, bool versioning_enabled, optional_yield y = null_yield
+  ) const;
 
   /// Commit attrs to database
   void metadata_flush_attrs(rgw::sal::SFStore* store) const;
@@ -151,17 +208,19 @@ class Bucket {
 
   bool _delete_object_non_versioned(
       const Object& obj, const rgw_obj_key& key,
-      const sqlite::SQLiteVersionedObjects& sqlite_versioned_objects
+      const sqlite::SQLiteVersionedObjects& sqlite_versioned_objects,
+      optional_yield y
   ) const;
 
   bool _delete_object_version(
       const sqlite::SQLiteVersionedObjects& sqlite_versioned_objects,
-      const sqlite::DBVersionedObject& version
+      const sqlite::DBVersionedObject& version, optional_yield y
   ) const;
 
   std::string _add_delete_marker(
       const Object& obj, const rgw_obj_key& key,
-      const sqlite::SQLiteVersionedObjects& sqlite_versioned_objects
+      const sqlite::SQLiteVersionedObjects& sqlite_versioned_objects,
+      optional_yield y
   ) const;
 
  public:
@@ -204,7 +263,9 @@ class Bucket {
 
  public:
   /// Create object version for key
-  ObjectRef create_version(const rgw_obj_key& key) const;
+  ObjectRef create_version(
+      const rgw_obj_key& key, optional_yield y = null_yield
+  ) const;
 
   /// Get existing object by key. Throws if it doesn't exist.
   ObjectRef get(const rgw_obj_key& key) const;
@@ -216,7 +277,17 @@ class Bucket {
   /// it. Return indicates if operation succeeded
   bool delete_object(
       const Object& obj, const rgw_obj_key& key, bool versioned_bucket,
-      std::string& delete_marker_version_id
+      std::string& delete_marker_version_id, optional_yield y = null_yield
+  ) const;
+
+  /// S3 delete objects operation: delete_object() for all `keys`, objects
+  /// that don't exist included, in a single transaction. Returns what
+  /// deleting each key did in `out_results`, in the order of `keys`.
+  /// Return indicates if operation succeeded
+  bool delete_objects(
+      const std::vector<rgw_obj_key>& keys, bool versioned_bucket,
+      std::vector<sqlite::DBDeleteObjectKey>& out_results,
+      optional_yield y = null_yield
   ) const;
 
   /// Delete a non-existing object. Creates object with toumbstone
@@ -16,6 +16,7 @@
 #include <filesystem>
 
 #include "driver/sfs/bucket.h"
+#include "rgw/driver/sfs/sqlite/sqlite_stats.h"
 #include "rgw/driver/sfs/sqlite/sqlite_users.h"
 #include "rgw_sal_sfs.h"
 
@@ -39,12 +40,27 @@ int SFSUser::merge_and_store_attrs(
 }
 
 int SFSUser::read_stats(
-    const DoutPrefixProvider* dpp, optional_yield /*y*/,
-    RGWStorageStats* /*stats*/, ceph::real_time* /*last_stats_sync*/,
-    ceph::real_time* /*last_stats_update*/
+    const DoutPrefixProvider* /*dpp*/, optional_yield /*y*/,
+    RGWStorageStats* stats, ceph::real_time* last_stats_sync,
+    ceph::real_time* last_stats_update
 ) {
   /** Read the User stats from the backing Store, synchronous */
-  ldpp_dout(dpp, 1) << __func__ << ": WARNING faked call" << dendl;
+  sfs::sqlite::SQLiteStats statsdb(store->db_conn);
+  const auto user_stats = statsdb.get_user_stats(get_id().id);
+  if (stats) {
+    stats->category = RGWObjCategory::Main;
+    stats->size = stats->size_utilized = user_stats.size;
+    stats->size_rounded = user_stats.size_rounded;
+    stats->num_objects = user_stats.obj_count;
+  }
+  // the counters are always current
+  const auto now = ceph::real_clock::now();
+  if (last_stats_sync) {
+    *last_stats_sync = now;
+  }
+  if (last_stats_update) {
+    *last_stats_update = now;
+  }
   return 0;
 }
 
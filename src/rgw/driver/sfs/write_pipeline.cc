@@ -0,0 +1,157 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#include "write_pipeline.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "common/Thread.h"
+
+namespace rgw::sal::sfs {
+
+DataIOQueue::DataIOQueue(size_t num_threads, const char* thread_name)
+    : stopping(false) {
+  num_threads = std::max<size_t>(num_threads, 1);
+  threads.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.push_back(
+        make_named_thread(thread_name, &DataIOQueue::worker, this)
+    );
+  }
+}
+
+DataIOQueue::~DataIOQueue() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void DataIOQueue::enqueue(std::function<void()>&& job) {
+  {
+    std::lock_guard lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  cond.notify_one();
+}
+
+void DataIOQueue::run(const std::function<void()>& job, optional_yield y) {
+  if (!y) {
+    job();
+    return;
+  }
+  auto& yield = y.get_yield_context();
+  boost::asio::async_completion<yield_context, void()> init(yield);
+  // the handler runs on the strand of the coroutine
+  auto completion = Completion::create(
+      y.get_io_context().get_executor(), std::move(init.completion_handler)
+  );
+  // `job` outlives the queued one, the coroutine resumes after it. Jobs
+  // are copyable, so the completion is held by its raw pointer.
+  enqueue([&job, completion = completion.release()]() {
+    job();
+    ceph::async::post(std::unique_ptr<Completion>(completion));
+  });
+  init.result.get();
+}
+
+void DataIOQueue::worker() {
+  std::unique_lock lock(mutex);
+  while (true) {
+    cond.wait(lock, [this]() { return stopping || !jobs.empty(); });
+    if (jobs.empty()) {
+      return;
+    }
+    auto job = std::move(jobs.front());
+    jobs.pop_front();
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+WritePipeline::WritePipeline(DataIOQueue* _queue, size_t _depth)
+    : queue(_queue), depth(_depth), in_flight(0), error(0), wait_for(0) {}
+
+WritePipeline::~WritePipeline() {
+  wait(0, null_yield);
+}
+
+void WritePipeline::finish(int ret) {
+  std::lock_guard lock(mutex);
+  if (ret < 0 && error == 0) {
+    error = ret;
+  }
+  in_flight--;
+  if (in_flight > wait_for) {
+    return;
+  }
+  if (completion) {
+    ceph::async::post(std::move(completion));
+  } else {
+    cond.notify_all();
+  }
+}
+
+int WritePipeline::wait(size_t max_in_flight, optional_yield y) {
+  std::unique_lock lock(mutex);
+  while (in_flight > max_in_flight) {
+    wait_for = max_in_flight;
+    if (y) {
+      auto& yield = y.get_yield_context();
+      boost::asio::async_completion<yield_context, void()> init(yield);
+      // the handler runs on the strand of the coroutine
+      completion = Completion::create(
+          y.get_io_context().get_executor(), std::move(init.completion_handler)
+      );
+      lock.unlock();
+      init.result.get();
+      lock.lock();
+    } else {
+      cond.wait(lock);
+    }
+  }
+  return error;
+}
+
+int WritePipeline::write(
+    int fd, bufferlist&& data, uint64_t offset, optional_yield y
+) {
+  if (queue == nullptr || depth == 0) {
+    return data.write_fd(fd, offset);
+  }
+  // make room for this write
+  const int ret = wait(depth - 1, y);
+  if (ret < 0) {
+    return ret;
+  }
+  {
+    std::lock_guard lock(mutex);
+    in_flight++;
+  }
+  queue->enqueue([this, fd, offset, data = std::move(data)]() mutable {
+    finish(data.write_fd(fd, offset));
+  });
+  return 0;
+}
+
+int WritePipeline::drain(optional_yield y) {
+  return wait(0, y);
+}
+
+}  // namespace rgw::sal::sfs
@@ -0,0 +1,102 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t
+// vim: ts=8 sw=2 smarttab ft=cpp
+/*
+ * Ceph - scalable distributed file system
+ * SFS SAL implementation
+ *
+ * Copyright (C) 2023 SUSE LLC
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/async/completion.h"
+#include "common/async/yield_context.h"
+#include "include/buffer.h"
+
+namespace rgw::sal::sfs {
+
+/// Threads doing the blocking data file I/O of requests: the writes of
+/// WritePipelines, and the reads of objects through run(). SFStore has
+/// one queue for each.
+class DataIOQueue {
+  using Completion = ceph::async::Completion<void()>;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::function<void()>> jobs;
+  std::vector<std::thread> threads;
+  bool stopping;
+
+  void worker();
+
+ public:
+  DataIOQueue(size_t num_threads, const char* thread_name);
+  DataIOQueue(const DataIOQueue&) = delete;
+  DataIOQueue& operator=(const DataIOQueue&) = delete;
+  /// Runs the jobs still queued before returning
+  ~DataIOQueue();
+
+  void enqueue(std::function<void()>&& job);
+  /// Runs `job` on one of the threads and returns once it is done. The
+  /// coroutine of the request is suspended meanwhile; without one the
+  /// job runs on the calling thread, which would only block waiting.
+  void run(const std::function<void()>& job, optional_yield y);
+};
+
+/// Writes the data of a file in the background, so that a writer
+/// receives and hashes the next piece of an upload while the previous
+/// one is written out. At most `depth` pieces are in flight: write()
+/// waits for one of them to finish beyond that, suspending the
+/// coroutine of the request instead of blocking its thread if it has
+/// one.
+///
+/// A failed write is reported by the following write() or drain().
+/// Without a queue, or with a depth of 0, writes are synchronous.
+class WritePipeline {
+  using Completion = ceph::async::Completion<void()>;
+
+  DataIOQueue* const queue;
+  const size_t depth;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t in_flight;
+  /// of the first write that failed, as a negative errno
+  int error;
+  /// the waiter is done once no more than this many writes are in flight
+  size_t wait_for;
+  /// resumes the coroutine waiting in wait(), if any
+  std::unique_ptr<Completion> completion;
+
+  void finish(int ret);
+  int wait(size_t max_in_flight, optional_yield y);
+
+ public:
+  WritePipeline(DataIOQueue* queue, size_t depth);
+  WritePipeline(const WritePipeline&) = delete;
+  WritePipeline& operator=(const WritePipeline&) = delete;
+  /// Waits for the writes in flight
+  ~WritePipeline();
+
+  /// Writes `data` at `offset` of `fd`, which must stay open until
+  /// drain() returns. Returns 0 or the negative errno of a failed write.
+  int write(int fd, bufferlist&& data, uint64_t offset, optional_yield y);
+  /// Waits for the writes in flight. Returns 0 or the negative errno of
+  /// a failed write.
+  int drain(optional_yield y);
+};
+
+}  // namespace rgw::sal::sfs
@@ -17,6 +17,7 @@
 #include <fmt/ostream.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <memory>
 #include <ranges>
@@ -28,8 +29,10 @@
 #include "rgw/driver/sfs/fmt.h"
 #include "rgw/driver/sfs/multipart_types.h"
 #include "rgw/driver/sfs/sqlite/sqlite_multipart.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
 #include "rgw_common.h"
 #include "rgw_obj_manifest.h"
+#include "rgw_perf_counters.h"
 #include "rgw_sal.h"
 #include "rgw_sal_sfs.h"
 
@@ -37,22 +40,57 @@
 
 using namespace std;
 
-static int close_fd_for(
-    int& fd, const DoutPrefixProvider* dpp, const std::string& whom,
-    bool* io_failed
+/// Makes the data written to fd durable, along with the files of other
+/// writers if `syncer` is set, or with fsync() otherwise. Only a failed
+/// batched sync is returned, as a negative errno: the upload must not be
+/// acknowledged then.
+static int sync_fd_for(
+    int fd, rgw::sal::sfs::DataSyncer* syncer, const DoutPrefixProvider* dpp,
+    const std::string& whom, optional_yield y
 ) noexcept {
   ceph_assert(fd >= 0);
-  int result = 0;
-  int ret;
-
-  ret = ::fsync(fd);
+  if (syncer == nullptr) {
+    if (::fsync(fd) < 0) {
+      lsfs_dout_for(dpp, -1, whom) << fmt::format(
+                                          "failed to fsync fd:{}: {}. "
+                                          "continuing.",
+                                          fd, cpp_strerror(errno)
+                                      )
+                                   << dendl;
+    }
+    return 0;
+  }
+  const int ret = syncer->sync(fd, y);
   if (ret < 0) {
     lsfs_dout_for(dpp, -1, whom)
         << fmt::format(
-               "failed to fsync fd:{}: {}. continuing.", fd, cpp_strerror(errno)
+               "failed to sync fd:{}: {}. failing operation.", fd,
+               cpp_strerror(ret)
            )
         << dendl;
   }
+  return ret;
+}
+
+/// Maps a failed data write, sync or metadata update, as a negative
+/// errno, to the error returned to the client
+static int write_error_to_s3(int ret) noexcept {
+  switch (ret) {
+    case -EDQUOT:
+    case -ENOSPC:
+      return -ERR_QUOTA_EXCEEDED;
+    default:
+      return -ERR_INTERNAL_ERROR;
+  }
+}
+
+static int close_fd_for(
+    int& fd, const DoutPrefixProvider* dpp, const std::string& whom,
+    bool* io_failed
+) noexcept {
+  ceph_assert(fd >= 0);
+  int result = 0;
+  int ret;
 
   ret = ::close(fd);
   fd = -1;
@@ -62,14 +100,7 @@ static int close_fd_for(
                "failed closing fd:{}: {}. continuing.", fd, cpp_strerror(errno)
            )
         << dendl;
-    switch (ret) {
-      case -EDQUOT:
-      case -ENOSPC:
-        result = -ERR_QUOTA_EXCEEDED;
-        break;
-      default:
-        result = -ERR_INTERNAL_ERROR;
-    }
+    result = write_error_to_s3(ret);
     if (io_failed) {
       *io_failed = true;
     }
@@ -94,8 +125,13 @@ SFSAtomicWriter::SFSAtomicWriter(
       olh_epoch(_olh_epoch),
       unique_tag(_unique_tag),
       bytes_written(0),
+      y(_y),
       io_failed(false),
-      fd(-1) {
+      fd(-1),
+      pipeline(_store->data_write_queue.get(), _store->write_pipeline_depth),
+      pack_threshold(0),
+      inline_threshold(0),
+      packing(false) {
   lsfs_dout(dpp, 10) << fmt::format(
                             "head_obj: {}, bucket: {}", _head_obj->get_key(),
                             _head_obj->get_bucket()->get_name()
@@ -128,15 +164,19 @@ SFSAtomicWriter::~SFSAtomicWriter() {
         << dendl;
     close();
   }
+  if (packed_segment.has_value()) {
+    store->packer->release(*packed_segment);
+  }
 }
 
 int SFSAtomicWriter::open() noexcept {
-  std::error_code ec;
-  std::filesystem::create_directories(object_path.parent_path(), ec);
-  if (ec) {
-    lsfs_dout(dpp, -1) << "failed to mkdir object path " << object_path << ": "
-                       << ec << dendl;
-    switch (ec.value()) {
+  const int ret = open_data_file(
+      object_path, O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY, 0644
+  );
+  if (ret < 0) {
+    lsfs_dout(dpp, -1) << "error opening file " << object_path << ": "
+                       << cpp_strerror(-ret) << dendl;
+    switch (-ret) {
       case ENOSPC:
         return -ERR_QUOTA_EXCEEDED;
       default:
@@ -144,22 +184,50 @@ int SFSAtomicWriter::open() noexcept {
     }
   }
 
-  int ret;
-  ret = ::open(
-      object_path.c_str(), O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY, 0644
-  );
-  if (ret < 0) {
-    lsfs_dout(dpp, -1) << "error opening file " << object_path << ": "
-                       << cpp_strerror(errno) << dendl;
-    return -ERR_INTERNAL_ERROR;
-  }
-
   fd = ret;
   return 0;
 }
 
 int SFSAtomicWriter::close() noexcept {
-  return close_fd_for(fd, dpp, get_cls_name(), &io_failed);
+  // failed writes were reported already
+  pipeline.drain(y);
+  const int sync_ret =
+      sync_fd_for(fd, store->data_syncer.get(), dpp, get_cls_name(), y);
+  const int ret = close_fd_for(fd, dpp, get_cls_name(), &io_failed);
+  if (sync_ret < 0) {
+    io_failed = true;
+    return write_error_to_s3(sync_ret);
+  }
+  return ret;
+}
+
+int SFSAtomicWriter::pack() noexcept {
+  uint64_t segment_id;
+  uint64_t segment_offset;
+  const int ret =
+      store->packer->append(pack_buffer, &segment_id, &segment_offset);
+  if (ret < 0) {
+    lsfs_dout(dpp, -1) << fmt::format(
+                              "failed to pack {} bytes: {}. failing operation.",
+                              pack_buffer.length(), cpp_strerror(-ret)
+                          )
+                       << dendl;
+    io_failed = true;
+    return write_error_to_s3(ret);
+  }
+  packed_segment = segment_id;
+  // stored by metadata_finish(), in the transaction committing the version
+  objref->set_packed_data(segment_id, segment_offset, pack_buffer.length());
+  lsfs_dout(dpp, 10) << fmt::format(
+                            "packed {} bytes in segment {} at offset {}",
+                            pack_buffer.length(), segment_id, segment_offset
+                        )
+                     << dendl;
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_sfs_pack_objects);
+    perfcounter->inc(l_rgw_sfs_pack_bytes, pack_buffer.length());
+  }
+  return 0;
 }
 
 void SFSAtomicWriter::cleanup() noexcept {
@@ -170,26 +238,29 @@ void SFSAtomicWriter::cleanup() noexcept {
                         )
                      << dendl;
 
-  std::error_code ec;
-  std::filesystem::remove(object_path, ec);
-  if (ec) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "failed deleting file {}: {} {}. ignoring.",
-                              object_path.string(), ec.message(), ec.value()
-                          )
-                       << dendl;
-  }
+  // packed data is left as garbage in its segment, there is no file
+  if (!packing) {
+    std::error_code ec;
+    std::filesystem::remove(object_path, ec);
+    if (ec) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed deleting file {}: {} {}. ignoring.",
+                                object_path.string(), ec.message(), ec.value()
+                            )
+                         << dendl;
+    }
 
-  const auto dir_fd = ::open(object_path.parent_path().c_str(), O_RDONLY);
-  int ret = ::fsync(dir_fd);
-  if (ret < 0) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "failed fsyncing dir {} fd:{} for obj file {}: {}. ignoring.",
-               object_path.parent_path().string(), dir_fd, object_path.string(),
-               cpp_strerror(errno)
-           )
-        << dendl;
+    const auto dir_fd = ::open(object_path.parent_path().c_str(), O_RDONLY);
+    int ret = ::fsync(dir_fd);
+    if (ret < 0) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed fsyncing dir {} fd:{} for obj file "
+                                "{}: {}. ignoring.",
+                                object_path.parent_path().string(), dir_fd,
+                                object_path.string(), cpp_strerror(errno)
+                            )
+                         << dendl;
+    }
   }
 
   try {
@@ -219,7 +290,7 @@ int SFSAtomicWriter::prepare(optional_yield /*y*/) {
     return -ERR_QUOTA_EXCEEDED;
   }
 
-  objref = bucketref->create_version(obj.get_key());
+  objref = bucketref->create_version(obj.get_key(), y);
   if (!objref) {
     lsfs_dout(dpp, -1)
         << fmt::format(
@@ -233,6 +304,19 @@ int SFSAtomicWriter::prepare(optional_yield /*y*/) {
   }
   object_path = store->get_data_path() / objref->get_storage_path();
 
+  pack_threshold = store->ctx()->_conf.get_val<Option::size_t>(
+      "rgw_sfs_pack_threshold"
+  );
+  inline_threshold = store->ctx()->_conf.get_val<Option::size_t>(
+      "rgw_sfs_inline_threshold"
+  );
+  packing = pack_threshold > 0 || inline_threshold > 0;
+  if (packing) {
+    // the object may be small enough to be packed or inlined. Wait for
+    // its data.
+    return 0;
+  }
+
   lsfs_dout(dpp, 10) << "creating file at " << object_path << dendl;
 
   return open();
@@ -255,8 +339,31 @@ int SFSAtomicWriter::process(bufferlist&& data, uint64_t offset) {
     return 0;
   }
 
+  if (packing) {
+    const auto len = data.length();
+    if (bytes_written + len <= std::max(pack_threshold, inline_threshold)) {
+      pack_buffer.claim_append(data);
+      bytes_written += len;
+      return 0;
+    }
+    // too large to be packed: write out what was held back so far along
+    // with this piece
+    packing = false;
+    lsfs_dout(dpp, 10) << "creating file at " << object_path << dendl;
+    const int ret = open();
+    if (ret < 0) {
+      io_failed = true;
+      return ret;
+    }
+    pack_buffer.claim_append(data);
+    data.swap(pack_buffer);
+    offset = 0;
+    bytes_written = 0;
+  }
+
   ceph_assert(fd >= 0);
-  int write_ret = data.write_fd(fd, offset);
+  const auto len = data.length();
+  int write_ret = pipeline.write(fd, std::move(data), offset, y);
   if (write_ret < 0) {
     lsfs_dout(dpp, -1) << fmt::format(
                               "failed to write size:{} offset:{} to fd:{}: {}. "
@@ -264,21 +371,15 @@ int SFSAtomicWriter::process(bufferlist&& data, uint64_t offset) {
                               "failing future io. "
                               "will delete partial data on completion. "
                               "returning internal error.",
-                              data.length(), offset, fd, cpp_strerror(errno)
+                              len, offset, fd, cpp_strerror(write_ret)
                           )
                        << dendl;
     io_failed = true;
     close();
     cleanup();
-    switch (write_ret) {
-      case -EDQUOT:
-      case -ENOSPC:
-        return -ERR_QUOTA_EXCEEDED;
-      default:
-        return -ERR_INTERNAL_ERROR;
-    }
+    return write_error_to_s3(write_ret);
   }
-  bytes_written += data.length();
+  bytes_written += len;
   return 0;
 }
 
@@ -311,12 +412,42 @@ int SFSAtomicWriter::complete(
                bytes_written, accounted_size
            )
         << dendl;
-    close();
+    if (fd >= 0) {
+      close();
+    }
     cleanup();
     return -ERR_INTERNAL_ERROR;
   }
 
-  int result = close();
+  if (!packing) {
+    const int ret = pipeline.drain(y);
+    if (ret < 0) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "failed to write to fd:{}: {}. "
+                                "failing operation.",
+                                fd, cpp_strerror(ret)
+                            )
+                         << dendl;
+      io_failed = true;
+      close();
+      cleanup();
+      return write_error_to_s3(ret);
+    }
+  }
+
+  int result = 0;
+  if (!packing) {
+    result = close();
+  } else if (bytes_written <= inline_threshold) {
+    // committed along with the metadata below
+    objref->set_inline_data(pack_buffer);
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_sfs_inline_objects);
+      perfcounter->inc(l_rgw_sfs_inline_bytes, bytes_written);
+    }
+  } else {
+    result = pack();
+  }
   if (io_failed) {
     cleanup();
     return result;
@@ -364,7 +495,9 @@ int SFSAtomicWriter::complete(
     *out_mtime = now;
   }
   try {
-    objref->metadata_finish(store, bucketref->get_info().versioning_enabled());
+    objref->metadata_finish(
+        store, bucketref->get_info().versioning_enabled(), y
+    );
   } catch (const std::system_error& e) {
     lsfs_dout(dpp, -1) << fmt::format(
                               "failed to update db object {}: {}. "
@@ -374,19 +507,28 @@ int SFSAtomicWriter::complete(
                        << dendl;
     io_failed = true;
     cleanup();
-    switch (e.code().value()) {
-      case -EDQUOT:
-      case -ENOSPC:
-        return -ERR_QUOTA_EXCEEDED;
-      default:
-        return -ERR_INTERNAL_ERROR;
-    }
+    return write_error_to_s3(e.code().value());
   }
   return 0;
 }
 
 namespace sfs {
 
+SFSMultipartWriterV2::SFSMultipartWriterV2(
+    const DoutPrefixProvider* _dpp, optional_yield _y,
+    const std::string& _upload_id, const rgw::sal::SFStore* _store,
+    uint32_t _part_num
+)
+    : StoreWriter(_dpp, _y),
+      store(_store),
+      upload_id(_upload_id),
+      part_num(_part_num),
+      y(_y),
+      bytes_written(0),
+      fd(-1),
+      pipeline(_store->data_write_queue.get(), _store->write_pipeline_depth),
+      synced(false) {}
+
 SFSMultipartWriterV2::~SFSMultipartWriterV2() {
   if (fd > 0) {
     close();
@@ -394,6 +536,10 @@ SFSMultipartWriterV2::~SFSMultipartWriterV2() {
 }
 
 int SFSMultipartWriterV2::close() noexcept {
+  pipeline.drain(y);
+  if (!synced) {
+    sync_fd_for(fd, store->data_syncer.get(), dpp, get_cls_name(), y);
+  }
   return close_fd_for(fd, dpp, get_cls_name(), nullptr);
 }
 
@@ -421,9 +567,15 @@ int SFSMultipartWriterV2::prepare(optional_yield /* y */) {
   sqlite::SQLiteMultipart mpdb(store->db_conn);
 
   // create part entry if it doesn't exist. Will also move the upload to "in
-  // progress" if it's still in "init".
+  // progress" if it's still in "init", and register it for process() to
+  // check its state.
   std::string error_str;
-  auto entry = mpdb.create_or_reset_part(upload_id, part_num, &error_str);
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_sfs_multipart_parts);
+    perfcounter->inc(l_rgw_sfs_multipart_part_db_queries);
+  }
+  auto entry =
+      mpdb.create_or_reset_part(upload_id, part_num, &error_str, &upload);
   if (!entry.has_value()) {
     lsfs_dout(dpp, -1)
         << fmt::format(
@@ -434,62 +586,58 @@ int SFSMultipartWriterV2::prepare(optional_yield /* y */) {
     return -ERR_NO_SUCH_UPLOAD;
   }
 
-  // prepare upload's file paths.
-  auto mp = mpdb.get_multipart(upload_id);
-  if (!mp.has_value()) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "multipart upload {} not found!", upload_id
-                          )
-                       << dendl;
-    return -ERR_NO_SUCH_UPLOAD;
-  }
-  if (mp->state != MultipartState::INPROGRESS) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "multipart upload {} not available -- raced with "
-                              "abort or complete!",
-                              upload_id
-                          )
-                       << dendl;
-    return -ERR_NO_SUCH_UPLOAD;
+  ceph_assert(upload);
+  int ret = check_upload_in_progress();
+  if (ret < 0) {
+    return ret;
   }
 
-  MultipartPartPath partpath(mp->path_uuid, entry->id);
+  // prepare upload's file paths.
+  MultipartPartPath partpath(upload->path_uuid, entry->id);
   std::filesystem::path path = store->get_data_path() / partpath.to_path();
 
-  std::error_code ec;
-  std::filesystem::create_directories(path.parent_path(), ec);
-  if (ec) {
-    lsfs_dout(dpp, -1)
-        << fmt::format(
-               "error creating multipart upload's part paths: {}", ec.message()
-           )
-        << dendl;
-    return -ERR_INTERNAL_ERROR;
-  }
-
-  // truncate file
-
-  int ret =
-      ::open(path.c_str(), O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY, 0600);
+  // truncate file. It's synced when closed, once written.
+  ret = open_data_file(path, O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY, 0600);
   if (ret < 0) {
     lsfs_dout(
         dpp, -1
-    ) << fmt::format("error opening file {}: {}", path, cpp_strerror(errno))
+    ) << fmt::format("error opening file {}: {}", path, cpp_strerror(-ret))
       << dendl;
     return -ERR_INTERNAL_ERROR;
   }
 
   fd = ret;
+  return 0;
+}
 
-  ret = ::fsync(fd);
-  if (ret < 0) {
-    lsfs_dout(
-        dpp, -1
-    ) << fmt::format("error sync'ing opened file: {}", cpp_strerror(errno))
-      << dendl;
-    return -ERR_INTERNAL_ERROR;
+int SFSMultipartWriterV2::check_upload_in_progress() {
+  auto state = upload->state.load();
+  if (state == MultipartState::NONE) {
+    // changed in bulk, read what it changed to
+    auto& registry = store->db_conn->multipart_registry;
+    const auto generation = registry.get_generation();
+    sqlite::SQLiteMultipart mpdb(store->db_conn);
+    if (perfcounter) perfcounter->inc(l_rgw_sfs_multipart_part_db_queries);
+    auto mp = mpdb.get_multipart(upload_id);
+    if (!mp.has_value()) {
+      lsfs_dout(dpp, -1) << fmt::format(
+                                "multipart upload {} not found!", upload_id
+                            )
+                         << dendl;
+      return -ERR_NO_SUCH_UPLOAD;
+    }
+    state = mp->state;
+    registry.refresh(*upload, state, generation);
+  }
+  if (state != MultipartState::INPROGRESS) {
+    lsfs_dout(dpp, -1) << fmt::format(
+                              "multipart upload {} not available -- raced with "
+                              "abort or complete!",
+                              upload_id
+                          )
+                       << dendl;
+    return -ERR_NO_SUCH_UPLOAD;
   }
-
   return 0;
 }
 
@@ -503,23 +651,10 @@ int SFSMultipartWriterV2::process(bufferlist&& data, uint64_t offset) {
          )
       << dendl;
 
-  sqlite::SQLiteMultipart mpdb(store->db_conn);
-  auto mp = mpdb.get_multipart(upload_id);
-  if (!mp.has_value()) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "multipart upload {} not found!", upload_id
-                          )
-                       << dendl;
-    return -ERR_NO_SUCH_UPLOAD;
-  }
-  if (mp->state != MultipartState::INPROGRESS) {
-    lsfs_dout(dpp, -1) << fmt::format(
-                              "multipart upload {} not available -- raced with "
-                              "abort or complete!",
-                              upload_id
-                          )
-                       << dendl;
-    return -ERR_NO_SUCH_UPLOAD;
+  ceph_assert(upload);
+  const int ret = check_upload_in_progress();
+  if (ret < 0) {
+    return ret;
   }
 
   if (len == 0) {
@@ -528,7 +663,7 @@ int SFSMultipartWriterV2::process(bufferlist&& data, uint64_t offset) {
   }
 
   ceph_assert(fd >= 0);
-  int write_ret = data.write_fd(fd, offset);
+  int write_ret = pipeline.write(fd, std::move(data), offset, y);
   if (write_ret < 0) {
     lsfs_dout(dpp, -1)
         << fmt::format(
@@ -536,13 +671,7 @@ int SFSMultipartWriterV2::process(bufferlist&& data, uint64_t offset) {
                offset, fd, cpp_strerror(write_ret)
            )
         << dendl;
-    switch (write_ret) {
-      case -EDQUOT:
-      case -ENOSPC:
-        return -ERR_QUOTA_EXCEEDED;
-      default:
-        return -ERR_INTERNAL_ERROR;
-    }
+    return write_error_to_s3(write_ret);
   }
   bytes_written += len;
   return 0;
@@ -585,9 +714,33 @@ int SFSMultipartWriterV2::complete(
     return -ERR_INTERNAL_ERROR;
   }
 
+  // the part must be written out before it's finished
+  const int write_ret = pipeline.drain(y);
+  if (write_ret < 0) {
+    lsfs_dout(dpp, -1) << fmt::format(
+                              "failed to write part {} of upload_id {}: {}",
+                              part_num, upload_id, cpp_strerror(write_ret)
+                          )
+                       << dendl;
+    return write_error_to_s3(write_ret);
+  }
+
+  // with batched syncs the part is made durable before it's finished
+  if (store->data_syncer) {
+    const int sync_ret =
+        sync_fd_for(fd, store->data_syncer.get(), dpp, get_cls_name(), y);
+    if (sync_ret < 0) {
+      return write_error_to_s3(sync_ret);
+    }
+    synced = true;
+  }
+
   // finish part in db
   sqlite::SQLiteMultipart mpdb(store->db_conn);
-  auto res = mpdb.finish_part(upload_id, part_num, etag, bytes_written);
+  if (perfcounter) perfcounter->inc(l_rgw_sfs_multipart_part_db_queries);
+  ceph::real_time part_mtime;
+  auto res =
+      mpdb.finish_part(upload_id, part_num, etag, bytes_written, &part_mtime);
   if (!res) {
     lsfs_dout(dpp, -1) << fmt::format(
                               "unable to finish upload_id {}, part_num {}",
@@ -596,12 +749,8 @@ int SFSMultipartWriterV2::complete(
                        << dendl;
     return -ERR_INTERNAL_ERROR;
   }
-  auto entry = mpdb.get_part(upload_id, part_num);
-  ceph_assert(entry.has_value());
-  ceph_assert(entry->mtime.has_value());
-
   if (mtime) {
-    *mtime = *entry->mtime;
+    *mtime = part_mtime;
   }
 
   return 0;
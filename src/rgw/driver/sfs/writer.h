@@ -15,9 +15,12 @@
 #define RGW_STORE_SFS_WRITER_H
 
 #include <memory>
+#include <optional>
 
 #include "driver/sfs/bucket.h"
 #include "driver/sfs/object.h"
+#include "driver/sfs/sqlite/buckets/multipart_registry.h"
+#include "driver/sfs/write_pipeline.h"
 #include "rgw_sal.h"
 #include "rgw_sal_store.h"
 
@@ -40,11 +43,27 @@ class SFSAtomicWriter : public StoreWriter {
 
  private:
   std::filesystem::path object_path;
+  optional_yield y;
   bool io_failed;
   int fd;
+  /// writes the data to fd while the next piece is received
+  sfs::WritePipeline pipeline;
+  /// Objects up to this size are packed (see sfs::SegmentPacker), 0 if
+  /// packing is disabled
+  uint64_t pack_threshold;
+  /// Objects up to this size are stored inline in the database, 0 if
+  /// disabled. Takes precedence over packing.
+  uint64_t inline_threshold;
+  /// Set while the data fits in pack_buffer. The data file is only
+  /// created once the object outgrows both thresholds.
+  bool packing;
+  bufferlist pack_buffer;
+  /// segment the object was packed in, until the writer is done
+  std::optional<uint64_t> packed_segment;
 
   int open() noexcept;
   int close() noexcept;
+  int pack() noexcept;
   void cleanup() noexcept;
 
  public:
@@ -75,21 +94,22 @@ class SFSMultipartWriterV2 : public StoreWriter {
   const rgw::sal::SFStore* store;
   const std::string upload_id;
   uint32_t part_num;
+  optional_yield y;
   uint64_t bytes_written;
   int fd;
+  sfs::WritePipeline pipeline;
+  /// the part was made durable by the store's data syncer on completion,
+  /// and isn't synced again when closed
+  bool synced;
+  /// the state of the upload, published by SQLiteMultipart
+  std::shared_ptr<sfs::sqlite::MultipartUploadState> upload;
 
  public:
   SFSMultipartWriterV2(
       const DoutPrefixProvider* _dpp, optional_yield _y,
       const std::string& _upload_id, const rgw::sal::SFStore* _store,
       uint32_t _part_num
-  )
-      : StoreWriter(_dpp, _y),
-        store(_store),
-        upload_id(_upload_id),
-        part_num(_part_num),
-        bytes_written(0),
-        fd(-1) {}
+  );
   virtual ~SFSMultipartWriterV2();
 
   virtual int prepare(optional_yield y) override;
@@ -106,6 +126,8 @@ class SFSMultipartWriterV2 : public StoreWriter {
 
  private:
   int close() noexcept;
+  /// Returns 0 if the upload is still in progress
+  int check_upload_in_progress();
 };
 
 }  // namespace sfs
@@ -74,6 +74,11 @@ extern "C" {
 #include "driver/rados/rgw_bucket.h"
 #include "driver/rados/rgw_sal_rados.h"
 
+#ifdef WITH_RADOSGW_SFS
+#include "rgw_sal_sfs.h"
+#include "driver/sfs/sqlite/sqlite_stats.h"
+#endif
+
 #define dout_context g_ceph_context
 
 #define SECRET_KEY_LEN 40
@@ -318,6 +323,7 @@ void usage()
   cout << "  script-package add         add a lua package to the scripts allowlist\n";
   cout << "  script-package rm          remove a lua package from the scripts allowlist\n";
   cout << "  script-package list        get the lua packages allowlist\n";
+  cout << "  sfs stats rebuild          recompute the sfs bucket and user usage counters\n";
   cout << "options:\n";
   cout << "   --tenant=<tenant>         tenant name\n";
   cout << "   --user_ns=<namespace>     namespace of user (oidc in case of users authenticated with oidc provider)\n";
@@ -838,7 +844,8 @@ enum class OPT {
   SCRIPT_RM,
   SCRIPT_PACKAGE_ADD,
   SCRIPT_PACKAGE_RM,
-  SCRIPT_PACKAGE_LIST
+  SCRIPT_PACKAGE_LIST,
+  SFS_STATS_REBUILD
 };
 
 }
@@ -1070,6 +1077,7 @@ static SimpleCmd::Commands all_cmds = {
   { "script-package add", OPT::SCRIPT_PACKAGE_ADD },
   { "script-package rm", OPT::SCRIPT_PACKAGE_RM },
   { "script-package list", OPT::SCRIPT_PACKAGE_LIST },
+  { "sfs stats rebuild", OPT::SFS_STATS_REBUILD },
 };
 
 static SimpleCmd::Aliases cmd_aliases = {
@@ -10609,6 +10617,34 @@ next:
 #endif
   }
 
+  if (opt_cmd == OPT::SFS_STATS_REBUILD) {
+#ifdef WITH_RADOSGW_SFS
+    auto sfs_store = dynamic_cast<rgw::sal::SFStore*>(driver);
+    if (!sfs_store) {
+      cerr << "ERROR: only supported by the sfs backend" << std::endl;
+      return EINVAL;
+    }
+    rgw::sal::sfs::sqlite::SQLiteStats::RebuildResult result;
+    try {
+      rgw::sal::sfs::sqlite::SQLiteStats stats(sfs_store->db_conn);
+      result = stats.rebuild();
+    } catch (const std::exception& e) {
+      cerr << "ERROR: failed to rebuild the sfs stats: " << e.what() << std::endl;
+      return EIO;
+    }
+    formatter->open_object_section("result");
+    encode_json("buckets", result.buckets, formatter.get());
+    encode_json("buckets_fixed", result.buckets_fixed, formatter.get());
+    encode_json("users", result.users, formatter.get());
+    encode_json("users_fixed", result.users_fixed, formatter.get());
+    formatter->close_section();
+    formatter->flush(cout);
+#else
+    cerr << "ERROR: sfs support is not built in" << std::endl;
+    return EPERM;
+#endif
+  }
+
   return 0;
 }
 
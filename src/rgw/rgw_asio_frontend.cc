@@ -1,6 +1,9 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab ft=cpp
 
+#include <pthread.h>
+#include <sched.h>
+
 #include <atomic>
 #include <ctime>
 #include <thread>
@@ -15,6 +18,8 @@
 
 #include "common/async/shared_mutex.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
+#include "common/perf_counters_collection.h"
 #include "common/strtol.h"
 
 #include "rgw_asio_client.h"
@@ -63,6 +68,34 @@ auto make_stack_allocator() {
   return boost::context::protected_fixedsize_stack{512*1024};
 }
 
+// counters of each io_context shard, see rgw_beast_io_shards
+namespace shard_counters {
+
+enum {
+  l_first = 429000,
+  l_connections,
+  l_active_connections,
+  l_requests,
+  l_request_latency,
+  l_last,
+};
+
+PerfCountersRef build(CephContext *cct, size_t shard)
+{
+  PerfCountersBuilder b(cct, "beast_shard." + std::to_string(shard),
+                        l_first, l_last);
+  b.add_u64_counter(l_connections, "connections", "Connections accepted");
+  b.add_u64(l_active_connections, "active_connections", "Open connections");
+  b.add_u64_counter(l_requests, "requests", "Requests processed");
+  b.add_time_avg(l_request_latency, "request_latency", "Request latency");
+
+  auto logger = PerfCountersRef{ b.create_perf_counters(), cct };
+  cct->get_perfcounters_collection()->add(logger.get());
+  return logger;
+}
+
+} // namespace shard_counters
+
 using namespace std;
 
 template <typename Stream>
@@ -192,6 +225,7 @@ void handle_connection(boost::asio::io_context& context,
                        parse_buffer& buffer, bool is_ssl,
                        SharedMutex& pause_mutex,
                        rgw::dmclock::Scheduler *scheduler,
+                       PerfCounters *counters,
                        const std::string& uri_prefix,
                        boost::system::error_code& ec,
                        yield_context yield)
@@ -283,6 +317,11 @@ void handle_connection(boost::asio::io_context& context,
       ceph::coarse_real_clock::duration latency{};
       process_request(env, &req, uri_prefix, &client, y,
                       scheduler, &user, &latency, &http_ret);
+      if (counters) {
+        counters->inc(shard_counters::l_requests);
+        counters->tinc(shard_counters::l_request_latency,
+                       std::chrono::duration_cast<ceph::timespan>(latency));
+      }
 
       if (cct->_conf->subsys.should_gather(ceph_subsys_rgw_access, 1)) {
         // access log line elements begin per Apache Combined Log Format with additions following
@@ -347,9 +386,20 @@ struct Connection : boost::intrusive::list_base_hook<>,
 {
   tcp_socket socket;
   parse_buffer buffer;
+  PerfCounters *counters;
 
-  explicit Connection(tcp_socket&& socket) noexcept
-      : socket(std::move(socket)) {}
+  Connection(tcp_socket&& socket, PerfCounters *counters) noexcept
+      : socket(std::move(socket)), counters(counters) {
+    if (counters) {
+      counters->inc(shard_counters::l_connections);
+      counters->inc(shard_counters::l_active_connections);
+    }
+  }
+  ~Connection() {
+    if (counters) {
+      counters->dec(shard_counters::l_active_connections);
+    }
+  }
 
   void close(boost::system::error_code& ec) {
     socket.close(ec);
@@ -396,6 +446,12 @@ class AsioFrontend {
   RGWProcessEnv& env;
   RGWFrontendConfig* conf;
   boost::asio::io_context context;
+  // with rgw_beast_io_shards, each shard serves the connections it accepts
+  // with its own io_context, run by a single thread. the first shard runs
+  // `context`, the others the ones below
+  size_t shard_count = 0;
+  std::vector<PerfCountersRef> shard_perf_counters;
+  std::vector<std::unique_ptr<boost::asio::io_context>> shard_contexts;
   std::string uri_prefix;
   ceph::timespan request_timeout = std::chrono::milliseconds(REQUEST_TIMEOUT);
   size_t header_limit = 16384;
@@ -417,17 +473,20 @@ class AsioFrontend {
     tcp_socket socket;
     bool use_ssl = false;
     bool use_nodelay = false;
+    // the io_context accepting and serving its connections
+    boost::asio::io_context *context;
+    PerfCounters *counters = nullptr;
 
     explicit Listener(boost::asio::io_context& context)
-      : acceptor(context), socket(context) {}
+      : acceptor(context), socket(context), context(&context) {}
   };
   std::vector<Listener> listeners;
 
   ConnectionList connections;
 
-  // work guard to keep run() threads busy while listeners are paused
+  // work guards to keep run() threads busy while listeners are paused
   using Executor = boost::asio::io_context::executor_type;
-  std::optional<boost::asio::executor_work_guard<Executor>> work;
+  std::vector<boost::asio::executor_work_guard<Executor>> work;
 
   std::vector<std::thread> threads;
   std::atomic<bool> going_down{false};
@@ -437,6 +496,12 @@ class AsioFrontend {
   std::unique_ptr<dmc::ClientConfig> client_config;
   void accept(Listener& listener, boost::system::error_code ec);
 
+  boost::asio::io_context& get_shard_context(size_t shard) {
+    return shard == 0 ? context : *shard_contexts[shard - 1];
+  }
+  void init_shards(size_t count);
+  int run_shards();
+
  public:
   AsioFrontend(RGWProcessEnv& env, RGWFrontendConfig* conf,
 	       dmc::SchedulerCtx& sched_ctx)
@@ -630,7 +695,12 @@ int AsioFrontend::init()
       l.use_nodelay = (nodelay->second == "1");
     }
   }
-  
+
+  const auto io_shards = ctx()->_conf.get_val<uint64_t>("rgw_beast_io_shards");
+  if (io_shards > 0) {
+    init_shards(io_shards);
+  }
+
 
   bool socket_bound = false;
   // start listeners
@@ -657,6 +727,18 @@ int AsioFrontend::init()
     }
 
     l.acceptor.set_option(tcp::acceptor::reuse_address(true));
+    if (shard_count > 0) {
+      // every shard listens on the endpoint, the kernel balances incoming
+      // connections across their sockets
+      using reuse_port = boost::asio::detail::socket_option::boolean<
+        SOL_SOCKET, SO_REUSEPORT>;
+      l.acceptor.set_option(reuse_port(true), ec);
+      if (ec) {
+        lderr(ctx()) << "failed to set SO_REUSEPORT socket option: "
+            << ec.message() << dendl;
+        return -ec.value();
+      }
+    }
     l.acceptor.bind(l.endpoint, ec);
     if (ec) {
       lderr(ctx()) << "failed to bind address " << l.endpoint
@@ -995,6 +1077,35 @@ int AsioFrontend::init_ssl()
 }
 #endif // WITH_RADOSGW_BEAST_OPENSSL
 
+void AsioFrontend::init_shards(size_t count)
+{
+  shard_count = count;
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      // a single thread runs each of them
+      shard_contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+    }
+    shard_perf_counters.push_back(shard_counters::build(ctx(), i));
+  }
+
+  // the first shard accepts on the parsed listeners, give the others their
+  // own listener for each endpoint
+  const size_t endpoint_count = listeners.size();
+  listeners.reserve(endpoint_count * count);
+  for (size_t i = 0; i < endpoint_count; i++) {
+    listeners[i].counters = shard_perf_counters[0].get();
+  }
+  for (size_t shard = 1; shard < count; shard++) {
+    for (size_t i = 0; i < endpoint_count; i++) {
+      auto& l = listeners.emplace_back(get_shard_context(shard));
+      l.endpoint = listeners[i].endpoint;
+      l.use_ssl = listeners[i].use_ssl;
+      l.use_nodelay = listeners[i].use_nodelay;
+      l.counters = shard_perf_counters[shard].get();
+    }
+  }
+}
+
 void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
 {
   if (!l.acceptor.is_open()) {
@@ -1015,9 +1126,10 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
   // spawn a coroutine to handle the connection
 #ifdef WITH_RADOSGW_BEAST_OPENSSL
   if (l.use_ssl) {
-    spawn::spawn(context,
-      [this, s=std::move(stream)] (yield_context yield) mutable {
-        auto conn = boost::intrusive_ptr{new Connection(std::move(s))};
+    spawn::spawn(*l.context,
+      [this, &context=*l.context, counters=l.counters,
+       s=std::move(stream)] (yield_context yield) mutable {
+        auto conn = boost::intrusive_ptr{new Connection(std::move(s), counters)};
         auto c = connections.add(*conn);
         // wrap the tcp stream in an ssl stream
         boost::asio::ssl::stream<tcp_socket&> stream{conn->socket, *ssl_context};
@@ -1035,7 +1147,7 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
         conn->buffer.consume(bytes);
         handle_connection(context, env, stream, timeout, header_limit,
                           conn->buffer, true, pause_mutex, scheduler.get(),
-                          uri_prefix, ec, yield);
+                          counters, uri_prefix, ec, yield);
         if (!ec) {
           // ssl shutdown (ignoring errors)
           stream.async_shutdown(yield[ec]);
@@ -1046,15 +1158,16 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
 #else
   {
 #endif // WITH_RADOSGW_BEAST_OPENSSL
-    spawn::spawn(context,
-      [this, s=std::move(stream)] (yield_context yield) mutable {
-        auto conn = boost::intrusive_ptr{new Connection(std::move(s))};
+    spawn::spawn(*l.context,
+      [this, &context=*l.context, counters=l.counters,
+       s=std::move(stream)] (yield_context yield) mutable {
+        auto conn = boost::intrusive_ptr{new Connection(std::move(s), counters)};
         auto c = connections.add(*conn);
         auto timeout = timeout_timer{context.get_executor(), request_timeout, conn};
         boost::system::error_code ec;
         handle_connection(context, env, conn->socket, timeout, header_limit,
                           conn->buffer, false, pause_mutex, scheduler.get(),
-                          uri_prefix, ec, yield);
+                          counters, uri_prefix, ec, yield);
         conn->socket.shutdown(tcp_socket::shutdown_both, ec);
       }, make_stack_allocator());
   }
@@ -1062,6 +1175,10 @@ void AsioFrontend::accept(Listener& l, boost::system::error_code ec)
 
 int AsioFrontend::run()
 {
+  if (shard_count > 0) {
+    return run_shards();
+  }
+
   auto cct = ctx();
   const int thread_count = cct->_conf->rgw_thread_pool_size;
   threads.reserve(thread_count);
@@ -1070,7 +1187,7 @@ int AsioFrontend::run()
 
   // the worker threads call io_context::run(), which will return when there's
   // no work left. hold a work guard to keep these threads going until join()
-  work.emplace(boost::asio::make_work_guard(context));
+  work.push_back(boost::asio::make_work_guard(context));
 
   for (int i = 0; i < thread_count; i++) {
     threads.emplace_back([this]() noexcept {
@@ -1084,6 +1201,50 @@ int AsioFrontend::run()
   return 0;
 }
 
+int AsioFrontend::run_shards()
+{
+  auto cct = ctx();
+  threads.reserve(shard_count);
+
+  ldout(cct, 4) << "frontend spawning " << shard_count
+      << " io_context shards" << dendl;
+
+  // pin the shard threads to the cpus we may run on in turn, so the
+  // connections of a shard stay on the same core
+  std::vector<int> cpus;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+
+  for (size_t shard = 0; shard < shard_count; shard++) {
+    auto& shard_context = get_shard_context(shard);
+    work.push_back(boost::asio::make_work_guard(shard_context));
+    const int cpu = cpus.empty() ? -1 : cpus[shard % cpus.size()];
+    threads.emplace_back([this, &shard_context, shard, cpu]() noexcept {
+      // request warnings on synchronous librados calls in this thread
+      is_asio_thread = true;
+      if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (r != 0) {
+          ldout(ctx(), 1) << "WARNING: failed to pin frontend shard " << shard
+              << " to cpu " << cpu << ": " << cpp_strerror(r) << dendl;
+        }
+      }
+      shard_context.run();
+    });
+  }
+  return 0;
+}
+
 void AsioFrontend::stop()
 {
   ldout(ctx(), 4) << "frontend initiating shutdown..." << dendl;
@@ -1105,7 +1266,7 @@ void AsioFrontend::join()
   if (!going_down) {
     stop();
   }
-  work.reset();
+  work.clear();
 
   ldout(ctx(), 4) << "frontend joining threads..." << dendl;
   for (auto& thread : threads) {
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "common/armor.h"
+#include "common/sharded_lru_map.h"
 #include "common/utf8.h"
 #include "rgw_rest_s3.h"
 #include "rgw_auth_s3.h"
@@ -16,6 +17,7 @@
 #include "rgw_client_io.h"
 #include "rgw_rest.h"
 #include "rgw_crypt_sanitize.h"
+#include "rgw_perf_counters.h"
 
 #include <boost/container/small_vector.hpp>
 #include <boost/algorithm/string.hpp>
@@ -898,10 +900,9 @@ transform_secret_key(const std::string_view& secret_access_key)
  * calculate the SigningKey of AWS auth version 4
  */
 static sha256_digest_t
-get_v4_signing_key(CephContext* const cct,
-                   const std::string_view& credential_scope,
-                   const std::string_view& secret_access_key,
-                   const DoutPrefixProvider *dpp)
+calc_v4_signing_key(const std::string_view& credential_scope,
+                    const std::string_view& secret_access_key,
+                    const DoutPrefixProvider *dpp)
 {
   std::string_view date, region, service;
   std::tie(date, region, service) = parse_cred_scope(credential_scope);
@@ -923,6 +924,75 @@ get_v4_signing_key(CephContext* const cct,
   return signing_key;
 }
 
+/* The signing key only depends on the secret key and the credential scope,
+ * which holds the date, region and service. The cache is keyed by both, so
+ * a new secret key never finds the signing key of the previous one, but
+ * holds a digest of the secret key rather than the key itself.
+ *
+ * There is one cache per CephContext, sized by its
+ * rgw_s3_signing_key_cache_size. */
+class SigningKeyCache {
+  using key_t = std::pair<std::string, std::string>;
+
+  struct key_hash {
+    size_t operator()(const key_t& key) const {
+      const size_t h = std::hash<std::string>{}(key.first);
+      return h ^ (std::hash<std::string>{}(key.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+    }
+  };
+
+  static constexpr size_t NUM_SHARDS = 16;
+
+  sharded_lru_map<key_t, sha256_digest_t, key_hash> cache;
+
+  static key_t make_key(const std::string_view& credential_scope,
+                        const std::string_view& secret_access_key) {
+    const auto secret_digest = calc_hash_sha256(secret_access_key);
+    return {std::string(reinterpret_cast<const char*>(secret_digest.v),
+                        secret_digest.SIZE),
+            std::string(credential_scope)};
+  }
+
+public:
+  explicit SigningKeyCache(CephContext* cct)
+    : cache(cct->_conf.get_val<uint64_t>("rgw_s3_signing_key_cache_size"),
+            NUM_SHARDS) {}
+
+  static SigningKeyCache& get(CephContext* cct) {
+    return cct->lookup_or_create_singleton_object<SigningKeyCache>(
+      "rgw_s3_signing_key_cache", false, cct);
+  }
+
+  sha256_digest_t get_signing_key(const std::string_view& credential_scope,
+                                  const std::string_view& secret_access_key,
+                                  const DoutPrefixProvider *dpp) {
+    const auto key = make_key(credential_scope, secret_access_key);
+    sha256_digest_t signing_key;
+    if (cache.find(key, signing_key)) {
+      if (perfcounter) perfcounter->inc(l_rgw_s3_signing_key_cache_hit);
+      ldpp_dout(dpp, 10) << "signing_k = " << signing_key << " (cached)" << dendl;
+      return signing_key;
+    }
+    if (perfcounter) perfcounter->inc(l_rgw_s3_signing_key_cache_miss);
+    signing_key = calc_v4_signing_key(credential_scope, secret_access_key, dpp);
+    cache.add(key, signing_key);
+    return signing_key;
+  }
+};
+
+static sha256_digest_t
+get_v4_signing_key(CephContext* const cct,
+                   const std::string_view& credential_scope,
+                   const std::string_view& secret_access_key,
+                   const DoutPrefixProvider *dpp)
+{
+  if (cct->_conf.get_val<uint64_t>("rgw_s3_signing_key_cache_size") == 0) {
+    return calc_v4_signing_key(credential_scope, secret_access_key, dpp);
+  }
+  return SigningKeyCache::get(cct).get_signing_key(credential_scope,
+                                                   secret_access_key, dpp);
+}
+
 /*
  * calculate the AWS signature version 4
  *
@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+#include "rgw_bucket_policy_cache.h"
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "rgw_perf_counters.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+RGWBucketPolicyCache::RGWBucketPolicyCache(CephContext* cct)
+  : max_size(cct->_conf.get_val<uint64_t>("rgw_bucket_policy_cache_size")),
+    policies(max_size, NUM_SHARDS),
+    acls(max_size, NUM_SHARDS)
+{
+}
+
+RGWBucketPolicyCache& RGWBucketPolicyCache::get(CephContext* cct)
+{
+  return cct->lookup_or_create_singleton_object<RGWBucketPolicyCache>(
+    "rgw_bucket_policy_cache", false, cct);
+}
+
+std::shared_ptr<const rgw::IAM::Policy> RGWBucketPolicyCache::get_policy(
+    CephContext* cct, const std::string& bucket_id,
+    const std::string& tenant, const bufferlist& raw)
+{
+  const bool cached = max_size > 0 && !bucket_id.empty();
+  Entry<rgw::IAM::Policy> entry;
+  if (cached && policies.find(bucket_id, entry) &&
+      entry.tenant == tenant && entry.raw.contents_equal(raw)) {
+    if (perfcounter) perfcounter->inc(l_rgw_bucket_policy_cache_hit);
+    return entry.parsed;
+  }
+  if (perfcounter) perfcounter->inc(l_rgw_bucket_policy_cache_miss);
+  auto policy =
+    std::make_shared<const rgw::IAM::Policy>(cct, tenant, raw, false);
+  if (cached) {
+    // shares the attribute's buffers rather than copying them
+    entry.raw = raw;
+    entry.tenant = tenant;
+    entry.parsed = policy;
+    policies.add(bucket_id, entry);
+  }
+  return policy;
+}
+
+int RGWBucketPolicyCache::get_acl(
+    const DoutPrefixProvider* dpp, CephContext* cct,
+    const std::string& bucket_id, const bufferlist& raw,
+    std::shared_ptr<const RGWAccessControlPolicy>& acl)
+{
+  const bool cached = max_size > 0 && !bucket_id.empty();
+  Entry<RGWAccessControlPolicy> entry;
+  if (cached && acls.find(bucket_id, entry) && entry.raw.contents_equal(raw)) {
+    if (perfcounter) perfcounter->inc(l_rgw_bucket_policy_cache_hit);
+    acl = entry.parsed;
+    return 0;
+  }
+  if (perfcounter) perfcounter->inc(l_rgw_bucket_policy_cache_miss);
+  auto decoded = std::make_shared<RGWAccessControlPolicy>(cct);
+  auto iter = raw.cbegin();
+  try {
+    decoded->decode(iter);
+  } catch (buffer::error& err) {
+    ldpp_dout(dpp, 0) << "ERROR: could not decode policy, caught buffer::error" << dendl;
+    return -EIO;
+  }
+  acl = decoded;
+  if (cached) {
+    entry.raw = raw;
+    entry.parsed = acl;
+    acls.add(bucket_id, entry);
+  }
+  return 0;
+}
+
+void RGWBucketPolicyCache::invalidate(const std::string& bucket_id)
+{
+  if (max_size == 0) {
+    return;
+  }
+  policies.erase(bucket_id);
+  acls.erase(bucket_id);
+}
@@ -0,0 +1,65 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "common/sharded_lru_map.h"
+#include "include/buffer.h"
+#include "rgw_acl.h"
+#include "rgw_iam_policy.h"
+
+class CephContext;
+class DoutPrefixProvider;
+
+/*
+ * Parsed bucket IAM policies and decoded bucket ACLs, shared by every
+ * request to the bucket, so their JSON and encoding are only parsed
+ * again after they change.
+ *
+ * Entries are keyed by bucket id and hold the attribute they were
+ * parsed from. A lookup only hits if the attribute it passes is still
+ * the same, so an entry never outlives a change, even one made behind
+ * the cache's back; invalidate() only spares it the comparison and
+ * drops the entry early. Cached objects are immutable and shared.
+ *
+ * Sized by rgw_bucket_policy_cache_size, 0 disables it.
+ */
+class RGWBucketPolicyCache {
+  template <typename T>
+  struct Entry {
+    bufferlist raw;
+    std::string tenant;
+    std::shared_ptr<const T> parsed;
+  };
+
+  static constexpr size_t NUM_SHARDS = 16;
+
+  const size_t max_size;
+  sharded_lru_map<std::string, Entry<rgw::IAM::Policy>> policies;
+  sharded_lru_map<std::string, Entry<RGWAccessControlPolicy>> acls;
+
+public:
+  explicit RGWBucketPolicyCache(CephContext* cct);
+
+  /// The cache of `cct`'s rgw
+  static RGWBucketPolicyCache& get(CephContext* cct);
+
+  /// The IAM policy of `bucket_id` parsed from `raw`. Throws
+  /// rgw::IAM::PolicyParseException if it doesn't parse, as the Policy
+  /// constructor does.
+  std::shared_ptr<const rgw::IAM::Policy> get_policy(
+      CephContext* cct, const std::string& bucket_id,
+      const std::string& tenant, const bufferlist& raw);
+
+  /// The ACL of `bucket_id` decoded from `raw`. Returns -EIO if it
+  /// doesn't decode.
+  int get_acl(const DoutPrefixProvider* dpp, CephContext* cct,
+              const std::string& bucket_id, const bufferlist& raw,
+              std::shared_ptr<const RGWAccessControlPolicy>& acl);
+
+  /// Drops the entries of `bucket_id`, whose policy or ACL changed
+  void invalidate(const std::string& bucket_id);
+};
@@ -1106,7 +1106,7 @@ struct perm_state_from_req_state : public perm_state_base {
 };
 
 Effect eval_or_pass(const DoutPrefixProvider* dpp,
-		    const boost::optional<Policy>& policy,
+		    const std::shared_ptr<const Policy>& policy,
 		    const rgw::IAM::Environment& env,
 		    boost::optional<const rgw::auth::Identity&> id,
 		    const uint64_t op,
@@ -1127,7 +1127,7 @@ Effect eval_identity_or_session_policies(const DoutPrefixProvider* dpp,
                           const ARN& arn) {
   auto policy_res = Effect::Pass, prev_res = Effect::Pass;
   for (auto& policy : policies) {
-    if (policy_res = eval_or_pass(dpp, policy, env, boost::none, op, arn); policy_res == Effect::Deny)
+    if (policy_res = policy.eval(env, boost::none, op, arn); policy_res == Effect::Deny)
       return policy_res;
     else if (policy_res == Effect::Allow)
       prev_res = Effect::Allow;
@@ -1238,8 +1238,8 @@ bool verify_bucket_permission(const DoutPrefixProvider* dpp,
                               struct perm_state_base * const s,
 			      const rgw_bucket& bucket,
                               RGWAccessControlPolicy * const user_acl,
-                              RGWAccessControlPolicy * const bucket_acl,
-			      const boost::optional<Policy>& bucket_policy,
+                              const RGWAccessControlPolicy * const bucket_acl,
+			      const std::shared_ptr<const Policy>& bucket_policy,
                               const vector<Policy>& identity_policies,
                               const vector<Policy>& session_policies,
                               const uint64_t op)
@@ -1253,7 +1253,7 @@ bool verify_bucket_permission(const DoutPrefixProvider* dpp,
 
   rgw::IAM::PolicyPrincipal princ_type = rgw::IAM::PolicyPrincipal::Other;
   if (bucket_policy) {
-    ldpp_dout(dpp, 16) << __func__ << ": policy: " << bucket_policy.get()
+    ldpp_dout(dpp, 16) << __func__ << ": policy: " << *bucket_policy
 		       << "resource: " << ARN(bucket) << dendl;
   }
   auto r = eval_or_pass(dpp, bucket_policy, s->env, *s->identity,
@@ -1297,8 +1297,8 @@ bool verify_bucket_permission(const DoutPrefixProvider* dpp,
                               req_state * const s,
 			      const rgw_bucket& bucket,
                               RGWAccessControlPolicy * const user_acl,
-                              RGWAccessControlPolicy * const bucket_acl,
-			      const boost::optional<Policy>& bucket_policy,
+                              const RGWAccessControlPolicy * const bucket_acl,
+			      const std::shared_ptr<const Policy>& bucket_policy,
                               const vector<Policy>& user_policies,
                               const vector<Policy>& session_policies,
                               const uint64_t op)
@@ -1312,7 +1312,7 @@ bool verify_bucket_permission(const DoutPrefixProvider* dpp,
 
 bool verify_bucket_permission_no_policy(const DoutPrefixProvider* dpp, struct perm_state_base * const s,
 					RGWAccessControlPolicy * const user_acl,
-					RGWAccessControlPolicy * const bucket_acl,
+					const RGWAccessControlPolicy * const bucket_acl,
 					const int perm)
 {
   if (!bucket_acl)
@@ -1335,7 +1335,7 @@ bool verify_bucket_permission_no_policy(const DoutPrefixProvider* dpp, struct pe
 
 bool verify_bucket_permission_no_policy(const DoutPrefixProvider* dpp, req_state * const s,
 					RGWAccessControlPolicy * const user_acl,
-					RGWAccessControlPolicy * const bucket_acl,
+					const RGWAccessControlPolicy * const bucket_acl,
 					const int perm)
 {
   perm_state_from_req_state ps(s);
@@ -1437,8 +1437,8 @@ static inline bool check_deferred_bucket_perms(const DoutPrefixProvider* dpp,
                                                struct perm_state_base * const s,
 					       const rgw_bucket& bucket,
 					       RGWAccessControlPolicy * const user_acl,
-					       RGWAccessControlPolicy * const bucket_acl,
-					       const boost::optional<Policy>& bucket_policy,
+					       const RGWAccessControlPolicy * const bucket_acl,
+					       const std::shared_ptr<const Policy>& bucket_policy,
                  const vector<Policy>& identity_policies,
                  const vector<Policy>& session_policies,
 					       const uint8_t deferred_check,
@@ -1451,7 +1451,7 @@ static inline bool check_deferred_bucket_perms(const DoutPrefixProvider* dpp,
 static inline bool check_deferred_bucket_only_acl(const DoutPrefixProvider* dpp,
                                                   struct perm_state_base * const s,
 						  RGWAccessControlPolicy * const user_acl,
-						  RGWAccessControlPolicy * const bucket_acl,
+						  const RGWAccessControlPolicy * const bucket_acl,
 						  const uint8_t deferred_check,
 						  const int perm)
 {
@@ -1462,9 +1462,9 @@ static inline bool check_deferred_bucket_only_acl(const DoutPrefixProvider* dpp,
 bool verify_object_permission(const DoutPrefixProvider* dpp, struct perm_state_base * const s,
 			      const rgw_obj& obj,
                               RGWAccessControlPolicy * const user_acl,
-                              RGWAccessControlPolicy * const bucket_acl,
+                              const RGWAccessControlPolicy * const bucket_acl,
                               RGWAccessControlPolicy * const object_acl,
-                              const boost::optional<Policy>& bucket_policy,
+                              const std::shared_ptr<const Policy>& bucket_policy,
                               const vector<Policy>& identity_policies,
                               const vector<Policy>& session_policies,
                               const uint64_t op)
@@ -1558,9 +1558,9 @@ bool verify_object_permission(const DoutPrefixProvider* dpp, struct perm_state_b
 bool verify_object_permission(const DoutPrefixProvider* dpp, req_state * const s,
 			      const rgw_obj& obj,
                               RGWAccessControlPolicy * const user_acl,
-                              RGWAccessControlPolicy * const bucket_acl,
+                              const RGWAccessControlPolicy * const bucket_acl,
                               RGWAccessControlPolicy * const object_acl,
-                              const boost::optional<Policy>& bucket_policy,
+                              const std::shared_ptr<const Policy>& bucket_policy,
                               const vector<Policy>& identity_policies,
                               const vector<Policy>& session_policies,
                               const uint64_t op)
@@ -1575,7 +1575,7 @@ bool verify_object_permission(const DoutPrefixProvider* dpp, req_state * const s
 bool verify_object_permission_no_policy(const DoutPrefixProvider* dpp,
                                         struct perm_state_base * const s,
 					RGWAccessControlPolicy * const user_acl,
-					RGWAccessControlPolicy * const bucket_acl,
+					const RGWAccessControlPolicy * const bucket_acl,
 					RGWAccessControlPolicy * const object_acl,
 					const int perm)
 {
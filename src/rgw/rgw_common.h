@@ -511,6 +511,7 @@ inline std::ostream& operator<<(std::ostream& out, const rgw_placement_rule& rul
 }
 
 class RateLimiter;
+class RateLimiterEntry;
 struct RGWRateLimitInfo {
   int64_t max_write_ops;
   int64_t max_read_ops;
@@ -546,6 +547,44 @@ struct RGWRateLimitInfo {
 };
 WRITE_CLASS_ENCODER(RGWRateLimitInfo)
 
+// a RateLimiter key: its kind ('u' for users, 'b' for buckets) and the name
+// it limits, hashed once when the key is built. the key refers to the strings
+// of the name without copying them, so it must not outlive them
+struct RGWRateLimitKey {
+  char kind = 0;
+  std::string_view tenant;
+  std::string_view ns;
+  std::string_view id;
+  size_t hash = 0;
+
+  RGWRateLimitKey() = default;
+  RGWRateLimitKey(char _kind, std::string_view _tenant, std::string_view _ns,
+                  std::string_view _id)
+    : kind(_kind), tenant(_tenant), ns(_ns), id(_id) {
+    const std::hash<std::string_view> h;
+    hash = std::hash<char>{}(kind);
+    for (const auto& part : {tenant, ns, id}) {
+      hash ^= h(part) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    }
+  }
+  RGWRateLimitKey(char _kind, std::string_view _id)
+    : RGWRateLimitKey(_kind, {}, {}, _id) {}
+  explicit RGWRateLimitKey(const rgw_user& user)
+    : RGWRateLimitKey('u', user.tenant, user.ns, user.id) {}
+  // a key written as its kind followed by its name, e.g. "uuser123"
+  RGWRateLimitKey(std::string_view key)
+    : RGWRateLimitKey(key.empty() ? 0 : key.front(),
+                      key.empty() ? key : key.substr(1)) {}
+  RGWRateLimitKey(const std::string& key)
+    : RGWRateLimitKey(std::string_view(key)) {}
+  RGWRateLimitKey(const char* key)
+    : RGWRateLimitKey(std::string_view(key)) {}
+
+  bool empty() const {
+    return tenant.empty() && ns.empty() && id.empty();
+  }
+};
+
 struct RGWUserInfo
 {
   rgw_user user_id;
@@ -1092,8 +1131,10 @@ struct req_state : DoutPrefixProvider {
   std::shared_ptr<RateLimiter> ratelimit_data;
   RGWRateLimitInfo user_ratelimit;
   RGWRateLimitInfo bucket_ratelimit;
-  std::string ratelimit_bucket_marker;
-  std::string ratelimit_user_name;
+  // the RateLimiter entries charged by the request, found once by
+  // rate_limit(). they stay valid even if the RateLimiter forgets them
+  std::shared_ptr<RateLimiterEntry> ratelimit_bucket_entry;
+  std::shared_ptr<RateLimiterEntry> ratelimit_user_entry;
   bool content_started{false};
   RGWFormat format{RGWFormat::PLAIN};
   ceph::Formatter *formatter{nullptr};
@@ -1176,11 +1217,13 @@ struct req_state : DoutPrefixProvider {
   } auth;
 
   std::unique_ptr<RGWAccessControlPolicy> user_acl;
-  std::unique_ptr<RGWAccessControlPolicy> bucket_acl;
+  /* The bucket's ACL and IAM policy are shared with RGWBucketPolicyCache
+   * and other requests, so they are never modified. */
+  std::shared_ptr<const RGWAccessControlPolicy> bucket_acl;
   std::unique_ptr<RGWAccessControlPolicy> object_acl;
 
   rgw::IAM::Environment env;
-  boost::optional<rgw::IAM::Policy> iam_policy;
+  std::shared_ptr<const rgw::IAM::Policy> iam_policy;
   boost::optional<PublicAccessBlockConfiguration> bucket_access_conf;
   std::vector<rgw::IAM::Policy> iam_user_policies;
 
@@ -1567,7 +1610,7 @@ bool verify_bucket_permission_no_policy(
   const DoutPrefixProvider* dpp,
   struct perm_state_base * const s,
   RGWAccessControlPolicy * const user_acl,
-  RGWAccessControlPolicy * const bucket_acl,
+  const RGWAccessControlPolicy * const bucket_acl,
   const int perm);
 
 bool verify_user_permission_no_policy(const DoutPrefixProvider* dpp,
@@ -1578,7 +1621,7 @@ bool verify_user_permission_no_policy(const DoutPrefixProvider* dpp,
 bool verify_object_permission_no_policy(const DoutPrefixProvider* dpp,
                                         struct perm_state_base * const s,
 					RGWAccessControlPolicy * const user_acl,
-					RGWAccessControlPolicy * const bucket_acl,
+					const RGWAccessControlPolicy * const bucket_acl,
 					RGWAccessControlPolicy * const object_acl,
 					const int perm);
 
@@ -1614,8 +1657,8 @@ bool verify_bucket_permission(
   req_state * const s,
   const rgw_bucket& bucket,
   RGWAccessControlPolicy * const user_acl,
-  RGWAccessControlPolicy * const bucket_acl,
-  const boost::optional<rgw::IAM::Policy>& bucket_policy,
+  const RGWAccessControlPolicy * const bucket_acl,
+  const std::shared_ptr<const rgw::IAM::Policy>& bucket_policy,
   const std::vector<rgw::IAM::Policy>& identity_policies,
   const std::vector<rgw::IAM::Policy>& session_policies,
   const uint64_t op);
@@ -1624,7 +1667,7 @@ bool verify_bucket_permission_no_policy(
   const DoutPrefixProvider* dpp,
   req_state * const s,
   RGWAccessControlPolicy * const user_acl,
-  RGWAccessControlPolicy * const bucket_acl,
+  const RGWAccessControlPolicy * const bucket_acl,
   const int perm);
 bool verify_bucket_permission_no_policy(const DoutPrefixProvider* dpp,
                                         req_state * const s,
@@ -1636,9 +1679,9 @@ extern bool verify_object_permission(
   req_state * const s,
   const rgw_obj& obj,
   RGWAccessControlPolicy * const user_acl,
-  RGWAccessControlPolicy * const bucket_acl,
+  const RGWAccessControlPolicy * const bucket_acl,
   RGWAccessControlPolicy * const object_acl,
-  const boost::optional<rgw::IAM::Policy>& bucket_policy,
+  const std::shared_ptr<const rgw::IAM::Policy>& bucket_policy,
   const std::vector<rgw::IAM::Policy>& identity_policies,
   const std::vector<rgw::IAM::Policy>& session_policies,
   const uint64_t op);
@@ -1647,7 +1690,7 @@ extern bool verify_object_permission_no_policy(
   const DoutPrefixProvider* dpp,
   req_state * const s,
   RGWAccessControlPolicy * const user_acl,
-  RGWAccessControlPolicy * const bucket_acl,
+  const RGWAccessControlPolicy * const bucket_acl,
   RGWAccessControlPolicy * const object_acl,
   int perm);
 extern bool verify_object_permission_no_policy(const DoutPrefixProvider* dpp, req_state *s,
@@ -1742,6 +1785,18 @@ extern void calc_hash_sha256_update_stream(ceph::crypto::SHA256* hash,
 extern std::string calc_hash_sha256_close_stream(ceph::crypto::SHA256** phash);
 extern std::string calc_hash_sha256_restart_stream(ceph::crypto::SHA256** phash);
 
+/* Feeds the buffers of a bufferlist to a digest one by one. Unlike
+ * hash.Update(bl.c_str(), bl.length()), it doesn't copy a fragmented
+ * bufferlist into a contiguous buffer first. */
+template <typename Digest>
+void hash_update(Digest& hash, const ceph::bufferlist& bl)
+{
+  for (const auto& bp : bl.buffers()) {
+    hash.Update(reinterpret_cast<const unsigned char*>(bp.c_str()),
+                bp.length());
+  }
+}
+
 extern int rgw_parse_op_type_list(const std::string& str, uint32_t *perm);
 
 static constexpr uint32_t MATCH_POLICY_ACTION = 0x01;
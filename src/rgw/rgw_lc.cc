@@ -313,6 +313,21 @@ static bool obj_has_expired(const DoutPrefixProvider *dpp, CephContext *cct, cep
   return (timediff >= cmp);
 }
 
+ceph::real_time rgw::lc::expiration_cutoff(CephContext* cct, int days)
+{
+  // obj_has_expired() compares whole seconds of the mtime
+  utime_t base_time;
+  int64_t cmp;
+  if (cct->_conf->rgw_lc_debug_interval <= 0) {
+    cmp = int64_t(days)*24*60*60;
+    base_time = ceph_clock_now().round_to_day();
+  } else {
+    cmp = int64_t(days)*cct->_conf->rgw_lc_debug_interval;
+    base_time = ceph_clock_now();
+  }
+  return ceph::real_clock::from_time_t(base_time.sec() - cmp + 1);
+}
+
 static bool pass_object_lock_check(rgw::sal::Driver* driver, rgw::sal::Object* obj, const DoutPrefixProvider *dpp)
 {
   if (!obj->get_bucket()->get_info().obj_lock_enabled()) {
@@ -947,8 +962,8 @@ static bool zone_check(const lc_op& op, rgw::sal::Zone* zone)
   }
 }
 
-static inline bool has_all_tags(const lc_op& rule_action,
-				const RGWObjTags& object_tags)
+bool rgw::lc::has_all_tags(const lc_op& rule_action,
+			   const RGWObjTags& object_tags)
 {
   if(! rule_action.obj_tags)
     return false;
@@ -995,7 +1010,7 @@ static int check_tags(const DoutPrefixProvider *dpp, lc_op_ctx& oc, bool *skip)
       return -EIO;
     }
 
-    if (! has_all_tags(op, dest_obj_tags)) {
+    if (! rgw::lc::has_all_tags(op, dest_obj_tags)) {
       ldpp_dout(oc.dpp, 20) << __func__ << "() skipping obj " << oc.obj
 			<< " as tags do not match in rule: "
 			<< op.id << " "
@@ -1581,6 +1596,15 @@ int RGWLC::bucket_lc_process(string& shard_id, LCWorker* worker,
       return -1;
     }
 
+  /* let the store expire the objects itself if it can */
+  ret = sal_lc->process_bucket_expiration(this, shard_id, bucket.get(), config,
+    [&]() { return worker_should_stop(stop_at, once); });
+  if (ret != -ENOTSUP) {
+    ldpp_dout(this, 5) << __func__ << "() processed " << bucket_name
+		       << " in the store ret=" << ret << dendl;
+    return ret;
+  }
+
   /* fetch information for zone checks */
   rgw::sal::Zone* zone = driver->get_zone();
 
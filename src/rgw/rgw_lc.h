@@ -637,4 +637,11 @@ bool s3_multipart_abort_header(
   ceph::real_time& abort_date,
   std::string& rule_id);
 
+/* objects last modified before the returned time have expired by a rule
+ * of @days days, as the lifecycle workers judge it now */
+ceph::real_time expiration_cutoff(CephContext* cct, int days);
+
+/* whether @object_tags include all the tags of the filter of @rule_action */
+bool has_all_tags(const lc_op& rule_action, const RGWObjTags& object_tags);
+
 } // namespace rgw::lc
@@ -575,6 +575,8 @@ struct PolicyMetaTable : public EmptyMetaTable {
   static std::string TableName() {return "Policy";}
   static std::string Name() {return TableName() + "Meta";}
 
+  using Type = rgw::IAM::Policy;
+
   static int IndexClosure(lua_State* L) {
     const auto policy = reinterpret_cast<rgw::IAM::Policy*>(lua_touserdata(L, lua_upvalueindex(FIRST_UPVAL)));
 
@@ -803,12 +805,7 @@ struct RequestMetaTable : public EmptyMetaTable {
     } else if (strcasecmp(index, "Environment") == 0) {
         create_metatable<StringMapMetaTable<rgw::IAM::Environment>>(L, false, &(s->env));
     } else if (strcasecmp(index, "Policy") == 0) {
-      // TODO: create a wrapper to std::optional
-      if (!s->iam_policy) {
-        lua_pushnil(L);
-      } else {
-        create_metatable<PolicyMetaTable>(L, false, s->iam_policy.get_ptr());
-      }
+      create_metatable<PolicyMetaTable>(L, false, s->iam_policy);
     } else if (strcasecmp(index, "UserPolicies") == 0) {
         create_metatable<PoliciesMetaTable>(L, false, &(s->iam_user_policies));
     } else if (strcasecmp(index, "RGWId") == 0) {
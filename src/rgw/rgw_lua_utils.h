@@ -164,6 +164,17 @@ void create_metatable(lua_State* L, bool toplevel, std::unique_ptr<typename Meta
   }
 }
 
+// for objects shared with other requests, the MetaTable must be read only
+template<typename MetaTable>
+void create_metatable(lua_State* L, bool toplevel, const std::shared_ptr<const typename MetaTable::Type>& ptr)
+{
+  if (ptr) {
+    create_metatable<MetaTable>(L, toplevel, const_cast<void*>(reinterpret_cast<const void*>(ptr.get())));
+  } else {
+    lua_pushnil(L);
+  }
+}
+
 // following struct may be used as a base class for other MetaTable classes
 // note, however, this is not mandatory to use it as a base
 struct EmptyMetaTable {
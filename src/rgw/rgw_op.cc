@@ -32,6 +32,7 @@
 #include "rgw_acl_swift.h"
 #include "rgw_user.h"
 #include "rgw_bucket.h"
+#include "rgw_bucket_policy_cache.h"
 #include "rgw_log.h"
 #include "rgw_multi.h"
 #include "rgw_multi_del.h"
@@ -216,26 +217,31 @@ static int get_user_policy_from_attr(const DoutPrefixProvider *dpp,
 }
 
 /**
- * Get the AccessControlPolicy for an object off of disk.
- * policy: must point to a valid RGWACL, and will be filled upon return.
- * bucket: name of the bucket containing the object.
- * object: name of the object to get the ACL for.
- * Returns: 0 on success, -ERR# otherwise.
+ * Like rgw_op_get_bucket_policy_from_attr(), but shares the ACL with
+ * RGWBucketPolicyCache rather than copying it.
  */
-int rgw_op_get_bucket_policy_from_attr(const DoutPrefixProvider *dpp, 
-                                       CephContext *cct,
-				       rgw::sal::Driver* driver,
-				       RGWBucketInfo& bucket_info,
-				       map<string, bufferlist>& bucket_attrs,
-				       RGWAccessControlPolicy *policy,
-				       optional_yield y)
+static int get_bucket_acl_from_attr(const DoutPrefixProvider *dpp,
+                                    CephContext *cct,
+                                    rgw::sal::Driver* driver,
+                                    RGWBucketInfo& bucket_info,
+                                    map<string, bufferlist>& bucket_attrs,
+                                    std::shared_ptr<const RGWAccessControlPolicy>& policy,
+                                    optional_yield y)
 {
   map<string, bufferlist>::iterator aiter = bucket_attrs.find(RGW_ATTR_ACL);
 
   if (aiter != bucket_attrs.end()) {
-    int ret = decode_policy(dpp, cct, aiter->second, policy);
+    int ret = RGWBucketPolicyCache::get(cct).get_acl(
+      dpp, cct, bucket_info.bucket.bucket_id, aiter->second, policy);
     if (ret < 0)
       return ret;
+    if (cct->_conf->subsys.should_gather<ceph_subsys_rgw, 15>()) {
+      RGWAccessControlPolicy_S3 s3policy(cct);
+      static_cast<RGWAccessControlPolicy&>(s3policy) = *policy;
+      ldpp_dout(dpp, 15) << __func__ << " Read AccessControlPolicy";
+      s3policy.to_xml(*_dout);
+      *_dout << dendl;
+    }
   } else {
     ldpp_dout(dpp, 0) << "WARNING: couldn't find acl header for bucket, generating default" << dendl;
     std::unique_ptr<rgw::sal::User> user = driver->get_user(bucket_info.owner);
@@ -244,11 +250,37 @@ int rgw_op_get_bucket_policy_from_attr(const DoutPrefixProvider *dpp,
     if (r < 0)
       return r;
 
-    policy->create_default(bucket_info.owner, user->get_display_name());
+    auto acl = std::make_shared<RGWAccessControlPolicy>(cct);
+    acl->create_default(bucket_info.owner, user->get_display_name());
+    policy = std::move(acl);
   }
   return 0;
 }
 
+/**
+ * Get the AccessControlPolicy for an object off of disk.
+ * policy: must point to a valid RGWACL, and will be filled upon return.
+ * bucket: name of the bucket containing the object.
+ * object: name of the object to get the ACL for.
+ * Returns: 0 on success, -ERR# otherwise.
+ */
+int rgw_op_get_bucket_policy_from_attr(const DoutPrefixProvider *dpp, 
+                                       CephContext *cct,
+				       rgw::sal::Driver* driver,
+				       RGWBucketInfo& bucket_info,
+				       map<string, bufferlist>& bucket_attrs,
+				       RGWAccessControlPolicy *policy,
+				       optional_yield y)
+{
+  std::shared_ptr<const RGWAccessControlPolicy> acl;
+  int ret = get_bucket_acl_from_attr(dpp, cct, driver, bucket_info,
+                                     bucket_attrs, acl, y);
+  if (ret < 0)
+    return ret;
+  *policy = *acl;
+  return 0;
+}
+
 static int get_obj_policy_from_attr(const DoutPrefixProvider *dpp, 
                                     CephContext *cct,
 				    rgw::sal::Driver* driver,
@@ -294,14 +326,16 @@ static int get_obj_policy_from_attr(const DoutPrefixProvider *dpp,
 }
 
 
-static boost::optional<Policy> get_iam_policy_from_attr(CephContext* cct,
+static std::shared_ptr<const Policy> get_iam_policy_from_attr(CephContext* cct,
 							map<string, bufferlist>& attrs,
+							const string& bucket_id,
 							const string& tenant) {
   auto i = attrs.find(RGW_ATTR_IAM_POLICY);
   if (i != attrs.end()) {
-    return Policy(cct, tenant, i->second, false);
+    return RGWBucketPolicyCache::get(cct).get_policy(cct, bucket_id, tenant,
+                                                      i->second);
   } else {
-    return none;
+    return nullptr;
   }
 }
 
@@ -344,7 +378,7 @@ static int read_bucket_policy(const DoutPrefixProvider *dpp,
                               req_state *s,
                               RGWBucketInfo& bucket_info,
                               map<string, bufferlist>& bucket_attrs,
-                              RGWAccessControlPolicy *policy,
+                              std::shared_ptr<const RGWAccessControlPolicy>& policy,
                               rgw_bucket& bucket,
 			      optional_yield y)
 {
@@ -355,10 +389,13 @@ static int read_bucket_policy(const DoutPrefixProvider *dpp,
   }
 
   if (bucket.name.empty()) {
+    if (!policy) {
+      policy = std::make_shared<RGWAccessControlPolicy>(s->cct);
+    }
     return 0;
   }
 
-  int ret = rgw_op_get_bucket_policy_from_attr(dpp, s->cct, driver, bucket_info, bucket_attrs, policy, y);
+  int ret = get_bucket_acl_from_attr(dpp, s->cct, driver, bucket_info, bucket_attrs, policy, y);
   if (ret == -ENOENT) {
       ret = -ERR_NO_SUCH_BUCKET;
   }
@@ -373,7 +410,7 @@ static int read_obj_policy(const DoutPrefixProvider *dpp,
                            map<string, bufferlist>& bucket_attrs,
                            RGWAccessControlPolicy* acl,
                            string *storage_class,
-                           boost::optional<Policy>& policy,
+                           std::shared_ptr<const Policy>& policy,
                            rgw::sal::Bucket* bucket,
                            rgw::sal::Object* object,
                            optional_yield y,
@@ -400,7 +437,9 @@ static int read_obj_policy(const DoutPrefixProvider *dpp,
     mpobj->set_in_extra_data(true);
     object = mpobj.get();
   }
-  policy = get_iam_policy_from_attr(s->cct, bucket_attrs, bucket->get_tenant());
+  policy = get_iam_policy_from_attr(s->cct, bucket_attrs,
+                                  bucket_info.bucket.bucket_id,
+                                  bucket->get_tenant());
 
   int ret = get_obj_policy_from_attr(dpp, s->cct, driver, bucket_info,
 				     bucket_attrs, acl, storage_class, object,
@@ -408,12 +447,12 @@ static int read_obj_policy(const DoutPrefixProvider *dpp,
   if (ret == -ENOENT) {
     /* object does not exist checking the bucket's ACL to make sure
        that we send a proper error code */
-    RGWAccessControlPolicy bucket_policy(s->cct);
-    ret = rgw_op_get_bucket_policy_from_attr(dpp, s->cct, driver, bucket_info, bucket_attrs, &bucket_policy, y);
+    std::shared_ptr<const RGWAccessControlPolicy> bucket_policy;
+    ret = get_bucket_acl_from_attr(dpp, s->cct, driver, bucket_info, bucket_attrs, bucket_policy, y);
     if (ret < 0) {
       return ret;
     }
-    const rgw_user& bucket_owner = bucket_policy.get_owner().get_id();
+    const rgw_user& bucket_owner = bucket_policy->get_owner().get_id();
     if (bucket_owner.compare(s->user->get_id()) != 0 &&
         ! s->auth.identity->is_admin_of(bucket_owner)) {
       auto r = eval_identity_or_session_policies(dpp, s->iam_user_policies, s->env,
@@ -438,7 +477,7 @@ static int read_obj_policy(const DoutPrefixProvider *dpp,
         if (r == Effect::Deny)
           return -EACCES;
       }
-      if (! bucket_policy.verify_permission(s, *s->auth.identity, s->perm_mask, RGW_PERM_READ))
+      if (! bucket_policy->verify_permission(s, *s->auth.identity, s->perm_mask, RGW_PERM_READ))
         ret = -EACCES;
       else
         ret = -ENOENT;
@@ -470,7 +509,7 @@ int rgw_build_bucket_policies(const DoutPrefixProvider *dpp, rgw::sal::Driver* d
   }
 
   if(s->dialect.compare("s3") == 0) {
-    s->bucket_acl = std::make_unique<RGWAccessControlPolicy_S3>(s->cct);
+    s->bucket_acl = std::make_shared<RGWAccessControlPolicy_S3>(s->cct);
   } else if(s->dialect.compare("swift")  == 0) {
     /* We aren't allocating the account policy for those operations using
      * the Swift's infrastructure that don't really need req_state::user.
@@ -478,9 +517,9 @@ int rgw_build_bucket_policies(const DoutPrefixProvider *dpp, rgw::sal::Driver* d
     if (!s->user->get_id().empty()) {
       s->user_acl = std::make_unique<RGWAccessControlPolicy_SWIFTAcct>(s->cct);
     }
-    s->bucket_acl = std::make_unique<RGWAccessControlPolicy_SWIFT>(s->cct);
+    s->bucket_acl = std::make_shared<RGWAccessControlPolicy_SWIFT>(s->cct);
   } else {
-    s->bucket_acl = std::make_unique<RGWAccessControlPolicy>(s->cct);
+    s->bucket_acl = std::make_shared<RGWAccessControlPolicy>(s->cct);
   }
 
   /* check if copy source is within the current domain */
@@ -529,7 +568,7 @@ int rgw_build_bucket_policies(const DoutPrefixProvider *dpp, rgw::sal::Driver* d
     s->bucket_attrs = s->bucket->get_attrs();
     ret = read_bucket_policy(dpp, driver, s, s->bucket->get_info(),
 			     s->bucket->get_attrs(),
-			     s->bucket_acl.get(), s->bucket->get_key(), y);
+			     s->bucket_acl, s->bucket->get_key(), y);
     acct_acl_user = {
       s->bucket->get_info().owner,
       s->bucket_acl->get_owner().get_display_name(),
@@ -626,7 +665,9 @@ int rgw_build_bucket_policies(const DoutPrefixProvider *dpp, rgw::sal::Driver* d
   }
 
   try {
-    s->iam_policy = get_iam_policy_from_attr(s->cct, s->bucket_attrs, s->bucket_tenant);
+    s->iam_policy = get_iam_policy_from_attr(s->cct, s->bucket_attrs,
+                                             s->bucket ? s->bucket->get_bucket_id() : string(),
+                                             s->bucket_tenant);
   } catch (const std::exception& e) {
     // Really this is a can't happen condition. We parse the policy
     // when it's given to us, so perhaps we should abort or otherwise
@@ -798,7 +839,7 @@ static void rgw_iam_add_crypt_attrs(rgw::IAM::Environment& e,
 }
 
 static std::tuple<bool, bool> rgw_check_policy_condition(const DoutPrefixProvider *dpp,
-                                                          boost::optional<rgw::IAM::Policy> iam_policy,
+                                                          const std::shared_ptr<const rgw::IAM::Policy>& iam_policy,
                                                           boost::optional<vector<rgw::IAM::Policy>> identity_policies,
                                                           boost::optional<vector<rgw::IAM::Policy>> session_policies,
                                                           bool check_obj_exist_tag=true) {
@@ -1611,8 +1652,8 @@ int rgw_policy_from_attrset(const DoutPrefixProvider *dpp, CephContext *cct, map
 
 int RGWGetObj::read_user_manifest_part(rgw::sal::Bucket* bucket,
                                        const rgw_bucket_dir_entry& ent,
-                                       RGWAccessControlPolicy * const bucket_acl,
-                                       const boost::optional<Policy>& bucket_policy,
+                                       const RGWAccessControlPolicy * const bucket_acl,
+                                       const std::shared_ptr<const Policy>& bucket_policy,
                                        const off_t start_ofs,
                                        const off_t end_ofs,
                                        bool swift_slo)
@@ -1711,15 +1752,15 @@ static int iterate_user_manifest_parts(const DoutPrefixProvider *dpp,
                                        const off_t end,
                                        rgw::sal::Bucket* bucket,
                                        const string& obj_prefix,
-                                       RGWAccessControlPolicy * const bucket_acl,
-                                       const boost::optional<Policy>& bucket_policy,
+                                       const RGWAccessControlPolicy * const bucket_acl,
+                                       const std::shared_ptr<const Policy>& bucket_policy,
                                        uint64_t * const ptotal_len,
                                        uint64_t * const pobj_size,
                                        string * const pobj_sum,
                                        int (*cb)(rgw::sal::Bucket* bucket,
                                                  const rgw_bucket_dir_entry& ent,
-                                                 RGWAccessControlPolicy * const bucket_acl,
-                                                 const boost::optional<Policy>& bucket_policy,
+                                                 const RGWAccessControlPolicy * const bucket_acl,
+                                                 const std::shared_ptr<const Policy>& bucket_policy,
                                                  off_t start_ofs,
                                                  off_t end_ofs,
                                                  void *param,
@@ -1803,8 +1844,8 @@ static int iterate_user_manifest_parts(const DoutPrefixProvider *dpp,
 }
 
 struct rgw_slo_part {
-  RGWAccessControlPolicy *bucket_acl = nullptr;
-  Policy* bucket_policy = nullptr;
+  std::shared_ptr<const RGWAccessControlPolicy> bucket_acl;
+  std::shared_ptr<const Policy> bucket_policy;
   rgw::sal::Bucket* bucket;
   string obj_name;
   uint64_t size = 0;
@@ -1819,8 +1860,8 @@ static int iterate_slo_parts(const DoutPrefixProvider *dpp,
                              map<uint64_t, rgw_slo_part>& slo_parts,
                              int (*cb)(rgw::sal::Bucket* bucket,
                                        const rgw_bucket_dir_entry& ent,
-                                       RGWAccessControlPolicy *bucket_acl,
-                                       const boost::optional<Policy>& bucket_policy,
+                                       const RGWAccessControlPolicy *bucket_acl,
+                                       const std::shared_ptr<const Policy>& bucket_policy,
                                        off_t start_ofs,
                                        off_t end_ofs,
                                        void *param,
@@ -1877,9 +1918,7 @@ static int iterate_slo_parts(const DoutPrefixProvider *dpp,
                           << dendl;
 
 	// SLO is a Swift thing, and Swift has no knowledge of S3 Policies.
-        int r = cb(part.bucket, ent, part.bucket_acl,
-		   (part.bucket_policy ?
-		    boost::optional<Policy>(*part.bucket_policy) : none),
+        int r = cb(part.bucket, ent, part.bucket_acl.get(), part.bucket_policy,
 		   start_ofs, end_ofs, cb_param, true /* swift_slo */);
 	if (r < 0)
           return r;
@@ -1894,8 +1933,8 @@ static int iterate_slo_parts(const DoutPrefixProvider *dpp,
 
 static int get_obj_user_manifest_iterate_cb(rgw::sal::Bucket* bucket,
                                             const rgw_bucket_dir_entry& ent,
-                                            RGWAccessControlPolicy * const bucket_acl,
-                                            const boost::optional<Policy>& bucket_policy,
+                                            const RGWAccessControlPolicy * const bucket_acl,
+                                            const std::shared_ptr<const Policy>& bucket_policy,
                                             const off_t start_ofs,
                                             const off_t end_ofs,
                                             void * const param,
@@ -1920,10 +1959,8 @@ int RGWGetObj::handle_user_manifest(const char *prefix, optional_yield y)
   const std::string bucket_name = url_decode(prefix_view.substr(0, pos));
   const std::string obj_prefix = url_decode(prefix_view.substr(pos + 1));
 
-  RGWAccessControlPolicy _bucket_acl(s->cct);
-  RGWAccessControlPolicy *bucket_acl;
-  boost::optional<Policy> _bucket_policy;
-  boost::optional<Policy>* bucket_policy;
+  std::shared_ptr<const RGWAccessControlPolicy> bucket_acl;
+  std::shared_ptr<const Policy> bucket_policy;
   RGWBucketInfo bucket_info;
   std::unique_ptr<rgw::sal::Bucket> ubucket;
   rgw::sal::Bucket* pbucket = NULL;
@@ -1937,19 +1974,18 @@ int RGWGetObj::handle_user_manifest(const char *prefix, optional_yield y)
 		       << bucket_name << dendl;
       return r;
     }
-    bucket_acl = &_bucket_acl;
     r = read_bucket_policy(this, driver, s, ubucket->get_info(), bucket_attrs, bucket_acl, ubucket->get_key(), y);
     if (r < 0) {
       ldpp_dout(this, 0) << "failed to read bucket policy" << dendl;
       return r;
     }
-    _bucket_policy = get_iam_policy_from_attr(s->cct, bucket_attrs, s->user->get_tenant());
-    bucket_policy = &_bucket_policy;
+    bucket_policy = get_iam_policy_from_attr(s->cct, bucket_attrs, ubucket->get_bucket_id(),
+                                             s->user->get_tenant());
     pbucket = ubucket.get();
   } else {
     pbucket = s->bucket.get();
-    bucket_acl = s->bucket_acl.get();
-    bucket_policy = &s->iam_policy;
+    bucket_acl = s->bucket_acl;
+    bucket_policy = s->iam_policy;
   }
 
   /* dry run to find out:
@@ -1957,7 +1993,7 @@ int RGWGetObj::handle_user_manifest(const char *prefix, optional_yield y)
    * - overall DLO's content size,
    * - md5 sum of overall DLO's content (for etag of Swift API). */
   r = iterate_user_manifest_parts(this, s->cct, driver, ofs, end,
-        pbucket, obj_prefix, bucket_acl, *bucket_policy,
+        pbucket, obj_prefix, bucket_acl.get(), bucket_policy,
         nullptr, &s->obj_size, &lo_etag,
 	nullptr /* cb */, nullptr /* cb arg */, y);
   if (r < 0) {
@@ -1971,7 +2007,7 @@ int RGWGetObj::handle_user_manifest(const char *prefix, optional_yield y)
   }
 
   r = iterate_user_manifest_parts(this, s->cct, driver, ofs, end,
-        pbucket, obj_prefix, bucket_acl, *bucket_policy,
+        pbucket, obj_prefix, bucket_acl.get(), bucket_policy,
         &total_len, nullptr, nullptr,
 	nullptr, nullptr, y);
   if (r < 0) {
@@ -1985,7 +2021,7 @@ int RGWGetObj::handle_user_manifest(const char *prefix, optional_yield y)
   }
 
   r = iterate_user_manifest_parts(this, s->cct, driver, ofs, end,
-        pbucket, obj_prefix, bucket_acl, *bucket_policy,
+        pbucket, obj_prefix, bucket_acl.get(), bucket_policy,
         nullptr, nullptr, nullptr,
 	get_obj_user_manifest_iterate_cb, (void *)this, y);
   if (r < 0) {
@@ -2012,8 +2048,8 @@ int RGWGetObj::handle_slo_manifest(bufferlist& bl, optional_yield y)
   }
   ldpp_dout(this, 2) << "RGWGetObj::handle_slo_manifest()" << dendl;
 
-  vector<RGWAccessControlPolicy> allocated_acls;
-  map<string, pair<RGWAccessControlPolicy *, boost::optional<Policy>>> policies;
+  map<string, pair<std::shared_ptr<const RGWAccessControlPolicy>,
+                   std::shared_ptr<const Policy>>> policies;
   map<string, std::unique_ptr<rgw::sal::Bucket>> buckets;
 
   map<uint64_t, rgw_slo_part> slo_parts;
@@ -2047,19 +2083,16 @@ int RGWGetObj::handle_slo_manifest(bufferlist& bl, optional_yield y)
     string obj_name = path.substr(pos_sep + 1);
 
     rgw::sal::Bucket* bucket;
-    RGWAccessControlPolicy *bucket_acl;
-    Policy* bucket_policy;
+    std::shared_ptr<const RGWAccessControlPolicy> bucket_acl;
+    std::shared_ptr<const Policy> bucket_policy;
 
     if (bucket_name.compare(s->bucket->get_name()) != 0) {
       const auto& piter = policies.find(bucket_name);
       if (piter != policies.end()) {
         bucket_acl = piter->second.first;
-        bucket_policy = piter->second.second.get_ptr();
+        bucket_policy = piter->second.second;
 	bucket = buckets[bucket_name].get();
       } else {
-	allocated_acls.push_back(RGWAccessControlPolicy(s->cct));
-	RGWAccessControlPolicy& _bucket_acl = allocated_acls.back();
-
 	std::unique_ptr<rgw::sal::Bucket> tmp_bucket;
 	int r = driver->get_bucket(this, s->user.get(), s->user->get_tenant(), bucket_name, &tmp_bucket, y);
         if (r < 0) {
@@ -2068,7 +2101,6 @@ int RGWGetObj::handle_slo_manifest(bufferlist& bl, optional_yield y)
           return r;
         }
         bucket = tmp_bucket.get();
-        bucket_acl = &_bucket_acl;
         r = read_bucket_policy(this, driver, s, tmp_bucket->get_info(), tmp_bucket->get_attrs(), bucket_acl,
                                tmp_bucket->get_key(), y);
         if (r < 0) {
@@ -2076,16 +2108,16 @@ int RGWGetObj::handle_slo_manifest(bufferlist& bl, optional_yield y)
                            << bucket << dendl;
           return r;
 	}
-	auto _bucket_policy = get_iam_policy_from_attr(
-	  s->cct, tmp_bucket->get_attrs(), tmp_bucket->get_tenant());
-        bucket_policy = _bucket_policy.get_ptr();
+	bucket_policy = get_iam_policy_from_attr(
+	  s->cct, tmp_bucket->get_attrs(), tmp_bucket->get_bucket_id(),
+	  tmp_bucket->get_tenant());
 	buckets[bucket_name].swap(tmp_bucket);
-        policies[bucket_name] = make_pair(bucket_acl, _bucket_policy);
+        policies[bucket_name] = make_pair(bucket_acl, bucket_policy);
       }
     } else {
       bucket = s->bucket.get();
-      bucket_acl = s->bucket_acl.get();
-      bucket_policy = s->iam_policy.get_ptr();
+      bucket_acl = s->bucket_acl;
+      bucket_policy = s->iam_policy;
     }
 
     rgw_slo_part part;
@@ -3684,7 +3716,7 @@ int RGWPutObj::verify_permission(optional_yield y)
   if (! copy_source.empty()) {
 
     RGWAccessControlPolicy cs_acl(s->cct);
-    boost::optional<Policy> policy;
+    std::shared_ptr<const Policy> policy;
     map<string, bufferlist> cs_attrs;
     std::unique_ptr<rgw::sal::Bucket> cs_bucket;
     int ret = driver->get_bucket(NULL, copy_source_bucket_info, &cs_bucket);
@@ -4232,7 +4264,7 @@ void RGWPutObj::execute(optional_yield y)
     }
 
     if (need_calc_md5) {
-      hash.Update((const unsigned char *)data.c_str(), data.length());
+      hash_update(hash, data);
     }
 
     /* update torrrent */
@@ -4564,7 +4596,7 @@ void RGWPostObj::execute(optional_yield y)
         break;
       }
 
-      hash.Update((const unsigned char *)data.c_str(), data.length());
+      hash_update(hash, data);
       op_ret = filter->process(std::move(data), ofs);
       if (op_ret < 0) {
         return;
@@ -4816,10 +4848,11 @@ void RGWPutMetadataBucket::execute(optional_yield y)
        * contain such keys yet. */
       if (has_policy) {
 	if (s->dialect.compare("swift") == 0) {
-	  auto old_policy =						\
-	    static_cast<RGWAccessControlPolicy_SWIFT*>(s->bucket_acl.get());
+	  /* the bucket's ACL is shared, merge from a copy of it */
+	  RGWAccessControlPolicy_SWIFT old_policy(s->cct);
+	  static_cast<RGWAccessControlPolicy&>(old_policy) = *s->bucket_acl;
 	  auto new_policy = static_cast<RGWAccessControlPolicy_SWIFT*>(&policy);
-	  new_policy->filter_merge(policy_rw_mask, old_policy);
+	  new_policy->filter_merge(policy_rw_mask, &old_policy);
 	  policy = *new_policy;
 	}
 	buffer::list bl;
@@ -5309,7 +5342,7 @@ int RGWCopyObj::init_processing(optional_yield y)
 int RGWCopyObj::verify_permission(optional_yield y)
 {
   RGWAccessControlPolicy src_acl(s->cct);
-  boost::optional<Policy> src_policy;
+  std::shared_ptr<const Policy> src_policy;
 
   /* get buckets info (source and dest) */
   if (s->local_source &&  source_zone.empty()) {
@@ -5407,21 +5440,23 @@ int RGWCopyObj::verify_permission(optional_yield y)
     }
   }
 
-  RGWAccessControlPolicy dest_bucket_policy(s->cct);
+  std::shared_ptr<const RGWAccessControlPolicy> dest_bucket_policy;
 
   s->object->set_atomic();
 
   /* check dest bucket permissions */
   op_ret = read_bucket_policy(this, driver, s, s->bucket->get_info(),
 			      s->bucket->get_attrs(),
-                              &dest_bucket_policy, s->bucket->get_key(), y);
+                              dest_bucket_policy, s->bucket->get_key(), y);
   if (op_ret < 0) {
     return op_ret;
   }
-  auto dest_iam_policy = get_iam_policy_from_attr(s->cct, s->bucket->get_attrs(), s->bucket->get_tenant());
+  auto dest_iam_policy = get_iam_policy_from_attr(s->cct, s->bucket->get_attrs(),
+                                                  s->bucket->get_bucket_id(),
+                                                  s->bucket->get_tenant());
   /* admin request overrides permission checks */
   if (! s->auth.identity->is_admin_of(dest_policy.get_owner().get_id())){
-    if (dest_iam_policy != boost::none || ! s->iam_user_policies.empty() || !s->session_policies.empty()) {
+    if (dest_iam_policy || ! s->iam_user_policies.empty() || !s->session_policies.empty()) {
       //Add destination bucket tags for authorization
       auto [has_s3_existing_tag, has_s3_resource_tag] = rgw_check_policy_condition(this, dest_iam_policy, s->iam_user_policies, s->session_policies);
       if (has_s3_resource_tag)
@@ -5475,14 +5510,14 @@ int RGWCopyObj::verify_permission(optional_yield y)
         }
       }
       if (identity_policy_res == Effect::Pass && e == Effect::Pass &&
-                 ! dest_bucket_policy.verify_permission(this,
-                                                        *s->auth.identity,
-                                                        s->perm_mask,
-                                                        RGW_PERM_WRITE)){
+                 ! dest_bucket_policy->verify_permission(this,
+                                                         *s->auth.identity,
+                                                         s->perm_mask,
+                                                         RGW_PERM_WRITE)){
         return -EACCES;
       }
-    } else if (! dest_bucket_policy.verify_permission(this, *s->auth.identity, s->perm_mask,
-                                                      RGW_PERM_WRITE)) {
+    } else if (! dest_bucket_policy->verify_permission(this, *s->auth.identity, s->perm_mask,
+                                                       RGW_PERM_WRITE)) {
       return -EACCES;
     }
 
@@ -5713,11 +5748,11 @@ void RGWGetACLs::pre_exec()
 void RGWGetACLs::execute(optional_yield y)
 {
   stringstream ss;
-  RGWAccessControlPolicy* const acl = \
-    (!rgw::sal::Object::empty(s->object.get()) ? s->object_acl.get() : s->bucket_acl.get());
-  RGWAccessControlPolicy_S3* const s3policy = \
-    static_cast<RGWAccessControlPolicy_S3*>(acl);
-  s3policy->to_xml(ss);
+  /* the bucket's ACL is shared and to_xml() isn't const, print a copy */
+  RGWAccessControlPolicy_S3 s3policy(s->cct);
+  static_cast<RGWAccessControlPolicy&>(s3policy) =
+    (!rgw::sal::Object::empty(s->object.get()) ? *s->object_acl : *s->bucket_acl);
+  s3policy.to_xml(ss);
   acls = ss.str();
 }
 
@@ -5823,7 +5858,7 @@ void RGWPutACLs::execute(optional_yield y)
   }
 
 
-  RGWAccessControlPolicy* const existing_policy = \
+  const RGWAccessControlPolicy* const existing_policy = \
     (rgw::sal::Object::empty(s->object.get()) ? s->bucket_acl.get() : s->object_acl.get());
 
   owner = existing_policy->get_owner();
@@ -6967,10 +7002,11 @@ void RGWDeleteMultiObj::wait_flush(optional_yield y,
   }
 }
 
-void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_yield y,
-                                                 boost::asio::deadline_timer *formatter_flush_cond)
+bool RGWDeleteMultiObj::prepare_individual_object(const rgw_obj_key& o, optional_yield y,
+                                                  boost::asio::deadline_timer *formatter_flush_cond,
+                                                  individual_delete& del,
+                                                  bool resolve_state)
 {
-  std::string version_id;
   std::unique_ptr<rgw::sal::Object> obj = bucket->get_object(o);
   if (s->iam_policy || ! s->iam_user_policies.empty() || !s->session_policies.empty()) {
     auto identity_policy_res = eval_identity_or_session_policies(this, s->iam_user_policies, s->env,
@@ -6980,7 +7016,7 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
                                                                  ARN(obj->get_obj()));
     if (identity_policy_res == Effect::Deny) {
       send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-      return;
+      return false;
     }
 
     rgw::IAM::Effect e = Effect::Pass;
@@ -6997,7 +7033,7 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
     }
     if (e == Effect::Deny) {
       send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-      return;
+      return false;
     }
 
     if (!s->session_policies.empty()) {
@@ -7008,34 +7044,34 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
                                                                   ARN(obj->get_obj()));
       if (session_policy_res == Effect::Deny) {
         send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-        return;
+        return false;
       }
       if (princ_type == rgw::IAM::PolicyPrincipal::Role) {
         //Intersection of session policy and identity policy plus intersection of session policy and bucket policy
         if ((session_policy_res != Effect::Allow || identity_policy_res != Effect::Allow) &&
             (session_policy_res != Effect::Allow || e != Effect::Allow)) {
           send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-          return;
+          return false;
         }
       } else if (princ_type == rgw::IAM::PolicyPrincipal::Session) {
         //Intersection of session policy and identity policy plus bucket policy
         if ((session_policy_res != Effect::Allow || identity_policy_res != Effect::Allow) && e != Effect::Allow) {
           send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-          return;
+          return false;
         }
       } else if (princ_type == rgw::IAM::PolicyPrincipal::Other) {// there was no match in the bucket policy
         if (session_policy_res != Effect::Allow || identity_policy_res != Effect::Allow) {
           send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-          return;
+          return false;
         }
       }
       send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-      return;
+      return false;
     }
 
     if ((identity_policy_res == Effect::Pass && e == Effect::Pass && !acl_allowed)) {
       send_partial_response(o, false, "", -EACCES, formatter_flush_cond);
-      return;
+      return false;
     }
   }
 
@@ -7045,7 +7081,10 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
   if (!rgw::sal::Object::empty(obj.get())) {
     RGWObjState* astate = nullptr;
     bool check_obj_lock = obj->have_instance() && bucket->get_info().obj_lock_enabled();
-    const auto ret = obj->get_obj_state(this, &astate, y, true);
+    // the object lock is checked before deleting, what else the state is
+    // needed for may come with the outcome of the deletion instead
+    const auto ret = resolve_state || check_obj_lock ?
+                     obj->get_obj_state(this, &astate, y, true) : -ENOENT;
 
     if (ret < 0) {
       if (ret == -ENOENT) {
@@ -7054,7 +7093,7 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
       } else {
         // Something went wrong.
         send_partial_response(o, false, "", ret, formatter_flush_cond);
-        return;
+        return false;
       }
     } else {
       obj_size = astate->size;
@@ -7066,7 +7105,7 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
       int object_lock_response = verify_object_lock(this, astate->attrset, bypass_perm, bypass_governance_mode);
       if (object_lock_response != 0) {
         send_partial_response(o, false, "", object_lock_response, formatter_flush_cond);
-        return;
+        return false;
       }
     }
   }
@@ -7081,8 +7120,26 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
   op_ret = res->publish_reserve(this);
   if (op_ret < 0) {
     send_partial_response(o, false, "", op_ret, formatter_flush_cond);
+    return false;
+  }
+
+  del.key = o;
+  del.obj = std::move(obj);
+  del.res = std::move(res);
+  del.obj_size = obj_size;
+  del.etag = std::move(etag);
+  return true;
+}
+
+void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_yield y,
+                                                 boost::asio::deadline_timer *formatter_flush_cond)
+{
+  std::string version_id;
+  individual_delete del;
+  if (!prepare_individual_object(o, y, formatter_flush_cond, del)) {
     return;
   }
+  auto& obj = del.obj;
 
   obj->set_atomic();
 
@@ -7100,13 +7157,57 @@ void RGWDeleteMultiObj::handle_individual_object(const rgw_obj_key& o, optional_
   send_partial_response(o, del_op->result.delete_marker, del_op->result.version_id, op_ret, formatter_flush_cond);
 
   // send request to notification manager
-  int ret = res->publish_commit(this, obj_size, ceph::real_clock::now(), etag, version_id);
+  int ret = del.res->publish_commit(this, del.obj_size, ceph::real_clock::now(), del.etag, version_id);
   if (ret < 0) {
     ldpp_dout(this, 1) << "ERROR: publishing notification failed, with error: " << ret << dendl;
     // too late to rollback operation, hence op_ret is not set here
   }
 }
 
+bool RGWDeleteMultiObj::handle_objects_batch(const std::vector<rgw_obj_key>& keys,
+                                             optional_yield y,
+                                             boost::asio::deadline_timer *formatter_flush_cond)
+{
+  if (!bucket->supports_delete_objects()) {
+    return false;
+  }
+
+  std::vector<rgw::sal::Bucket::DeleteObjectsEntry> batch;
+  std::vector<individual_delete> dels;
+  dels.reserve(keys.size());
+  batch.reserve(keys.size());
+  for (const auto& key : keys) {
+    individual_delete del;
+    // the size and etag of the deleted version come with the outcome
+    if (!prepare_individual_object(key, y, formatter_flush_cond, del, false)) {
+      continue;
+    }
+    batch.emplace_back();
+    batch.back().key = key;
+    dels.emplace_back(std::move(del));
+  }
+
+  const int r = batch.empty() ? 0 : bucket->delete_objects(this, batch, y);
+  if (r < 0) {
+    ldpp_dout(this, 1) << "ERROR: batch delete of " << batch.size()
+                       << " objects failed, with error: " << r << dendl;
+  }
+  for (size_t i = 0; i < batch.size(); i++) {
+    const auto& entry = batch[i];
+    op_ret = r < 0 ? r : entry.ret;
+    if (op_ret == -ENOENT) {
+      op_ret = 0;
+    }
+    send_partial_response(entry.key, entry.delete_marker, entry.version_id, op_ret, formatter_flush_cond);
+
+    int ret = dels[i].res->publish_commit(this, entry.size, ceph::real_clock::now(), entry.etag, "");
+    if (ret < 0) {
+      ldpp_dout(this, 1) << "ERROR: publishing notification failed, with error: " << ret << dendl;
+    }
+  }
+  return true;
+}
+
 void RGWDeleteMultiObj::execute(optional_yield y)
 {
   RGWMultiDelDelete *multi_delete;
@@ -7176,6 +7277,11 @@ void RGWDeleteMultiObj::execute(optional_yield y)
     goto done;
   }
 
+  if (handle_objects_batch(multi_delete->objects, y,
+                           formatter_flush_cond ? &*formatter_flush_cond : nullptr)) {
+    goto handled;
+  }
+
   for (iter = multi_delete->objects.begin();
         iter != multi_delete->objects.end();
         ++iter) {
@@ -7193,6 +7299,8 @@ void RGWDeleteMultiObj::execute(optional_yield y)
       handle_individual_object(obj_key, y, &*formatter_flush_cond);
     }
   }
+
+handled:
   if (formatter_flush_cond) {
     wait_flush(y, &*formatter_flush_cond, [this, n=multi_delete->objects.size()] {
       return n == ops_log_entries.size();
@@ -7219,20 +7327,21 @@ bool RGWBulkDelete::Deleter::verify_permission(RGWBucketInfo& binfo,
                                                ACLOwner& bucket_owner /* out */,
 					       optional_yield y)
 {
-  RGWAccessControlPolicy bacl(driver->ctx());
-  int ret = read_bucket_policy(dpp, driver, s, binfo, battrs, &bacl, binfo.bucket, y);
+  std::shared_ptr<const RGWAccessControlPolicy> bacl;
+  int ret = read_bucket_policy(dpp, driver, s, binfo, battrs, bacl, binfo.bucket, y);
   if (ret < 0) {
     return false;
   }
 
-  auto policy = get_iam_policy_from_attr(s->cct, battrs, binfo.bucket.tenant);
+  auto policy = get_iam_policy_from_attr(s->cct, battrs, binfo.bucket.bucket_id,
+                                         binfo.bucket.tenant);
 
-  bucket_owner = bacl.get_owner();
+  bucket_owner = bacl->get_owner();
 
   /* We can use global user_acl because each BulkDelete request is allowed
    * to work on entities from a single account only. */
   return verify_bucket_permission(dpp, s, binfo.bucket, s->user_acl.get(),
-				  &bacl, policy, s->iam_user_policies, s->session_policies, rgw::IAM::s3DeleteBucket);
+				  bacl.get(), policy, s->iam_user_policies, s->session_policies, rgw::IAM::s3DeleteBucket);
 }
 
 bool RGWBulkDelete::Deleter::delete_single(const acct_path_t& path, optional_yield y)
@@ -7544,16 +7653,17 @@ bool RGWBulkUploadOp::handle_file_verify_permission(RGWBucketInfo& binfo,
                                                     ACLOwner& bucket_owner /* out */,
 						    optional_yield y)
 {
-  RGWAccessControlPolicy bacl(driver->ctx());
-  op_ret = read_bucket_policy(this, driver, s, binfo, battrs, &bacl, binfo.bucket, y);
+  std::shared_ptr<const RGWAccessControlPolicy> bacl;
+  op_ret = read_bucket_policy(this, driver, s, binfo, battrs, bacl, binfo.bucket, y);
   if (op_ret < 0) {
     ldpp_dout(this, 20) << "cannot read_policy() for bucket" << dendl;
     return false;
   }
 
-  auto policy = get_iam_policy_from_attr(s->cct, battrs, binfo.bucket.tenant);
+  auto policy = get_iam_policy_from_attr(s->cct, battrs, binfo.bucket.bucket_id,
+                                         binfo.bucket.tenant);
 
-  bucket_owner = bacl.get_owner();
+  bucket_owner = bacl->get_owner();
   if (policy || ! s->iam_user_policies.empty() || !s->session_policies.empty()) {
     auto identity_policy_res = eval_identity_or_session_policies(this, s->iam_user_policies, s->env,
                                               rgw::IAM::s3PutObject, obj);
@@ -7599,7 +7709,7 @@ bool RGWBulkUploadOp::handle_file_verify_permission(RGWBucketInfo& binfo,
   }
     
   return verify_bucket_permission_no_policy(this, s, s->user_acl.get(),
-					    &bacl, RGW_PERM_WRITE);
+					    bacl.get(), RGW_PERM_WRITE);
 }
 
 int RGWBulkUploadOp::handle_file(const std::string_view path,
@@ -7693,7 +7803,7 @@ int RGWBulkUploadOp::handle_file(const std::string_view path,
       op_ret = len;
       return op_ret;
     } else if (len > 0) {
-      hash.Update((const unsigned char *)data.c_str(), data.length());
+      hash_update(hash, data);
       op_ret = filter->process(std::move(data), ofs);
       if (op_ret < 0) {
         ldpp_dout(this, 20) << "filter->process() returned ret=" << op_ret << dendl;
@@ -421,8 +421,8 @@ public:
   int read_user_manifest_part(
     rgw::sal::Bucket* bucket,
     const rgw_bucket_dir_entry& ent,
-    RGWAccessControlPolicy * const bucket_acl,
-    const boost::optional<rgw::IAM::Policy>& bucket_policy,
+    const RGWAccessControlPolicy * const bucket_acl,
+    const std::shared_ptr<const rgw::IAM::Policy>& bucket_policy,
     const off_t start_ofs,
     const off_t end_ofs,
     bool swift_slo);
@@ -2033,6 +2033,31 @@ public:
 
 
 class RGWDeleteMultiObj : public RGWOp {
+  /**
+   * An object cleared for deletion by prepare_individual_object()
+   */
+  struct individual_delete {
+    rgw_obj_key key;
+    std::unique_ptr<rgw::sal::Object> obj;
+    std::unique_ptr<rgw::sal::Notification> res;
+    uint64_t obj_size = 0;
+    std::string etag;
+  };
+
+  /**
+   * Runs the permission and object lock checks for deleting an
+   * individual object and reserves its notification. Returns false
+   * after recording the outcome with send_partial_response if the
+   * object can't be deleted. Without @a resolve_state the state of the
+   * object is only read if the object lock needs it, and the size and
+   * etag for the notification are left to the caller.
+   */
+  bool prepare_individual_object(const rgw_obj_key& o,
+                                 optional_yield y,
+                                 boost::asio::deadline_timer *formatter_flush_cond,
+                                 individual_delete& del,
+                                 bool resolve_state = true);
+
   /**
    * Handles the deletion of an individual object and uses
    * set_partial_response to record the outcome.
@@ -2041,6 +2066,15 @@ class RGWDeleteMultiObj : public RGWOp {
 				optional_yield y,
                                 boost::asio::deadline_timer *formatter_flush_cond);
 
+  /**
+   * Deletes all of @a keys with a single Bucket::delete_objects() call
+   * and records the outcome of each. Returns false without doing
+   * anything if the driver doesn't implement batch deletes.
+   */
+  bool handle_objects_batch(const std::vector<rgw_obj_key>& keys,
+                            optional_yield y,
+                            boost::asio::deadline_timer *formatter_flush_cond);
+
   /**
    * When the request is being executed in a coroutine, performs
    * the actual formatter flushing and is responsible for the
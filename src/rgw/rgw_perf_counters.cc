@@ -31,6 +31,14 @@ PerfHistogramCommon::axis_config_d perfcounter_op_hist_y_axis_config{
     "Count", PerfHistogramCommon::SCALE_LINEAR, 0, 1, 1,
 };
 
+static PerfHistogramCommon::axis_config_d sfs_group_commit_batch_x_axis_config{
+    "Batch size",
+    PerfHistogramCommon::SCALE_LOG2, // Batch size in logarithmic scale
+    1,                               // Start
+    1,                               // Quantization unit
+    12,                              // buckets
+};
+
 std::ostream& operator<<(std::ostream& os, sfs_gc_process_exit_state state) {
   switch (state) {
     case sfs_gc_process_exit_state::delete_pending_objects_data:
@@ -48,6 +56,9 @@ std::ostream& operator<<(std::ostream& os, sfs_gc_process_exit_state state) {
     case sfs_gc_process_exit_state::finished:
       os << "finished";
       break;
+    case sfs_gc_process_exit_state::process_stale_open_versions:
+      os << "process_stale_open_versions";
+      break;
     default:
       os << "unknown";
   }
@@ -58,7 +69,7 @@ std::ostream& operator<<(std::ostream& os, sfs_gc_process_exit_state state) {
 static std::string sfs_gc_process_exit_help_str() {
   std::ostringstream os;
   os << "Step where GC last finished. Values: ";
-  for (int i = 1; i <= static_cast<int>(sfs_gc_process_exit_state::finished); i++) {
+  for (int i = 1; i <= static_cast<int>(sfs_gc_process_exit_state::process_stale_open_versions); i++) {
     os << static_cast<sfs_gc_process_exit_state>(i) << " ";
   }
   return os.str();
@@ -92,6 +103,11 @@ int rgw_perf_start(CephContext* cct) {
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
 
+  plb.add_u64_counter(l_rgw_s3_signing_key_cache_hit, "s3_signing_key_cache_hit", "AWS SigV4 signing key cache hits");
+  plb.add_u64_counter(l_rgw_s3_signing_key_cache_miss, "s3_signing_key_cache_miss", "AWS SigV4 signing key cache misses");
+  plb.add_u64_counter(l_rgw_bucket_policy_cache_hit, "bucket_policy_cache_hit", "Bucket IAM policy and ACL cache hits");
+  plb.add_u64_counter(l_rgw_bucket_policy_cache_miss, "bucket_policy_cache_miss", "Bucket IAM policy and ACL cache misses");
+
   plb.add_u64_counter(l_rgw_gc_retire, "gc_retire_object", "GC object retires");
 
   plb.add_u64_counter(l_rgw_lc_expire_current, "lc_expire_current",
@@ -126,6 +142,49 @@ int rgw_perf_start(CephContext* cct) {
   plb.add_u64_counter(l_rgw_sfs_sqlite_retry_retried_count, "sfs_retry_retried_count", "Number of transactions succeeded after retry");
   plb.add_u64_counter(l_rgw_sfs_sqlite_retry_failed_count, "sfs_retry_failed_count", "Number of yransactions failed after retry");
 
+  plb.add_time_avg(l_rgw_sfs_sqlite_pool_wait, "sfs_sqlite_pool_wait", "Average time to obtain a pooled SQLite connection");
+  plb.add_u64(l_rgw_sfs_sqlite_pool_size, "sfs_sqlite_pool_size", "Number of open pooled SQLite connections");
+  plb.add_u64(l_rgw_sfs_sqlite_writer_queue_depth, "sfs_sqlite_writer_queue_depth", "Number of tasks waiting for the SQLite writer thread");
+  plb.add_time_avg(l_rgw_sfs_sqlite_writer_queue_wait, "sfs_sqlite_writer_queue_wait", "Average time a task waits in the SQLite writer queue");
+  plb.add_u64_counter(l_rgw_sfs_sqlite_group_commit_batches, "sfs_sqlite_group_commit_batches", "Number of group committed SQLite transactions");
+  plb.add_u64_counter_histogram(
+      l_rgw_sfs_sqlite_group_commit_batch_size, "sfs_sqlite_group_commit_batch_size",
+      sfs_group_commit_batch_x_axis_config, perfcounter_op_hist_y_axis_config,
+      "Histogram of operations per group committed SQLite transaction"
+  );
+  plb.add_time_avg(l_rgw_sfs_sqlite_group_commit_time, "sfs_sqlite_group_commit_time", "Average time to run and commit a group commit batch");
+  plb.add_u64_counter(l_rgw_sfs_sqlite_stmt_cache_hit, "sfs_sqlite_stmt_cache_hit", "Number of SQLite statements reused from the prepared statement cache");
+  plb.add_u64_counter(l_rgw_sfs_sqlite_stmt_cache_miss, "sfs_sqlite_stmt_cache_miss", "Number of SQLite statements prepared for the prepared statement cache");
+
+  plb.add_u64_counter(l_rgw_sfs_read_mmap_bytes, "sfs_read_mmap_bytes", "Object data bytes read through mmap-backed buffers", nullptr, 0, unit_t(UNIT_BYTES));
+  plb.add_u64_counter(l_rgw_sfs_read_pread_bytes, "sfs_read_pread_bytes", "Object data bytes read with pread", nullptr, 0, unit_t(UNIT_BYTES));
+
+  plb.add_u64_counter(l_rgw_sfs_user_cache_hit, "sfs_user_cache_hit", "Users found in the access key cache");
+  plb.add_u64_counter(l_rgw_sfs_user_cache_miss, "sfs_user_cache_miss", "Users looked up in the database by access key");
+  plb.add_u64_counter(l_rgw_sfs_object_meta_cache_hit, "sfs_object_meta_cache_hit", "Object versions found in the metadata cache");
+  plb.add_u64_counter(l_rgw_sfs_object_meta_cache_miss, "sfs_object_meta_cache_miss", "Object versions looked up in the database");
+
+  plb.add_u64_counter(l_rgw_sfs_pack_objects, "sfs_pack_objects", "Number of objects packed in segment files");
+  plb.add_u64_counter(l_rgw_sfs_pack_bytes, "sfs_pack_bytes", "Object data bytes packed in segment files", nullptr, 0, unit_t(UNIT_BYTES));
+  plb.add_u64_counter(l_rgw_sfs_pack_removed_segments, "sfs_pack_removed_segments", "Number of segment files removed by the GC");
+  plb.add_u64_counter(l_rgw_sfs_pack_removed_bytes, "sfs_pack_removed_bytes", "Bytes of the segment files removed by the GC", nullptr, 0, unit_t(UNIT_BYTES));
+  plb.add_u64_counter(l_rgw_sfs_pack_moved_bytes, "sfs_pack_moved_bytes", "Object data bytes the GC copied out of segment files to compact them", nullptr, 0, unit_t(UNIT_BYTES));
+
+  plb.add_u64_counter(l_rgw_sfs_inline_objects, "sfs_inline_objects", "Number of objects stored inline in the metadata database");
+  plb.add_u64_counter(l_rgw_sfs_inline_bytes, "sfs_inline_bytes", "Object data bytes stored inline in the metadata database", nullptr, 0, unit_t(UNIT_BYTES));
+  plb.add_u64_counter(l_rgw_sfs_inline_read_bytes, "sfs_inline_read_bytes", "Object data bytes read from inline objects", nullptr, 0, unit_t(UNIT_BYTES));
+
+  plb.add_u64_counter(l_rgw_sfs_copy_reflink_objects, "sfs_copy_reflink_objects", "Number of objects copied by cloning their data files");
+  plb.add_u64_counter(l_rgw_sfs_copy_shared_objects, "sfs_copy_shared_objects", "Number of objects copied by sharing the data files of their source");
+  plb.add_u64_counter(l_rgw_sfs_copy_bytes, "sfs_copy_bytes", "Object data bytes copied by server side copies", nullptr, 0, unit_t(UNIT_BYTES));
+
+  plb.add_u64_counter(l_rgw_sfs_multipart_parts, "sfs_multipart_parts", "Number of multipart upload parts written");
+  plb.add_u64_counter(l_rgw_sfs_multipart_part_db_queries, "sfs_multipart_part_db_queries", "Database queries made by multipart upload part writers");
+
+  plb.add_u64_counter(l_rgw_sfs_data_sync_batches, "sfs_data_sync_batches", "Batches of data files synced together");
+  plb.add_u64_counter(l_rgw_sfs_data_sync_files, "sfs_data_sync_files", "Data files synced in batches");
+  plb.add_time_avg(l_rgw_sfs_data_sync_batch_time, "sfs_data_sync_batch_time", "Average time syncing a batch of data files");
+
   plb.add_u64_counter(l_rgw_sfs_gc_count, "sfs_gc_count", "Number of GC runs so far");
   plb.add_time_avg(l_rgw_sfs_gc_processing_time, "sfs_gc_process_time", "Average GC processing runtime");
   plb.add_u64(l_rgw_sfs_gc_process_exit, "sfs_gc_process_exit", sfs_gc_process_help.c_str());
@@ -135,6 +194,11 @@ int rgw_perf_start(CephContext* cct) {
   plb.add_time_avg(l_rgw_sfs_gc_deleted_buckets_elapsed, "sfs_gc_deleted_buckets_elapsed", "GC step deleted buckets time");
   plb.add_time_avg(l_rgw_sfs_gc_done_aborted_multiparts_elapsed, "sfs_gc_pending_objects_data_elapsed", "GC step done+aborted multiparts time");
   plb.add_time_avg(l_rgw_sfs_gc_abort_bucket_multiparts_elapsed, "sfs_gc_pending_objects_data_elapsed", "GC abort bucket multiparts");
+  plb.add_u64_counter(l_rgw_sfs_gc_reclaimed_files, "sfs_gc_reclaimed_files", "Number of data files removed by the GC");
+  plb.add_u64_counter(l_rgw_sfs_gc_reclaimed_bytes, "sfs_gc_reclaimed_bytes", "Data bytes reclaimed by the GC", nullptr, 0, unit_t(UNIT_BYTES));
+  plb.add_u64_counter(l_rgw_sfs_gc_reclaimed_dirs, "sfs_gc_reclaimed_dirs", "Number of emptied data directories removed by the GC");
+  plb.add_u64(l_rgw_sfs_gc_reclaim_files_rate, "sfs_gc_reclaim_files_rate", "Data files removed per second by the last GC reclaim batch");
+  plb.add_u64(l_rgw_sfs_gc_reclaim_bytes_rate, "sfs_gc_reclaim_bytes_rate", "Data bytes reclaimed per second by the last GC reclaim batch", nullptr, 0, unit_t(UNIT_BYTES));
 
   PerfCountersBuilder prom_plb_hist(
       cct, "rgw_prom_hist", l_rgw_prom_first, l_rgw_prom_last
@@ -41,6 +41,11 @@ enum {
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_s3_signing_key_cache_hit,
+  l_rgw_s3_signing_key_cache_miss,
+  l_rgw_bucket_policy_cache_hit,
+  l_rgw_bucket_policy_cache_miss,
+
   l_rgw_gc_retire,
 
   l_rgw_lc_expire_current,
@@ -68,6 +73,45 @@ enum {
   l_rgw_sfs_sqlite_retry_retried_count,
   l_rgw_sfs_sqlite_retry_failed_count,
 
+  l_rgw_sfs_sqlite_pool_wait,
+  l_rgw_sfs_sqlite_pool_size,
+  l_rgw_sfs_sqlite_writer_queue_depth,
+  l_rgw_sfs_sqlite_writer_queue_wait,
+  l_rgw_sfs_sqlite_group_commit_batches,
+  l_rgw_sfs_sqlite_group_commit_batch_size,
+  l_rgw_sfs_sqlite_group_commit_time,
+  l_rgw_sfs_sqlite_stmt_cache_hit,
+  l_rgw_sfs_sqlite_stmt_cache_miss,
+
+  l_rgw_sfs_read_mmap_bytes,
+  l_rgw_sfs_read_pread_bytes,
+
+  l_rgw_sfs_user_cache_hit,
+  l_rgw_sfs_user_cache_miss,
+  l_rgw_sfs_object_meta_cache_hit,
+  l_rgw_sfs_object_meta_cache_miss,
+
+  l_rgw_sfs_pack_objects,
+  l_rgw_sfs_pack_bytes,
+  l_rgw_sfs_pack_removed_segments,
+  l_rgw_sfs_pack_removed_bytes,
+  l_rgw_sfs_pack_moved_bytes,
+
+  l_rgw_sfs_inline_objects,
+  l_rgw_sfs_inline_bytes,
+  l_rgw_sfs_inline_read_bytes,
+
+  l_rgw_sfs_copy_reflink_objects,
+  l_rgw_sfs_copy_shared_objects,
+  l_rgw_sfs_copy_bytes,
+
+  l_rgw_sfs_multipart_parts,
+  l_rgw_sfs_multipart_part_db_queries,
+
+  l_rgw_sfs_data_sync_batches,
+  l_rgw_sfs_data_sync_files,
+  l_rgw_sfs_data_sync_batch_time,
+
   l_rgw_sfs_gc_count,
   l_rgw_sfs_gc_processing_time,
   l_rgw_sfs_gc_process_exit,
@@ -77,6 +121,11 @@ enum {
   l_rgw_sfs_gc_deleted_objects_elapsed,
   l_rgw_sfs_gc_done_aborted_multiparts_elapsed,
   l_rgw_sfs_gc_abort_bucket_multiparts_elapsed,
+  l_rgw_sfs_gc_reclaimed_files,
+  l_rgw_sfs_gc_reclaimed_bytes,
+  l_rgw_sfs_gc_reclaimed_dirs,
+  l_rgw_sfs_gc_reclaim_files_rate,
+  l_rgw_sfs_gc_reclaim_bytes_rate,
 
   l_rgw_last,
 };
@@ -93,6 +142,7 @@ enum class sfs_gc_process_exit_state : int {
   process_deleted_buckets,
   process_deleted_objects,
   finished,
+  process_stale_open_versions,
 };
 
 std::ostream& operator<<(std::ostream& os, sfs_gc_process_exit_state state);
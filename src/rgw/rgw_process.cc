@@ -100,7 +100,6 @@ bool rate_limit(rgw::sal::Driver* driver, req_state* s) {
   const auto& is_admin_or_system = s->user->get_info();
   if ((s->op_type ==  RGW_OP_GET_HEALTH_CHECK) || is_admin_or_system.admin || is_admin_or_system.system)
     return false;
-  std::string userfind;
   RGWRateLimitInfo global_user;
   RGWRateLimitInfo global_bucket;
   RGWRateLimitInfo global_anon;
@@ -109,11 +108,9 @@ bool rate_limit(rgw::sal::Driver* driver, req_state* s) {
   driver->get_ratelimit(global_bucket, global_user, global_anon);
   bucket_ratelimit = &global_bucket;
   user_ratelimit = &global_user;
-  s->user->get_id().to_str(userfind);
-  userfind = "u" + userfind;
-  s->ratelimit_user_name = userfind;
-  std::string bucketfind = !rgw::sal::Bucket::empty(s->bucket.get()) ? "b" + s->bucket->get_marker() : "";
-  s->ratelimit_bucket_marker = bucketfind;
+  // the keys refer to the user id and bucket marker, nothing is copied
+  const RGWRateLimitKey user_key(s->user->get_id());
+  const RGWRateLimitKey bucket_key = !rgw::sal::Bucket::empty(s->bucket.get()) ? RGWRateLimitKey('b', s->bucket->get_marker()) : RGWRateLimitKey();
   const char *method = s->info.method;
 
   auto iter = s->user->get_attrs().find(RGW_ATTR_RATELIMIT);
@@ -135,7 +132,7 @@ bool rate_limit(rgw::sal::Driver* driver, req_state* s) {
     *user_ratelimit = global_anon;
   }
   bool limit_bucket = false;
-  bool limit_user = s->ratelimit_data->should_rate_limit(method, s->ratelimit_user_name, s->time, user_ratelimit);
+  bool limit_user = s->ratelimit_data->should_rate_limit(method, user_key, s->time, user_ratelimit, &s->ratelimit_user_entry);
 
   if(!rgw::sal::Bucket::empty(s->bucket.get()))
   {
@@ -155,11 +152,11 @@ bool rate_limit(rgw::sal::Driver* driver, req_state* s) {
       }
     }
     if (!limit_user) {
-      limit_bucket = s->ratelimit_data->should_rate_limit(method, s->ratelimit_bucket_marker, s->time, bucket_ratelimit);
+      limit_bucket = s->ratelimit_data->should_rate_limit(method, bucket_key, s->time, bucket_ratelimit, &s->ratelimit_bucket_entry);
     }
   }
   if(limit_bucket && !limit_user) {
-    s->ratelimit_data->giveback_tokens(method, s->ratelimit_user_name);
+    s->ratelimit_data->giveback_tokens(method, s->ratelimit_user_entry);
   }
   s->user_ratelimit = *user_ratelimit;
   s->bucket_ratelimit = *bucket_ratelimit;
@@ -1,78 +1,67 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <shared_mutex>
 #include <thread>
 #include <condition_variable>
+#include <memory>
+#include <unordered_map>
 #include "rgw_common.h"
 
 
 class RateLimiterEntry {
-  /* 
+  /*
     fixed_point_rgw_ratelimit is important to preserve the precision of the token calculation
     for example: a user have a limit of single op per minute, the user will consume its single token and then will send another request, 1s after it.
     in that case, without this method, the user will get 0 tokens although it should get 0.016 tokens.
     using this method it will add 16 tokens to the user, and the user will have 16 tokens, each time rgw will do comparison rgw will divide by fixed_point_rgw_ratelimit, so the user will be blocked anyway until it has enough tokens.
   */
   static constexpr int64_t fixed_point_rgw_ratelimit = 1000;
-  // counters are tracked in multiples of fixed_point_rgw_ratelimit
+  // counters are tracked in multiples of fixed_point_rgw_ratelimit.
+  // they are atomic, so concurrent requests of a user or bucket don't serialize on a lock
   struct counters {
-    int64_t ops = 0;
-    int64_t bytes = 0;
+    std::atomic_int64_t ops = 0;
+    std::atomic_int64_t bytes = 0;
   };
   counters read;
   counters write;
-  ceph::timespan ts;
-  bool first_run = true;
-  std::mutex ts_lock;
-  // Those functions are returning the integer value of the tokens 
-  int64_t read_ops () const
-  {
-    return read.ops / fixed_point_rgw_ratelimit;
-  }
-  int64_t write_ops() const
-  {
-    return write.ops / fixed_point_rgw_ratelimit;
-  }
-  int64_t read_bytes() const
-  {
-    return read.bytes / fixed_point_rgw_ratelimit;
-  }
-  int64_t write_bytes() const
-  {
-    return write.bytes / fixed_point_rgw_ratelimit;
-  }
-  bool should_rate_limit_read(int64_t ops_limit, int64_t bw_limit) {
-    //check if tenants did not reach their bw or ops limits and that the limits are not 0 (which is unlimited)
-    if(((read_ops() - 1 < 0) && (ops_limit > 0)) ||
-      (read_bytes() < 0 && bw_limit > 0))
+  // timestamp of the last refill, 0 before the first one
+  std::atomic<ceph::timespan::rep> ts = 0;
+  // held by the request adding the tokens of the time elapsed since ts
+  std::atomic_flag refilling;
+  // timestamp of the last request, to expire idle entries
+  std::atomic<ceph::timespan::rep> last_used = 0;
+
+  static bool should_rate_limit(counters& c, int64_t ops_limit, int64_t bw_limit)
   {
-    return true;
-  }
-    // we don't want to reduce ops' tokens if we've rejected it.
-    read.ops -= fixed_point_rgw_ratelimit;
+    int64_t ops = c.ops.load();
+    do {
+      //check if tenants did not reach their bw or ops limits and that the limits are not 0 (which is unlimited)
+      if(((ops / fixed_point_rgw_ratelimit - 1 < 0) && (ops_limit > 0)) ||
+        (c.bytes.load() / fixed_point_rgw_ratelimit < 0 && bw_limit > 0))
+      {
+        return true;
+      }
+      // we don't want to reduce ops' tokens if we've rejected it.
+    } while (!c.ops.compare_exchange_weak(ops, ops - fixed_point_rgw_ratelimit));
     return false;
   }
-  bool should_rate_limit_write(int64_t ops_limit, int64_t bw_limit) 
+  // adds tokens to a counter, up to its limit
+  static void add_tokens(std::atomic_int64_t& counter, int64_t tokens, int64_t max)
   {
-    //check if tenants did not reach their bw or ops limits and that the limits are not 0 (which is unlimited)
-    if(((write_ops() - 1 < 0) && (ops_limit > 0)) ||
-      (write_bytes() < 0 && bw_limit > 0))
-    {
-      return true;
-    }
-
-    // we don't want to reduce ops' tokens if we've rejected it.
-    write.ops -= fixed_point_rgw_ratelimit;
-    return false;
+    int64_t curr = counter.load();
+    while (!counter.compare_exchange_weak(curr, std::min(max, curr + tokens)));
   }
   /* The purpose of this function is to minimum time before overriding the stored timestamp
      This function is necessary to force the increase tokens add at least 1 token when it updates the last stored timestamp.
      That way the user/bucket will not lose tokens because of rounding
   */
-  bool minimum_time_reached(ceph::timespan curr_timestamp) const
+  static bool minimum_time_reached(ceph::timespan curr_timestamp, ceph::timespan prev_timestamp)
   {
     using namespace std::chrono;
     constexpr auto min_duration = duration_cast<ceph::timespan>(seconds(60)) / fixed_point_rgw_ratelimit;
-    const auto delta = curr_timestamp - ts;
+    const auto delta = curr_timestamp - prev_timestamp;
     if (delta < min_duration)
     {
       return false;
@@ -84,72 +73,136 @@ class RateLimiterEntry {
                        const RGWRateLimitInfo* info)
   {
     constexpr int fixed_point = fixed_point_rgw_ratelimit;
-    if (first_run)
+    auto prev = ts.load();
+    if (prev == 0)
     {
+      // the first run must not race with other requests, see RateLimiter::should_rate_limit()
       write.ops = info->max_write_ops * fixed_point;
       write.bytes = info->max_write_bytes * fixed_point;
       read.ops = info->max_read_ops * fixed_point;
       read.bytes = info->max_read_bytes * fixed_point;
-      ts = curr_timestamp;
-      first_run = false;
+      ts = curr_timestamp.count();
       return;
     }
-    else if(curr_timestamp > ts && minimum_time_reached(curr_timestamp))
+    if (!refill_due(curr_timestamp, prev))
     {
-      const int64_t time_in_ms = std::chrono::duration_cast<std::chrono::milliseconds>(curr_timestamp - ts).count() / 60.0 / std::milli::den * fixed_point; // / 60 to make it work with 1 min token bucket
-      ts = curr_timestamp;
-      const int64_t write_ops = info->max_write_ops * time_in_ms;
-      const int64_t write_bw = info->max_write_bytes * time_in_ms;
-      const int64_t read_ops = info->max_read_ops * time_in_ms;
-      const int64_t read_bw = info->max_read_bytes * time_in_ms;
-      read.ops = std::min(info->max_read_ops * fixed_point, read_ops + read.ops);
-      read.bytes = std::min(info->max_read_bytes * fixed_point, read_bw + read.bytes);
-      write.ops = std::min(info->max_write_ops * fixed_point, write_ops + write.ops);
-      write.bytes = std::min(info->max_write_bytes * fixed_point, write_bw + write.bytes);
+      return;
     }
+    // a single request adds the tokens of the elapsed time. it publishes the
+    // new timestamp only after adding them and the others wait for it, so no
+    // request sees the timestamp moved forward without the tokens it brought
+    while (refilling.test_and_set(std::memory_order_acquire))
+    {
+      refilling.wait(true, std::memory_order_relaxed);
+    }
+    prev = ts.load();
+    if (refill_due(curr_timestamp, prev))
+    {
+      add_tokens_since(ceph::timespan(prev), curr_timestamp, info);
+      ts = curr_timestamp.count();
+    }
+    refilling.clear(std::memory_order_release);
+    refilling.notify_all();
+  }
+  static bool refill_due(ceph::timespan curr_timestamp, ceph::timespan::rep prev)
+  {
+    const ceph::timespan prev_timestamp(prev);
+    return curr_timestamp > prev_timestamp && minimum_time_reached(curr_timestamp, prev_timestamp);
+  }
+  void add_tokens_since(ceph::timespan prev_timestamp, ceph::timespan curr_timestamp,
+                        const RGWRateLimitInfo* info)
+  {
+    constexpr int fixed_point = fixed_point_rgw_ratelimit;
+    const int64_t time_in_ms = std::chrono::duration_cast<std::chrono::milliseconds>(curr_timestamp - prev_timestamp).count() / 60.0 / std::milli::den * fixed_point; // / 60 to make it work with 1 min token bucket
+    add_tokens(read.ops, info->max_read_ops * time_in_ms, info->max_read_ops * fixed_point);
+    add_tokens(read.bytes, info->max_read_bytes * time_in_ms, info->max_read_bytes * fixed_point);
+    add_tokens(write.ops, info->max_write_ops * time_in_ms, info->max_write_ops * fixed_point);
+    add_tokens(write.bytes, info->max_write_bytes * time_in_ms, info->max_write_bytes * fixed_point);
   }
 
   public:
     bool should_rate_limit(bool is_read, const RGWRateLimitInfo* ratelimit_info, ceph::timespan curr_timestamp)
     {
-      std::unique_lock lock(ts_lock);
       increase_tokens(curr_timestamp, ratelimit_info);
       if (is_read)
       {
-        return should_rate_limit_read(ratelimit_info->max_read_ops, ratelimit_info->max_read_bytes);
+        return should_rate_limit(read, ratelimit_info->max_read_ops, ratelimit_info->max_read_bytes);
       }
-      return should_rate_limit_write(ratelimit_info->max_write_ops, ratelimit_info->max_write_bytes);
+      return should_rate_limit(write, ratelimit_info->max_write_ops, ratelimit_info->max_write_bytes);
     }
     void decrease_bytes(bool is_read, int64_t amount, const RGWRateLimitInfo* info) {
-      std::unique_lock lock(ts_lock);
       // we don't want the tenant to be with higher debt than 120 seconds(2 min) of its limit
-      if (is_read)
-      {
-        read.bytes = std::max(read.bytes - amount * fixed_point_rgw_ratelimit,info->max_read_bytes * fixed_point_rgw_ratelimit * -2);
-      } else {
-        write.bytes = std::max(write.bytes - amount * fixed_point_rgw_ratelimit,info->max_write_bytes * fixed_point_rgw_ratelimit * -2);
-      }
+      auto& c = is_read ? read : write;
+      const int64_t max_debt = (is_read ? info->max_read_bytes : info->max_write_bytes) * fixed_point_rgw_ratelimit * -2;
+      int64_t bytes = c.bytes.load();
+      while (!c.bytes.compare_exchange_weak(bytes, std::max(bytes - amount * fixed_point_rgw_ratelimit, max_debt)));
     }
     void giveback_tokens(bool is_read)
     {
-      std::unique_lock lock(ts_lock);
-      if (is_read) 
+      if (is_read)
       {
         read.ops += fixed_point_rgw_ratelimit;
       } else {
         write.ops += fixed_point_rgw_ratelimit;
       }
     }
+    void touch(ceph::timespan curr_timestamp)
+    {
+      last_used.store(curr_timestamp.count(), std::memory_order_relaxed);
+    }
+    // an entry unused for this long has refilled all its tokens: the debt is at most
+    // 2 minutes of its limit and it holds 1 minute of it. forgetting it changes nothing
+    static constexpr auto idle_expiry = std::chrono::minutes(3);
+    bool is_idle(ceph::timespan curr_timestamp) const
+    {
+      const ceph::timespan used(last_used.load(std::memory_order_relaxed));
+      return curr_timestamp > used && curr_timestamp - used >= idle_expiry;
+    }
 };
 
 class RateLimiter {
 
-  static constexpr size_t map_size = 2000000; // will create it with the closest upper prime number
-  std::shared_mutex insert_lock;
+  static constexpr size_t map_size = 2000000; // number of entries at which the ActiveRateLimiter replaces this one
+  // the entries are split in stripes by the hash of their key, each with its own lock.
+  // requests for different keys rarely contend and those for the same key take a shared lock
+  static constexpr size_t num_stripes = 64;
+  // every new entry of a stripe expires the idle entries of this many of its buckets
+  static constexpr size_t expiry_buckets = 4;
   std::atomic_bool& replacing;
   std::condition_variable& cv;
-  typedef std::unordered_map<std::string, RateLimiterEntry> hash_map;
-  hash_map ratelimit_entries{map_size};
+  // the key of an entry, owning the strings of its name
+  struct entry_key {
+    char kind;
+    std::string tenant;
+    std::string ns;
+    std::string id;
+    size_t hash;
+    explicit entry_key(const RGWRateLimitKey& key)
+      : kind(key.kind), tenant(key.tenant), ns(key.ns), id(key.id), hash(key.hash) {}
+  };
+  // entries are looked up by RGWRateLimitKey, so a lookup copies no string
+  struct key_hash {
+    using is_transparent = void;
+    size_t operator()(const entry_key& key) const { return key.hash; }
+    size_t operator()(const RGWRateLimitKey& key) const { return key.hash; }
+  };
+  struct key_equal {
+    using is_transparent = void;
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+      return a.hash == b.hash && a.kind == b.kind && a.id == b.id &&
+        a.tenant == b.tenant && a.ns == b.ns;
+    }
+  };
+  typedef std::unordered_map<entry_key, std::shared_ptr<RateLimiterEntry>, key_hash, key_equal> hash_map;
+  struct alignas(64) stripe {
+    std::shared_mutex lock;
+    hash_map entries;
+    // the next bucket to expire idle entries from
+    size_t expiry_cursor = 0;
+  };
+  std::array<stripe, num_stripes> stripes;
+  std::atomic_size_t num_entries = 0;
   static bool is_read_op(const std::string_view method) {
     if (method == "GET" || method == "HEAD")
     {
@@ -158,29 +211,42 @@ class RateLimiter {
     return false;
   }
 
-    // find or create an entry, and return its iterator
-  auto& find_or_create(const std::string& key) {
-    std::shared_lock rlock(insert_lock);
-    if (ratelimit_entries.size() > 0.9 * map_size && replacing == false)
+  stripe& stripe_of(const RGWRateLimitKey& key) {
+    return stripes[key.hash % num_stripes];
+  }
+
+  // forgets the idle entries of the next few buckets of a stripe, whose lock is held
+  // exclusively. every new entry moves on, so all the stripe is visited as it grows
+  // and the lock is never held for a scan of the whole stripe
+  void expire_idle(stripe& s, ceph::timespan curr_timestamp) {
+    if (s.entries.empty())
     {
-      replacing = true;
-      cv.notify_all();
+      return;
     }
-    auto ret = ratelimit_entries.find(key);
-    rlock.unlock();
-    if (ret == ratelimit_entries.end())
+    for (size_t n = 0; n < expiry_buckets; n++)
     {
-      std::unique_lock wlock(insert_lock);
-      ret = ratelimit_entries.emplace(std::piecewise_construct,
-                                 std::forward_as_tuple(key),
-                                 std::forward_as_tuple()).first;
+      const size_t bucket = s.expiry_cursor++ % s.entries.bucket_count();
+      auto it = s.entries.begin(bucket);
+      while (it != s.entries.end(bucket))
+      {
+        if (!it->second->is_idle(curr_timestamp))
+        {
+          ++it;
+          continue;
+        }
+        // erasing invalidates the bucket iterator, start over
+        s.entries.erase(s.entries.find(it->first));
+        num_entries--;
+        it = s.entries.begin(bucket);
+      }
     }
-    return ret->second;
   }
 
-  
-
   public:
+    // an entry found by should_rate_limit(). it stays valid after its RateLimiter
+    // forgets it, the tokens it holds then no longer matter
+    typedef std::shared_ptr<RateLimiterEntry> entry_ref;
+
     RateLimiter(const RateLimiter&) = delete;
     RateLimiter& operator =(const RateLimiter&) = delete;
     RateLimiter(RateLimiter&&) = delete;
@@ -189,28 +255,84 @@ class RateLimiter {
     RateLimiter(std::atomic_bool& replacing, std::condition_variable& cv)
       : replacing(replacing), cv(cv)
     {
-      // prevents rehash, so no iterators invalidation
-      ratelimit_entries.max_load_factor(1000);
     };
 
-    bool should_rate_limit(const char *method, const std::string& key, ceph::coarse_real_time curr_timestamp, const RGWRateLimitInfo* ratelimit_info) {
-      if (key.empty() || key.length() == 1 || !ratelimit_info->enabled)
+    // checks and charges a request of a key. if entry is given, it is set to the
+    // entry of the key, so later calls for the request don't have to look it up
+    bool should_rate_limit(const char *method, const RGWRateLimitKey& key, ceph::coarse_real_time curr_timestamp, const RGWRateLimitInfo* ratelimit_info, entry_ref* entry = nullptr) {
+      if (key.empty() || !ratelimit_info->enabled)
       {
         return false;
       }
       bool is_read = is_read_op(method);
-      auto& it = find_or_create(key);
       auto curr_ts = curr_timestamp.time_since_epoch();
-      return it.should_rate_limit(is_read ,ratelimit_info, curr_ts);
+      auto& s = stripe_of(key);
+      {
+        std::shared_lock rlock(s.lock);
+        auto it = s.entries.find(key);
+        if (it != s.entries.end())
+        {
+          if (entry)
+          {
+            *entry = it->second;
+          }
+          it->second->touch(curr_ts);
+          return it->second->should_rate_limit(is_read, ratelimit_info, curr_ts);
+        }
+      }
+      // create the entry and do its first refill before other requests can see it
+      std::unique_lock wlock(s.lock);
+      auto it = s.entries.find(key);
+      if (it == s.entries.end())
+      {
+        expire_idle(s, curr_ts);
+        it = s.entries.try_emplace(entry_key(key), std::make_shared<RateLimiterEntry>()).first;
+        if (++num_entries > 0.9 * map_size && replacing == false)
+        {
+          replacing = true;
+          cv.notify_all();
+        }
+      }
+      if (entry)
+      {
+        *entry = it->second;
+      }
+      it->second->touch(curr_ts);
+      return it->second->should_rate_limit(is_read, ratelimit_info, curr_ts);
     }
-    void giveback_tokens(const char *method, const std::string& key)
+    // giveback_tokens() and decrease_bytes() ignore unknown keys: a new entry starts with all its tokens
+    void giveback_tokens(const char *method, const RGWRateLimitKey& key)
     {
-      bool is_read = is_read_op(method);
-      auto& it = find_or_create(key);
-      it.giveback_tokens(is_read);
+      auto& s = stripe_of(key);
+      std::shared_lock rlock(s.lock);
+      auto it = s.entries.find(key);
+      if (it != s.entries.end())
+      {
+        giveback_tokens(method, it->second);
+      }
+    }
+    void giveback_tokens(const char *method, const entry_ref& entry)
+    {
+      if (entry)
+      {
+        entry->giveback_tokens(is_read_op(method));
+      }
     }
-    void decrease_bytes(const char *method, const std::string& key, const int64_t amount, const RGWRateLimitInfo* info) {
-      if (key.empty() || key.length() == 1 || !info->enabled)
+    void decrease_bytes(const char *method, const RGWRateLimitKey& key, const int64_t amount, const RGWRateLimitInfo* info) {
+      if (key.empty())
+      {
+        return;
+      }
+      auto& s = stripe_of(key);
+      std::shared_lock rlock(s.lock);
+      auto it = s.entries.find(key);
+      if (it != s.entries.end())
+      {
+        decrease_bytes(method, it->second, amount, info);
+      }
+    }
+    void decrease_bytes(const char *method, const entry_ref& entry, const int64_t amount, const RGWRateLimitInfo* info) {
+      if (!entry || !info->enabled)
       {
         return;
       }
@@ -219,11 +341,20 @@ class RateLimiter {
       {
         return;
       }
-      auto& it = find_or_create(key);
-      it.decrease_bytes(is_read, amount, info);
+      entry->touch(ceph::coarse_real_clock::now().time_since_epoch());
+      entry->decrease_bytes(is_read, amount, info);
+    }
+    size_t size() const {
+      return num_entries;
     }
     void clear() {
-      ratelimit_entries.clear();
+      for (auto& s : stripes)
+      {
+        std::unique_lock wlock(s.lock);
+        num_entries -= s.entries.size();
+        s.entries.clear();
+        s.expiry_cursor = 0;
+      }
     }
 };
 // This class purpose is to hold 2 RateLimiter instances, one active and one passive.
@@ -760,9 +760,9 @@ int dump_body(req_state* const s,
     healthchk = true;
   if(len > 0 && !healthchk) {
     const char *method = s->info.method;
-    s->ratelimit_data->decrease_bytes(method, s->ratelimit_user_name, len, &s->user_ratelimit);
+    s->ratelimit_data->decrease_bytes(method, s->ratelimit_user_entry, len, &s->user_ratelimit);
     if(!rgw::sal::Bucket::empty(s->bucket.get()))
-      s->ratelimit_data->decrease_bytes(method, s->ratelimit_bucket_marker, len, &s->bucket_ratelimit);
+      s->ratelimit_data->decrease_bytes(method, s->ratelimit_bucket_entry, len, &s->bucket_ratelimit);
   }
   try {
     return RESTFUL_IO(s)->send_body(buf, len);
@@ -797,9 +797,9 @@ int recv_body(req_state* const s,
     healthchk = true;
   if(len > 0 && !healthchk) {
     const char *method = s->info.method;
-    s->ratelimit_data->decrease_bytes(method, s->ratelimit_user_name, len, &s->user_ratelimit);
+    s->ratelimit_data->decrease_bytes(method, s->ratelimit_user_entry, len, &s->user_ratelimit);
     if(!rgw::sal::Bucket::empty(s->bucket.get()))
-      s->ratelimit_data->decrease_bytes(method, s->ratelimit_bucket_marker, len, &s->bucket_ratelimit);
+      s->ratelimit_data->decrease_bytes(method, s->ratelimit_bucket_entry, len, &s->bucket_ratelimit);
   }
   return len;
 
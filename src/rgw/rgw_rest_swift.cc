@@ -465,10 +465,11 @@ static void dump_container_metadata(req_state *s,
   dump_header(s, "X-Container-Bytes-Used-Actual", bucket->get_size_rounded());
 
   if (rgw::sal::Object::empty(s->object.get())) {
-    auto swift_policy = \
-      static_cast<RGWAccessControlPolicy_SWIFT*>(s->bucket_acl.get());
+    /* the bucket's ACL is shared and to_str() isn't const, print a copy */
+    RGWAccessControlPolicy_SWIFT swift_policy(s->cct);
+    static_cast<RGWAccessControlPolicy&>(swift_policy) = *s->bucket_acl;
     std::string read_acl, write_acl;
-    swift_policy->to_str(read_acl, write_acl);
+    swift_policy.to_str(read_acl, write_acl);
 
     if (read_acl.size()) {
       dump_header(s, "X-Container-Read", read_acl);
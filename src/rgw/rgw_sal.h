@@ -26,6 +26,7 @@
 class RGWRESTMgr;
 class RGWAccessListFilter;
 class RGWLC;
+class RGWLifecycleConfiguration;
 struct rgw_user_bucket;
 class RGWUsageBatch;
 class RGWCoroutinesManagerRegistry;
@@ -639,6 +640,24 @@ class Bucket {
       bool is_truncated{false};
       rgw_obj_key next_marker;
     };
+    /**
+     * @brief An object of a delete_objects() batch and the outcome of its deletion
+     */
+    struct DeleteObjectsEntry {
+      /** The object, and version if any, to delete */
+      rgw_obj_key key;
+      /** 0, or the error deleting this object */
+      int ret{0};
+      /** As Object::DeleteOp::Result::delete_marker */
+      bool delete_marker{false};
+      /** As Object::DeleteOp::Result::version_id */
+      std::string version_id;
+      /** Size of the version deleted or hidden by a delete marker, for
+       * the notification of the deletion */
+      uint64_t size{0};
+      /** ETag of that version */
+      std::string etag;
+    };
 
     Bucket() = default;
     virtual ~Bucket() = default;
@@ -647,6 +666,18 @@ class Bucket {
     virtual std::unique_ptr<Object> get_object(const rgw_obj_key& key) = 0;
     /** List the contents of this bucket */
     virtual int list(const DoutPrefixProvider* dpp, ListParams&, int, ListResults&, optional_yield y) = 0;
+    /** Whether delete_objects() is implemented by the driver */
+    virtual bool supports_delete_objects() const { return false; }
+    /** Delete the objects of @a batch at once, as an Object::DeleteOp with
+     * the versioning status of this bucket would one by one, and set the
+     * outcome of each in its entry. Returns -ENOTSUP if the driver can't
+     * (see supports_delete_objects()), in which case the caller deletes
+     * the objects one at a time. */
+    virtual int delete_objects(const DoutPrefixProvider* dpp,
+			       std::vector<DeleteObjectsEntry>& batch,
+			       optional_yield y) {
+      return -ENOTSUP;
+    }
     /** Get the cached attributes associated with this bucket */
     virtual Attrs& get_attrs(void) = 0;
     /** Set the cached attributes on this bucket */
@@ -1384,6 +1415,19 @@ public:
   virtual std::unique_ptr<LCSerializer> get_serializer(const std::string& lock_name,
 						       const std::string& oid,
 						       const std::string& cookie) = 0;
+  /** Apply the expiration rules of @a config to @a bucket in the backing store
+   * itself, rather than listing its objects and expiring them one at a time.
+   * @a entry_bucket is the bucket of the LC entry being processed and
+   * @a should_stop tells when the processing time of the worker is over.
+   * Returns -ENOTSUP if the store can't, in which case the caller processes
+   * the bucket as usual. */
+  virtual int process_bucket_expiration(const DoutPrefixProvider* dpp,
+					const std::string& entry_bucket,
+					Bucket* bucket,
+					RGWLifecycleConfiguration& config,
+					const std::function<bool()>& should_stop) {
+    return -ENOTSUP;
+  }
 };
 
 /**
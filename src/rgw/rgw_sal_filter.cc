@@ -1288,6 +1288,16 @@ std::unique_ptr<LCSerializer> FilterLifecycle::get_serializer(
   return std::make_unique<FilterLCSerializer>(std::move(ns));
 }
 
+int FilterLifecycle::process_bucket_expiration(const DoutPrefixProvider* dpp,
+					       const std::string& entry_bucket,
+					       Bucket* bucket,
+					       RGWLifecycleConfiguration& config,
+					       const std::function<bool()>& should_stop)
+{
+  return next->process_bucket_expiration(dpp, entry_bucket, nextBucket(bucket),
+					 config, should_stop);
+}
+
 int FilterNotification::publish_reserve(const DoutPrefixProvider *dpp,
 					RGWObjTags* obj_tags)
 {
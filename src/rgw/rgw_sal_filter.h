@@ -862,6 +862,11 @@ public:
   virtual std::unique_ptr<LCSerializer> get_serializer(const std::string& lock_name,
 						       const std::string& oid,
 						       const std::string& cookie) override;
+  virtual int process_bucket_expiration(const DoutPrefixProvider* dpp,
+					const std::string& entry_bucket,
+					Bucket* bucket,
+					RGWLifecycleConfiguration& config,
+					const std::function<bool()>& should_stop) override;
 };
 
 class FilterNotification : public Notification {
@@ -28,6 +28,7 @@
 #include "common/Clock.h"
 #include "common/ceph_mutex.h"
 #include "common/errno.h"
+#include "driver/sfs/data_copy.h"
 #include "driver/sfs/notification.h"
 #include "driver/sfs/sfs_gc.h"
 #include "driver/sfs/sfs_lc.h"
@@ -122,9 +123,8 @@ std::unique_ptr<Writer> SFStore::get_atomic_writer(
   ldpp_dout(dpp, 10) << __func__ << ": return basic atomic writer" << dendl;
   std::string bucketname = _head_obj->get_bucket()->get_name();
 
-  std::lock_guard l(buckets_map_lock);
-  ceph_assert(buckets.count(bucketname) > 0);
-  auto bucketref = buckets[bucketname];
+  auto bucketref = get_bucket_ref(bucketname);
+  ceph_assert(bucketref);
   return std::make_unique<SFSAtomicWriter>(
       dpp, y, std::move(_head_obj), this, bucketref, owner,
       ptail_placement_rule, olh_epoch, unique_tag
@@ -397,14 +397,13 @@ SFSStatusPage::~SFSStatusPage() {}
 
 http::status SFSStatusPage::render(std::ostream& os) {
   os << "<h1>SFS</h1>\n"
-     << "<h2>Locks</h2>\n"
+     << "<h2>Buckets</h2>\n"
      << "<ul>\n";
 
-  os << "<li>buckets_map: "
-     << " locked=" << ceph_mutex_is_locked(sfs->buckets_map_lock) << "</li>\n";
+  os << "<li>cached: " << sfs->buckets.size() << "</li>\n";
   os << "</ul>\n";
 
-  auto db = sfs->db_conn->get_storage();
+  auto& db = sfs->db_conn->get_storage();
   sqlite3* sqlite_db = sfs->db_conn->first_sqlite_conn;
 
   os << "<h2>SQLite</h2>\n"
@@ -604,14 +603,45 @@ SFStore::SFStore(CephContext* c, const std::filesystem::path& data_path)
       filesystem_stats_avail_percent(100),
       min_space_left_for_data_write_ops_bytes(
           c->_conf.get_val<uint64_t>("rgw_sfs_min_space_left_for_write_ops")
-      ) {
+      ),
+      write_pipeline_depth(
+          c->_conf.get_val<uint64_t>("rgw_sfs_write_pipeline_depth")
+      ),
+      reflink(false) {
   maybe_init_store();
+  reflink = sfs::reflink_supported(data_path);
   db_conn = std::make_shared<sfs::sqlite::DBConn>(cctx);
+  // versions left open by a previous run are marked deleted by the GC,
+  // startup only remembers which ones those are
   sfs::sqlite::SQLiteVersionedObjects objs_versions(db_conn);
-  int num_deleted = objs_versions.set_all_open_versions_to_deleted();
-  ldout(ctx(), 10) << "marked " << num_deleted << " open objects deleted"
-                   << dendl;
+  const auto stale_max_id = objs_versions.get_max_version_id();
+  packer = std::make_unique<sfs::SegmentPacker>(
+      data_path, c->_conf.get_val<Option::size_t>("rgw_sfs_pack_segment_size")
+  );
+  if (write_pipeline_depth > 0) {
+    data_write_queue = std::make_unique<sfs::DataIOQueue>(
+        c->_conf.get_val<uint64_t>("rgw_sfs_write_threads"), "sfs_data_write"
+    );
+  }
+  const auto read_threads = c->_conf.get_val<uint64_t>("rgw_sfs_read_threads");
+  if (read_threads > 0) {
+    data_read_queue =
+        std::make_unique<sfs::DataIOQueue>(read_threads, "sfs_data_read");
+  }
+  const auto data_sync_mode =
+      c->_conf.get_val<std::string>("rgw_sfs_data_sync_mode");
+  if (data_sync_mode != "fsync") {
+    data_syncer = std::make_unique<sfs::DataSyncer>(
+        data_sync_mode == "syncfs" ? sfs::DataSyncer::Mode::SYNCFS
+                                   : sfs::DataSyncer::Mode::FDATASYNC,
+        c->_conf.get_val<std::chrono::milliseconds>("rgw_sfs_data_sync_window"),
+        c->_conf.get_val<uint64_t>("rgw_sfs_data_sync_max_files")
+    );
+  }
   gc = std::make_shared<sfs::SFSGC>(cctx, this);
+  gc->set_stale_open_versions(stale_max_id);
+  ldout(ctx(), 10) << "open versions up to id " << stale_max_id
+                   << " left for the gc to delete" << dendl;
 
   filesystem_stats_updater = make_named_thread(
       "sfs_stats_updater", &SFStore::filesystem_stats_updater_main, this,
@@ -620,10 +650,8 @@ SFStore::SFStore(CephContext* c, const std::filesystem::path& data_path)
       )
   );
 
-  // no need to be safe, we're in the ctor.
-  _refresh_buckets();
-
-  ldout(ctx(), 0) << "sfs serving data from " << data_path << dendl;
+  ldout(ctx(), 0) << "sfs serving data from " << data_path
+                  << (reflink ? ", copies clone data files" : "") << dendl;
 }
 
 SFStore::~SFStore() {
@@ -22,12 +22,16 @@
 
 #include "common/ceph_mutex.h"
 #include "driver/sfs/bucket.h"
+#include "driver/sfs/bucket_map.h"
+#include "driver/sfs/data_sync.h"
 #include "driver/sfs/object.h"
+#include "driver/sfs/segment_packer.h"
 #include "driver/sfs/sqlite/dbconn.h"
 #include "driver/sfs/sqlite/sqlite_buckets.h"
 #include "driver/sfs/sqlite/sqlite_users.h"
 #include "driver/sfs/types.h"
 #include "driver/sfs/user.h"
+#include "driver/sfs/write_pipeline.h"
 #include "driver/sfs/zone.h"
 #include "rgw_multi.h"
 #include "rgw_notify.h"
@@ -114,8 +118,13 @@ class SFStore : public StoreDriver {
   SFSZone zone;
   const std::filesystem::path data_path;
   CephContext* const cctx;
-  ceph::mutex buckets_map_lock = ceph::make_mutex("buckets_map_lock");
-  std::map<std::string, sfs::BucketRef> buckets;
+  /// The buckets looked up so far. Buckets are loaded from the database
+  /// on their first lookup rather than all of them on startup, until
+  /// something needs the whole list (see bucket_list()).
+  sfs::BucketMap buckets;
+  /// Whether `buckets` holds every bucket, and a bucket missing from it
+  /// doesn't exist
+  std::atomic<bool> buckets_loaded{false};
   RGWLC* lc = nullptr;
 
   // Signal shutdown condition to service threads
@@ -128,11 +137,25 @@ class SFStore : public StoreDriver {
  public:
   sfs::sqlite::DBConnRef db_conn;
   std::shared_ptr<sfs::SFSGC> gc = nullptr;
+  std::unique_ptr<sfs::SegmentPacker> packer;
 
   std::atomic_uint64_t filesystem_stats_total_bytes;
   std::atomic_uint64_t filesystem_stats_avail_bytes;
   std::atomic_uint64_t filesystem_stats_avail_percent;
   const uint64_t min_space_left_for_data_write_ops_bytes;
+  /// writes upload data in the background, null if writes are synchronous
+  std::unique_ptr<sfs::DataIOQueue> data_write_queue;
+  /// reads object data for requests running in coroutines, null if
+  /// reads block the thread of the request
+  std::unique_ptr<sfs::DataIOQueue> data_read_queue;
+  /// pieces of an upload written in the background at a time
+  const size_t write_pipeline_depth;
+  /// syncs the data files of concurrent uploads together, null if every
+  /// writer fsyncs its own (see rgw_sfs_data_sync_mode)
+  std::unique_ptr<sfs::DataSyncer> data_syncer;
+  /// the filesystem of the data path clones files (see
+  /// sfs::reflink_supported()), probed on startup
+  bool reflink;
 
   SFStore(CephContext* c, const std::filesystem::path& data_path);
   SFStore(const SFStore&) = delete;
@@ -375,14 +398,8 @@ class SFStore : public StoreDriver {
 
   std::filesystem::path get_data_path() const { return data_path; }
 
-  bool _bucket_exists(const std::string& name) {
-    const auto it = buckets.find(name);
-    return it != buckets.cend();
-  }
-
   bool bucket_exists(const rgw_bucket& bucket) {
-    std::lock_guard l(buckets_map_lock);
-    return _bucket_exists(bucket.name);
+    return get_bucket_ref(bucket.name) != nullptr;
   }
 
   sfs::BucketRef bucket_create(
@@ -391,11 +408,31 @@ class SFStore : public StoreDriver {
       const std::string& swift_ver_location, const RGWQuotaInfo* pquota_info,
       std::map<std::string, bufferlist>& attrs, RGWBucketInfo& info
   ) {
-    std::lock_guard l(buckets_map_lock);
-    if (_bucket_exists(bucket.name)) {
+    if (get_bucket_ref(bucket.name)) {
       return nullptr;
     }
+    uint64_t generation = 0;
+    auto created = _bucket_create(
+        bucket, owner, zonegroup_id, placement_rule, pquota_info, attrs, info,
+        generation
+    );
+    if (created && !buckets.add(created, generation)) {
+      // the map may have missed a change of the bucket since: it is
+      // loaded from the database on its next lookup
+      buckets_loaded = false;
+    }
+    return created;
+  }
 
+  /// Stores a new bucket, unless one with its name exists, and returns
+  /// it with the generation it was stored with. Publishing it is left to
+  /// the caller, the map isn't locked while the database is written.
+  sfs::BucketRef _bucket_create(
+      const rgw_bucket& bucket, const RGWUserInfo& owner,
+      const std::string& zonegroup_id, const rgw_placement_rule& placement_rule,
+      const RGWQuotaInfo* pquota_info, std::map<std::string, bufferlist>& attrs,
+      RGWBucketInfo& info, uint64_t& generation
+  ) {
     sfs::sqlite::DBOPBucketInfo db_binfo;
     db_binfo.binfo.bucket = bucket;
     db_binfo.binfo.owner = owner.user_id;
@@ -426,59 +463,126 @@ class SFStore : public StoreDriver {
     db_binfo.battrs = attrs;
 
     auto meta_buckets = sfs::get_meta_buckets(db_conn);
-    meta_buckets->store_bucket(db_binfo);
+    if (!meta_buckets->create_bucket(db_binfo, [&]() {
+          generation = buckets.next_generation();
+        })) {
+      return nullptr;
+    }
 
-    sfs::BucketRef b = std::make_shared<sfs::Bucket>(
+    return std::make_shared<sfs::Bucket>(
         ctx(), this, db_binfo.binfo, owner, db_binfo.battrs
     );
-    buckets[bucket.name] = b;
-    return b;
-  }
-
-  void _refresh_buckets_safe() {
-    std::lock_guard l(buckets_map_lock);
-    _refresh_buckets();
   }
 
+  /// Reloads all buckets from the database. Only needed when the
+  /// database was changed behind our back, every change made through the
+  /// store updates the map in place.
   void _refresh_buckets() {
+    const auto generation = buckets.next_generation();
     auto meta_buckets = sfs::get_meta_buckets(db_conn);
     auto existing = meta_buckets->get_buckets();
-    buckets.clear();
-    sfs::sqlite::SQLiteUsers users(db_conn);
+    std::vector<sfs::BucketRef> refs;
+    refs.reserve(existing.size());
     for (auto& b : existing) {
       if (!b.deleted) {
-        auto user = users.get_user(b.binfo.owner.id);
-        sfs::BucketRef ref = std::make_shared<sfs::Bucket>(
-            ctx(), this, b.binfo, user->uinfo, b.battrs
-        );
-        buckets[b.binfo.bucket.name] = ref;
+        if (auto ref = _make_bucket(b)) {
+          refs.push_back(std::move(ref));
+        }
       }
     }
+    buckets.reset(refs, generation);
+    buckets_loaded = true;
   }
 
-  void _delete_bucket(const std::string& name) {
-    std::lock_guard l(buckets_map_lock);
-    buckets.erase(name);
+  /// Loads the bucket named `name` from the database into the map, or
+  /// returns nullptr if there is no such bucket. The database is read
+  /// without locking the map; the bucket is only added if nothing newer
+  /// was published meanwhile (see sfs::BucketMap::add_loaded()), `kept`
+  /// tells which.
+  sfs::BucketRef _load_bucket(
+      const std::string& name, bool* kept = nullptr
+  ) {
+    const auto generation = buckets.next_generation();
+    sfs::BucketRef loaded;
+    auto meta_buckets = sfs::get_meta_buckets(db_conn);
+    for (const auto& b : meta_buckets->get_bucket_by_name(name)) {
+      if (!b.deleted) {
+        loaded = _make_bucket(b);
+        break;
+      }
+    }
+    return buckets.add_loaded(name, loaded, generation, kept);
   }
 
-  std::list<sfs::BucketRef> bucket_list() {
-    _refresh_buckets_safe();
+  /// Loads the buckets not looked up yet. Buckets already in the map are
+  /// kept, they are never older than the database. Each one is read
+  /// again, as _load_bucket() does, so a bucket deleted meanwhile isn't
+  /// brought back. A bucket the map didn't keep, because another bucket
+  /// of its shard changed while it was read, leaves the buckets to be
+  /// loaded again: until then, lookups of names the map doesn't have go
+  /// to the database.
+  void _load_all_buckets() {
+    bool complete = true;
+    auto meta_buckets = sfs::get_meta_buckets(db_conn);
+    for (const auto& b : meta_buckets->get_buckets()) {
+      if (!b.deleted && !buckets.contains(b.binfo.bucket.name)) {
+        bool kept = false;
+        _load_bucket(b.binfo.bucket.name, &kept);
+        complete = complete && kept;
+      }
+    }
+    buckets_loaded = complete;
+  }
+
+  sfs::BucketRef _make_bucket(const sfs::sqlite::DBOPBucketInfo& b) {
+    sfs::sqlite::SQLiteUsers users(db_conn);
+    auto user = users.get_user(b.binfo.owner.id);
+    if (!user.has_value()) {
+      ldout(ctx(), 1) << "bucket " << b.binfo.bucket.name << " owner "
+                      << b.binfo.owner.id << " not found" << dendl;
+      return nullptr;
+    }
+    return std::make_shared<sfs::Bucket>(
+        ctx(), this, b.binfo, user->uinfo, b.battrs
+    );
+  }
 
-    std::list<sfs::BucketRef> lst;
-    std::lock_guard l(buckets_map_lock);
-    for (const auto& [name, bucketref] : buckets) {
-      lst.push_back(bucketref);
+  /// Stores the new state of a bucket in the database and publishes it,
+  /// replacing only that bucket's entry. The map isn't locked while the
+  /// database is written; the state is stamped with a generation in the
+  /// order it is stored, so a concurrent change can't publish an older
+  /// state over a newer one.
+  void _update_bucket(
+      const sfs::BucketRef& bucketref, const RGWBucketInfo& info,
+      const Attrs& attrs
+  ) {
+    auto updated = std::make_shared<sfs::Bucket>(
+        ctx(), this, info, bucketref->get_owner(), attrs
+    );
+    uint64_t generation = 0;
+    sfs::get_meta_buckets(db_conn)->store_bucket(
+        sfs::sqlite::DBOPBucketInfo(info, attrs),
+        [&]() { generation = buckets.next_generation(); }
+    );
+    buckets.update(updated, generation);
+  }
+
+  void _delete_bucket(const std::string& name) { buckets.remove(name); }
+
+  std::list<sfs::BucketRef> bucket_list() {
+    if (!buckets_loaded) {
+      _load_all_buckets();
     }
-    return lst;
+    auto refs = buckets.list();
+    return std::list<sfs::BucketRef>(refs.begin(), refs.end());
   }
 
   sfs::BucketRef get_bucket_ref(const std::string& name) {
-    std::lock_guard l(buckets_map_lock);
-    auto it = buckets.find(name);
-    if (it == buckets.end()) {
-      return nullptr;
+    sfs::BucketRef bucket;
+    if (buckets.find(name, bucket) || buckets_loaded) {
+      return bucket;
     }
-    return it->second;
+    return _load_bucket(name);
   }
 
   std::string get_cls_name() const { return "sfstore"; }
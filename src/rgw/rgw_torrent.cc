@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <sstream>
 
 #include "rgw_torrent.h"
@@ -146,32 +147,41 @@ void seed::set_info_name(const string& value)
 
 void seed::sha1(SHA1 *h, bufferlist &bl, off_t bl_len)
 {
-  off_t num = bl_len/info.piece_length;
-  off_t remain = 0;
-  remain = bl_len%info.piece_length;
-
-  char *pstr = bl.c_str();
   char sha[25];
+  off_t piece_left = info.piece_length;
 
-  /* get sha1 */
-  for (off_t i = 0; i < num; i++)
+  /* get sha1 of each piece, walking the buffers rather than flattening
+   * the bufferlist with c_str() */
+  for (const auto& bp : bl.buffers())
   {
-    // FIPS zeroization audit 20191116: this memset is not intended to
-    // wipe out a secret after use.
-    memset(sha, 0x00, sizeof(sha));
-    h->Update((unsigned char *)pstr, info.piece_length);
-    h->Final((unsigned char *)sha);
-    set_info_pieces(sha);
-    pstr += info.piece_length;
+    const char *pstr = bp.c_str();
+    off_t left = std::min<off_t>(bp.length(), bl_len);
+    bl_len -= left;
+    while (left > 0)
+    {
+      const off_t n = std::min(left, piece_left);
+      h->Update((const unsigned char *)pstr, n);
+      pstr += n;
+      left -= n;
+      piece_left -= n;
+      if (0 == piece_left)
+      {
+        // FIPS zeroization audit 20191116: this memset is not intended to
+        // wipe out a secret after use.
+        memset(sha, 0x00, sizeof(sha));
+        h->Final((unsigned char *)sha);
+        set_info_pieces(sha);
+        piece_left = info.piece_length;
+      }
+    }
   }
 
   /* process remain */
-  if (0 != remain)
+  if (piece_left != info.piece_length)
   {
     // FIPS zeroization audit 20191116: this memset is not intended to
     // wipe out a secret after use.
     memset(sha, 0x00, sizeof(sha));
-    h->Update((unsigned char *)pstr, remain);
     h->Final((unsigned char *)sha);
     set_info_pieces(sha);
   }
@@ -0,0 +1,125 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+/*
+ * Single core throughput of the data integrity stage of a PUT: the ETag
+ * MD5 (and optionally the SigV4 payload SHA256) of every uploaded chunk.
+ * Compares hashing a flattened bufferlist, as RGWPutObj used to with
+ * bl.c_str(), with hashing its buffers one by one with hash_update().
+ *
+ * Chunks are built from --fragment_size slices of a source buffer, the
+ * way data read back from a copy source or a filter usually is.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "common/ceph_crypto.h"
+#include "include/buffer.h"
+#include "rgw_common.h"
+
+using ceph::crypto::MD5;
+using ceph::crypto::SHA256;
+
+struct parameters {
+  size_t chunk_size = 4 * 1024 * 1024;
+  size_t fragment_size = 64 * 1024;
+  size_t total_size = 1024 * 1024 * 1024;
+  bool sha256 = false;
+};
+
+static bufferlist make_chunk(const bufferptr& source, size_t fragment_size)
+{
+  bufferlist bl;
+  for (size_t ofs = 0; ofs < source.length(); ofs += fragment_size) {
+    bl.append(source, ofs, std::min(fragment_size, source.length() - ofs));
+  }
+  return bl;
+}
+
+template <typename Hasher>
+static std::string run(const char* name, const bufferptr& source,
+                       const parameters& params, Hasher&& hash_chunk)
+{
+  MD5 md5;
+  md5.SetFlags(EVP_MD_CTX_FLAG_NON_FIPS_ALLOW);
+  SHA256 sha256;
+  const size_t chunks = std::max<size_t>(params.total_size / params.chunk_size, 1);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < chunks; i++) {
+    auto chunk = make_chunk(source, params.fragment_size);
+    hash_chunk(md5, chunk);
+    if (params.sha256) {
+      hash_chunk(sha256, chunk);
+    }
+  }
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  md5.Final(digest);
+  const std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  const double mib = static_cast<double>(chunks * params.chunk_size) / (1024 * 1024);
+  std::cout << name << ": " << mib / elapsed.count() << " MiB/s" << std::endl;
+
+  char hex[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
+  buf_to_hex(digest, CEPH_CRYPTO_MD5_DIGESTSIZE, hex);
+  return hex;
+}
+
+int main(int argc, char **argv)
+{
+  parameters params;
+  try
+  {
+    using namespace boost::program_options;
+    options_description desc{"Options"};
+    desc.add_options()
+    ("help,h", "Help screen")
+    ("chunk_size", value<size_t>()->default_value(params.chunk_size), "bytes per chunk, like rgw_max_chunk_size")
+    ("fragment_size", value<size_t>()->default_value(params.fragment_size), "bytes per buffer of a chunk")
+    ("total_size", value<size_t>()->default_value(params.total_size), "bytes to hash per run")
+    ("sha256", bool_switch()->default_value(false), "also compute the payload SHA256");
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+    params.chunk_size = vm["chunk_size"].as<size_t>();
+    params.fragment_size = std::max<size_t>(vm["fragment_size"].as<size_t>(), 1);
+    params.total_size = vm["total_size"].as<size_t>();
+    params.sha256 = vm["sha256"].as<bool>();
+  }
+  catch (const boost::program_options::error &ex)
+  {
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bufferptr source(params.chunk_size);
+  std::mt19937 rng{42};
+  for (size_t i = 0; i < source.length(); i++) {
+    source.c_str()[i] = static_cast<char>(rng());
+  }
+
+  const auto flattened = run("c_str", source, params,
+    [] (auto& hash, bufferlist& bl) {
+      hash.Update(reinterpret_cast<const unsigned char*>(bl.c_str()), bl.length());
+    });
+  const auto scattered = run("hash_update", source, params,
+    [] (auto& hash, bufferlist& bl) {
+      hash_update(hash, bl);
+    });
+
+  if (flattened != scattered) {
+    std::cerr << "digest mismatch: " << flattened << " != " << scattered << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
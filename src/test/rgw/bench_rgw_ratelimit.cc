@@ -25,6 +25,7 @@ struct client_info {
     uint64_t bytes = 0;
     uint64_t num_retries = 0;
     std::string tenant;
+    RateLimiter::entry_ref entry;
 };
 
 struct parameters {
@@ -49,12 +50,12 @@ void simulate_transfer(client_info& it, const RGWRateLimitInfo* info, std::share
         if (req_size <= backend_bandwidth) {
             while (req_size > 0) {
                 if(req_size > 4*1024*1024) {
-                    ratelimit->decrease_bytes(methodop.c_str(),it.tenant, 4*1024*1024, info);
+                    ratelimit->decrease_bytes(methodop.c_str(),it.entry, 4*1024*1024, info);
                     it.bytes += 4*1024*1024;
                     req_size = req_size - 4*1024*1024;
                 }
                 else {
-                    ratelimit->decrease_bytes(methodop.c_str(),it.tenant, req_size, info);
+                    ratelimit->decrease_bytes(methodop.c_str(),it.entry, req_size, info);
                     req_size = 0;
                 }
             }
@@ -68,13 +69,13 @@ void simulate_transfer(client_info& it, const RGWRateLimitInfo* info, std::share
                         timer.async_wait(yield);
                         total_bytes = 0;
                     }
-                    ratelimit->decrease_bytes(methodop.c_str(),it.tenant, 4*1024*1024, info);
+                    ratelimit->decrease_bytes(methodop.c_str(),it.entry, 4*1024*1024, info);
                     it.bytes += 4*1024*1024;
                     req_size = req_size - 4*1024*1024;
                     total_bytes += 4*1024*1024;
                 }
                 else {
-                    ratelimit->decrease_bytes(methodop.c_str(),it.tenant, req_size, info);
+                    ratelimit->decrease_bytes(methodop.c_str(),it.entry, req_size, info);
                     it.bytes += req_size;
                     total_bytes += req_size;
                     req_size = 0;
@@ -90,7 +91,7 @@ bool simulate_request(client_info& it, const RGWRateLimitInfo& info, std::shared
     int rw = 0; // will always use PUT method as there is no different
     std::string methodop = method[rw];
     auto dout = DoutPrefix(g_ceph_context, ceph_subsys_rgw, "rate limiter: ");
-    bool to_fail = ratelimit->should_rate_limit(methodop.c_str(), it.tenant, time, &info);
+    bool to_fail = ratelimit->should_rate_limit(methodop.c_str(), RGWRateLimitKey(it.tenant), time, &info, &it.entry);
     if(to_fail)
     {
         it.rejected++;
@@ -227,6 +228,7 @@ int main(int argc, char **argv)
     {
         i.join();
     }
+    uint64_t total_requests = 0;
     std::unordered_map<std::string,client_info> metrics_by_tenant;
     for(auto& i : *ds.get())
     {
@@ -234,6 +236,7 @@ int main(int argc, char **argv)
         std::cout << i.accepted << std::endl;
         it->second.accepted += i.accepted;
         it->second.rejected += i.rejected;
+        total_requests += i.accepted + i.rejected;
     }
     // TODO sum the results by tenant
     for(auto& i : metrics_by_tenant)
@@ -243,5 +246,9 @@ int main(int argc, char **argv)
         std::cout << "Simulator finished rejected  sum : " << i.second.rejected << std::endl;
     }
 
+    // compare runs with different --threads to see how the rate limiter scales
+    std::cout << "Simulator finished requests per second with " << thread_count << " threads : "
+              << total_requests / runtime << std::endl;
+
     return 0;
 }
@@ -4,17 +4,65 @@
 #include <cstdlib>
 #include <string>
 #include <chrono>
+#include <thread>
+#include <vector>
 #include <boost/program_options.hpp>
+
+// every thread checks and charges requests of its own keys, the way
+// concurrent requests of different users do. returns the requests per second
+double run_threads(RateLimiter& ratelimit, const RGWRateLimitInfo& info, int num_threads, int keys_per_thread, int requests_per_thread)
+{
+    // the keys refer to the names, which must not move once they are built
+    std::vector<std::vector<std::string>> names(num_threads);
+    std::vector<std::vector<RGWRateLimitKey>> keys(num_threads);
+    for (int t = 0; t < num_threads; t++)
+    {
+        for (int k = 0; k < keys_per_thread; k++)
+        {
+            names[t].emplace_back("uuser" + std::to_string(t) + "_" + std::to_string(k));
+        }
+        keys[t].assign(names[t].begin(), names[t].end());
+    }
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < requests_per_thread; i++)
+            {
+                const auto& key = keys[t][i % keys_per_thread];
+                auto time = ceph::coarse_real_clock::now();
+                if (!ratelimit.should_rate_limit("PUT", key, time, &info))
+                {
+                    ratelimit.decrease_bytes("PUT", key, 4096, &info);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return num_threads * requests_per_thread / elapsed.count();
+}
+
 int main(int argc, char **argv)
 {
     int num_qos_classes = 1;
+    int max_threads = 0;
+    int keys_per_thread = 1000;
+    int requests_per_thread = 1000000;
     try
     {
         using namespace boost::program_options;
         options_description desc{"Options"};
         desc.add_options()
         ("help,h", "Help screen")
-        ("num_qos_classes", value<int>()->default_value(1), "how many qos tenants");
+        ("num_qos_classes", value<int>()->default_value(1), "how many qos tenants")
+        ("threads", value<int>()->default_value(0), "measure requests per second from 1 up to this many threads")
+        ("keys_per_thread", value<int>()->default_value(1000), "how many tenants each thread sends requests for")
+        ("requests_per_thread", value<int>()->default_value(1000000), "how many requests each thread sends");
         variables_map vm;
         store(parse_command_line(argc, argv, desc), vm);
         if (vm.count("help")) {
@@ -22,6 +70,9 @@ int main(int argc, char **argv)
             return EXIT_SUCCESS;
         }
         num_qos_classes = vm["num_qos_classes"].as<int>();
+        max_threads = vm["threads"].as<int>();
+        keys_per_thread = std::max(vm["keys_per_thread"].as<int>(), 1);
+        requests_per_thread = vm["requests_per_thread"].as<int>();
     }
     catch (const boost::program_options::error &ex)
     {
@@ -42,11 +93,26 @@ int main(int argc, char **argv)
     std::shared_ptr<ActiveRateLimiter> ratelimit(new ActiveRateLimiter(g_ceph_context));
     ratelimit->start();
     auto dout = DoutPrefix(g_ceph_context, ceph_subsys_rgw, "rate limiter: ");
+    const auto start = std::chrono::steady_clock::now();
     for(int i = 0; i < num_qos_classes; i++)
     {
         std::string tenant = "uuser" + std::to_string(i);
         auto time = ceph::coarse_real_clock::now();
         ratelimit->get_active()->should_rate_limit("PUT", tenant, time, &info);
     }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "inserted " << num_qos_classes << " tenants in " << elapsed.count() << "s" << std::endl;
 
+    if (max_threads > 0)
+    {
+        // limits high enough to accept every request, so all of them update the counters
+        info.max_write_ops = 1000000000;
+        info.max_write_bytes = 1000000000000;
+        for (int threads = 1; threads <= max_threads; threads *= 2)
+        {
+            std::cout << threads << " threads: "
+                      << run_threads(*ratelimit->get_active(), info, threads, keys_per_thread, requests_per_thread)
+                      << " requests/s" << std::endl;
+        }
+    }
 }
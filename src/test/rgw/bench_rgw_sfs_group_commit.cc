@@ -0,0 +1,151 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab ft=cpp
+
+/*
+ * Throughput of the metadata side of small object PUTs (create_version +
+ * metadata_finish) on SFS from many threads, for each of the given
+ * rgw_sfs_sqlite_group_commit_window values. A window of 0 commits every
+ * operation on its own and is the baseline the other runs compare to.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <fmt/core.h>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "common/random_string.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+
+namespace fs = std::filesystem;
+using namespace rgw::sal::sfs;
+
+struct parameters {
+  std::vector<int> windows = {0, 1, 2, 5};
+  size_t threads = std::max<size_t>(std::thread::hardware_concurrency() * 4, 16);
+  size_t ops = 10000;
+};
+
+static bool run(CephContext* cct, int window, const parameters& params)
+{
+  const auto path = fs::temp_directory_path() / gen_rand_alphanumeric(cct, 23);
+  fs::create_directory(path);
+  cct->_conf.set_val("rgw_sfs_data_path", path.string());
+  cct->_conf.set_val("rgw_sfs_sqlite_group_commit_window", std::to_string(window));
+  auto store = std::make_unique<rgw::sal::SFStore>(cct, path);
+
+  sqlite::SQLiteUsers users(store->db_conn);
+  sqlite::DBOPUserInfo user;
+  user.uinfo.user_id.id = "testuser";
+  users.store_user(user);
+  sqlite::SQLiteBuckets db_buckets(store->db_conn);
+  sqlite::DBOPBucketInfo db_binfo;
+  db_binfo.binfo.bucket = rgw_bucket("", "testbucket", "1234");
+  db_binfo.binfo.owner = rgw_user("testuser");
+  db_binfo.binfo.creation_time = ceph::real_clock::now();
+  db_binfo.deleted = false;
+  db_buckets.store_bucket(db_binfo);
+  RGWUserInfo bucket_owner;
+  auto bucket = std::make_shared<Bucket>(
+    cct, store.get(), db_binfo.binfo, bucket_owner, db_binfo.battrs);
+
+  const size_t ops_per_thread = std::max<size_t>(params.ops / params.threads, 1);
+  const auto batches_before = perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches);
+  std::atomic<size_t> failed{0};
+  std::vector<std::thread> threads;
+  const auto start = ceph::mono_clock::now();
+  for (size_t i = 0; i < params.threads; i++) {
+    threads.emplace_back([&, i] {
+      for (size_t j = 0; j < ops_per_thread; j++) {
+        try {
+          ObjectRef obj;
+          while (!obj) {
+            obj = bucket->create_version(rgw_obj_key(fmt::format("obj_{}_{}", i, j)));
+          }
+          obj->metadata_finish(store.get(), false);
+        } catch (const std::exception&) {
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const std::chrono::duration<double> elapsed = ceph::mono_clock::now() - start;
+
+  const size_t total_ops = params.threads * ops_per_thread;
+  const auto batches =
+    perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches) - batches_before;
+  std::cout << fmt::format(
+    "window {}ms: {} PUTs from {} threads in {:.2f}s, {:.0f} PUT/s, "
+    "{} batches, {:.2f} ops/batch",
+    window, total_ops, params.threads, elapsed.count(),
+    total_ops / elapsed.count(), batches,
+    batches ? static_cast<double>(2 * total_ops) / batches : 0.0) << std::endl;
+
+  // all PUTs must be visible once their callers returned
+  const bool ok = failed == 0 && bucket->get_all().size() == total_ops;
+  if (!ok) {
+    std::cerr << "window " << window << "ms: " << failed << " PUTs failed, "
+              << bucket->get_all().size() << " of " << total_ops
+              << " objects visible" << std::endl;
+  }
+  bucket.reset();
+  store.reset();
+  fs::remove_all(path);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  parameters params;
+  try
+  {
+    using namespace boost::program_options;
+    options_description desc{"Options"};
+    desc.add_options()
+    ("help,h", "Help screen")
+    ("window", value<std::vector<int>>()->multitoken(), "group commit windows to run, in ms (default 0 1 2 5)")
+    ("threads", value<size_t>()->default_value(params.threads), "threads doing PUTs")
+    ("ops", value<size_t>()->default_value(params.ops), "PUTs per run, over all threads");
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return EXIT_SUCCESS;
+    }
+    if (vm.count("window")) {
+      params.windows = vm["window"].as<std::vector<int>>();
+    }
+    params.threads = std::max<size_t>(vm["threads"].as<size_t>(), 1);
+    params.ops = vm["ops"].as<size_t>();
+  }
+  catch (const boost::program_options::error &ex)
+  {
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto cct = std::make_unique<CephContext>(CEPH_ENTITY_TYPE_ANY);
+  rgw_perf_start(cct.get());
+  bool ok = true;
+  for (const int window : params.windows) {
+    ok = run(cct.get(), window, params) && ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
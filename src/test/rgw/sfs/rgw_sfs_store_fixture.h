@@ -0,0 +1,108 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "common/ceph_context.h"
+#include "common/random_string.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+
+const static std::string TEST_USERNAME = "test_user";
+const static std::string TEST_BUCKET = "test_bucket";
+
+/// Collects the data of an object read through an SFS read op
+class CollectDataCB : public RGWGetDataCB {
+ public:
+  bufferlist data;
+  size_t calls{0};
+  /// of the last call
+  std::thread::id thread;
+
+  int handle_data(bufferlist& bl, off_t bl_ofs, off_t bl_len) override {
+    bufferlist part;
+    part.substr_of(bl, bl_ofs, bl_len);
+    data.claim_append(part);
+    calls++;
+    thread = std::this_thread::get_id();
+    return 0;
+  }
+};
+
+/// Runs an SFStore in a temporary directory of its own, in which user
+/// TEST_USERNAME owns bucket TEST_BUCKET. Tests needing other options set
+/// them on `cct` before calling SFSStoreFixture::SetUp(), or restart the
+/// store with stopStore() and startStore().
+class SFSStoreFixture : public ::testing::Test {
+ protected:
+  const std::unique_ptr<CephContext> cct{
+      new CephContext(CEPH_ENTITY_TYPE_ANY)};
+  const std::filesystem::path data_path{
+      std::filesystem::temp_directory_path() /
+      gen_rand_alphanumeric(cct.get(), 23)};
+  std::unique_ptr<NoDoutPrefix> ndp;
+  std::unique_ptr<rgw::sal::SFStore> store;
+  std::unique_ptr<rgw::sal::User> user;
+  std::unique_ptr<rgw::sal::Bucket> bucket;
+
+  void SetUp() override {
+    std::filesystem::create_directories(data_path);
+    cct->_conf.set_val("rgw_sfs_data_path", data_path.string());
+    cct->_log->start();
+    rgw_perf_start(cct.get());
+    ndp = std::make_unique<NoDoutPrefix>(cct.get(), 1);
+    startStore();
+  }
+
+  void TearDown() override {
+    stopStore();
+    std::filesystem::remove_all(data_path);
+  }
+
+  /// Starts the store on `data_path` and (re)stores the test user and
+  /// bucket in it
+  void startStore() {
+    store = std::make_unique<rgw::sal::SFStore>(cct.get(), data_path);
+
+    rgw::sal::sfs::sqlite::SQLiteUsers users(store->db_conn);
+    rgw::sal::sfs::sqlite::DBOPUserInfo user_info;
+    user_info.uinfo.user_id.id = TEST_USERNAME;
+    users.store_user(user_info);
+    storeBucket(TEST_BUCKET);
+    store->_refresh_buckets();
+
+    user = store->get_user(rgw_user("", TEST_USERNAME, ""));
+    ASSERT_EQ(
+        store->get_bucket(
+            ndp.get(), user.get(), rgw_bucket("", TEST_BUCKET, TEST_BUCKET),
+            &bucket, null_yield
+        ),
+        0
+    );
+  }
+
+  void stopStore() {
+    bucket.reset();
+    user.reset();
+    store.reset();
+  }
+
+  /// Stores bucket `name`, with `name` as its id, owned by TEST_USERNAME
+  void storeBucket(const std::string& name, bool deleted = false) {
+    rgw::sal::sfs::sqlite::SQLiteBuckets db_buckets(store->db_conn);
+    rgw::sal::sfs::sqlite::DBOPBucketInfo bucket_info;
+    bucket_info.binfo.bucket.name = name;
+    bucket_info.binfo.bucket.bucket_id = name;
+    bucket_info.binfo.owner.id = TEST_USERNAME;
+    bucket_info.deleted = deleted;
+    db_buckets.store_bucket(bucket_info);
+  }
+};
@@ -0,0 +1,465 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "include/random.h"
+#include "rgw/driver/sfs/bucket_map.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_perf_counters.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+
+namespace fs = std::filesystem;
+
+class TestSFSBucketMap : public ::testing::Test {
+ protected:
+  const std::unique_ptr<CephContext> cct{
+      new CephContext(CEPH_ENTITY_TYPE_ANY)};
+
+  BucketRef make_bucket(const std::string& name, const std::string& id = "") {
+    RGWBucketInfo info;
+    info.bucket.name = name;
+    info.bucket.bucket_id = id.empty() ? name : id;
+    return std::make_shared<Bucket>(
+        cct.get(), nullptr, info, RGWUserInfo(), rgw::sal::Attrs()
+    );
+  }
+};
+
+TEST_F(TestSFSBucketMap, add_get_remove) {
+  BucketMap buckets;
+  EXPECT_EQ(buckets.get("b1"), nullptr);
+  EXPECT_FALSE(buckets.contains("b1"));
+
+  // stored, then published
+  const auto stored = buckets.next_generation();
+  auto b1 = make_bucket("b1");
+  EXPECT_TRUE(buckets.add(b1, stored));
+  EXPECT_EQ(buckets.get("b1"), b1);
+  EXPECT_TRUE(buckets.contains("b1"));
+  EXPECT_EQ(buckets.size(), 1);
+
+  // an add published late doesn't replace a newer state
+  EXPECT_TRUE(buckets.add(make_bucket("b1", "old"), stored - 1));
+  EXPECT_EQ(buckets.get("b1"), b1);
+
+  buckets.remove("b1");
+  EXPECT_EQ(buckets.get("b1"), nullptr);
+  EXPECT_EQ(buckets.size(), 0);
+}
+
+TEST_F(TestSFSBucketMap, update_replaces_existing_buckets_only) {
+  BucketMap buckets;
+  auto old_ref = make_bucket("b1", "v1");
+  buckets.add(old_ref, buckets.next_generation());
+  auto new_ref = make_bucket("b1", "v2");
+  buckets.update(new_ref, buckets.next_generation());
+  EXPECT_EQ(buckets.get("b1"), new_ref);
+  // holders of the old reference still see the old state
+  EXPECT_EQ(old_ref->get_bucket_id(), "v1");
+
+  // a removed bucket is not brought back by a late update
+  buckets.remove("b1");
+  buckets.update(make_bucket("b1", "v3"), buckets.next_generation());
+  EXPECT_EQ(buckets.get("b1"), nullptr);
+}
+
+TEST_F(TestSFSBucketMap, stale_updates_are_not_published) {
+  BucketMap buckets;
+  buckets.add(make_bucket("b1", "v1"), buckets.next_generation());
+  const auto older = buckets.next_generation();
+  const auto newer = buckets.next_generation();
+  auto new_ref = make_bucket("b1", "v3");
+  buckets.update(new_ref, newer);
+  // stored before, but published after
+  buckets.update(make_bucket("b1", "v2"), older);
+  EXPECT_EQ(buckets.get("b1"), new_ref);
+}
+
+TEST_F(TestSFSBucketMap, stored_updates_are_published_in_order) {
+  BucketMap buckets;
+  buckets.add(make_bucket("b1", "0"), buckets.next_generation());
+
+  // stand for the bucket's row in the database and the writer thread
+  // storing it, see SFStore::_update_bucket()
+  std::mutex writer;
+  int stored = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&]() {
+      for (int n = 0; n < 1000; ++n) {
+        int id;
+        uint64_t generation;
+        {
+          std::lock_guard l(writer);
+          id = ++stored;
+          generation = buckets.next_generation();
+        }
+        // published without holding the writer, in any order
+        buckets.update(make_bucket("b1", std::to_string(id)), generation);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // the published bucket is the last one stored
+  EXPECT_EQ(stored, 8000);
+  EXPECT_EQ(buckets.get("b1")->get_bucket_id(), "8000");
+}
+
+TEST_F(TestSFSBucketMap, loads_do_not_replace_newer_states) {
+  BucketMap buckets;
+  // read before the bucket was changed, added after
+  const auto loading = buckets.next_generation();
+  auto stale = make_bucket("b1", "v1");
+  auto current = buckets.add_loaded(
+      "b1", make_bucket("b1", "v2"), buckets.next_generation()
+  );
+  EXPECT_EQ(buckets.add_loaded("b1", stale, loading), current);
+  EXPECT_EQ(buckets.get("b1"), current);
+
+  // an update of a bucket that isn't in the map can't be published, a
+  // load started before it is used but not kept
+  const auto before_update = buckets.next_generation();
+  buckets.update(make_bucket("b2", "v2"), buckets.next_generation());
+  auto loaded = make_bucket("b2", "v1");
+  EXPECT_EQ(buckets.add_loaded("b2", loaded, before_update), loaded);
+  EXPECT_FALSE(buckets.contains("b2"));
+
+  // the same for a removed bucket
+  const auto before_remove = buckets.next_generation();
+  buckets.remove("b1");
+  EXPECT_EQ(buckets.add_loaded("b1", stale, before_remove), stale);
+  EXPECT_EQ(buckets.get("b1"), nullptr);
+}
+
+TEST_F(TestSFSBucketMap, loads_turned_away_are_reported) {
+  BucketMap buckets;
+  auto loaded = make_bucket("b1");
+  bool kept = false;
+  EXPECT_EQ(
+      buckets.add_loaded("b1", loaded, buckets.next_generation(), &kept),
+      loaded
+  );
+  EXPECT_TRUE(kept);
+
+  // other buckets, some in the shard of b2, are removed while b2 is read
+  const auto loading = buckets.next_generation();
+  for (int i = 0; i < 1000; ++i) {
+    buckets.remove(fmt::format("removed_{}", i));
+  }
+  loaded = make_bucket("b2");
+  EXPECT_EQ(buckets.add_loaded("b2", loaded, loading, &kept), loaded);
+  EXPECT_FALSE(kept);
+  BucketRef found;
+  EXPECT_FALSE(buckets.find("b2", found));
+
+  // loaded again
+  EXPECT_EQ(
+      buckets.add_loaded("b2", loaded, buckets.next_generation(), &kept),
+      loaded
+  );
+  EXPECT_TRUE(kept);
+  EXPECT_EQ(buckets.get("b2"), loaded);
+}
+
+TEST_F(TestSFSBucketMap, missing_buckets_are_remembered) {
+  BucketMap buckets(std::chrono::milliseconds(50));
+  BucketRef found;
+  EXPECT_FALSE(buckets.find("b1", found));
+  EXPECT_EQ(
+      buckets.add_loaded("b1", nullptr, buckets.next_generation()), nullptr
+  );
+  found = make_bucket("b1");
+  EXPECT_TRUE(buckets.find("b1", found));
+  EXPECT_EQ(found, nullptr);
+  EXPECT_FALSE(buckets.contains("b1"));
+  EXPECT_EQ(buckets.size(), 0);
+  EXPECT_TRUE(buckets.list().empty());
+
+  // until they expire
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(buckets.find("b1", found));
+
+  // or are created
+  buckets.add_loaded("b2", nullptr, buckets.next_generation());
+  auto b2 = make_bucket("b2");
+  EXPECT_TRUE(buckets.add(b2, buckets.next_generation()));
+  EXPECT_TRUE(buckets.find("b2", found));
+  EXPECT_EQ(found, b2);
+  EXPECT_EQ(buckets.size(), 1);
+}
+
+TEST_F(TestSFSBucketMap, negative_entries_are_bounded) {
+  BucketMap buckets(std::chrono::hours(1));
+  for (int i = 0; i < 100000; ++i) {
+    buckets.add_loaded(
+        fmt::format("missing_{}", i), nullptr, buckets.next_generation()
+    );
+  }
+  size_t remembered = 0;
+  for (int i = 0; i < 100000; ++i) {
+    BucketRef found;
+    if (buckets.find(fmt::format("missing_{}", i), found)) {
+      remembered++;
+    }
+  }
+  EXPECT_GT(remembered, 0);
+  EXPECT_LE(remembered, 64 * 64);
+}
+
+TEST_F(TestSFSBucketMap, reset_and_list) {
+  BucketMap buckets;
+  buckets.add(make_bucket("gone"), buckets.next_generation());
+
+  std::vector<BucketRef> refs;
+  for (int i = 0; i < 1000; ++i) {
+    refs.push_back(make_bucket(fmt::format("bucket_{}", i)));
+  }
+  buckets.reset(refs, buckets.next_generation());
+  EXPECT_EQ(buckets.size(), refs.size());
+  EXPECT_FALSE(buckets.contains("gone"));
+  for (const auto& ref : refs) {
+    EXPECT_EQ(buckets.get(ref->get_name()), ref);
+  }
+
+  auto listed = buckets.list();
+  ASSERT_EQ(listed.size(), refs.size());
+  std::sort(listed.begin(), listed.end());
+  std::sort(refs.begin(), refs.end());
+  EXPECT_EQ(listed, refs);
+}
+
+TEST_F(TestSFSBucketMap, adds_removed_meanwhile_are_not_published) {
+  BucketMap buckets;
+  // removed after it was stored, before it was published
+  const auto stored = buckets.next_generation();
+  buckets.remove("b1");
+  EXPECT_FALSE(buckets.add(make_bucket("b1"), stored));
+  EXPECT_FALSE(buckets.contains("b1"));
+  BucketRef found;
+  EXPECT_FALSE(buckets.find("b1", found));
+}
+
+class TestSFSBucketCreate : public SFSStoreFixture {};
+
+TEST_F(TestSFSBucketCreate, concurrent_creates_of_the_same_name) {
+  std::atomic<int> created{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 16; ++i) {
+    threads.emplace_back([&]() {
+      std::map<std::string, bufferlist> attrs;
+      RGWBucketInfo info;
+      if (store->bucket_create(
+              rgw_bucket("", "b1", ""), user->get_info(), "zg1",
+              rgw_placement_rule(), "", nullptr, attrs, info
+          )) {
+        created++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(created, 1);
+  auto bucket = store->get_bucket_ref("b1");
+  ASSERT_TRUE(bucket);
+  rgw::sal::sfs::sqlite::SQLiteBuckets db_buckets(store->db_conn);
+  const auto stored = db_buckets.get_bucket_by_name("b1");
+  ASSERT_EQ(stored.size(), 1);
+  EXPECT_EQ(stored[0].binfo.bucket.bucket_id, bucket->get_bucket_id());
+}
+
+/*
+  Measures get_bucket_ref() latency while other threads keep changing
+  buckets. "incremental" publishes a single bucket per change, the way
+  SFSBucket::put_info/set_acl/merge_and_store_attrs do now. "full_reload"
+  reloads every bucket from the database per change, the way they did
+  before, and is the baseline.
+*/
+
+enum class BucketUpdateMode { INCREMENTAL, FULL_RELOAD };
+
+class TestSFSBucketMapPerf
+    : public ::testing::TestWithParam<BucketUpdateMode> {
+ protected:
+  static constexpr size_t NUM_BUCKETS = 5000;
+
+  const std::unique_ptr<CephContext> cct;
+  const fs::path database_directory;
+  std::unique_ptr<rgw::sal::SFStore> store;
+
+  TestSFSBucketMapPerf()
+      : cct(new CephContext(CEPH_ENTITY_TYPE_ANY)),
+        database_directory(create_database_directory()) {
+    cct->_conf.set_val("rgw_sfs_data_path", database_directory);
+    cct->_log->start();
+    rgw_perf_start(cct.get());
+  }
+
+  void SetUp() override {
+    ASSERT_TRUE(fs::exists(database_directory)) << database_directory;
+    store.reset(new rgw::sal::SFStore(cct.get(), database_directory));
+
+    sqlite::SQLiteUsers users(store->db_conn);
+    sqlite::DBOPUserInfo user;
+    user.uinfo.user_id.id = "testuser";
+    user.uinfo.display_name = "display_name";
+    users.store_user(user);
+
+    sqlite::SQLiteBuckets db_buckets(store->db_conn);
+    // store_bucket() runs inline on the writer thread, in one transaction
+    store->db_conn->run_on_writer([&](sqlite::Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        sqlite::DBOPBucketInfo db_binfo;
+        db_binfo.binfo.bucket =
+            rgw_bucket("", bucket_name(i), fmt::format("id_{}", i));
+        db_binfo.binfo.owner = rgw_user("testuser");
+        db_binfo.binfo.creation_time = ceph::real_clock::now();
+        db_binfo.deleted = false;
+        db_buckets.store_bucket(db_binfo);
+      }
+      transaction.commit();
+    });
+    store->_refresh_buckets();
+  }
+
+  void TearDown() override {
+    store.reset();
+    fs::remove_all(database_directory);
+  }
+
+  fs::path create_database_directory() const {
+    const std::string rand = gen_rand_alphanumeric(cct.get(), 23);
+    const auto result{fs::temp_directory_path() / rand};
+    fs::create_directory(result);
+    return result;
+  }
+
+  static std::string bucket_name(size_t i) {
+    return fmt::format("bucket_{}", i);
+  }
+};
+
+TEST_P(TestSFSBucketMapPerf, lookup_latency_during_updates) {
+  const size_t num_readers = std::max<size_t>(
+      std::thread::hardware_concurrency(), 4
+  );
+  const size_t num_writers = 2;
+  const auto duration = std::chrono::seconds(2);
+
+  std::atomic<bool> stop{false};
+  std::atomic<size_t> missing{0};
+  std::atomic<size_t> lookups{0};
+  std::atomic<size_t> updates{0};
+  std::vector<std::vector<uint64_t>> latencies(num_readers);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < num_readers; ++i) {
+    threads.emplace_back([&, i]() {
+      std::mt19937 rng(i);
+      std::uniform_int_distribution<size_t> pick(0, NUM_BUCKETS - 1);
+      for (size_t n = 0; !stop; ++n) {
+        const auto name = bucket_name(pick(rng));
+        const auto start = ceph::mono_clock::now();
+        auto ref = store->get_bucket_ref(name);
+        const auto elapsed = ceph::mono_clock::now() - start;
+        if (!ref) {
+          missing++;
+        }
+        lookups++;
+        // keep a sample, recording them all would take gigabytes
+        if (n % 16 == 0) {
+          latencies[i].push_back(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                  .count()
+          );
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < num_writers; ++i) {
+    threads.emplace_back([&, i]() {
+      std::mt19937 rng(1000 + i);
+      std::uniform_int_distribution<size_t> pick(0, NUM_BUCKETS - 1);
+      while (!stop) {
+        if (GetParam() == BucketUpdateMode::INCREMENTAL) {
+          auto ref = store->get_bucket_ref(bucket_name(pick(rng)));
+          ASSERT_NE(ref, nullptr);
+          store->_update_bucket(ref, ref->get_info(), ref->get_attrs());
+        } else {
+          store->_refresh_buckets();
+        }
+        updates++;
+      }
+    });
+  }
+
+  std::this_thread::sleep_for(duration);
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // lookups never miss an existing bucket, not even during a reload
+  EXPECT_EQ(missing, 0);
+
+  std::vector<uint64_t> all;
+  for (const auto& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  ASSERT_FALSE(all.empty());
+  std::sort(all.begin(), all.end());
+  const auto percentile = [&](double p) {
+    return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+  };
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} buckets, {} readers, {} writers: {} lookups "
+                          "({:.0f}/s), {} updates, lookup latency p50 {}ns "
+                          "p99 {}ns p99.9 {}ns max {}ns",
+                          GetParam() == BucketUpdateMode::INCREMENTAL
+                              ? "incremental"
+                              : "full_reload",
+                          NUM_BUCKETS, num_readers, num_writers,
+                          lookups.load(),
+                          lookups.load() /
+                              std::chrono::duration<double>(duration).count(),
+                          updates.load(), percentile(0.5), percentile(0.99),
+                          percentile(0.999), all.back()
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    BucketUpdates, TestSFSBucketMapPerf,
+    testing::Values(
+        BucketUpdateMode::INCREMENTAL, BucketUpdateMode::FULL_RELOAD
+    ),
+    [](const testing::TestParamInfo<TestSFSBucketMapPerf::ParamType>& info) {
+      return info.param == BucketUpdateMode::INCREMENTAL ? "incremental"
+                                                         : "full_reload";
+    }
+);
@@ -0,0 +1,373 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/data_copy.h"
+#include "rgw/driver/sfs/object.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSCopyObject : public SFSStoreFixture {
+ protected:
+  void SetUp() override {
+    // keep the test objects in files of their own
+    cct->_conf.set_val("rgw_sfs_pack_threshold", "0");
+    SFSStoreFixture::SetUp();
+  }
+
+  static std::string makeData(size_t size, size_t seed = 0) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>('a' + (i * 7 + seed) % 26);
+    }
+    return data;
+  }
+
+  // creates a committed object with data `data` and the given attributes
+  rgw::sal::sfs::ObjectRef createObject(
+      const std::string& name, const std::string& data,
+      const rgw::sal::Attrs& attrs = {}
+  ) {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+
+    const fs::path path = data_path / objref->get_storage_path();
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ofstream::binary);
+    ofs.write(data.data(), data.size());
+    ofs.close();
+
+    auto meta = objref->get_meta();
+    meta.size = data.size();
+    meta.etag = "etag_" + name;
+    objref->update_meta(meta);
+    objref->update_attrs(attrs);
+    objref->metadata_finish(store.get(), false);
+    return objref;
+  }
+
+  // like createObject() but stores the data in one file per part, as
+  // completing a multipart upload does
+  std::string createSegmentedObject(
+      const std::string& name, const std::vector<size_t>& part_sizes
+  ) {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+
+    std::string data;
+    std::vector<DBVersionedObjectPart> parts;
+    for (size_t i = 0; i < part_sizes.size(); ++i) {
+      const auto part = makeData(part_sizes[i], i);
+      const fs::path path = data_path / objref->get_part_storage_path(i);
+      fs::create_directories(path.parent_path());
+      std::ofstream ofs(path, std::ofstream::binary);
+      ofs.write(part.data(), part.size());
+      ofs.close();
+      parts.push_back(
+          {.versioned_object_id = objref->version_id,
+           .part_num = static_cast<uint32_t>(i),
+           .object_offset = data.size(),
+           .size = part.size()}
+      );
+      data += part;
+    }
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    db_versions.store_versioned_object_parts(parts);
+
+    auto meta = objref->get_meta();
+    meta.size = data.size();
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+    return data;
+  }
+
+  int copyObject(
+      const std::string& src_name, const std::string& dst_name,
+      rgw::sal::AttrsMod attrs_mod = rgw::sal::ATTRSMOD_NONE,
+      rgw::sal::Attrs attrs = {}
+  ) {
+    auto src = bucket->get_object(rgw_obj_key(src_name));
+    auto dst = bucket->get_object(rgw_obj_key(dst_name));
+    std::string etag;
+    ceph::real_time mtime;
+    return src->copy_object(
+        user.get(), nullptr, rgw_zone_id(), dst.get(), bucket.get(),
+        bucket.get(), rgw_placement_rule(), nullptr, &mtime, nullptr, nullptr,
+        false, nullptr, nullptr, attrs_mod, false, attrs, RGWObjCategory::Main,
+        0, boost::none, nullptr, nullptr, &etag, nullptr, nullptr, ndp.get(),
+        null_yield
+    );
+  }
+
+  rgw::sal::sfs::ObjectRef getVersion(const std::string& name) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    auto sfs_object = dynamic_cast<rgw::sal::SFSObject*>(object.get());
+    EXPECT_NE(sfs_object, nullptr);
+    sfs_object->refresh_meta(true);
+    return sfs_object->get_object_ref();
+  }
+
+  std::string readObject(const std::string& name) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    auto read_op = object->get_read_op();
+    EXPECT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+    CollectDataCB cb;
+    const auto size = object->get_obj_size();
+    if (size > 0) {
+      EXPECT_EQ(read_op->iterate(ndp.get(), 0, size - 1, &cb, null_yield), 0);
+    }
+    return cb.data.to_str();
+  }
+
+  void deleteVersion(const rgw::sal::sfs::ObjectRef& objref) {
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    auto version = db_versions.get_versioned_object(objref->version_id);
+    ASSERT_TRUE(version.has_value());
+    version->object_state = rgw::sal::sfs::ObjectState::DELETED;
+    db_versions.store_versioned_object(*version);
+  }
+};
+
+TEST_F(TestSFSCopyObject, copy_shares_data_without_reflink) {
+  store->reflink = false;
+  const auto data = makeData(100000);
+  createObject("src", data);
+  const auto shared_before = perfcounter->get(l_rgw_sfs_copy_shared_objects);
+  ASSERT_EQ(copyObject("src", "dst"), 0);
+  EXPECT_EQ(
+      perfcounter->get(l_rgw_sfs_copy_shared_objects), shared_before + 1
+  );
+
+  const auto src = getVersion("src");
+  const auto dst = getVersion("dst");
+  // no data of its own
+  EXPECT_FALSE(fs::exists(data_path / dst->get_storage_path()));
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  const auto shared = db_versions.get_shared_data(dst->version_id);
+  ASSERT_TRUE(shared.has_value());
+  EXPECT_EQ(shared->data_version_id, src->version_id);
+  EXPECT_EQ(shared->data_object_id, src->path.get_uuid());
+  EXPECT_EQ(readObject("dst"), data);
+  EXPECT_EQ(dst->get_meta().etag, src->get_meta().etag);
+
+  // a copy of the copy shares the data of the source
+  ASSERT_EQ(copyObject("dst", "dst2"), 0);
+  const auto dst2 = getVersion("dst2");
+  const auto shared2 = db_versions.get_shared_data(dst2->version_id);
+  ASSERT_TRUE(shared2.has_value());
+  EXPECT_EQ(shared2->data_version_id, src->version_id);
+  EXPECT_EQ(readObject("dst2"), data);
+}
+
+TEST_F(TestSFSCopyObject, copy_shares_segmented_data) {
+  store->reflink = false;
+  const auto data = createSegmentedObject("src", {5000, 7000, 300});
+  ASSERT_EQ(copyObject("src", "dst"), 0);
+  EXPECT_EQ(readObject("dst"), data);
+
+  const auto dst = getVersion("dst");
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  EXPECT_EQ(db_versions.get_versioned_object_parts(dst->version_id).size(), 3);
+  EXPECT_FALSE(fs::exists(data_path / dst->get_parts_storage_path()));
+}
+
+TEST_F(TestSFSCopyObject, copy_of_removed_source_is_not_committed) {
+  createObject("src", makeData(1000));
+  const auto src = getVersion("src");
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  auto dst = bucketref->create_version(rgw_obj_key("dst"));
+  ASSERT_NE(dst, nullptr);
+  dst->set_shared_data(src->version_id);
+
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  db_versions.remove_versioned_object(src->version_id);
+  // the data is shared in the transaction committing the copy, which
+  // finds the source gone
+  EXPECT_FALSE(dst->metadata_finish(store.get(), false));
+  const auto version = db_versions.get_versioned_object(dst->version_id);
+  ASSERT_TRUE(version.has_value());
+  EXPECT_EQ(version->object_state, rgw::sal::sfs::ObjectState::OPEN);
+  EXPECT_FALSE(db_versions.get_shared_data(dst->version_id).has_value());
+  EXPECT_FALSE(db_versions.get_shared_data(src->version_id).has_value());
+}
+
+TEST_F(TestSFSCopyObject, copy_data_when_sharing_is_disabled) {
+  store->reflink = false;
+  cct->_conf.set_val("rgw_sfs_copy_share_data", "false");
+  const auto data = createSegmentedObject("src", {5000, 7000, 300});
+  const auto copied_before = perfcounter->get(l_rgw_sfs_copy_bytes);
+  ASSERT_EQ(copyObject("src", "dst"), 0);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_copy_bytes), copied_before + 12300);
+
+  const auto dst = getVersion("dst");
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  EXPECT_FALSE(db_versions.get_shared_data(dst->version_id).has_value());
+  // concatenated in a single file
+  EXPECT_TRUE(fs::exists(data_path / dst->get_storage_path()));
+  EXPECT_TRUE(db_versions.get_versioned_object_parts(dst->version_id).empty());
+  EXPECT_EQ(readObject("dst"), data);
+}
+
+TEST_F(TestSFSCopyObject, copy_clones_data_with_reflink) {
+  if (!rgw::sal::sfs::reflink_supported(data_path)) {
+    GTEST_SKIP() << "the filesystem of " << data_path
+                 << " does not clone files";
+  }
+  store->reflink = true;
+  const auto data = makeData(1 << 20);
+  createObject("src", data);
+  ASSERT_EQ(copyObject("src", "dst"), 0);
+
+  const auto dst = getVersion("dst");
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  EXPECT_FALSE(db_versions.get_shared_data(dst->version_id).has_value());
+  EXPECT_TRUE(fs::exists(data_path / dst->get_storage_path()));
+  EXPECT_EQ(readObject("dst"), data);
+}
+
+TEST_F(TestSFSCopyObject, gc_keeps_shared_data_until_last_reference) {
+  store->reflink = false;
+  createObject("src", makeData(1000));
+  ASSERT_EQ(copyObject("src", "dst"), 0);
+  const auto src = getVersion("src");
+  const auto dst = getVersion("dst");
+
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  deleteVersion(src);
+  size_t num_removed = 0;
+  auto to_reclaim =
+      db_versions.remove_deleted_versions_transact(10, &num_removed);
+  ASSERT_TRUE(to_reclaim.has_value());
+  EXPECT_EQ(num_removed, 1);
+  // still used by the copy
+  EXPECT_TRUE(to_reclaim->empty());
+  EXPECT_EQ(readObject("dst"), makeData(1000));
+
+  deleteVersion(dst);
+  to_reclaim = db_versions.remove_deleted_versions_transact(10, &num_removed);
+  ASSERT_TRUE(to_reclaim.has_value());
+  EXPECT_EQ(num_removed, 1);
+  ASSERT_EQ(to_reclaim->size(), 1);
+  EXPECT_EQ(get_uuid((*to_reclaim)[0]), src->path.get_uuid());
+  EXPECT_EQ(get_version_id((*to_reclaim)[0]), src->version_id);
+  EXPECT_FALSE(db_versions.get_shared_data(src->version_id).has_value());
+}
+
+TEST_F(TestSFSCopyObject, copy_replaces_metadata) {
+  rgw::sal::Attrs src_attrs;
+  src_attrs[RGW_ATTR_META_PREFIX "color"].append("red");
+  src_attrs[RGW_ATTR_CONTENT_TYPE].append("text/plain");
+  createObject("src", makeData(1000), src_attrs);
+
+  // MetadataDirective=COPY
+  ASSERT_EQ(copyObject("src", "copied"), 0);
+  auto attrs = getVersion("copied")->get_attrs();
+  EXPECT_EQ(attrs[RGW_ATTR_META_PREFIX "color"].to_str(), "red");
+  EXPECT_EQ(attrs[RGW_ATTR_CONTENT_TYPE].to_str(), "text/plain");
+
+  // MetadataDirective=REPLACE
+  rgw::sal::Attrs new_attrs;
+  new_attrs[RGW_ATTR_META_PREFIX "shape"].append("round");
+  new_attrs[RGW_ATTR_CONTENT_TYPE].append("application/json");
+  ASSERT_EQ(
+      copyObject("src", "replaced", rgw::sal::ATTRSMOD_REPLACE, new_attrs), 0
+  );
+  attrs = getVersion("replaced")->get_attrs();
+  EXPECT_EQ(attrs.count(RGW_ATTR_META_PREFIX "color"), 0);
+  EXPECT_EQ(attrs[RGW_ATTR_META_PREFIX "shape"].to_str(), "round");
+  EXPECT_EQ(attrs[RGW_ATTR_CONTENT_TYPE].to_str(), "application/json");
+  EXPECT_EQ(readObject("replaced"), makeData(1000));
+
+  // replacing the metadata of an object in place
+  ASSERT_EQ(
+      copyObject("src", "src", rgw::sal::ATTRSMOD_REPLACE, new_attrs), 0
+  );
+  attrs = getVersion("src")->get_attrs();
+  EXPECT_EQ(attrs[RGW_ATTR_CONTENT_TYPE].to_str(), "application/json");
+  EXPECT_EQ(readObject("src"), makeData(1000));
+}
+
+/*
+  Measures a server side copy of a 1 GiB object: copying the data, cloning
+  its file (if the filesystem of the test directory can) and sharing it.
+*/
+
+class TestSFSCopyObjectPerf : public TestSFSCopyObject,
+                              public ::testing::WithParamInterface<std::string> {
+};
+
+TEST_P(TestSFSCopyObjectPerf, copy_1g_object) {
+  const std::string mode = GetParam();
+  if (mode == "reflink") {
+    if (!rgw::sal::sfs::reflink_supported(data_path)) {
+      GTEST_SKIP() << "the filesystem of " << data_path
+                   << " does not clone files";
+    }
+    store->reflink = true;
+  } else {
+    store->reflink = false;
+  }
+  cct->_conf.set_val(
+      "rgw_sfs_copy_share_data", mode == "share" ? "true" : "false"
+  );
+
+  const size_t object_size = 1024 * 1024 * 1024;
+  const size_t piece_size = 4 * 1024 * 1024;
+  {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key("large"));
+    ASSERT_NE(objref, nullptr);
+    const fs::path path = data_path / objref->get_storage_path();
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ofstream::binary);
+    const auto piece = makeData(piece_size);
+    for (size_t written = 0; written < object_size; written += piece_size) {
+      ofs.write(piece.data(), piece.size());
+    }
+    ofs.close();
+    auto meta = objref->get_meta();
+    meta.size = object_size;
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+  }
+
+  const auto start = ceph::mono_clock::now();
+  ASSERT_EQ(copyObject("large", "copy"), 0);
+  const std::chrono::duration<double> elapsed =
+      ceph::mono_clock::now() - start;
+  EXPECT_EQ(getVersion("copy")->get_meta().size, object_size);
+
+  lderr(cct.get()) << fmt::format(
+                          "{}: copied {} MiB in {:.3f}s", mode,
+                          object_size >> 20, elapsed.count()
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    LargeObjects, TestSFSCopyObjectPerf,
+    testing::Values("copy", "reflink", "share"),
+    [](const testing::TestParamInfo<TestSFSCopyObjectPerf::ParamType>& info) {
+      return info.param;
+    }
+);
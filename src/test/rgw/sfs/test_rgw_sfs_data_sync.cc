@@ -0,0 +1,324 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/data_sync.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_multipart.h"
+#include "rgw/driver/sfs/writer.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSDataSync : public SFSStoreFixture {
+ protected:
+  const rgw_placement_rule placement;
+  const std::string unique_tag = "tag";
+
+  void SetUp() override {
+    // every object gets a data file
+    cct->_conf.set_val("rgw_sfs_pack_threshold", "0");
+    cct->_conf.set_val("rgw_sfs_inline_threshold", "0");
+    SFSStoreFixture::SetUp();
+  }
+
+  /// Restarts the store with `sync_mode` as its rgw_sfs_data_sync_mode
+  void startStore(const std::string& sync_mode) {
+    stopStore();
+    cct->_conf.set_val("rgw_sfs_data_sync_mode", sync_mode);
+    SFSStoreFixture::startStore();
+  }
+
+  static bufferlist makeData(size_t size) {
+    bufferlist bl;
+    bl.append(std::string(size, 'x'));
+    return bl;
+  }
+
+  int put(const std::string& name, size_t size) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    auto writer = store->get_atomic_writer(
+        ndp.get(), null_yield, object.get(), user->get_id(), &placement, 0,
+        unique_tag
+    );
+    int ret = writer->prepare(null_yield);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = writer->process(makeData(size), 0);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = writer->process({}, size);
+    if (ret < 0) {
+      return ret;
+    }
+    std::map<std::string, bufferlist> attrs;
+    return writer->complete(
+        size, "etag", nullptr, ceph::real_time(), attrs, ceph::real_time(),
+        nullptr, nullptr, nullptr, nullptr, nullptr, null_yield
+    );
+  }
+
+  bool objectExists(const std::string& name) {
+    try {
+      store->get_bucket_ref(TEST_BUCKET)->get(rgw_obj_key(name));
+      return true;
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  /// The data files of objects and parts
+  size_t countDataFiles() {
+    size_t count = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(data_path)) {
+      if (entry.is_regular_file() &&
+          !entry.path().filename().string().starts_with(SCHEMA_DB_NAME)) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  int openFile(const std::string& name) {
+    const auto path = data_path / name;
+    const int fd =
+        ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(makeData(4096).write_fd(fd, 0), 0);
+    return fd;
+  }
+
+  /// Syncs a file of each of `fds` from a thread of its own, returns
+  /// their results
+  static std::vector<int> syncConcurrently(
+      DataSyncer& syncer, const std::vector<int>& fds
+  ) {
+    std::vector<int> results(fds.size(), 1);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < fds.size(); i++) {
+      threads.emplace_back([&, i]() {
+        results[i] = syncer.sync(fds[i], null_yield);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    return results;
+  }
+};
+
+TEST_F(TestSFSDataSync, concurrent_syncs_share_a_batch) {
+  const size_t num_files = 8;
+  std::vector<int> fds;
+  for (size_t i = 0; i < num_files; i++) {
+    fds.push_back(openFile(fmt::format("file{}", i)));
+  }
+  const auto batches = perfcounter->get(l_rgw_sfs_data_sync_batches);
+  const auto files = perfcounter->get(l_rgw_sfs_data_sync_files);
+  {
+    // a window long enough to gather them all, synced once full
+    DataSyncer syncer(
+        DataSyncer::Mode::FDATASYNC, std::chrono::seconds(30), num_files
+    );
+    const auto start = ceph::mono_clock::now();
+    for (const int result : syncConcurrently(syncer, fds)) {
+      EXPECT_EQ(result, 0);
+    }
+    const std::chrono::duration<double> elapsed =
+        ceph::mono_clock::now() - start;
+    EXPECT_LT(elapsed.count(), 10);
+  }
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_data_sync_batches), batches + 1);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_data_sync_files), files + num_files);
+  for (const int fd : fds) {
+    ::close(fd);
+  }
+}
+
+TEST_F(TestSFSDataSync, syncfs_syncs_once_per_batch) {
+  std::vector<int> fds{openFile("file1"), openFile("file2")};
+  const auto batches = perfcounter->get(l_rgw_sfs_data_sync_batches);
+  {
+    DataSyncer syncer(DataSyncer::Mode::SYNCFS, std::chrono::seconds(30), 2);
+    for (const int result : syncConcurrently(syncer, fds)) {
+      EXPECT_EQ(result, 0);
+    }
+  }
+  {
+    // without a window, alone
+    DataSyncer syncer(DataSyncer::Mode::SYNCFS, std::chrono::seconds(0), 2);
+    EXPECT_EQ(syncer.sync(fds[0], null_yield), 0);
+  }
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_data_sync_batches), batches + 2);
+  for (const int fd : fds) {
+    ::close(fd);
+  }
+}
+
+TEST_F(TestSFSDataSync, failures_are_reported_to_their_writers) {
+  std::vector<int> fds{openFile("file1"), openFile("file2")};
+  const int failing = fds[1];
+  auto inject = [failing](int fd) { return fd == failing ? -EIO : 0; };
+
+  DataSyncer fdatasync(
+      DataSyncer::Mode::FDATASYNC, std::chrono::seconds(30), 2
+  );
+  fdatasync.set_fault_injector(inject);
+  EXPECT_EQ(syncConcurrently(fdatasync, fds), std::vector<int>({0, -EIO}));
+
+  // syncfs can't tell which file failed, all of the batch fail
+  DataSyncer syncfs(DataSyncer::Mode::SYNCFS, std::chrono::seconds(30), 2);
+  syncfs.set_fault_injector(inject);
+  EXPECT_EQ(syncConcurrently(syncfs, fds), std::vector<int>({-EIO, -EIO}));
+  for (const int fd : fds) {
+    ::close(fd);
+  }
+}
+
+TEST_F(TestSFSDataSync, fsync_mode_has_no_syncer) {
+  startStore("fsync");
+  EXPECT_FALSE(store->data_syncer);
+  const auto files = perfcounter->get(l_rgw_sfs_data_sync_files);
+  EXPECT_EQ(put("obj", 4096), 0);
+  EXPECT_TRUE(objectExists("obj"));
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_data_sync_files), files);
+}
+
+TEST_F(TestSFSDataSync, failed_sync_fails_the_put) {
+  startStore("batched");
+  ASSERT_TRUE(store->data_syncer);
+  const auto files = perfcounter->get(l_rgw_sfs_data_sync_files);
+  ASSERT_EQ(put("good", 4096), 0);
+  EXPECT_TRUE(objectExists("good"));
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_data_sync_files), files + 1);
+  ASSERT_EQ(countDataFiles(), 1);
+
+  store->data_syncer->set_fault_injector([](int) { return -EIO; });
+  EXPECT_EQ(put("failed", 4096), -ERR_INTERNAL_ERROR);
+  // not committed, and its data file is gone
+  EXPECT_FALSE(objectExists("failed"));
+  EXPECT_EQ(countDataFiles(), 1);
+
+  store->data_syncer->set_fault_injector([](int) { return -ENOSPC; });
+  EXPECT_EQ(put("full", 4096), -ERR_QUOTA_EXCEEDED);
+  EXPECT_FALSE(objectExists("full"));
+
+  store->data_syncer->set_fault_injector({});
+  EXPECT_EQ(put("failed", 4096), 0);
+  EXPECT_TRUE(objectExists("failed"));
+}
+
+TEST_F(TestSFSDataSync, failed_sync_fails_the_part) {
+  startStore("syncfs");
+  DBMultipart mp{};
+  mp.id = -1;
+  mp.bucket_id = TEST_BUCKET;
+  mp.upload_id = "upload";
+  mp.state = MultipartState::INIT;
+  mp.state_change_time = ceph::real_clock::now();
+  mp.object_name = "obj";
+  mp.path_uuid.generate_random();
+  mp.meta_str = "_meta.obj.upload";
+  mp.mtime = ceph::real_clock::now();
+  SQLiteMultipart mpdb(store->db_conn);
+  mpdb.insert(mp);
+
+  auto complete_part = [&](uint32_t part_num) {
+    SFSMultipartWriterV2 writer(
+        ndp.get(), null_yield, "upload", store.get(), part_num
+    );
+    EXPECT_EQ(writer.prepare(null_yield), 0);
+    EXPECT_EQ(writer.process(makeData(4096), 0), 0);
+    std::map<std::string, bufferlist> attrs;
+    return writer.complete(
+        4096, "etag", nullptr, ceph::real_time(), attrs, ceph::real_time(),
+        nullptr, nullptr, nullptr, nullptr, nullptr, null_yield
+    );
+  };
+  EXPECT_EQ(complete_part(1), 0);
+  store->data_syncer->set_fault_injector([](int) { return -EIO; });
+  EXPECT_EQ(complete_part(2), -ERR_INTERNAL_ERROR);
+
+  std::map<uint32_t, bool> finished;
+  for (const auto& part : mpdb.get_parts("upload")) {
+    finished[part.part_num] = part.is_finished();
+  }
+  EXPECT_EQ(finished, (std::map<uint32_t, bool>{{1, true}, {2, false}}));
+}
+
+/*
+  Measures the rate of small PUTs by concurrent clients, each of which
+  waits for its data to be durable before it is acknowledged: "fsync"
+  has every writer fsync its own file, "batched" and "syncfs" sync the
+  files of concurrent writers together.
+*/
+
+class TestSFSDataSyncPerf : public TestSFSDataSync,
+                            public ::testing::WithParamInterface<std::string> {
+};
+
+TEST_P(TestSFSDataSyncPerf, concurrent_small_puts) {
+  const size_t num_clients = 16;
+  const size_t puts_per_client = 64;
+  const size_t object_size = 16 * 1024;
+  startStore(GetParam());
+
+  std::atomic<size_t> failed{0};
+  const auto start = ceph::mono_clock::now();
+  std::vector<std::thread> clients;
+  for (size_t c = 0; c < num_clients; c++) {
+    clients.emplace_back([&, c]() {
+      for (size_t i = 0; i < puts_per_client; i++) {
+        if (put(fmt::format("obj_{}_{}", c, i), object_size) != 0) {
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      ceph::mono_clock::now() - start;
+  EXPECT_EQ(failed.load(), 0);
+
+  const size_t puts = num_clients * puts_per_client;
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} PUTs of {} KiB by {} clients in {:.3f}s: "
+                          "{:.0f} PUT/s",
+                          GetParam(), puts, object_size >> 10, num_clients,
+                          elapsed.count(), puts / elapsed.count()
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    SmallObjects, TestSFSDataSyncPerf,
+    testing::Values("fsync", "batched", "syncfs"),
+    [](const testing::TestParamInfo<TestSFSDataSyncPerf::ParamType>& info) {
+      return info.param;
+    }
+);
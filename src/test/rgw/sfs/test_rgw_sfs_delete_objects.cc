@@ -0,0 +1,298 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/bucket.h"
+#include "rgw/driver/sfs/sqlite/sqlite_objects.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+/*
+  Checks that deleting a batch of objects in a single transaction
+  (rgw::sal::Bucket::delete_objects()) leaves the bucket as deleting
+  them one by one would, and measures it against the per key deletes.
+*/
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+using DeleteObjectsEntry = rgw::sal::Bucket::DeleteObjectsEntry;
+
+class TestSFSDeleteObjects : public SFSStoreFixture {
+ protected:
+  void enableVersioning() {
+    bucket->get_info().flags |= BUCKET_VERSIONED;
+    ASSERT_TRUE(bucket->versioning_enabled());
+  }
+
+  /// commits a version of `name` and returns its version id
+  std::string commitVersion(const std::string& name) {
+    auto objref =
+        store->get_bucket_ref(TEST_BUCKET)->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+    auto meta = objref->get_meta();
+    meta.size = 10;
+    meta.etag = "etag_" + name;
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), bucket->versioning_enabled());
+    return objref->instance;
+  }
+
+  bool exists(const std::string& name, const std::string& instance = "") {
+    try {
+      store->get_bucket_ref(TEST_BUCKET)->get(rgw_obj_key(name, instance));
+      return true;
+    } catch (const UnknownObjectException&) {
+      return false;
+    }
+  }
+
+  /// the versions of `name` not deleted, latest first
+  std::vector<DBVersionedObject> liveVersions(const std::string& name) {
+    SQLiteObjects db_objects(store->db_conn);
+    const auto object = db_objects.get_object(TEST_BUCKET, name);
+    if (!object.has_value()) {
+      return {};
+    }
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    return db_versions.get_versioned_objects(object->uuid);
+  }
+
+  static std::vector<DeleteObjectsEntry> makeBatch(
+      const std::vector<rgw_obj_key>& keys
+  ) {
+    std::vector<DeleteObjectsEntry> batch;
+    for (const auto& key : keys) {
+      batch.emplace_back();
+      batch.back().key = key;
+    }
+    return batch;
+  }
+};
+
+TEST_F(TestSFSDeleteObjects, batches_are_supported) {
+  EXPECT_TRUE(bucket->supports_delete_objects());
+  std::vector<DeleteObjectsEntry> batch;
+  EXPECT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+}
+
+TEST_F(TestSFSDeleteObjects, reports_the_deleted_versions) {
+  commitVersion("obj");
+  auto batch = makeBatch({rgw_obj_key("obj"), rgw_obj_key("missing")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  // for the notifications, instead of reading them before the deletion
+  EXPECT_EQ(batch[0].size, 10);
+  EXPECT_EQ(batch[0].etag, "etag_obj");
+  EXPECT_EQ(batch[1].size, 0);
+  EXPECT_TRUE(batch[1].etag.empty());
+}
+
+TEST_F(TestSFSDeleteObjects, deletes_the_committed_version_as_one_by_one) {
+  // a newer upload of each object is in progress
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  for (const auto& name : {"single", "batch"}) {
+    commitVersion(name);
+    ASSERT_NE(bucketref->create_version(rgw_obj_key(name)), nullptr);
+  }
+
+  std::string delete_marker;
+  EXPECT_TRUE(bucketref->delete_object(
+      *bucketref->get(rgw_obj_key("single")), rgw_obj_key("single"), false,
+      delete_marker
+  ));
+  auto batch = makeBatch({rgw_obj_key("batch")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+
+  for (const auto& name : {"single", "batch"}) {
+    EXPECT_FALSE(exists(name)) << name;
+    const auto live = liveVersions(name);
+    ASSERT_EQ(live.size(), 1) << name;
+    EXPECT_EQ(live[0].object_state, ObjectState::OPEN) << name;
+  }
+}
+
+TEST_F(TestSFSDeleteObjects, open_versions_are_left_alone_as_one_by_one) {
+  enableVersioning();
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  const auto single = bucketref->create_version(rgw_obj_key("single"));
+  const auto batched = bucketref->create_version(rgw_obj_key("batch"));
+  ASSERT_NE(single, nullptr);
+  ASSERT_NE(batched, nullptr);
+
+  std::string delete_marker;
+  EXPECT_FALSE(bucketref->delete_object(
+      *single, rgw_obj_key("single", single->instance), true, delete_marker
+  ));
+  auto batch = makeBatch({rgw_obj_key("batch", batched->instance)});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+
+  for (const auto& name : {"single", "batch"}) {
+    const auto live = liveVersions(name);
+    ASSERT_EQ(live.size(), 1) << name;
+    EXPECT_EQ(live[0].object_state, ObjectState::OPEN) << name;
+  }
+}
+
+TEST_F(TestSFSDeleteObjects, non_versioned_deletes_objects) {
+  commitVersion("obj1");
+  commitVersion("obj2");
+  commitVersion("keep");
+
+  auto batch = makeBatch(
+      {rgw_obj_key("obj1"), rgw_obj_key("obj2"), rgw_obj_key("missing")}
+  );
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  for (const auto& entry : batch) {
+    EXPECT_EQ(entry.ret, 0) << entry.key;
+    EXPECT_FALSE(entry.delete_marker) << entry.key;
+    EXPECT_TRUE(entry.version_id.empty()) << entry.key;
+  }
+  EXPECT_FALSE(exists("obj1"));
+  EXPECT_FALSE(exists("obj2"));
+  EXPECT_FALSE(exists("missing"));
+  EXPECT_TRUE(exists("keep"));
+}
+
+TEST_F(TestSFSDeleteObjects, deletes_invalidate_cached_versions) {
+  commitVersion("obj");
+  // cached by the first read
+  EXPECT_TRUE(exists("obj"));
+  EXPECT_TRUE(exists("obj"));
+
+  auto batch = makeBatch({rgw_obj_key("obj")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  EXPECT_FALSE(exists("obj"));
+}
+
+TEST_F(TestSFSDeleteObjects, versioned_adds_delete_markers) {
+  enableVersioning();
+  const auto version = commitVersion("obj");
+
+  auto batch = makeBatch({rgw_obj_key("obj"), rgw_obj_key("missing")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  for (const auto& entry : batch) {
+    EXPECT_EQ(entry.ret, 0) << entry.key;
+    EXPECT_TRUE(entry.delete_marker) << entry.key;
+    EXPECT_FALSE(entry.version_id.empty()) << entry.key;
+  }
+  EXPECT_NE(batch[0].version_id, batch[1].version_id);
+
+  EXPECT_FALSE(exists("obj"));
+  EXPECT_TRUE(exists("obj", version));
+  // even objects that didn't exist get one, as AWS does
+  auto live = liveVersions("missing");
+  ASSERT_EQ(live.size(), 1);
+  EXPECT_EQ(live[0].version_type, VersionType::DELETE_MARKER);
+  EXPECT_EQ(live[0].version_id, batch[1].version_id);
+
+  live = liveVersions("obj");
+  ASSERT_EQ(live.size(), 2);
+  EXPECT_EQ(live[0].version_type, VersionType::DELETE_MARKER);
+  EXPECT_EQ(live[0].version_id, batch[0].version_id);
+  EXPECT_EQ(live[1].version_id, version);
+}
+
+TEST_F(TestSFSDeleteObjects, versioned_duplicates_add_a_single_marker) {
+  enableVersioning();
+  commitVersion("obj");
+
+  auto batch = makeBatch({rgw_obj_key("obj"), rgw_obj_key("obj")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  size_t num_markers = 0;
+  for (const auto& version : liveVersions("obj")) {
+    if (version.version_type == VersionType::DELETE_MARKER) {
+      num_markers++;
+    }
+  }
+  EXPECT_EQ(num_markers, 1);
+}
+
+TEST_F(TestSFSDeleteObjects, versioned_deletes_specific_versions) {
+  enableVersioning();
+  const auto first = commitVersion("obj");
+  const auto second = commitVersion("obj");
+
+  auto batch = makeBatch({rgw_obj_key("obj", second)});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  EXPECT_EQ(batch[0].ret, 0);
+  EXPECT_EQ(batch[0].version_id, second);
+  EXPECT_FALSE(exists("obj", second));
+  ASSERT_TRUE(exists("obj"));
+  EXPECT_EQ(
+      store->get_bucket_ref(TEST_BUCKET)->get(rgw_obj_key("obj"))->instance,
+      first
+  );
+}
+
+TEST_F(TestSFSDeleteObjects, deleting_a_delete_marker_restores_the_object) {
+  enableVersioning();
+  const auto version = commitVersion("obj");
+
+  auto batch = makeBatch({rgw_obj_key("obj")});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  const auto marker = batch[0].version_id;
+  EXPECT_FALSE(exists("obj"));
+
+  batch = makeBatch({rgw_obj_key("obj", marker)});
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  EXPECT_EQ(batch[0].version_id, marker);
+  ASSERT_TRUE(exists("obj"));
+  const auto live = liveVersions("obj");
+  ASSERT_EQ(live.size(), 1);
+  EXPECT_EQ(live[0].version_id, version);
+}
+
+TEST_F(TestSFSDeleteObjects, performance_batch_vs_single_deletes) {
+  const size_t num_objects = 1000;
+  std::vector<rgw_obj_key> keys;
+  for (size_t i = 0; i < num_objects; i++) {
+    keys.emplace_back(fmt::format("single{:06}", i));
+    commitVersion(keys.back().name);
+  }
+  auto start = ceph::mono_clock::now();
+  for (const auto& key : keys) {
+    auto object = bucket->get_object(key);
+    auto del_op = object->get_delete_op();
+    ASSERT_EQ(del_op->delete_obj(ndp.get(), null_yield), 0);
+  }
+  const auto single_elapsed = ceph::mono_clock::now() - start;
+
+  keys.clear();
+  for (size_t i = 0; i < num_objects; i++) {
+    keys.emplace_back(fmt::format("batch{:06}", i));
+    commitVersion(keys.back().name);
+  }
+  auto batch = makeBatch(keys);
+  start = ceph::mono_clock::now();
+  ASSERT_EQ(bucket->delete_objects(ndp.get(), batch, null_yield), 0);
+  const auto batch_elapsed = ceph::mono_clock::now() - start;
+  for (const auto& key : keys) {
+    ASSERT_FALSE(exists(key.name)) << key;
+  }
+
+  lderr(cct.get()) << fmt::format(
+                          "deleting {} objects: one by one {:.1f}ms, "
+                          "batched {:.1f}ms",
+                          num_objects,
+                          std::chrono::duration<double, std::milli>(
+                              single_elapsed
+                          )
+                              .count(),
+                          std::chrono::duration<double, std::milli>(
+                              batch_elapsed
+                          )
+                              .count()
+                      )
+                   << dendl;
+}
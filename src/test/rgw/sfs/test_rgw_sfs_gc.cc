@@ -182,11 +182,12 @@ class TestSFSGC : public ::testing::Test {
   ) {
     SQLiteMultipart db_multiparts(conn);
     rgw::sal::sfs::sqlite::DBMultipartPart mp;
-    auto storage = conn->get_storage();
     mp.upload_id = upload_id;
     mp.part_num = part_num;
     mp.size = 123;
-    const int id = storage.insert(mp);
+    const int id = conn->run_on_writer([&](Storage& storage) {
+      return storage.insert(mp);
+    });
     storeRandomPart(uuid, id);
     return mp;
   }
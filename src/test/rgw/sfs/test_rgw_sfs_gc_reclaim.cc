@@ -0,0 +1,197 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "common/random_string.h"
+#include "rgw/driver/sfs/sfs_gc_reclaim.h"
+#include "rgw/driver/sfs/uuid_path.h"
+
+using namespace rgw::sal::sfs;
+
+namespace fs = std::filesystem;
+
+class TestSFSGCReclaim : public ::testing::Test {
+ protected:
+  const std::unique_ptr<CephContext> cct{
+      new CephContext(CEPH_ENTITY_TYPE_ANY)};
+  fs::path data_path;
+
+  void SetUp() override {
+    data_path = fs::temp_directory_path() / gen_rand_alphanumeric(cct.get(), 23);
+    fs::create_directories(data_path);
+  }
+
+  void TearDown() override { fs::remove_all(data_path); }
+
+  static void write_file(const fs::path& path, size_t size) {
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ofstream::binary);
+    ofs << std::string(size, 'x');
+  }
+
+  // writes the data of a version the way Object::get_storage_path() and
+  // get_parts_storage_path() lay it out, returning its reclaim item
+  ReclaimItem add_version(
+      const UUIDPath& path, uint version_id, size_t size, size_t num_parts = 0
+  ) const {
+    const auto dir = path.to_path();
+    const auto version = std::to_string(version_id);
+    if (num_parts == 0) {
+      write_file(data_path / dir / (version + ".v"), size);
+    }
+    for (size_t i = 0; i < num_parts; i++) {
+      write_file(
+          data_path / dir / (version + ".parts") / fmt::format("{}.p", i), size
+      );
+    }
+    return {.dir = dir, .file = version + ".v", .subdir = version + ".parts"};
+  }
+
+  size_t count_entries() const {
+    return std::distance(
+        fs::recursive_directory_iterator(data_path),
+        fs::recursive_directory_iterator{}
+    );
+  }
+};
+
+TEST_F(TestSFSGCReclaim, removes_files_and_emptied_directories) {
+  std::vector<ReclaimItem> items;
+  for (int i = 0; i < 50; i++) {
+    const auto path = UUIDPath::create();
+    items.push_back(add_version(path, 1, 100));
+    items.push_back(add_version(path, 2, 10, 3));
+  }
+  ASSERT_GT(count_entries(), 0);
+
+  DataReclaimer reclaimer(data_path, 4, 4);
+  const auto stats = reclaimer.reclaim(items, []() { return false; });
+  EXPECT_EQ(stats.items, items.size());
+  EXPECT_EQ(stats.files, 50 * (1 + 3));
+  EXPECT_EQ(stats.bytes, 50 * (100 + 3 * 10));
+  // nothing left but the data path itself
+  EXPECT_EQ(count_entries(), 0);
+  EXPECT_TRUE(fs::exists(data_path));
+}
+
+TEST_F(TestSFSGCReclaim, keeps_directories_in_use) {
+  const auto path = UUIDPath::create();
+  std::vector<ReclaimItem> items{add_version(path, 1, 100)};
+  add_version(path, 2, 100);
+
+  DataReclaimer reclaimer(data_path, 1);
+  const auto stats = reclaimer.reclaim(items, []() { return false; });
+  EXPECT_EQ(stats.items, 1);
+  EXPECT_EQ(stats.files, 1);
+  EXPECT_EQ(stats.dirs, 0);
+  EXPECT_FALSE(fs::exists(data_path / path.to_path() / "1.v"));
+  EXPECT_TRUE(fs::exists(data_path / path.to_path() / "2.v"));
+}
+
+TEST_F(TestSFSGCReclaim, missing_data_is_not_an_error) {
+  const auto path = UUIDPath::create();
+  std::vector<ReclaimItem> items{
+      {.dir = path.to_path(), .file = "1.v", .subdir = "1.parts"},
+      {.dir = path.to_path(), .file = "2.v", .subdir = ""}};
+  DataReclaimer reclaimer(data_path, 2);
+  const auto stats = reclaimer.reclaim(items, []() { return false; });
+  EXPECT_EQ(stats.items, 2);
+  EXPECT_EQ(stats.files, 0);
+}
+
+TEST_F(TestSFSGCReclaim, stops_after_the_first_chunk) {
+  std::vector<ReclaimItem> items;
+  for (int i = 0; i < 20; i++) {
+    items.push_back(add_version(UUIDPath::create(), 1, 1));
+  }
+  DataReclaimer reclaimer(data_path, 1, 5);
+  auto stats = reclaimer.reclaim(items, []() { return true; });
+  // always makes progress, but stops at a chunk boundary
+  EXPECT_EQ(stats.items, 5);
+  EXPECT_EQ(stats.files, 5);
+  items.erase(items.begin(), items.begin() + stats.items);
+
+  stats = reclaimer.reclaim(items, []() { return false; });
+  EXPECT_EQ(stats.items, 15);
+  EXPECT_EQ(count_entries(), 0);
+}
+
+TEST_F(TestSFSGCReclaim, chunks_hold_whole_directories) {
+  // the versions of an object are reclaimed by the same chunk
+  const auto path = UUIDPath::create();
+  std::vector<ReclaimItem> items;
+  for (uint v = 1; v <= 10; v++) {
+    items.push_back(add_version(path, v, 1));
+  }
+  items.push_back(add_version(UUIDPath::create(), 1, 1));
+  DataReclaimer reclaimer(data_path, 1, 2);
+  const auto stats = reclaimer.reclaim(items, []() { return true; });
+  EXPECT_GE(stats.items, 10);
+  EXPECT_FALSE(fs::exists(data_path / path.to_path()));
+}
+
+/*
+  Reclaims the data of many small deleted objects, as after deleting a
+  large bucket, with 1 thread (the former GC, one file at a time) and
+  with several.
+*/
+
+class TestSFSGCReclaimPerf : public TestSFSGCReclaim,
+                             public testing::WithParamInterface<size_t> {};
+
+TEST_P(TestSFSGCReclaimPerf, reclaim_throughput) {
+  constexpr int NUM_OBJECTS = 20000;
+  constexpr size_t OBJECT_SIZE = 4096;
+  std::vector<ReclaimItem> items;
+  for (int i = 0; i < NUM_OBJECTS; i++) {
+    items.push_back(add_version(UUIDPath::create(), 1, OBJECT_SIZE));
+  }
+
+  DataReclaimer reclaimer(data_path, GetParam());
+  const auto start = ceph::mono_clock::now();
+  ReclaimStats total;
+  while (!items.empty()) {
+    // in batches, as the GC does
+    std::vector<ReclaimItem> batch(
+        items.begin(), items.begin() + std::min<size_t>(items.size(), 1000)
+    );
+    items.erase(items.begin(), items.begin() + batch.size());
+    const auto stats = reclaimer.reclaim(batch, []() { return false; });
+    ASSERT_EQ(stats.items, batch.size());
+    total.files += stats.files;
+    total.bytes += stats.bytes;
+    total.dirs += stats.dirs;
+  }
+  const auto secs =
+      std::chrono::duration<double>(ceph::mono_clock::now() - start).count();
+  EXPECT_EQ(total.files, NUM_OBJECTS);
+  EXPECT_EQ(count_entries(), 0);
+
+  lderr(cct.get()) << fmt::format(
+                          "{} threads: reclaimed {} files, {} bytes, {} dirs "
+                          "in {:.3f}s: {:.0f} files/s {:.0f} MiB/s",
+                          GetParam(), total.files, total.bytes, total.dirs,
+                          secs, total.files / secs,
+                          total.bytes / secs / (1024 * 1024)
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ReclaimThreads, TestSFSGCReclaimPerf, testing::Values(1, 4, 16),
+    [](const testing::TestParamInfo<TestSFSGCReclaimPerf::ParamType>& info) {
+      return fmt::format("threads_{}", info.param);
+    }
+);
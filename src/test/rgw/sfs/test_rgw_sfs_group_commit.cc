@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <memory>
+#include <spawn/spawn.hpp>
+#include <thread>
+#include <vector>
+
+#include "common/async/yield_context.h"
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "include/random.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_perf_counters.h"
+#include "rgw_sfs_store_fixture.h"
+
+/*
+  Checks that object metadata updates coalesced by group commit (see
+  rgw_sfs_sqlite_group_commit_window) are all committed once their
+  callers return, and that requests running as coroutines share batches
+  rather than block the thread they run on. bench_rgw_sfs_group_commit
+  measures the throughput.
+*/
+
+using namespace rgw::sal::sfs;
+
+class TestSFSGroupCommit : public SFSStoreFixture,
+                           public ::testing::WithParamInterface<int> {
+ protected:
+  BucketRef bucketref;
+
+  void SetUp() override {
+    cct->_conf.set_val(
+        "rgw_sfs_sqlite_group_commit_window", std::to_string(GetParam())
+    );
+    SFSStoreFixture::SetUp();
+    bucketref = store->get_bucket_ref(TEST_BUCKET);
+  }
+
+  void TearDown() override {
+    bucketref.reset();
+    SFSStoreFixture::TearDown();
+  }
+
+  void put_object(const std::string& name, optional_yield y = null_yield) {
+    ObjectRef obj;
+    while (!obj) {
+      obj = bucketref->create_version(rgw_obj_key(name), y);
+    }
+    obj->metadata_finish(store.get(), false, y);
+  }
+};
+
+TEST_P(TestSFSGroupCommit, concurrent_puts_are_committed) {
+  const size_t num_threads = 8;
+  const size_t ops_per_thread = 16;
+  const auto batches_before =
+      perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches);
+  std::atomic<size_t> failed{0};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&, i] {
+      for (size_t j = 0; j < ops_per_thread; j++) {
+        try {
+          const auto name = fmt::format("obj_{}_{}", i, j);
+          put_object(name);
+          // visible once metadata_finish returned, throws otherwise
+          bucketref->get(rgw_obj_key(name));
+        } catch (const std::exception&) {
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(failed, 0);
+
+  const size_t total_ops = num_threads * ops_per_thread;
+  EXPECT_EQ(bucketref->get_all().size(), total_ops);
+  const auto batches =
+      perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches) -
+      batches_before;
+  if (GetParam() == 0) {
+    // every operation commits on its own
+    EXPECT_EQ(batches, 0u);
+  } else {
+    // a batch holds at least one create_version or metadata_finish
+    EXPECT_GT(batches, 0u);
+    EXPECT_LE(batches, 2 * total_ops);
+  }
+}
+
+TEST_P(TestSFSGroupCommit, coroutines_wait_without_blocking_their_thread) {
+  const size_t num_coroutines = 16;
+  const auto batches_before =
+      perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches);
+  // all requests share the thread of the frontend, each is suspended
+  // while its changes are committed
+  boost::asio::io_context context;
+  for (size_t i = 0; i < num_coroutines; i++) {
+    spawn::spawn(context, [&, i](yield_context yield) {
+      optional_yield y(context, yield);
+      put_object(fmt::format("obj_{}", i), y);
+    });
+  }
+  context.run();
+
+  EXPECT_EQ(bucketref->get_all().size(), num_coroutines);
+  const auto batches =
+      perfcounter->get(l_rgw_sfs_sqlite_group_commit_batches) -
+      batches_before;
+  if (GetParam() == 0) {
+    EXPECT_EQ(batches, 0u);
+  } else {
+    // a blocked thread would commit each operation in a batch of its own
+    EXPECT_LT(batches, num_coroutines);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    GroupCommitWindow, TestSFSGroupCommit, testing::Values(0, 2),
+    [](const testing::TestParamInfo<TestSFSGroupCommit::ParamType>& info) {
+      return fmt::format("window_{}ms", info.param);
+    }
+);
@@ -0,0 +1,205 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/object.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSInlineObjects : public SFSStoreFixture {
+ protected:
+  void SetUp() override {
+    cct->_conf.set_val("rgw_sfs_inline_threshold", "1024");
+    SFSStoreFixture::SetUp();
+  }
+
+  static bufferlist make_data(size_t size, char seed) {
+    bufferlist bl;
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>('a' + (i + seed) % 26);
+    }
+    bl.append(data);
+    return bl;
+  }
+
+  // uploads `data` in pieces of `piece_size` through SFSAtomicWriter
+  void putObject(
+      const std::string& name, const bufferlist& data, size_t piece_size = 100
+  ) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    const rgw_placement_rule placement;
+    const std::string unique_tag = "tag";
+    auto writer = store->get_atomic_writer(
+        ndp.get(), null_yield, object.get(), user->get_id(), &placement, 0,
+        unique_tag
+    );
+    ASSERT_EQ(writer->prepare(null_yield), 0);
+    for (uint64_t ofs = 0; ofs < data.length(); ofs += piece_size) {
+      bufferlist piece;
+      piece.substr_of(
+          data, ofs, std::min<uint64_t>(piece_size, data.length() - ofs)
+      );
+      ASSERT_EQ(writer->process(std::move(piece), ofs), 0);
+    }
+    ASSERT_EQ(writer->process({}, data.length()), 0);
+    std::map<std::string, bufferlist> attrs;
+    ASSERT_EQ(
+        writer->complete(
+            data.length(), "etag_" + name, nullptr, ceph::real_time(), attrs,
+            ceph::real_time(), nullptr, nullptr, nullptr, nullptr, nullptr,
+            null_yield
+        ),
+        0
+    );
+  }
+
+  std::string readObject(const std::string& name) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    auto read_op = object->get_read_op();
+    EXPECT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+    CollectDataCB cb;
+    const auto size = object->get_obj_size();
+    if (size > 0) {
+      EXPECT_EQ(
+          read_op->iterate(ndp.get(), 0, size - 1, &cb, null_yield), size
+      );
+    }
+    return cb.data.to_str();
+  }
+
+  ObjectRef getVersion(const std::string& name) {
+    return store->get_bucket_ref(TEST_BUCKET)->get(rgw_obj_key(name));
+  }
+
+  std::optional<std::vector<char>> getInlineData(const ObjectRef& objref) {
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    auto version = db_versions.get_versioned_object(objref->version_id);
+    EXPECT_TRUE(version.has_value());
+    return version->inline_data;
+  }
+};
+
+TEST_F(TestSFSInlineObjects, small_objects_are_stored_inline) {
+  const auto inlined_before = perfcounter->get(l_rgw_sfs_inline_objects);
+  const auto data = make_data(1000, 0);
+  putObject("small", data);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_inline_objects), inlined_before + 1);
+
+  const auto objref = getVersion("small");
+  EXPECT_FALSE(fs::exists(data_path / objref->get_storage_path()));
+  const auto inline_data = getInlineData(objref);
+  ASSERT_TRUE(inline_data.has_value());
+  EXPECT_EQ(
+      std::string(inline_data->begin(), inline_data->end()), data.to_str()
+  );
+  EXPECT_EQ(objref->get_meta().size, 1000);
+  EXPECT_EQ(readObject("small"), data.to_str());
+
+  // and ranges of them
+  auto object = bucket->get_object(rgw_obj_key("small"));
+  auto read_op = object->get_read_op();
+  ASSERT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+  bufferlist range;
+  EXPECT_EQ(read_op->read(100, 199, range, null_yield, ndp.get()), 100);
+  EXPECT_EQ(range.to_str(), data.to_str().substr(100, 100));
+}
+
+TEST_F(TestSFSInlineObjects, empty_objects_are_stored_inline) {
+  putObject("empty", bufferlist());
+  const auto objref = getVersion("empty");
+  EXPECT_FALSE(fs::exists(data_path / objref->get_storage_path()));
+  const auto inline_data = getInlineData(objref);
+  ASSERT_TRUE(inline_data.has_value());
+  EXPECT_TRUE(inline_data->empty());
+  EXPECT_EQ(readObject("empty"), "");
+}
+
+TEST_F(TestSFSInlineObjects, larger_objects_get_a_file) {
+  const auto data = make_data(1025, 1);
+  putObject("large", data);
+  const auto objref = getVersion("large");
+  EXPECT_TRUE(fs::exists(data_path / objref->get_storage_path()));
+  EXPECT_FALSE(getInlineData(objref).has_value());
+  EXPECT_EQ(readObject("large"), data.to_str());
+}
+
+TEST_F(TestSFSInlineObjects, inlining_takes_precedence_over_packing) {
+  cct->_conf.set_val("rgw_sfs_pack_threshold", "4096");
+  putObject("inline", make_data(1000, 2));
+  putObject("packed", make_data(2000, 3));
+
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  const auto inlined = getVersion("inline");
+  EXPECT_TRUE(getInlineData(inlined).has_value());
+  EXPECT_FALSE(db_versions.get_packed_object(inlined->version_id).has_value());
+  const auto packed = getVersion("packed");
+  EXPECT_FALSE(getInlineData(packed).has_value());
+  EXPECT_TRUE(db_versions.get_packed_object(packed->version_id).has_value());
+  EXPECT_EQ(readObject("inline"), make_data(1000, 2).to_str());
+  EXPECT_EQ(readObject("packed"), make_data(2000, 3).to_str());
+}
+
+TEST_F(TestSFSInlineObjects, copies_of_inline_objects_are_inline) {
+  const auto data = make_data(500, 4);
+  putObject("src", data);
+  auto src = bucket->get_object(rgw_obj_key("src"));
+  auto dst = bucket->get_object(rgw_obj_key("dst"));
+  rgw::sal::Attrs attrs;
+  ceph::real_time mtime;
+  std::string etag;
+  ASSERT_EQ(
+      src->copy_object(
+          user.get(), nullptr, rgw_zone_id(), dst.get(), bucket.get(),
+          bucket.get(), rgw_placement_rule(), nullptr, &mtime, nullptr,
+          nullptr, false, nullptr, nullptr, rgw::sal::ATTRSMOD_NONE, false,
+          attrs, RGWObjCategory::Main, 0, boost::none, nullptr, nullptr,
+          &etag, nullptr, nullptr, ndp.get(), null_yield
+      ),
+      0
+  );
+  const auto objref = getVersion("dst");
+  EXPECT_TRUE(getInlineData(objref).has_value());
+  EXPECT_FALSE(fs::exists(data_path / objref->get_storage_path()));
+  EXPECT_EQ(readObject("dst"), data.to_str());
+}
+
+TEST_F(TestSFSInlineObjects, gc_has_nothing_to_reclaim_for_inline_objects) {
+  putObject("inline", make_data(100, 5));
+  cct->_conf.set_val("rgw_sfs_inline_threshold", "0");
+  putObject("file", make_data(100, 6));
+
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  for (const auto& name : {"inline", "file"}) {
+    auto version =
+        db_versions.get_versioned_object(getVersion(name)->version_id);
+    ASSERT_TRUE(version.has_value());
+    version->object_state = ObjectState::DELETED;
+    db_versions.store_versioned_object(*version);
+  }
+  size_t num_removed = 0;
+  const auto to_reclaim =
+      db_versions.remove_deleted_versions_transact(10, &num_removed);
+  ASSERT_TRUE(to_reclaim.has_value());
+  EXPECT_EQ(num_removed, 2);
+  ASSERT_EQ(to_reclaim->size(), 1);
+}
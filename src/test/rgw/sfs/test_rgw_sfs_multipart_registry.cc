@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/sqlite/buckets/multipart_registry.h"
+#include "rgw/driver/sfs/sqlite/sqlite_multipart.h"
+#include "rgw/driver/sfs/writer.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+static DBMultipart make_multipart(
+    const std::string& upload_id, const std::string& bucket_id = TEST_BUCKET
+) {
+  DBMultipart mp{};
+  mp.id = -1;
+  mp.bucket_id = bucket_id;
+  mp.upload_id = upload_id;
+  mp.state = MultipartState::INIT;
+  mp.state_change_time = ceph::real_clock::now();
+  mp.object_name = "obj_" + upload_id;
+  mp.path_uuid.generate_random();
+  mp.meta_str = "_meta.obj_" + upload_id + "." + upload_id;
+  mp.mtime = ceph::real_clock::now();
+  return mp;
+}
+
+TEST(TestSFSMultipartRegistry, publishes_state_changes) {
+  MultipartRegistry registry;
+  auto upload = registry.add(
+      make_multipart("upload"), MultipartState::INPROGRESS,
+      registry.get_generation()
+  );
+  ASSERT_TRUE(upload);
+  EXPECT_EQ(upload->state, MultipartState::INPROGRESS);
+  // writers of other parts share it
+  EXPECT_EQ(
+      registry.add(
+          make_multipart("upload"), MultipartState::INPROGRESS,
+          registry.get_generation()
+      ),
+      upload
+  );
+
+  registry.publish("other", MultipartState::ABORTED);
+  EXPECT_EQ(upload->state, MultipartState::INPROGRESS);
+  registry.publish("upload", MultipartState::ABORTED);
+  EXPECT_EQ(upload->state, MultipartState::ABORTED);
+}
+
+TEST(TestSFSMultipartRegistry, racing_change_makes_state_unknown) {
+  MultipartRegistry registry;
+  // read from the database before the upload was aborted
+  const auto generation = registry.get_generation();
+  registry.publish("upload", MultipartState::ABORTED);
+  auto upload = registry.add(
+      make_multipart("upload"), MultipartState::INPROGRESS, generation
+  );
+  EXPECT_EQ(upload->state, MultipartState::NONE);
+
+  registry.refresh(*upload, MultipartState::INPROGRESS, generation);
+  EXPECT_EQ(upload->state, MultipartState::NONE);
+  registry.refresh(
+      *upload, MultipartState::ABORTED, registry.get_generation()
+  );
+  EXPECT_EQ(upload->state, MultipartState::ABORTED);
+}
+
+TEST(TestSFSMultipartRegistry, bucket_changes_make_states_unknown) {
+  MultipartRegistry registry;
+  auto upload = registry.add(
+      make_multipart("upload"), MultipartState::INPROGRESS,
+      registry.get_generation()
+  );
+  auto other = registry.add(
+      make_multipart("other", "other_bucket"), MultipartState::INPROGRESS,
+      registry.get_generation()
+  );
+  registry.invalidate_bucket(TEST_BUCKET);
+  EXPECT_EQ(upload->state, MultipartState::NONE);
+  EXPECT_EQ(other->state, MultipartState::INPROGRESS);
+}
+
+TEST(TestSFSMultipartRegistry, forgets_uploads_without_writers) {
+  MultipartRegistry registry;
+  for (int i = 0; i < 1000; i++) {
+    registry.add(
+        make_multipart("upload" + std::to_string(i)),
+        MultipartState::INPROGRESS, registry.get_generation()
+    );
+  }
+  EXPECT_LT(registry.size(), 100);
+}
+
+class TestSFSMultipartWriter : public SFSStoreFixture {
+ protected:
+  void createUpload(const std::string& upload_id) {
+    SQLiteMultipart mpdb(store->db_conn);
+    mpdb.insert(make_multipart(upload_id));
+  }
+
+  std::unique_ptr<SFSMultipartWriterV2> makeWriter(
+      const std::string& upload_id, uint32_t part_num
+  ) {
+    return std::make_unique<SFSMultipartWriterV2>(
+        ndp.get(), null_yield, upload_id, store.get(), part_num
+    );
+  }
+
+  static bufferlist makeChunk(size_t size) {
+    bufferlist bl;
+    bl.append(std::string(size, 'x'));
+    return bl;
+  }
+};
+
+TEST_F(TestSFSMultipartWriter, parts_take_two_queries_whatever_their_size) {
+  createUpload("upload");
+  const size_t num_parts = 10;
+  const size_t num_chunks = 50;
+  const size_t chunk_size = 4096;
+
+  const auto parts = perfcounter->get(l_rgw_sfs_multipart_parts);
+  const auto queries = perfcounter->get(l_rgw_sfs_multipart_part_db_queries);
+  for (uint32_t part_num = 1; part_num <= num_parts; part_num++) {
+    auto writer = makeWriter("upload", part_num);
+    ASSERT_EQ(writer->prepare(null_yield), 0);
+    for (size_t i = 0; i < num_chunks; i++) {
+      ASSERT_EQ(writer->process(makeChunk(chunk_size), i * chunk_size), 0);
+    }
+    ASSERT_EQ(writer->process({}, num_chunks * chunk_size), 0);
+    std::map<std::string, bufferlist> attrs;
+    ceph::real_time mtime;
+    ASSERT_EQ(
+        writer->complete(
+            num_chunks * chunk_size, "etag", &mtime, ceph::real_time(), attrs,
+            ceph::real_time(), nullptr, nullptr, nullptr, nullptr, nullptr,
+            null_yield
+        ),
+        0
+    );
+    EXPECT_NE(mtime, ceph::real_time());
+  }
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_multipart_parts), parts + num_parts);
+  // create_or_reset_part() and finish_part(), down from one more for
+  // prepare() and one per chunk
+  EXPECT_EQ(
+      perfcounter->get(l_rgw_sfs_multipart_part_db_queries),
+      queries + 2 * num_parts
+  );
+
+  SQLiteMultipart mpdb(store->db_conn);
+  const auto db_parts = mpdb.get_parts("upload");
+  ASSERT_EQ(db_parts.size(), num_parts);
+  for (const auto& part : db_parts) {
+    EXPECT_TRUE(part.is_finished());
+    EXPECT_EQ(part.size, num_chunks * chunk_size);
+  }
+}
+
+TEST_F(TestSFSMultipartWriter, abort_stops_writers) {
+  createUpload("upload");
+  auto writer = makeWriter("upload", 1);
+  ASSERT_EQ(writer->prepare(null_yield), 0);
+  ASSERT_EQ(writer->process(makeChunk(100), 0), 0);
+
+  SQLiteMultipart mpdb(store->db_conn);
+  ASSERT_TRUE(mpdb.abort("upload"));
+  EXPECT_EQ(writer->process(makeChunk(100), 100), -ERR_NO_SUCH_UPLOAD);
+  EXPECT_EQ(makeWriter("upload", 2)->prepare(null_yield), -ERR_NO_SUCH_UPLOAD);
+}
+
+TEST_F(TestSFSMultipartWriter, bucket_wide_abort_stops_writers) {
+  createUpload("upload");
+  auto writer = makeWriter("upload", 1);
+  ASSERT_EQ(writer->prepare(null_yield), 0);
+
+  SQLiteMultipart mpdb(store->db_conn);
+  EXPECT_EQ(mpdb.abort_multiparts_by_bucket_id(TEST_BUCKET), 1);
+  const auto queries = perfcounter->get(l_rgw_sfs_multipart_part_db_queries);
+  EXPECT_EQ(writer->process(makeChunk(100), 0), -ERR_NO_SUCH_UPLOAD);
+  // read once, known afterwards
+  EXPECT_EQ(writer->process(makeChunk(100), 0), -ERR_NO_SUCH_UPLOAD);
+  EXPECT_EQ(
+      perfcounter->get(l_rgw_sfs_multipart_part_db_queries), queries + 1
+  );
+}
+
+TEST_F(TestSFSMultipartWriter, complete_stops_writers) {
+  createUpload("upload");
+  auto writer = makeWriter("upload", 1);
+  ASSERT_EQ(writer->prepare(null_yield), 0);
+
+  SQLiteMultipart mpdb(store->db_conn);
+  bool duplicate = true;
+  ASSERT_TRUE(mpdb.mark_complete("upload", &duplicate));
+  EXPECT_FALSE(duplicate);
+  EXPECT_EQ(writer->process(makeChunk(100), 0), -ERR_NO_SUCH_UPLOAD);
+}
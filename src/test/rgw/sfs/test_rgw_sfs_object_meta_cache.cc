@@ -0,0 +1,194 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/sqlite/versioned_object/object_meta_cache.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+static DBVersionedObject make_version(uint id, const std::string& etag) {
+  DBVersionedObject version;
+  version.id = id;
+  version.object_id.generate_random();
+  version.size = id * 10;
+  version.object_state = ObjectState::COMMITTED;
+  version.version_id = "version" + std::to_string(id);
+  version.etag = etag;
+  version.attrs[RGW_ATTR_META_PREFIX "etag"].append(etag);
+  return version;
+}
+
+TEST(TestSFSObjectMetaCache, finds_added_versions) {
+  ObjectMetaCache cache(100);
+  EXPECT_FALSE(cache.find("bucket", "obj", "").has_value());
+
+  cache.add(
+      "bucket", "obj", "", make_version(1, "a"),
+      cache.get_generation("bucket", "obj")
+  );
+  cache.add(
+      "bucket", "obj", "version2", make_version(2, "b"),
+      cache.get_generation("bucket", "obj")
+  );
+  auto found = cache.find("bucket", "obj", "");
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found->id, 1);
+  EXPECT_EQ(found->etag, "a");
+  EXPECT_EQ(found->attrs[RGW_ATTR_META_PREFIX "etag"].to_str(), "a");
+  found = cache.find("bucket", "obj", "version2");
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found->id, 2);
+
+  EXPECT_FALSE(cache.find("bucket", "obj", "version3").has_value());
+  EXPECT_FALSE(cache.find("bucket", "other", "").has_value());
+  EXPECT_FALSE(cache.find("other", "obj", "").has_value());
+}
+
+TEST(TestSFSObjectMetaCache, invalidate_drops_all_versions_of_object) {
+  ObjectMetaCache cache(100);
+  cache.add(
+      "bucket", "obj", "", make_version(1, "a"),
+      cache.get_generation("bucket", "obj")
+  );
+  cache.add(
+      "bucket", "obj", "version1", make_version(1, "a"),
+      cache.get_generation("bucket", "obj")
+  );
+  cache.add(
+      "bucket", "obj2", "", make_version(2, "b"),
+      cache.get_generation("bucket", "obj2")
+  );
+
+  cache.invalidate("bucket", "obj");
+  EXPECT_FALSE(cache.find("bucket", "obj", "").has_value());
+  EXPECT_FALSE(cache.find("bucket", "obj", "version1").has_value());
+  EXPECT_TRUE(cache.find("bucket", "obj2", "").has_value());
+
+  cache.invalidate_all();
+  EXPECT_FALSE(cache.find("bucket", "obj2", "").has_value());
+  // cached again afterwards
+  cache.add(
+      "bucket", "obj2", "", make_version(2, "b"),
+      cache.get_generation("bucket", "obj2")
+  );
+  EXPECT_TRUE(cache.find("bucket", "obj2", "").has_value());
+}
+
+TEST(TestSFSObjectMetaCache, racing_modification_is_not_cached) {
+  ObjectMetaCache cache(100);
+  // read from the database before the object was modified
+  const auto generation = cache.get_generation("bucket", "obj");
+  cache.invalidate("bucket", "obj");
+  cache.add("bucket", "obj", "", make_version(1, "stale"), generation);
+  EXPECT_FALSE(cache.find("bucket", "obj", "").has_value());
+
+  // or before all objects were
+  const auto generation2 = cache.get_generation("bucket", "obj");
+  cache.invalidate_all();
+  cache.add("bucket", "obj", "", make_version(1, "stale"), generation2);
+  EXPECT_FALSE(cache.find("bucket", "obj", "").has_value());
+}
+
+TEST(TestSFSObjectMetaCache, modification_only_affects_its_shard) {
+  ObjectMetaCache cache(1000);
+  std::vector<uint64_t> generations;
+  for (int i = 0; i < 64; i++) {
+    generations.push_back(
+        cache.get_generation("bucket", "obj" + std::to_string(i))
+    );
+  }
+  cache.invalidate("bucket", "obj0");
+
+  // objects in other shards are cached even though their versions were
+  // read before the modification
+  size_t cached = 0;
+  for (int i = 1; i < 64; i++) {
+    const auto name = "obj" + std::to_string(i);
+    cache.add("bucket", name, "", make_version(i, "a"), generations[i]);
+    const bool same_shard =
+        cache.get_generation("bucket", name) != generations[i];
+    EXPECT_EQ(cache.find("bucket", name, "").has_value(), !same_shard)
+        << name;
+    cached += same_shard ? 0 : 1;
+  }
+  EXPECT_GT(cached, 0u);
+}
+
+TEST(TestSFSObjectMetaCache, disabled_with_size_zero) {
+  ObjectMetaCache cache(0);
+  cache.add(
+      "bucket", "obj", "", make_version(1, "a"),
+      cache.get_generation("bucket", "obj")
+  );
+  EXPECT_FALSE(cache.find("bucket", "obj", "").has_value());
+}
+
+class TestSFSObjectMetaCacheStore : public SFSStoreFixture {
+ protected:
+  BucketRef bucketref;
+
+  void SetUp() override {
+    SFSStoreFixture::SetUp();
+    bucketref = store->get_bucket_ref(TEST_BUCKET);
+  }
+
+  void TearDown() override {
+    bucketref.reset();
+    SFSStoreFixture::TearDown();
+  }
+
+  void commitVersion(const std::string& name, const std::string& etag) {
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    ASSERT_NE(objref, nullptr);
+    auto meta = objref->get_meta();
+    meta.size = 10;
+    meta.etag = etag;
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+  }
+};
+
+TEST_F(TestSFSObjectMetaCacheStore, get_is_served_from_cache) {
+  commitVersion("obj", "etag1");
+  const auto hits = perfcounter->get(l_rgw_sfs_object_meta_cache_hit);
+  EXPECT_EQ(bucketref->get(rgw_obj_key("obj"))->get_meta().etag, "etag1");
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_object_meta_cache_hit), hits);
+  EXPECT_EQ(bucketref->get(rgw_obj_key("obj"))->get_meta().etag, "etag1");
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_object_meta_cache_hit), hits + 1);
+}
+
+TEST_F(TestSFSObjectMetaCacheStore, commit_and_delete_invalidate) {
+  commitVersion("obj", "etag1");
+  EXPECT_EQ(bucketref->get(rgw_obj_key("obj"))->get_meta().etag, "etag1");
+
+  commitVersion("obj", "etag2");
+  EXPECT_EQ(bucketref->get(rgw_obj_key("obj"))->get_meta().etag, "etag2");
+
+  // attributes flushed to the database
+  auto objref = bucketref->get(rgw_obj_key("obj"));
+  bufferlist value;
+  value.append("red");
+  objref->set_attr(RGW_ATTR_META_PREFIX "color", value);
+  objref->metadata_flush_attrs(store.get());
+  bufferlist found;
+  EXPECT_TRUE(bucketref->get(rgw_obj_key("obj"))
+                  ->get_attr(RGW_ATTR_META_PREFIX "color", found));
+  EXPECT_EQ(found.to_str(), "red");
+
+  std::string delete_marker;
+  ASSERT_TRUE(bucketref->delete_object(
+      *objref, rgw_obj_key("obj"), false, delete_marker
+  ));
+  EXPECT_THROW(bucketref->get(rgw_obj_key("obj")), UnknownObjectException);
+}
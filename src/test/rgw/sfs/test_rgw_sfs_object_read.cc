@@ -0,0 +1,297 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_context.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <spawn/spawn.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/async/yield_context.h"
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/object.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSObjectRead : public SFSStoreFixture {
+ protected:
+  // creates a committed object whose data is `size` bytes of a known
+  // pattern and returns that data
+  std::string createObject(const std::string& name, size_t size) {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>('a' + (i * 7) % 26);
+    }
+    const fs::path path = data_path / objref->get_storage_path();
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ofstream::binary);
+    ofs.write(data.data(), data.size());
+    ofs.close();
+
+    auto meta = objref->get_meta();
+    meta.size = size;
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+    return data;
+  }
+
+  // like createObject() but stores the data in one file per part, as
+  // completing a multipart upload does
+  std::string createSegmentedObject(
+      const std::string& name, const std::vector<size_t>& part_sizes
+  ) {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+
+    std::string data;
+    std::vector<DBVersionedObjectPart> parts;
+    for (size_t i = 0; i < part_sizes.size(); ++i) {
+      std::string part(part_sizes[i], '\0');
+      for (size_t j = 0; j < part.size(); ++j) {
+        part[j] = static_cast<char>('a' + (data.size() + j + i) % 26);
+      }
+      const fs::path path = data_path / objref->get_part_storage_path(i);
+      fs::create_directories(path.parent_path());
+      std::ofstream ofs(path, std::ofstream::binary);
+      ofs.write(part.data(), part.size());
+      ofs.close();
+      parts.push_back(
+          {.versioned_object_id = objref->version_id,
+           .part_num = static_cast<uint32_t>(i),
+           .object_offset = data.size(),
+           .size = part.size()}
+      );
+      data += part;
+    }
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    db_versions.store_versioned_object_parts(parts);
+
+    auto meta = objref->get_meta();
+    meta.size = data.size();
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+    return data;
+  }
+
+  std::unique_ptr<rgw::sal::Object> getObject(const std::string& name) {
+    return bucket->get_object(rgw_obj_key(name));
+  }
+
+  void checkIterate(const std::string& name, const std::string& expected) {
+    auto object = getObject(name);
+    auto read_op = object->get_read_op();
+    ASSERT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+
+    CollectDataCB cb;
+    ASSERT_EQ(
+        read_op->iterate(ndp.get(), 0, expected.size() - 1, &cb, null_yield),
+        expected.size()
+    );
+    EXPECT_EQ(cb.data.to_str(), expected);
+
+    // ranged read in the middle of the object, not page aligned
+    const size_t ofs = expected.size() / 3 + 1;
+    const size_t end = expected.size() - expected.size() / 3;
+    CollectDataCB range_cb;
+    ASSERT_EQ(
+        read_op->iterate(ndp.get(), ofs, end, &range_cb, null_yield),
+        end - ofs + 1
+    );
+    EXPECT_EQ(range_cb.data.to_str(), expected.substr(ofs, end - ofs + 1));
+
+    bufferlist bl;
+    ASSERT_EQ(
+        read_op->read(ofs, end, bl, null_yield, ndp.get()), end - ofs + 1
+    );
+    EXPECT_EQ(bl.to_str(), expected.substr(ofs, end - ofs + 1));
+  }
+};
+
+TEST_F(TestSFSObjectRead, read_small_object_with_pread) {
+  const auto expected = createObject("small", 1000);
+  const auto mmap_before = perfcounter->get(l_rgw_sfs_read_mmap_bytes);
+  checkIterate("small", expected);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_read_mmap_bytes), mmap_before);
+}
+
+TEST_F(TestSFSObjectRead, read_large_object_with_mmap) {
+  cct->_conf.set_val("rgw_sfs_read_mmap_threshold", "4096");
+  const auto expected = createObject("large", 3 * 1024 * 1024 + 123);
+  const auto pread_before = perfcounter->get(l_rgw_sfs_read_pread_bytes);
+  checkIterate("large", expected);
+  EXPECT_GT(perfcounter->get(l_rgw_sfs_read_mmap_bytes), 0);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_read_pread_bytes), pread_before);
+}
+
+TEST_F(TestSFSObjectRead, read_with_mmap_disabled) {
+  cct->_conf.set_val("rgw_sfs_read_mmap_threshold", "0");
+  const auto expected = createObject("large", 3 * 1024 * 1024 + 123);
+  checkIterate("large", expected);
+  EXPECT_EQ(perfcounter->get(l_rgw_sfs_read_mmap_bytes), 0);
+}
+
+TEST_F(TestSFSObjectRead, read_survives_data_file_removal) {
+  const auto expected = createObject("removed", 64 * 1024);
+  auto object = getObject("removed");
+  auto read_op = object->get_read_op();
+  ASSERT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+
+  // the data file is opened in prepare(), removing it afterwards (as the
+  // GC would) must not break a read in progress
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  auto objref = bucketref->get(rgw_obj_key("removed"));
+  fs::remove(data_path / objref->get_storage_path());
+
+  CollectDataCB cb;
+  ASSERT_EQ(
+      read_op->iterate(ndp.get(), 0, expected.size() - 1, &cb, null_yield),
+      expected.size()
+  );
+  EXPECT_EQ(cb.data.to_str(), expected);
+}
+
+TEST_F(TestSFSObjectRead, read_in_coroutines) {
+  // more than one 10MB chunk each
+  const auto expected_a = createObject("a", 12 * 1024 * 1024 + 1);
+  const auto expected_b = createObject("b", 11 * 1024 * 1024 + 3);
+  ASSERT_NE(store->data_read_queue, nullptr);
+
+  // both requests share the thread of the frontend, each yields while
+  // its data is read on the read threads
+  boost::asio::io_context context;
+  CollectDataCB cb_a;
+  CollectDataCB cb_b;
+  bufferlist bl;
+  auto read_object = [&](const std::string& name, const std::string& expected,
+                         CollectDataCB& cb) {
+    spawn::spawn(context, [&, name](yield_context yield) {
+      optional_yield y(context, yield);
+      auto object = getObject(name);
+      auto read_op = object->get_read_op();
+      ASSERT_EQ(read_op->prepare(y, ndp.get()), 0);
+      ASSERT_EQ(
+          read_op->iterate(ndp.get(), 0, expected.size() - 1, &cb, y),
+          expected.size()
+      );
+    });
+  };
+  read_object("a", expected_a, cb_a);
+  read_object("b", expected_b, cb_b);
+  spawn::spawn(context, [&](yield_context yield) {
+    auto object = getObject("a");
+    auto read_op = object->get_read_op();
+    optional_yield y(context, yield);
+    ASSERT_EQ(read_op->prepare(y, ndp.get()), 0);
+    ASSERT_EQ(read_op->read(100, 199, bl, y, ndp.get()), 100);
+  });
+  context.run();
+
+  EXPECT_EQ(cb_a.data.to_str(), expected_a);
+  EXPECT_EQ(cb_b.data.to_str(), expected_b);
+  EXPECT_EQ(cb_a.calls, 2u);
+  // the data is handed over on the thread of the request
+  EXPECT_EQ(cb_a.thread, std::this_thread::get_id());
+  EXPECT_EQ(cb_b.thread, std::this_thread::get_id());
+  EXPECT_EQ(bl.to_str(), expected_a.substr(100, 100));
+}
+
+TEST_F(TestSFSObjectRead, read_on_request_thread_without_read_threads) {
+  stopStore();
+  cct->_conf.set_val("rgw_sfs_read_threads", "0");
+  startStore();
+  ASSERT_EQ(store->data_read_queue, nullptr);
+
+  const auto expected = createObject("object", 64 * 1024);
+  boost::asio::io_context context;
+  CollectDataCB cb;
+  spawn::spawn(context, [&](yield_context yield) {
+    optional_yield y(context, yield);
+    auto object = getObject("object");
+    auto read_op = object->get_read_op();
+    ASSERT_EQ(read_op->prepare(y, ndp.get()), 0);
+    ASSERT_EQ(
+        read_op->iterate(ndp.get(), 0, expected.size() - 1, &cb, y),
+        expected.size()
+    );
+  });
+  context.run();
+  EXPECT_EQ(cb.data.to_str(), expected);
+}
+
+TEST_F(TestSFSObjectRead, prepare_fails_without_data_file) {
+  createObject("missing", 100);
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  auto objref = bucketref->get(rgw_obj_key("missing"));
+  fs::remove(data_path / objref->get_storage_path());
+
+  auto object = getObject("missing");
+  auto read_op = object->get_read_op();
+  EXPECT_EQ(read_op->prepare(null_yield, ndp.get()), -ENOENT);
+}
+
+TEST_F(TestSFSObjectRead, read_segmented_object) {
+  const auto expected =
+      createSegmentedObject("segmented", {5000, 1, 4096, 12345});
+  checkIterate("segmented", expected);
+
+  // every single byte maps to the right segment
+  auto object = getObject("segmented");
+  auto read_op = object->get_read_op();
+  ASSERT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+  for (const size_t ofs : {0, 4999, 5000, 5001, 9096, 9097, 21441}) {
+    bufferlist bl;
+    ASSERT_EQ(read_op->read(ofs, ofs, bl, null_yield, ndp.get()), 1);
+    EXPECT_EQ(bl.to_str(), expected.substr(ofs, 1)) << "offset " << ofs;
+  }
+}
+
+TEST_F(TestSFSObjectRead, read_segmented_object_with_mmap) {
+  cct->_conf.set_val("rgw_sfs_read_mmap_threshold", "4096");
+  const auto expected = createSegmentedObject(
+      "segmented", {5 * 1024 * 1024, 5 * 1024 * 1024 + 7, 1024 * 1024}
+  );
+  checkIterate("segmented", expected);
+  EXPECT_GT(perfcounter->get(l_rgw_sfs_read_mmap_bytes), 0);
+}
+
+TEST_F(TestSFSObjectRead, prepare_fails_without_segment_files) {
+  createSegmentedObject("missing", {100, 100});
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  auto objref = bucketref->get(rgw_obj_key("missing"));
+  fs::remove_all(data_path / objref->get_parts_storage_path());
+
+  auto object = getObject("missing");
+  auto read_op = object->get_read_op();
+  EXPECT_EQ(read_op->prepare(null_yield, ndp.get()), -ENOENT);
+}
+
+TEST_F(TestSFSObjectRead, delete_data_removes_segment_files) {
+  createSegmentedObject("deleted", {100, 100});
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  auto objref = bucketref->get(rgw_obj_key("deleted"));
+  const auto parts_path = data_path / objref->get_parts_storage_path();
+  ASSERT_TRUE(fs::exists(parts_path / "0.p"));
+  ASSERT_TRUE(fs::exists(parts_path / "1.p"));
+
+  rgw::sal::sfs::Object::delete_version_data(
+      store.get(), objref->path.get_uuid(), objref->version_id
+  );
+  EXPECT_FALSE(fs::exists(parts_path));
+}
@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "common/random_string.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
+#include "rgw/driver/sfs/sqlite/sqlite_list.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw_perf_counters.h"
+
+/*
+  Checks statements reused from the per-connection prepared statement
+  cache, and measures the per operation latency of the hot metadata
+  queries with and without it.
+*/
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+const static std::string TEST_USERNAME = "test_user";
+const static std::string TEST_BUCKET = "test_bucket";
+const static std::string TEST_ACCESS_KEY = "test_access_key";
+
+class TestSFSPreparedStatements : public ::testing::TestWithParam<bool> {
+ protected:
+  const std::unique_ptr<CephContext> cct;
+  const fs::path database_directory;
+  DBConnRef conn;
+
+  TestSFSPreparedStatements()
+      : cct(new CephContext(CEPH_ENTITY_TYPE_ANY)),
+        database_directory(create_database_directory()) {
+    cct->_conf.set_val("rgw_sfs_data_path", database_directory);
+    cct->_conf.set_val(
+        "rgw_sfs_sqlite_prepared_statements", GetParam() ? "true" : "false"
+    );
+    // measure the database, not the caches in front of it
+    cct->_conf.set_val("rgw_sfs_user_cache_size", "0");
+    cct->_log->start();
+    rgw_perf_start(cct.get());
+  }
+
+  void SetUp() override {
+    ASSERT_TRUE(fs::exists(database_directory)) << database_directory;
+    conn = std::make_shared<DBConn>(cct.get());
+
+    SQLiteUsers users(conn);
+    DBOPUserInfo user;
+    user.uinfo.user_id.id = TEST_USERNAME;
+    user.uinfo.access_keys[TEST_ACCESS_KEY] =
+        RGWAccessKey(TEST_ACCESS_KEY, "secret");
+    users.store_user(user);
+
+    SQLiteBuckets buckets(conn);
+    DBOPBucketInfo bucket;
+    bucket.binfo.bucket.name = TEST_BUCKET;
+    bucket.binfo.bucket.bucket_id = TEST_BUCKET;
+    bucket.binfo.owner.id = TEST_USERNAME;
+    bucket.deleted = false;
+    buckets.store_bucket(bucket);
+  }
+
+  void TearDown() override {
+    conn.reset();
+    fs::remove_all(database_directory);
+  }
+
+  fs::path create_database_directory() const {
+    const std::string rand = gen_rand_alphanumeric(cct.get(), 23);
+    const auto result{fs::temp_directory_path() / rand};
+    fs::create_directory(result);
+    return result;
+  }
+
+  DBVersionedObject commit_version(
+      const std::string& name, const std::string& etag
+  ) {
+    SQLiteVersionedObjects versions(conn);
+    auto version = versions.create_new_versioned_object_transact(
+        TEST_BUCKET, name, name + "_" + etag
+    );
+    EXPECT_TRUE(version.has_value());
+    version->object_state = ObjectState::COMMITTED;
+    version->commit_time = ceph::real_clock::now();
+    version->etag = etag;
+    EXPECT_TRUE(
+        versions.store_versioned_object_if_state(*version, {ObjectState::OPEN})
+    );
+    return *version;
+  }
+
+  std::string committed_etag(const std::string& name) {
+    SQLiteVersionedObjects versions(conn);
+    auto version =
+        versions.get_committed_versioned_object(TEST_BUCKET, name, "");
+    return version.has_value() ? version->etag : "";
+  }
+
+  /// Runs `op` `count` times and returns its average latency in us
+  static double measure(size_t count, const std::function<void(size_t)>& op) {
+    const auto start = ceph::mono_clock::now();
+    for (size_t i = 0; i < count; i++) {
+      op(i);
+    }
+    const auto elapsed = ceph::mono_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / count;
+  }
+};
+
+TEST_P(TestSFSPreparedStatements, results_follow_the_bound_values) {
+  commit_version("obj1", "etag1");
+  commit_version("obj2", "etag2");
+
+  const auto hits = perfcounter->get(l_rgw_sfs_sqlite_stmt_cache_hit);
+  EXPECT_EQ(committed_etag("obj1"), "etag1");
+  EXPECT_EQ(committed_etag("obj2"), "etag2");
+  EXPECT_EQ(committed_etag("obj1"), "etag1");
+  EXPECT_EQ(committed_etag("missing"), "");
+  if (GetParam()) {
+    EXPECT_GT(perfcounter->get(l_rgw_sfs_sqlite_stmt_cache_hit), hits);
+  } else {
+    EXPECT_EQ(perfcounter->get(l_rgw_sfs_sqlite_stmt_cache_hit), hits);
+  }
+
+  SQLiteUsers users(conn);
+  for (int i = 0; i < 2; i++) {
+    auto user = users.get_user_by_access_key(TEST_ACCESS_KEY);
+    ASSERT_TRUE(user.has_value());
+    EXPECT_EQ(user->uinfo.user_id.id, TEST_USERNAME);
+    EXPECT_FALSE(users.get_user_by_access_key("missing").has_value());
+  }
+}
+
+TEST_P(TestSFSPreparedStatements, reused_statements_see_later_commits) {
+  commit_version("obj", "etag1");
+  EXPECT_EQ(committed_etag("obj"), "etag1");
+
+  // committed on the writer connection: the statements of this thread's
+  // connection must not hold on to the snapshot they last read
+  for (const auto& etag : {"etag2", "etag3"}) {
+    commit_version("obj", etag);
+    EXPECT_EQ(committed_etag("obj"), etag);
+  }
+}
+
+TEST_P(TestSFSPreparedStatements, performance_hot_queries) {
+  const size_t num_objects = 2000;
+  const size_t num_lookups = 20000;
+  const size_t page_size = 100;
+
+  const double create_us = measure(num_objects, [&](size_t i) {
+    commit_version(fmt::format("obj{:06}", i), "etag");
+  });
+
+  SQLiteVersionedObjects versions(conn);
+  const double get_us = measure(num_lookups, [&](size_t i) {
+    const auto name = fmt::format("obj{:06}", i % num_objects);
+    ASSERT_TRUE(
+        versions.get_committed_versioned_object(TEST_BUCKET, name, "")
+            .has_value()
+    );
+  });
+
+  SQLiteList list(conn);
+  const double list_us = measure(num_lookups / page_size, [&](size_t i) {
+    std::vector<rgw_bucket_dir_entry> entries;
+    const auto start_after =
+        fmt::format("obj{:06}", (i * page_size) % num_objects);
+    ASSERT_TRUE(list.objects(TEST_BUCKET, "", start_after, page_size, entries)
+    );
+  });
+
+  SQLiteUsers users(conn);
+  const double user_us = measure(num_lookups, [&](size_t) {
+    ASSERT_TRUE(users.get_user_by_access_key(TEST_ACCESS_KEY).has_value());
+  });
+
+  lderr(cct.get()) << fmt::format(
+                          "prepared statements {}: create+commit {:.1f}us, "
+                          "get committed version {:.1f}us, list page of {} "
+                          "{:.1f}us, user by access key {:.1f}us",
+                          GetParam() ? "on" : "off", create_us, get_us,
+                          page_size, list_us, user_us
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    PreparedStatements, TestSFSPreparedStatements, testing::Bool(),
+    [](const testing::TestParamInfo<TestSFSPreparedStatements::ParamType>& info
+    ) { return info.param ? "prepared" : "unprepared"; }
+);
@@ -0,0 +1,355 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/object.h"
+#include "rgw/driver/sfs/segment_packer.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/driver/sfs/types.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSSegmentPacker : public SFSStoreFixture {
+ protected:
+  static bufferlist make_data(size_t size, char seed) {
+    bufferlist bl;
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>('a' + (i + seed) % 26);
+    }
+    bl.append(data);
+    return bl;
+  }
+
+  static std::string read_file(const fs::path& path) {
+    std::ifstream ifs(path, std::ifstream::binary);
+    return {std::istreambuf_iterator<char>(ifs), {}};
+  }
+
+  // creates a committed object packed in `packer`, as SFSAtomicWriter
+  // does for small objects, and returns its version
+  ObjectRef create_packed_object(
+      SegmentPacker& packer, const std::string& name, const bufferlist& data
+  ) {
+    auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+    uint64_t segment_id;
+    uint64_t segment_offset;
+    EXPECT_EQ(packer.append(data, &segment_id, &segment_offset), 0);
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    db_versions.store_packed_object(
+        {.versioned_object_id = objref->version_id,
+         .segment_id = segment_id,
+         .segment_offset = segment_offset,
+         .size = data.length()}
+    );
+    packer.release(segment_id);
+
+    auto meta = objref->get_meta();
+    meta.size = data.length();
+    objref->update_meta(meta);
+    objref->metadata_finish(store.get(), false);
+    return objref;
+  }
+
+  std::string read_object(const std::string& name) {
+    auto object = bucket->get_object(rgw_obj_key(name));
+    auto read_op = object->get_read_op();
+    EXPECT_EQ(read_op->prepare(null_yield, ndp.get()), 0);
+    CollectDataCB cb;
+    const auto size = object->get_obj_size();
+    EXPECT_EQ(read_op->iterate(ndp.get(), 0, size - 1, &cb, null_yield), size);
+    return cb.data.to_str();
+  }
+
+  size_t count_segments() const {
+    return std::distance(
+        fs::directory_iterator(data_path / "segments"),
+        fs::directory_iterator{}
+    );
+  }
+};
+
+TEST_F(TestSFSSegmentPacker, appends_to_one_segment) {
+  SegmentPacker packer(data_path, 1024 * 1024);
+  std::string expected;
+  uint64_t first_segment = 0;
+  for (int i = 0; i < 10; i++) {
+    const auto data = make_data(100 + i, i);
+    uint64_t segment_id;
+    uint64_t segment_offset;
+    ASSERT_EQ(packer.append(data, &segment_id, &segment_offset), 0);
+    if (i == 0) {
+      first_segment = segment_id;
+    }
+    EXPECT_EQ(segment_id, first_segment);
+    EXPECT_EQ(segment_offset, expected.size());
+    expected += data.to_str();
+    packer.release(segment_id);
+  }
+  EXPECT_EQ(read_file(packer.get_segment_path(first_segment)), expected);
+}
+
+TEST_F(TestSFSSegmentPacker, starts_a_new_segment_when_full) {
+  SegmentPacker packer(data_path, 1000);
+  uint64_t segment_id;
+  uint64_t segment_offset;
+  ASSERT_EQ(packer.append(make_data(600, 0), &segment_id, &segment_offset), 0);
+  const auto first_segment = segment_id;
+  packer.release(segment_id);
+
+  ASSERT_EQ(packer.append(make_data(600, 1), &segment_id, &segment_offset), 0);
+  EXPECT_GT(segment_id, first_segment);
+  EXPECT_EQ(segment_offset, 0);
+  packer.release(segment_id);
+
+  // objects larger than a segment still get one of their own
+  ASSERT_EQ(packer.append(make_data(2000, 2), &segment_id, &segment_offset), 0);
+  EXPECT_EQ(segment_offset, 0);
+  packer.release(segment_id);
+
+  // segments are never appended to again after a restart
+  SegmentPacker restarted(data_path, 1000);
+  const auto last_segment = segment_id;
+  ASSERT_EQ(
+      restarted.append(make_data(1, 3), &segment_id, &segment_offset), 0
+  );
+  EXPECT_GT(segment_id, last_segment);
+  restarted.release(segment_id);
+}
+
+TEST_F(TestSFSSegmentPacker, read_packed_objects) {
+  auto& packer = *store->packer;
+  const auto a = make_data(1000, 0);
+  const auto b = make_data(1, 1);
+  const auto c = make_data(64 * 1024, 2);
+  auto objref = create_packed_object(packer, "a", a);
+  create_packed_object(packer, "b", b);
+  create_packed_object(packer, "c", c);
+
+  EXPECT_EQ(read_object("a"), a.to_str());
+  EXPECT_EQ(read_object("b"), b.to_str());
+  EXPECT_EQ(read_object("c"), c.to_str());
+  // there is no file of their own
+  EXPECT_FALSE(fs::exists(data_path / objref->get_storage_path()));
+}
+
+TEST_F(TestSFSSegmentPacker, removes_unused_segments) {
+  SegmentPacker packer(data_path, 1000);
+  std::vector<ObjectRef> objs;
+  for (int i = 0; i < 4; i++) {
+    objs.push_back(
+        create_packed_object(packer, fmt::format("obj{}", i), make_data(500, i))
+    );
+  }
+  ASSERT_EQ(count_segments(), 2);
+
+  // the first segment holds obj0 and obj1
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  const auto first =
+      db_versions.get_packed_object(objs[0]->version_id)->segment_id;
+  db_versions.remove_versioned_object(objs[0]->version_id);
+  db_versions.remove_versioned_object(objs[1]->version_id);
+  EXPECT_FALSE(db_versions.get_packed_object(objs[0]->version_id).has_value());
+
+  const auto stats = packer.compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.segments, 1);
+  EXPECT_EQ(stats.bytes, 1000);
+  EXPECT_EQ(stats.moved_objects, 0);
+  EXPECT_FALSE(fs::exists(packer.get_segment_path(first)));
+  // the active segment is never removed
+  EXPECT_EQ(count_segments(), 1);
+  EXPECT_EQ(read_object("obj3"), make_data(500, 3).to_str());
+}
+
+TEST_F(TestSFSSegmentPacker, compacts_segments_full_of_garbage) {
+  SegmentPacker packer(data_path, 10000);
+  std::vector<ObjectRef> objs;
+  for (int i = 0; i < 10; i++) {
+    objs.push_back(
+        create_packed_object(packer, fmt::format("obj{}", i), make_data(1000, i))
+    );
+  }
+  // seal the segment
+  create_packed_object(packer, "next", make_data(1000, 10));
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  const auto first =
+      db_versions.get_packed_object(objs[0]->version_id)->segment_id;
+
+  // 40% garbage is not enough
+  for (int i = 0; i < 4; i++) {
+    db_versions.remove_versioned_object(objs[i]->version_id);
+  }
+  auto stats = packer.compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.segments, 0);
+  EXPECT_TRUE(fs::exists(packer.get_segment_path(first)));
+
+  for (int i = 4; i < 8; i++) {
+    db_versions.remove_versioned_object(objs[i]->version_id);
+  }
+  stats = packer.compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.segments, 1);
+  EXPECT_EQ(stats.moved_objects, 2);
+  EXPECT_EQ(stats.moved_bytes, 2000);
+  EXPECT_FALSE(fs::exists(packer.get_segment_path(first)));
+  EXPECT_NE(
+      db_versions.get_packed_object(objs[8]->version_id)->segment_id, first
+  );
+
+  const auto segments = db_versions.get_packed_segments();
+  ASSERT_EQ(segments.size(), 1);
+  EXPECT_EQ(segments[0].live_count, 3);
+  EXPECT_EQ(segments[0].live_size, 3000);
+}
+
+TEST_F(TestSFSSegmentPacker, relocated_objects_stay_readable) {
+  auto& packer = *store->packer;
+  std::vector<ObjectRef> objs;
+  for (int i = 0; i < 10; i++) {
+    objs.push_back(
+        create_packed_object(packer, fmt::format("obj{}", i), make_data(100, i))
+    );
+  }
+  // a restart seals the segment
+  store->packer = std::make_unique<SegmentPacker>(data_path, 64 * 1024 * 1024);
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  for (int i = 1; i < 10; i++) {
+    db_versions.remove_versioned_object(objs[i]->version_id);
+  }
+  const auto stats =
+      store->packer->compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.moved_objects, 1);
+  EXPECT_EQ(read_object("obj0"), make_data(100, 0).to_str());
+}
+
+TEST_F(TestSFSSegmentPacker, segments_with_pending_appends_are_kept) {
+  SegmentPacker packer(data_path, 100);
+  uint64_t segment_id;
+  uint64_t segment_offset;
+  // appended, but its location is not committed yet
+  ASSERT_EQ(packer.append(make_data(100, 0), &segment_id, &segment_offset), 0);
+  const auto pending_segment = segment_id;
+  create_packed_object(packer, "next", make_data(100, 1));
+
+  auto stats = packer.compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.segments, 0);
+  EXPECT_TRUE(fs::exists(packer.get_segment_path(pending_segment)));
+
+  // abandoned: it's garbage now
+  packer.release(pending_segment);
+  stats = packer.compact(store->db_conn, 0.5, []() { return false; });
+  EXPECT_EQ(stats.segments, 1);
+  EXPECT_FALSE(fs::exists(packer.get_segment_path(pending_segment)));
+}
+
+/*
+  Measures storing small objects' data durably. "packed" appends them to
+  a segment file, "file_per_object" creates, writes, syncs and closes a
+  file per object the way SFSAtomicWriter does for larger objects. Both
+  record where the data is in the database.
+*/
+
+enum class SmallObjectLayout { PACKED, FILE_PER_OBJECT };
+
+class TestSFSSegmentPackerPerf
+    : public TestSFSSegmentPacker,
+      public ::testing::WithParamInterface<SmallObjectLayout> {};
+
+TEST_P(TestSFSSegmentPackerPerf, store_small_objects) {
+  const size_t num_threads = 8;
+  const size_t objects_per_thread = 250;
+  const size_t object_size = 4096;
+  const auto data = make_data(object_size, 0);
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+
+  std::vector<std::vector<ObjectRef>> objrefs(num_threads);
+  for (size_t t = 0; t < num_threads; t++) {
+    for (size_t i = 0; i < objects_per_thread; i++) {
+      objrefs[t].push_back(
+          bucketref->create_version(rgw_obj_key(fmt::format("{}_{}", t, i)))
+      );
+    }
+  }
+
+  const auto start = ceph::mono_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      SQLiteVersionedObjects db_versions(store->db_conn);
+      for (const auto& objref : objrefs[t]) {
+        if (GetParam() == SmallObjectLayout::PACKED) {
+          uint64_t segment_id;
+          uint64_t segment_offset;
+          ASSERT_EQ(
+              store->packer->append(data, &segment_id, &segment_offset), 0
+          );
+          db_versions.store_packed_object(
+              {.versioned_object_id = objref->version_id,
+               .segment_id = segment_id,
+               .segment_offset = segment_offset,
+               .size = data.length()}
+          );
+          store->packer->release(segment_id);
+        } else {
+          const auto path = data_path / objref->get_storage_path();
+          const int fd = open_data_file(
+              path, O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY, 0644
+          );
+          ASSERT_GE(fd, 0);
+          ASSERT_EQ(data.write_fd(fd, 0), 0);
+          ::fsync(fd);
+          ::close(fd);
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      ceph::mono_clock::now() - start;
+
+  const size_t total = num_threads * objects_per_thread;
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} objects of {} bytes from {} threads in "
+                          "{:.3f}s: {:.0f} objects/s",
+                          GetParam() == SmallObjectLayout::PACKED
+                              ? "packed"
+                              : "file_per_object",
+                          total, object_size, num_threads, elapsed.count(),
+                          total / elapsed.count()
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    SmallObjects, TestSFSSegmentPackerPerf,
+    testing::Values(SmallObjectLayout::PACKED, SmallObjectLayout::FILE_PER_OBJECT),
+    [](const testing::TestParamInfo<TestSFSSegmentPackerPerf::ParamType>& info
+    ) {
+      return info.param == SmallObjectLayout::PACKED ? "packed"
+                                                     : "file_per_object";
+    }
+);
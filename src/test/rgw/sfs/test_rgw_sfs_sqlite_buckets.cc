@@ -191,23 +191,22 @@ void createDBBucketBasic(
     const std::string& user, const std::string& name,
     const std::string& bucket_id, const std::shared_ptr<DBConn>& conn
 ) {
-  auto storage = conn->get_storage();
   DBBucket db_bucket;
   db_bucket.bucket_name = name;
   db_bucket.bucket_id = bucket_id;
   db_bucket.owner_id = user;
   db_bucket.deleted = false;
-  storage.replace(db_bucket);
+  conn->run_on_writer([&](Storage& storage) { storage.replace(db_bucket); });
 }
 
 void deleteDBBucketBasic(
     const std::string& bucket_id, const std::shared_ptr<DBConn>& conn
 ) {
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
   auto bucket = storage.get_pointer<DBBucket>(bucket_id);
   ASSERT_TRUE(bucket != nullptr);
   bucket->deleted = true;
-  storage.replace(*bucket);
+  conn->run_on_writer([&](Storage& writer) { writer.replace(*bucket); });
 }
 
 TEST_F(TestSFSSQLiteBuckets, CreateAndGet) {
@@ -490,7 +489,7 @@ TEST_F(TestSFSSQLiteBuckets, UseStorage) {
   createUser("usertest", conn);
 
   SQLiteBuckets db_buckets(conn);
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
 
   DBBucket db_bucket;
   db_bucket.bucket_name = "test_storage";
@@ -498,7 +497,7 @@ TEST_F(TestSFSSQLiteBuckets, UseStorage) {
   db_bucket.bucket_id = "test_storage_id";
 
   // we have to use replace because the primary key of rgw_bucket is a string
-  storage.replace(db_bucket);
+  conn->run_on_writer([&](Storage& writer) { writer.replace(db_bucket); });
 
   auto bucket = storage.get_pointer<DBBucket>("test_storage_id");
 
@@ -518,7 +517,7 @@ TEST_F(TestSFSSQLiteBuckets, UseStorage) {
   auto db_bucket_2 = get_db_bucket(rgw_bucket_2);
 
   // we have to use replace because the primary key of rgw_bucket is a string
-  storage.replace(db_bucket_2);
+  conn->run_on_writer([&](Storage& writer) { writer.replace(db_bucket_2); });
 
   // now use the SqliteBuckets method, so user is already converted
   auto ret_bucket = db_buckets.get_bucket("BucketID1");
@@ -536,7 +535,6 @@ TEST_F(TestSFSSQLiteBuckets, CreateBucketForNonExistingUser) {
   createUser("usertest", conn);
 
   SQLiteBuckets db_buckets(conn);
-  auto storage = conn->get_storage();
 
   DBBucket db_bucket;
   db_bucket.bucket_name = "test_storage";
@@ -545,8 +543,9 @@ TEST_F(TestSFSSQLiteBuckets, CreateBucketForNonExistingUser) {
   EXPECT_THROW(
       {
         try {
-          storage.replace(db_bucket);
-          ;
+          conn->run_on_writer([&](Storage& writer) {
+            writer.replace(db_bucket);
+          });
         } catch (const std::system_error& e) {
           EXPECT_STREQ(
               "FOREIGN KEY constraint failed: constraint failed", e.what()
@@ -568,7 +567,6 @@ TEST_F(TestSFSSQLiteBuckets, CreateBucketOwnerNotSet) {
   createUser("usertest", conn);
 
   SQLiteBuckets db_buckets(conn);
-  auto storage = conn->get_storage();
 
   DBBucket db_bucket;
   db_bucket.bucket_name = "test_storage";
@@ -576,7 +574,9 @@ TEST_F(TestSFSSQLiteBuckets, CreateBucketOwnerNotSet) {
   EXPECT_THROW(
       {
         try {
-          storage.replace(db_bucket);
+          conn->run_on_writer([&](Storage& writer) {
+            writer.replace(db_bucket);
+          });
         } catch (const std::system_error& e) {
           EXPECT_STREQ(
               "FOREIGN KEY constraint failed: constraint failed", e.what()
@@ -0,0 +1,387 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
+#include <future>
+#include <latch>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+const static std::string TEST_DIR = "rgw_sfs_tests";
+
+class TestSFSSQLiteDBConn : public ::testing::Test {
+ protected:
+  std::unique_ptr<CephContext> cct;
+  DBConnRef conn;
+
+  void SetUp() override {
+    fs::current_path(fs::temp_directory_path());
+    fs::create_directory(TEST_DIR);
+    cct.reset(new CephContext(CEPH_ENTITY_TYPE_ANY));
+    cct->_conf.set_val("rgw_sfs_data_path", getTestDir());
+    conn = std::make_shared<DBConn>(cct.get());
+  }
+
+  void TearDown() override {
+    conn.reset();
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(TEST_DIR);
+  }
+
+  std::string getTestDir() const {
+    auto test_dir = fs::temp_directory_path() / TEST_DIR;
+    return test_dir.string();
+  }
+
+  // off by default
+  void enableGroupCommit() {
+    conn.reset();
+    cct->_conf.set_val("rgw_sfs_sqlite_group_commit_window", "1");
+    conn = std::make_shared<DBConn>(cct.get());
+  }
+};
+
+TEST_F(TestSFSSQLiteDBConn, same_thread_gets_same_connection) {
+  auto& first = conn->get_storage();
+  auto& second = conn->get_storage();
+  EXPECT_EQ(&first, &second);
+  EXPECT_EQ(conn->storage_pool_size(), 1);
+}
+
+TEST_F(TestSFSSQLiteDBConn, each_thread_gets_its_own_connection) {
+  const size_t num_threads = 8;
+  std::vector<Storage*> storages(num_threads, nullptr);
+  std::vector<std::thread> threads;
+  // all of them hold their connection at once
+  std::latch holding(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      storages[i] = &conn->get_storage();
+      // the connection must be usable from the owning thread
+      storages[i]->count<DBUser>();
+      holding.arrive_and_wait();
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(conn->storage_pool_size(), num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    for (size_t j = i + 1; j < num_threads; ++j) {
+      EXPECT_NE(storages[i], storages[j]);
+    }
+  }
+}
+
+TEST_F(TestSFSSQLiteDBConn, exited_threads_give_back_their_connection) {
+  Storage* first = nullptr;
+  std::thread([&]() { first = &conn->get_storage(); }).join();
+  Storage* second = nullptr;
+  std::thread([&]() {
+    second = &conn->get_storage();
+    second->count<DBUser>();
+  }).join();
+  // the idle connection was handed to the new thread
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(conn->storage_pool_size(), 1);
+}
+
+TEST_F(TestSFSSQLiteDBConn, idle_connections_are_capped) {
+  conn.reset();
+  cct->_conf.set_val("rgw_sfs_sqlite_idle_connections", "2");
+  conn = std::make_shared<DBConn>(cct.get());
+
+  const size_t num_threads = 6;
+  std::latch holding(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      conn->get_storage().count<DBUser>();
+      holding.arrive_and_wait();
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // the others were closed as their threads exited
+  EXPECT_EQ(conn->storage_pool_size(), 2);
+}
+
+TEST_F(TestSFSSQLiteDBConn, open_connections_are_capped) {
+  conn.reset();
+  cct->_conf.set_val("rgw_sfs_sqlite_max_connections", "1");
+  conn = std::make_shared<DBConn>(cct.get());
+
+  std::promise<void> release;
+  std::promise<Storage*> held;
+  std::thread holder([&]() {
+    held.set_value(&conn->get_storage());
+    release.get_future().wait();
+  });
+  Storage* first = held.get_future().get();
+
+  auto waiter = std::async(std::launch::async, [&]() {
+    return &conn->get_storage();
+  });
+  // waits for the holder to exit
+  EXPECT_EQ(
+      waiter.wait_for(std::chrono::milliseconds(200)),
+      std::future_status::timeout
+  );
+  release.set_value();
+  holder.join();
+  EXPECT_EQ(waiter.get(), first);
+  EXPECT_EQ(conn->storage_pool_size(), 1);
+}
+
+TEST_F(TestSFSSQLiteDBConn, waiting_for_a_connection_times_out) {
+  conn.reset();
+  cct->_conf.set_val("rgw_sfs_sqlite_max_connections", "1");
+  cct->_conf.set_val("rgw_sfs_sqlite_connection_wait_timeout", "100");
+  conn = std::make_shared<DBConn>(cct.get());
+
+  std::promise<void> release;
+  std::promise<void> held;
+  std::thread holder([&]() {
+    conn->get_storage();
+    held.set_value();
+    release.get_future().wait();
+  });
+  held.get_future().wait();
+
+  auto waiter = std::async(std::launch::async, [&]() {
+    try {
+      conn->get_storage();
+    } catch (const std::system_error& e) {
+      return e.code().value();
+    }
+    return 0;
+  });
+  EXPECT_EQ(waiter.get(), EBUSY);
+  release.set_value();
+  holder.join();
+
+  // the connection of the exited holder is available again
+  std::thread([&]() { conn->get_storage().count<DBUser>(); }).join();
+  EXPECT_EQ(conn->storage_pool_size(), 1);
+}
+
+TEST_F(TestSFSSQLiteDBConn, more_threads_than_connections) {
+  conn.reset();
+  cct->_conf.set_val("rgw_sfs_sqlite_max_connections", "2");
+  conn = std::make_shared<DBConn>(cct.get());
+
+  const size_t num_threads = 16;
+  std::atomic<size_t> failed{0};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      try {
+        conn->get_storage().count<DBUser>();
+      } catch (const std::system_error&) {
+        failed++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // threads waited for the ones before them to exit
+  EXPECT_EQ(failed, 0);
+  EXPECT_LE(conn->storage_pool_size(), 2);
+}
+
+TEST_F(TestSFSSQLiteDBConn, pooled_connections_do_not_write) {
+  std::thread([&]() {
+    DBUser user;
+    user.user_id = "usertest";
+    auto& storage = conn->get_storage();
+    try {
+      storage.replace(user);
+      ADD_FAILURE() << "pooled connection wrote to the database";
+    } catch (const std::system_error& e) {
+      EXPECT_EQ(e.code().value() & 0xff, SQLITE_READONLY);
+    }
+    // the writer connection still can
+    conn->run_on_writer([&](Storage& writer) { writer.replace(user); });
+    EXPECT_EQ(storage.count<DBUser>(), 1);
+  }).join();
+}
+
+TEST_F(TestSFSSQLiteDBConn, connections_of_a_destroyed_dbconn_are_not_reused) {
+  auto& old_storage = conn->get_storage();
+  old_storage.count<DBUser>();
+  conn.reset();
+  conn = std::make_shared<DBConn>(cct.get());
+  auto& storage = conn->get_storage();
+  storage.count<DBUser>();
+  EXPECT_EQ(conn->storage_pool_size(), 1);
+}
+
+TEST_F(TestSFSSQLiteDBConn, writer_runs_on_its_own_thread) {
+  const auto caller = std::this_thread::get_id();
+  const auto writer = conn->run_on_writer([](Storage&) {
+    return std::this_thread::get_id();
+  });
+  EXPECT_NE(caller, writer);
+
+  // nested calls run inline instead of deadlocking on the queue
+  const auto nested = conn->run_on_writer([&](Storage&) {
+    return conn->run_on_writer([](Storage&) {
+      return std::this_thread::get_id();
+    });
+  });
+  EXPECT_EQ(writer, nested);
+
+  // running tasks on the writer thread must not create pooled connections
+  EXPECT_EQ(conn->storage_pool_size(), 0);
+}
+
+TEST_F(TestSFSSQLiteDBConn, writer_propagates_exceptions) {
+  EXPECT_THROW(
+      conn->run_on_writer([](Storage&) -> int {
+        throw std::runtime_error("expected");
+      }),
+      std::runtime_error
+  );
+  // the writer thread is still alive after a failed task
+  EXPECT_EQ(conn->run_on_writer([](Storage&) { return 42; }), 42);
+}
+
+TEST_F(TestSFSSQLiteDBConn, writer_changes_are_visible_to_readers) {
+  conn->run_on_writer([](Storage& storage) {
+    DBUser user;
+    user.user_id = "usertest";
+    storage.replace(user);
+  });
+
+  std::thread reader([&]() {
+    auto& storage = conn->get_storage();
+    EXPECT_EQ(storage.count<DBUser>(), 1);
+  });
+  reader.join();
+
+  auto& storage = conn->get_storage();
+  auto user = storage.get_pointer<DBUser>("usertest");
+  ASSERT_NE(user, nullptr);
+}
+
+TEST_F(TestSFSSQLiteDBConn, concurrent_writers_are_serialized) {
+  const size_t num_threads = 16;
+  const size_t num_tasks = 100;
+  std::atomic<int> in_writer{0};
+  std::atomic<bool> overlapped{false};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      for (size_t j = 0; j < num_tasks; ++j) {
+        conn->run_on_writer([&](Storage&) {
+          if (in_writer.fetch_add(1) != 0) {
+            overlapped = true;
+          }
+          in_writer.fetch_sub(1);
+        });
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_FALSE(overlapped);
+}
+
+TEST_F(TestSFSSQLiteDBConn, batched_tasks_are_committed) {
+  enableGroupCommit();
+  const size_t num_threads = 16;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      const auto user_id = conn->run_batched([i](Storage& storage) {
+        DBUser user;
+        user.user_id = "user" + std::to_string(i);
+        storage.replace(user);
+        return user.user_id;
+      });
+      // the change is committed once run_batched returns
+      auto& storage = conn->get_storage();
+      EXPECT_NE(storage.get_pointer<DBUser>(user_id), nullptr);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(conn->get_storage().count<DBUser>(), num_threads);
+}
+
+TEST_F(TestSFSSQLiteDBConn, failed_batched_task_only_rolls_back_itself) {
+  enableGroupCommit();
+  std::vector<std::thread> threads;
+  std::atomic<int> failed{0};
+  for (size_t i = 0; i < 8; ++i) {
+    threads.emplace_back([&, i]() {
+      try {
+        conn->run_batched([i](Storage& storage) {
+          DBUser user;
+          user.user_id = "user" + std::to_string(i);
+          storage.replace(user);
+          if (i % 2 == 1) {
+            throw std::runtime_error("expected");
+          }
+        });
+      } catch (const std::runtime_error&) {
+        failed++;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(failed, 4);
+  auto& storage = conn->get_storage();
+  EXPECT_EQ(storage.count<DBUser>(), 4);
+  for (size_t i = 0; i < 8; ++i) {
+    auto user = storage.get_pointer<DBUser>("user" + std::to_string(i));
+    if (i % 2 == 1) {
+      EXPECT_EQ(user, nullptr);
+    } else {
+      EXPECT_NE(user, nullptr);
+    }
+  }
+}
+
+TEST_F(TestSFSSQLiteDBConn, batched_tasks_without_group_commit) {
+  conn.reset();
+  cct->_conf.set_val("rgw_sfs_sqlite_group_commit_window", "0");
+  conn = std::make_shared<DBConn>(cct.get());
+
+  EXPECT_THROW(
+      conn->run_batched([](Storage& storage) {
+        DBUser user;
+        user.user_id = "rolledback";
+        storage.replace(user);
+        throw std::runtime_error("expected");
+      }),
+      std::runtime_error
+  );
+  conn->run_batched([](Storage& storage) {
+    DBUser user;
+    user.user_id = "committed";
+    storage.replace(user);
+  });
+
+  auto& storage = conn->get_storage();
+  EXPECT_EQ(storage.get_pointer<DBUser>("rolledback"), nullptr);
+  EXPECT_NE(storage.get_pointer<DBUser>("committed"), nullptr);
+}
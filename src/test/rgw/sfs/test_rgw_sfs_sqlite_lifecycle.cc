@@ -1,16 +1,26 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <fmt/format.h>
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <random>
+#include <vector>
 
 #include "common/ceph_context.h"
+#include "common/ceph_time.h"
 #include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
 #include "rgw/driver/sfs/sqlite/sqlite_lifecycle.h"
+#include "rgw/driver/sfs/sqlite/sqlite_multipart.h"
+#include "rgw/driver/sfs/sqlite/sqlite_objects.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
 #include "rgw/rgw_sal_sfs.h"
+#include "test/rgw/sfs/rgw_sfs_utils.h"
 
 using namespace rgw::sal::sfs::sqlite;
 
@@ -279,3 +289,275 @@ TEST_F(TestSFSSQLiteLifecycle, ListEntries) {
   ASSERT_EQ(entries[0].start_time, 4444);
   ASSERT_EQ(entries[0].status, 4);
 }
+
+TEST_F(TestSFSSQLiteLifecycle, StoreEntryKeepsCounts) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_log->start();
+
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+  auto db_lc = std::make_shared<SQLiteLifecycle>(conn);
+
+  DBOPLCEntry db_entry{LC_SHARD, "bucket_1", 1111, 1};
+  db_lc->store_entry(db_entry);
+
+  DBOPLCEntry counts{"", "bucket_1", 0, 0, 1, 2, 3, 4};
+  db_lc->store_entry_counts(counts);
+
+  // RGWLC updates the status of an entry once it processed its bucket
+  db_entry.start_time = 2222;
+  db_entry.status = 2;
+  db_lc->store_entry(db_entry);
+
+  auto db_entry_found = db_lc->get_entry(LC_SHARD, "bucket_1");
+  ASSERT_TRUE(db_entry_found.has_value());
+  ASSERT_EQ(db_entry_found->start_time, 2222);
+  ASSERT_EQ(db_entry_found->status, 2);
+  ASSERT_EQ(db_entry_found->expired_current, 1);
+  ASSERT_EQ(db_entry_found->expired_noncurrent, 2);
+  ASSERT_EQ(db_entry_found->expired_delete_markers, 3);
+  ASSERT_EQ(db_entry_found->aborted_multiparts, 4);
+}
+
+class TestSFSSQLiteLifecycleExpiration : public TestSFSSQLiteLifecycle {
+ protected:
+  const std::string bucket_id = "testbucket";
+  std::shared_ptr<CephContext> ceph_context;
+  DBConnRef conn;
+  std::shared_ptr<SQLiteLifecycle> db_lc;
+  const ceph::real_time now = ceph::real_clock::now();
+
+  void SetUp() override {
+    TestSFSSQLiteLifecycle::SetUp();
+    ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+    ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+    ceph_context->_log->start();
+    conn = std::make_shared<DBConn>(ceph_context.get());
+    db_lc = std::make_shared<SQLiteLifecycle>(conn);
+
+    SQLiteUsers users(conn);
+    DBOPUserInfo user;
+    user.uinfo.user_id.id = "testuser";
+    users.store_user(user);
+
+    SQLiteBuckets db_buckets(conn);
+    DBOPBucketInfo db_binfo;
+    db_binfo.binfo.bucket = rgw_bucket("", bucket_id, bucket_id);
+    db_binfo.binfo.owner = rgw_user("testuser");
+    db_binfo.deleted = false;
+    db_buckets.store_bucket(db_binfo);
+  }
+
+  void TearDown() override {
+    db_lc.reset();
+    conn.reset();
+    TestSFSSQLiteLifecycle::TearDown();
+  }
+
+  static ceph::real_time days_ago(int days) {
+    return ceph::real_clock::now() - std::chrono::hours(24 * days);
+  }
+
+  // adds object `name` with one committed version per mtime, oldest first
+  std::vector<uint> add_object(
+      const std::string& name, const std::vector<ceph::real_time>& mtimes,
+      rgw::sal::sfs::VersionType last_type =
+          rgw::sal::sfs::VersionType::REGULAR
+  ) const {
+    const auto obj = create_test_object(bucket_id, name);
+    SQLiteObjects objects(conn);
+    objects.store_object(obj);
+    SQLiteVersionedObjects versions(conn);
+    std::vector<uint> ids;
+    for (size_t i = 0; i < mtimes.size(); i++) {
+      auto version = create_test_versionedobject(
+          obj.uuid, fmt::format("{}_v{}", name, i)
+      );
+      version.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+      version.mtime = mtimes[i];
+      version.commit_time = mtimes[i];
+      if (i + 1 == mtimes.size()) {
+        version.version_type = last_type;
+      }
+      ids.push_back(versions.insert_versioned_object(version));
+    }
+    return ids;
+  }
+
+  rgw::sal::sfs::ObjectState state_of(uint id) const {
+    SQLiteVersionedObjects versions(conn);
+    auto version = versions.get_versioned_object(id, false);
+    EXPECT_TRUE(version.has_value());
+    return version->object_state;
+  }
+
+  // expires the whole bucket, `window_size` objects at a time
+  DBOPLCEntry expire_all(
+      const DBOPLCExpiration& expiration, size_t window_size = 1000
+  ) const {
+    DBOPLCEntry counts{"", bucket_id, 0, 0};
+    DBOPLCWindow window;
+    while (true) {
+      auto last_name = db_lc->get_window_end(
+          bucket_id, expiration.prefix, window.after_name, window_size
+      );
+      if (!last_name.has_value()) {
+        break;
+      }
+      window.last_name = *last_name;
+      db_lc->expire(expiration, window, counts);
+      window.after_name = window.last_name;
+    }
+    return counts;
+  }
+};
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, GetWindowEnd) {
+  for (const auto& name : {"a/1", "a/2", "a/3", "b/1", "a_1"}) {
+    add_object(name, {now});
+  }
+  ASSERT_EQ(db_lc->get_window_end(bucket_id, "a/", "", 2), "a/2");
+  ASSERT_EQ(db_lc->get_window_end(bucket_id, "a/", "a/2", 2), "a/3");
+  ASSERT_FALSE(db_lc->get_window_end(bucket_id, "a/", "a/3", 2).has_value());
+  // '_' is not a wildcard
+  ASSERT_EQ(db_lc->get_window_end(bucket_id, "a_", "", 10), "a_1");
+  ASSERT_EQ(db_lc->get_window_end(bucket_id, "", "", 10), "b/1");
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, ExpireCurrentNotVersioned) {
+  const auto old_ids = add_object("a/old", {days_ago(10)});
+  const auto new_ids = add_object("a/new", {now});
+  const auto other_ids = add_object("b/old", {days_ago(10)});
+
+  DBOPLCExpiration expiration;
+  expiration.bucket_id = bucket_id;
+  expiration.prefix = "a/";
+  expiration.current_before = days_ago(5);
+  auto counts = expire_all(expiration, 1);
+
+  ASSERT_EQ(counts.expired_current, 1);
+  ASSERT_EQ(counts.expired_noncurrent, 0);
+  ASSERT_EQ(state_of(old_ids[0]), rgw::sal::sfs::ObjectState::DELETED);
+  ASSERT_EQ(state_of(new_ids[0]), rgw::sal::sfs::ObjectState::COMMITTED);
+  ASSERT_EQ(state_of(other_ids[0]), rgw::sal::sfs::ObjectState::COMMITTED);
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, ExpireCurrentVersioned) {
+  const auto ids = add_object("old", {days_ago(10)});
+  add_object("new", {now});
+
+  DBOPLCExpiration expiration;
+  expiration.bucket_id = bucket_id;
+  expiration.current_before = days_ago(5);
+  expiration.versioned = true;
+  auto counts = expire_all(expiration);
+
+  ASSERT_EQ(counts.expired_current, 1);
+  // the version stays, hidden by a delete marker
+  ASSERT_EQ(state_of(ids[0]), rgw::sal::sfs::ObjectState::COMMITTED);
+  SQLiteVersionedObjects versions(conn);
+  auto last = versions.get_committed_versioned_object_last_version(
+      bucket_id, "old"
+  );
+  ASSERT_TRUE(last.has_value());
+  ASSERT_EQ(last->version_type, rgw::sal::sfs::VersionType::DELETE_MARKER);
+  ASSERT_NE(last->id, ids[0]);
+  last = versions.get_committed_versioned_object_last_version(bucket_id, "new");
+  ASSERT_TRUE(last.has_value());
+  ASSERT_EQ(last->version_type, rgw::sal::sfs::VersionType::REGULAR);
+
+  // a second run finds nothing to expire
+  counts = expire_all(expiration);
+  ASSERT_EQ(counts.expired_current, 0);
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, ExpireNoncurrent) {
+  // noncurrent versions expire by the mtime of the version replacing them
+  const auto ids = add_object("obj", {days_ago(20), days_ago(10), now});
+
+  DBOPLCExpiration expiration;
+  expiration.bucket_id = bucket_id;
+  expiration.noncurrent_before = days_ago(5);
+  auto counts = expire_all(expiration);
+
+  ASSERT_EQ(counts.expired_noncurrent, 1);
+  ASSERT_EQ(counts.expired_current, 0);
+  ASSERT_EQ(state_of(ids[0]), rgw::sal::sfs::ObjectState::DELETED);
+  ASSERT_EQ(state_of(ids[1]), rgw::sal::sfs::ObjectState::COMMITTED);
+  ASSERT_EQ(state_of(ids[2]), rgw::sal::sfs::ObjectState::COMMITTED);
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, ExpireDeleteMarkers) {
+  const auto lone_ids = add_object(
+      "lone", {days_ago(1)}, rgw::sal::sfs::VersionType::DELETE_MARKER
+  );
+  const auto hiding_ids = add_object(
+      "hiding", {days_ago(2), days_ago(1)},
+      rgw::sal::sfs::VersionType::DELETE_MARKER
+  );
+
+  DBOPLCExpiration expiration;
+  expiration.bucket_id = bucket_id;
+  expiration.delete_markers = true;
+  auto counts = expire_all(expiration);
+
+  ASSERT_EQ(counts.expired_delete_markers, 1);
+  ASSERT_EQ(state_of(lone_ids[0]), rgw::sal::sfs::ObjectState::DELETED);
+  ASSERT_EQ(state_of(hiding_ids[0]), rgw::sal::sfs::ObjectState::COMMITTED);
+  ASSERT_EQ(state_of(hiding_ids[1]), rgw::sal::sfs::ObjectState::COMMITTED);
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, ExpireTaggedVersions) {
+  const auto tagged_ids = add_object("tagged", {days_ago(10)});
+  const auto untagged_ids = add_object("untagged", {days_ago(10)});
+
+  DBOPLCExpiration expiration;
+  expiration.bucket_id = bucket_id;
+  expiration.current_before = days_ago(5);
+  DBOPLCWindow window{"", "untagged", std::vector<uint>{tagged_ids[0]}};
+  ASSERT_EQ(db_lc->get_window_versions(expiration, window).size(), 2);
+
+  DBOPLCEntry counts{"", bucket_id, 0, 0};
+  db_lc->expire(expiration, window, counts);
+  ASSERT_EQ(counts.expired_current, 1);
+  ASSERT_EQ(state_of(tagged_ids[0]), rgw::sal::sfs::ObjectState::DELETED);
+  ASSERT_EQ(state_of(untagged_ids[0]), rgw::sal::sfs::ObjectState::COMMITTED);
+}
+
+TEST_F(TestSFSSQLiteLifecycleExpiration, AbortMultiparts) {
+  SQLiteMultipart multiparts(conn);
+  auto add_multipart = [&](const std::string& upload_id,
+                           const std::string& object_name,
+                           rgw::sal::sfs::MultipartState state,
+                           ceph::real_time mtime) {
+    DBMultipart mp;
+    mp.bucket_id = bucket_id;
+    mp.upload_id = upload_id;
+    mp.state = state;
+    mp.state_change_time = mtime;
+    mp.object_name = object_name;
+    mp.mtime = mtime;
+    mp.path_uuid.generate_random();
+    multiparts.insert(mp);
+  };
+  add_multipart(
+      "old", "a/obj", rgw::sal::sfs::MultipartState::INPROGRESS, days_ago(10)
+  );
+  add_multipart("new", "a/obj", rgw::sal::sfs::MultipartState::INIT, now);
+  add_multipart(
+      "other", "b/obj", rgw::sal::sfs::MultipartState::INIT, days_ago(10)
+  );
+  add_multipart(
+      "done", "a/obj", rgw::sal::sfs::MultipartState::DONE, days_ago(10)
+  );
+
+  ASSERT_EQ(db_lc->abort_multiparts(bucket_id, "a/", days_ago(5)), 1);
+  auto old_mp = multiparts.get_multipart("old");
+  ASSERT_TRUE(old_mp.has_value());
+  ASSERT_EQ(old_mp->state, rgw::sal::sfs::MultipartState::ABORTED);
+  for (const auto& upload_id : {"new", "other", "done"}) {
+    auto mp = multiparts.get_multipart(upload_id);
+    ASSERT_TRUE(mp.has_value());
+    ASSERT_NE(mp->state, rgw::sal::sfs::MultipartState::ABORTED);
+  }
+}
@@ -9,12 +9,16 @@
  * License version 2.1, as published by the Free Software
  * Foundation. See file COPYING.
  */
+#include <fmt/core.h>
 #include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
 
 #include <chrono>
 #include <filesystem>
+#include <limits>
+#include <map>
 #include <memory>
+#include <random>
 #include <stdexcept>
 #include <string_view>
 
@@ -100,12 +104,27 @@ class TestSFSList : public ::testing::Test {
     auto ver = create_test_versionedobject(obj.uuid, "testversion");
     ver.object_state = version_state;
     SQLiteVersionedObjects vos(dbconn);
-    vos.insert_versioned_object(ver);
+    ver.id = vos.insert_versioned_object(ver);
     return std::make_pair(obj, ver);
   }
 
+  // adds committed object `name` with `num_versions` versions
+  void add_obj(const std::string& name, size_t num_versions = 1) const {
+    const auto obj = create_test_object("testbucket", name);
+    SQLiteObjects os(dbconn);
+    os.store_object(obj);
+    SQLiteVersionedObjects vos(dbconn);
+    for (size_t i = 0; i < num_versions; i++) {
+      auto ver = create_test_versionedobject(
+          obj.uuid, fmt::format("{}_v{}", name, i)
+      );
+      ver.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+      vos.insert_versioned_object(ver);
+    }
+  }
+
   void dump_db() {
-    auto storage = dbconn->get_storage();
+    auto& storage = dbconn->get_storage();
     lderr(cct.get()) << "Dumping objects:" << dendl;
     for (const auto& row : storage.get_all<DBObject>()) {
       lderr(cct.get()) << row << dendl;
@@ -116,10 +135,28 @@ class TestSFSList : public ::testing::Test {
     }
   }
 
-  rgw_bucket_dir_entry make_dentry_with_name(const std::string& name) {
-    rgw_bucket_dir_entry e;
-    e.key.name = name;
-    return e;
+  // rolls the sorted `objects` with `delimiter` after `prefix` up into
+  // `out_common_prefixes` and copies the others to `out_objects`, the
+  // way listing every name and rolling them up afterwards would
+  static void roll_up(
+      const std::string& prefix, const std::string& delimiter,
+      const std::vector<rgw_bucket_dir_entry>& objects,
+      std::map<std::string, bool>& out_common_prefixes,
+      std::vector<rgw_bucket_dir_entry>& out_objects
+  ) {
+    for (const auto& object : objects) {
+      const std::string& name = object.key.name;
+      const auto delim_pos = name.starts_with(prefix)
+                                 ? name.find(delimiter, prefix.length())
+                                 : name.npos;
+      if (delim_pos == name.npos) {
+        out_objects.push_back(object);
+      } else {
+        out_common_prefixes.emplace(
+            name.substr(0, delim_pos + delimiter.length()), true
+        );
+      }
+    }
   }
 
   SQLiteList make_uut() { return SQLiteList(dbconn); }
@@ -543,66 +580,71 @@ TEST_F(TestSFSList, versions__delete_marker_is_not_latest) {
   EXPECT_FALSE(results[2].is_current());
 }
 
-TEST_F(TestSFSList, roll_up_example) {
+TEST_F(TestSFSList, list_delimited__example) {
   // https://docs.aws.amazon.com/AmazonS3/latest/userguide/using-prefixes.html
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("sample.foo"),
-      make_dentry_with_name("photos/2006/January/sample.jpg"),
-      make_dentry_with_name("photos/2006/February/sample2.jpg"),
-      make_dentry_with_name("photos/2006/February/sample3.jpg"),
-      make_dentry_with_name("photos/2006/February/sample4.jpg")};
-  const auto expected_still_exists = objects[0];
+  add_obj("sample.foo");
+  add_obj("photos/2006/January/sample.jpg");
+  add_obj("photos/2006/February/sample2.jpg");
+  add_obj("photos/2006/February/sample3.jpg");
+  add_obj("photos/2006/February/sample4.jpg");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "/", objects, prefixes, out);
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 10, out, prefixes)
+  );
   EXPECT_EQ(prefixes.size(), 1);
-  EXPECT_EQ(out.size(), 1);
-  EXPECT_EQ(out[0].key.name, expected_still_exists.key.name);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "sample.foo");
   EXPECT_THAT(
       prefixes, ::testing::ElementsAre(::testing::Pair("photos/", true))
   );
 }
 
-TEST_F(TestSFSList, roll_up_empty) {
+TEST_F(TestSFSList, list_delimited__empty) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects;
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "/", objects, prefixes, out);
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 10, out, prefixes)
+  );
   EXPECT_EQ(prefixes.size(), 0);
   EXPECT_EQ(out.size(), 0);
 }
 
-TEST_F(TestSFSList, roll_up_no_such_delim_in_equals_out) {
+TEST_F(TestSFSList, list_delimited__no_such_delim_lists_all) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("prefix/aaa"), make_dentry_with_name("prefix/bbb"),
-      make_dentry_with_name("prefix/ccc")};
-  const auto expected_still_exists = objects[0];
+  const std::vector<std::string> names{
+      "prefix/aaa", "prefix/bbb", "prefix/ccc"};
+  for (const auto& name : names) {
+    add_obj(name);
+  }
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "$", objects, prefixes, out);
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "$", "", 10, out, prefixes)
+  );
   ASSERT_EQ(prefixes.size(), 0);
-  ASSERT_EQ(out.size(), objects.size());
-  for (size_t i = 0; i < objects.size(); i++) {
-    EXPECT_EQ(objects[i].key.name, out[i].key.name);
+  ASSERT_EQ(out.size(), names.size());
+  for (size_t i = 0; i < names.size(); i++) {
+    EXPECT_EQ(out[i].key.name, names[i]);
   }
 }
 
-TEST_F(TestSFSList, roll_up_multi_delim_group_by_first) {
+TEST_F(TestSFSList, list_delimited__multi_delim_group_by_first) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("prefix/aaa/1"),
-      make_dentry_with_name("prefix/bbb/2"),
-      make_dentry_with_name("prefix/ccc/3")};
+  add_obj("prefix/aaa/1");
+  add_obj("prefix/bbb/2");
+  add_obj("prefix/ccc/3");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "/", objects, prefixes, out);
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 10, out, prefixes)
+  );
   EXPECT_EQ(prefixes.size(), 1);
   EXPECT_EQ(out.size(), 0);
   EXPECT_THAT(
@@ -610,15 +652,17 @@ TEST_F(TestSFSList, roll_up_multi_delim_group_by_first) {
   );
 }
 
-TEST_F(TestSFSList, roll_up_multi_prefixes) {
+TEST_F(TestSFSList, list_delimited__multi_prefixes) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("a/1"), make_dentry_with_name("b/2"),
-      make_dentry_with_name("c/3")};
+  add_obj("a/1");
+  add_obj("b/2");
+  add_obj("c/3");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "/", objects, prefixes, out);
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 10, out, prefixes)
+  );
   EXPECT_EQ(prefixes.size(), 3);
   EXPECT_EQ(out.size(), 0);
   EXPECT_THAT(
@@ -629,71 +673,59 @@ TEST_F(TestSFSList, roll_up_multi_prefixes) {
   );
 }
 
-TEST_F(TestSFSList, roll_up_empty_delimiter_prefix_is_copy) {
+TEST_F(TestSFSList, list_delimited__starts_after_prefix) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("a"), make_dentry_with_name("b"),
-      make_dentry_with_name("c")};
+  add_obj("prefix/xxx");
+  add_obj("prefix/yyy/0");
+  add_obj("something/else");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "", objects, prefixes, out);
-  ASSERT_EQ(prefixes.size(), 0);
-  ASSERT_EQ(out.size(), objects.size());
-  for (size_t i = 0; i < objects.size(); i++) {
-    EXPECT_EQ(objects[i].key.name, out[i].key.name);
-  }
-}
-
-TEST_F(TestSFSList, roll_up_starts_after_prefix) {
-  const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("prefix/xxx"),
-      make_dentry_with_name("prefix/yyy/0"),
-      make_dentry_with_name("something/else")};
-  std::map<std::string, bool> prefixes;
-  std::vector<rgw_bucket_dir_entry> out;
-
-  uut.roll_up_common_prefixes("prefix/", "/", objects, prefixes, out);
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "prefix/", "/", "", 10, out, prefixes
+  ));
   ASSERT_EQ(prefixes.size(), 1);
   EXPECT_THAT(
       prefixes, ::testing::ElementsAre(::testing::Pair("prefix/yyy/", true))
   );
+  ASSERT_EQ(out.size(), 1);
   EXPECT_EQ(out[0].key.name, "prefix/xxx");
 }
 
-TEST_F(TestSFSList, roll_up_a_multichar_delimiters_work) {
+TEST_F(TestSFSList, list_delimited__multichar_delimiters_work) {
   // https://docs.aws.amazon.com/AmazonS3/latest/userguide/using-prefixes.html
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("sample.foo"),
-      make_dentry_with_name("photosDeLiM2006DeLiMJanuaryDeLiMsample.jpg"),
-      make_dentry_with_name("photosDeLiM2006DeLiMFebruaryDeLiMsample2.jpg"),
-      make_dentry_with_name("photosDeLiM2006DeLiMFebruaryDeLiMsample3.jpg"),
-      make_dentry_with_name("photosDeLiM2006DeLiMFebruaryDeLiMsample4.jpg")};
-  const auto expected_still_exists = objects[0];
+  add_obj("sample.foo");
+  add_obj("photosDeLiM2006DeLiMJanuaryDeLiMsample.jpg");
+  add_obj("photosDeLiM2006DeLiMFebruaryDeLiMsample2.jpg");
+  add_obj("photosDeLiM2006DeLiMFebruaryDeLiMsample3.jpg");
+  add_obj("photosDeLiM2006DeLiMFebruaryDeLiMsample4.jpg");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "DeLiM", objects, prefixes, out);
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "DeLiM", "", 10, out, prefixes
+  ));
   EXPECT_EQ(prefixes.size(), 1);
-  EXPECT_EQ(out.size(), 1);
-  EXPECT_EQ(out[0].key.name, expected_still_exists.key.name);
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "sample.foo");
   EXPECT_THAT(
       prefixes, ::testing::ElementsAre(::testing::Pair("photosDeLiM", true))
   );
 }
 
-TEST_F(TestSFSList, roll_up_delim_must_follow_prefix) {
+TEST_F(TestSFSList, list_delimited__delim_must_follow_prefix) {
   const auto uut = make_uut();
-  const std::vector<rgw_bucket_dir_entry> objects{
-      make_dentry_with_name("prefix"), make_dentry_with_name("prefixDELIM"),
-      make_dentry_with_name("prefixDELIMsomething"),
-      make_dentry_with_name("prefixSOMETHING")};
+  add_obj("prefix");
+  add_obj("prefixDELIM");
+  add_obj("prefixDELIMsomething");
+  add_obj("prefixSOMETHING");
   std::map<std::string, bool> prefixes;
   std::vector<rgw_bucket_dir_entry> out;
 
-  uut.roll_up_common_prefixes("", "DELIM", objects, prefixes, out);
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "DELIM", "", 10, out, prefixes
+  ));
   ASSERT_EQ(prefixes.size(), 1);
   EXPECT_THAT(
       prefixes, ::testing::ElementsAre(::testing::Pair("prefixDELIM", true))
@@ -702,3 +734,535 @@ TEST_F(TestSFSList, roll_up_delim_must_follow_prefix) {
   EXPECT_EQ(out[0].key.name, "prefix");
   EXPECT_EQ(out[1].key.name, "prefixSOMETHING");
 }
+
+TEST_F(TestSFSList, list_delimited__prefixes_do_not_starve_the_page) {
+  const auto uut = make_uut();
+  for (int i = 0; i < 100; i++) {
+    add_obj(fmt::format("a/{:03}", i));
+    add_obj(fmt::format("b/{:03}/x", i));
+  }
+  add_obj("c");
+  for (int i = 0; i < 50; i++) {
+    add_obj(fmt::format("d/{:03}", i));
+  }
+  add_obj("e");
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = false;
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 3, out, prefixes, &more)
+  );
+  EXPECT_THAT(
+      prefixes, ::testing::ElementsAre(
+                    ::testing::Pair("a/", true), ::testing::Pair("b/", true)
+                )
+  );
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "c");
+  EXPECT_TRUE(more);
+
+  out.clear();
+  prefixes.clear();
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "/", "c", 10, out, prefixes, &more
+  ));
+  EXPECT_THAT(prefixes, ::testing::ElementsAre(::testing::Pair("d/", true)));
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "e");
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__marker_in_prefix_skips_the_prefix) {
+  const auto uut = make_uut();
+  add_obj("a/1");
+  add_obj("a/2");
+  add_obj("b");
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = true;
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "/", "a/", 10, out, prefixes, &more
+  ));
+  EXPECT_TRUE(prefixes.empty());
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "b");
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__skips_prefixes_with_non_ascii_names) {
+  const auto uut = make_uut();
+  add_obj("b");
+  add_obj("\u00e4/1");
+  add_obj("\u00e4/2");
+  add_obj("\u00e4\u00e4");
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = true;
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "/", "\u00e4/1", 10, out, prefixes, &more
+  ));
+  EXPECT_TRUE(prefixes.empty());
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "\u00e4\u00e4");
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__object_and_prefix_of_the_same_name) {
+  const auto uut = make_uut();
+  add_obj("dir");
+  add_obj("dir/file");
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = false;
+  ASSERT_TRUE(
+      uut.list_delimited(false, "testbucket", "", "/", "", 1, out, prefixes, &more)
+  );
+  EXPECT_TRUE(prefixes.empty());
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "dir");
+  EXPECT_TRUE(more);
+
+  out.clear();
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "", "/", "dir", 1, out, prefixes, &more
+  ));
+  EXPECT_TRUE(out.empty());
+  EXPECT_THAT(prefixes, ::testing::ElementsAre(::testing::Pair("dir/", true)));
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__with_prefix) {
+  const auto uut = make_uut();
+  add_obj("photos/2023/a.jpg");
+  add_obj("photos/2023/b.jpg");
+  add_obj("photos/2024/c.jpg");
+  add_obj("photos/index.html");
+  add_obj("videos/x/y.mp4");
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = true;
+  ASSERT_TRUE(uut.list_delimited(
+      false, "testbucket", "photos/", "/", "", 10, out, prefixes, &more
+  ));
+  EXPECT_THAT(
+      prefixes, ::testing::ElementsAre(
+                    ::testing::Pair("photos/2023/", true),
+                    ::testing::Pair("photos/2024/", true)
+                )
+  );
+  ASSERT_EQ(out.size(), 1);
+  EXPECT_EQ(out[0].key.name, "photos/index.html");
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__versions_of_an_object_stay_together) {
+  const auto uut = make_uut();
+  // more versions than the first batch fetches
+  add_obj("a", 40);
+  add_obj("b/1", 3);
+  add_obj("c", 2);
+
+  std::vector<rgw_bucket_dir_entry> out;
+  std::map<std::string, bool> prefixes;
+  bool more = true;
+  ASSERT_TRUE(uut.list_delimited(
+      true, "testbucket", "", "/", "", 1000, out, prefixes, &more
+  ));
+  EXPECT_THAT(prefixes, ::testing::ElementsAre(::testing::Pair("b/", true)));
+  ASSERT_EQ(out.size(), 42);
+  for (size_t i = 0; i < 40; i++) {
+    EXPECT_EQ(out[i].key.name, "a");
+  }
+  EXPECT_EQ(out[40].key.name, "c");
+  EXPECT_EQ(out[41].key.name, "c");
+  EXPECT_FALSE(more);
+}
+
+TEST_F(TestSFSList, list_delimited__pages_add_up_to_a_full_roll_up) {
+  const auto uut = make_uut();
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> pick(0, 5);
+  for (int i = 0; i < 500; i++) {
+    std::string name;
+    for (int depth = pick(rng) % 4; depth > 0; depth--) {
+      name += fmt::format("d{}/", pick(rng));
+    }
+    name += fmt::format("o{}", i);
+    add_obj(name);
+  }
+
+  std::vector<rgw_bucket_dir_entry> all;
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, all));
+  std::map<std::string, bool> expected_prefixes;
+  std::vector<rgw_bucket_dir_entry> expected_objects;
+  roll_up("", "/", all, expected_prefixes, expected_objects);
+
+  std::map<std::string, bool> prefixes;
+  std::vector<rgw_bucket_dir_entry> objects;
+  std::string marker;
+  for (bool more = true; more;) {
+    std::map<std::string, bool> page_prefixes;
+    std::vector<rgw_bucket_dir_entry> page_objects;
+    ASSERT_TRUE(uut.list_delimited(
+        false, "testbucket", "", "/", marker, 3, page_objects, page_prefixes,
+        &more
+    ));
+    ASSERT_LE(page_prefixes.size() + page_objects.size(), 3);
+    for (const auto& p : page_prefixes) {
+      marker = std::max(marker, p.first);
+    }
+    for (auto& o : page_objects) {
+      marker = std::max(marker, o.key.name);
+      objects.emplace_back(std::move(o));
+    }
+    prefixes.merge(page_prefixes);
+  }
+  EXPECT_EQ(prefixes, expected_prefixes);
+  ASSERT_EQ(objects.size(), expected_objects.size());
+  for (size_t i = 0; i < objects.size(); i++) {
+    EXPECT_EQ(objects[i].key.name, expected_objects[i].key.name);
+  }
+}
+
+/*
+  Lists a deep hierarchy of "directories" with a delimiter, one level at
+  a time, the way S3 browsers and `aws s3 ls` do. "skip_scan" is
+  SQLiteList::list_delimited(). "full_scan" lists every name under the
+  prefix and rolls them up afterwards, and is the baseline.
+*/
+
+class TestSFSListPerf : public TestSFSList,
+                        public testing::WithParamInterface<std::string> {
+ protected:
+  static constexpr int FANOUT = 8;
+  static constexpr int DEPTH = 4;
+  static constexpr int OBJECTS_PER_DIR = 4;
+  static constexpr int NUM_LEAF_DIRS = FANOUT * FANOUT * FANOUT * FANOUT;
+
+  // FANOUT^DEPTH leaf directories with OBJECTS_PER_DIR objects each
+  void add_hierarchy() {
+    dbconn->run_on_writer([&](Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      for (int leaf = 0; leaf < NUM_LEAF_DIRS; leaf++) {
+        std::string dir;
+        for (int level = 0, n = leaf; level < DEPTH; level++, n /= FANOUT) {
+          dir += fmt::format("dir{}/", n % FANOUT);
+        }
+        for (int i = 0; i < OBJECTS_PER_DIR; i++) {
+          const auto obj =
+              create_test_object("testbucket", fmt::format("{}obj{}", dir, i));
+          storage.replace(obj);
+          auto ver = create_test_versionedobject(obj.uuid, "v");
+          ver.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+          storage.insert(ver);
+        }
+      }
+      transaction.commit();
+    });
+  }
+
+  size_t list_level(
+      const std::string& prefix, std::map<std::string, bool>& prefixes,
+      std::vector<rgw_bucket_dir_entry>& objects
+  ) {
+    const auto uut = make_uut();
+    if (GetParam() == "skip_scan") {
+      EXPECT_TRUE(uut.list_delimited(
+          false, "testbucket", prefix, "/", "", 1000, objects, prefixes
+      ));
+    } else {
+      std::vector<rgw_bucket_dir_entry> all;
+      EXPECT_TRUE(uut.objects(
+          "testbucket", prefix, "", std::numeric_limits<size_t>::max() / 2, all
+      ));
+      roll_up(prefix, "/", all, prefixes, objects);
+    }
+    return prefixes.size() + objects.size();
+  }
+};
+
+TEST_P(TestSFSListPerf, list_deep_hierarchy) {
+  add_hierarchy();
+
+  // walk down one branch, listing each level on the way
+  size_t entries = 0;
+  int listings = 0;
+  const auto start = ceph::mono_clock::now();
+  for (int round = 0; round < 10; round++) {
+    std::string prefix;
+    for (int level = 0; level <= DEPTH; level++) {
+      std::map<std::string, bool> prefixes;
+      std::vector<rgw_bucket_dir_entry> objects;
+      entries += list_level(prefix, prefixes, objects);
+      listings++;
+      if (level < DEPTH) {
+        ASSERT_EQ(prefixes.size(), FANOUT) << prefix;
+        ASSERT_TRUE(objects.empty()) << prefix;
+        prefix = std::next(prefixes.begin(), round % FANOUT)->first;
+      } else {
+        ASSERT_TRUE(prefixes.empty()) << prefix;
+        ASSERT_EQ(objects.size(), OBJECTS_PER_DIR) << prefix;
+      }
+    }
+  }
+  const auto elapsed = ceph::mono_clock::now() - start;
+
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} objects, depth {}, fanout {}: {} listings "
+                          "returning {} entries in {}ms ({:.0f}us/listing)",
+                          GetParam(),
+                          NUM_LEAF_DIRS * OBJECTS_PER_DIR, DEPTH,
+                          FANOUT, listings, entries,
+                          std::chrono::duration_cast<std::chrono::milliseconds>(
+                              elapsed
+                          )
+                              .count(),
+                          std::chrono::duration<double, std::micro>(elapsed)
+                                  .count() /
+                              listings
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    DelimitedListing, TestSFSListPerf,
+    testing::Values("skip_scan", "full_scan"),
+    [](const testing::TestParamInfo<TestSFSListPerf::ParamType>& info) {
+      return info.param;
+    }
+);
+
+TEST_F(TestSFSList, latest_version__follows_commits_and_deletes) {
+  const auto uut = make_uut();
+  auto [obj, v1] = add_obj_single_ver();
+  SQLiteVersionedObjects vos(dbconn);
+  auto v2 = create_test_versionedobject(obj.uuid, "v2");
+  v2.size = 42;
+  v2.commit_time = v1.commit_time + std::chrono::seconds(1);
+  v2.object_state = rgw::sal::sfs::ObjectState::OPEN;
+  v2.id = vos.insert_versioned_object(v2);
+
+  // open versions are not the latest yet
+  std::vector<rgw_bucket_dir_entry> results;
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].meta.size, v1.size);
+
+  v2.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+  vos.store_versioned_object(v2);
+  results.clear();
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].meta.size, 42);
+
+  auto del = create_test_versionedobject(obj.uuid, "deletemarker");
+  del.commit_time = v2.commit_time + std::chrono::seconds(1);
+  del.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+  del.version_type = rgw::sal::sfs::VersionType::DELETE_MARKER;
+  del.id = vos.insert_versioned_object(del);
+  results.clear();
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  EXPECT_TRUE(results.empty());
+  results.clear();
+  ASSERT_TRUE(uut.versions("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_TRUE(results[0].is_delete_marker());
+  EXPECT_TRUE(results[0].is_current());
+  EXPECT_FALSE(results[1].is_current());
+  EXPECT_FALSE(results[2].is_current());
+
+  // removing the delete marker brings back the version before it
+  vos.remove_versioned_object(del.id);
+  results.clear();
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].meta.size, 42);
+
+  // as does deleting the newest version
+  v2.object_state = rgw::sal::sfs::ObjectState::DELETED;
+  vos.store_versioned_object(v2);
+  results.clear();
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].meta.size, v1.size);
+
+  // no committed version left, no latest version
+  vos.remove_versioned_object(v1.id);
+  auto& storage = dbconn->get_storage();
+  EXPECT_TRUE(storage.get_all<DBLatestVersion>().empty());
+}
+
+TEST_F(TestSFSList, latest_version__removed_with_its_object) {
+  auto [obj, ver] = add_obj_single_ver();
+  auto& storage = dbconn->get_storage();
+  ASSERT_EQ(storage.get_all<DBLatestVersion>().size(), 1);
+  dbconn->run_on_writer([](Storage& writer) {
+    writer.remove_all<DBVersionedObject>();
+    writer.remove_all<DBObject>();
+  });
+  EXPECT_TRUE(storage.get_all<DBLatestVersion>().empty());
+}
+
+TEST_F(TestSFSList, latest_version__upgrade_fills_the_table) {
+  add_obj_single_ver("a");
+  auto [obj, v1] = add_obj_single_ver("b");
+  auto del = create_test_versionedobject(obj.uuid, "deletemarker");
+  del.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+  del.version_type = rgw::sal::sfs::VersionType::DELETE_MARKER;
+  SQLiteVersionedObjects vos(dbconn);
+  vos.insert_versioned_object(del);
+  add_obj_single_ver("c", rgw::sal::sfs::ObjectState::OPEN);
+
+  // make it look like a database written before the table existed
+  ASSERT_EQ(
+      sqlite3_exec(
+          dbconn->first_sqlite_conn,
+          "DROP TRIGGER sfs_latest_version_insert;"
+          "DROP TRIGGER sfs_latest_version_delete;"
+          "DROP TRIGGER sfs_latest_version_update;"
+          "DROP TRIGGER sfs_latest_version_object_insert;"
+          "DROP TRIGGER sfs_latest_version_object_update;"
+          "DROP TRIGGER sfs_latest_version_object_delete;"
+          "DROP TABLE latest_versions;"
+          "DROP TRIGGER sfs_packed_segment_insert;"
+          "DROP TRIGGER sfs_packed_segment_delete;"
+          "DROP TRIGGER sfs_packed_segment_update;"
+          "DROP TABLE packed_objects;"
+          "DROP TABLE packed_segments;"
+          "PRAGMA user_version = 6;",
+          nullptr, nullptr, nullptr
+      ),
+      SQLITE_OK
+  );
+  store.reset();
+  dbconn.reset();
+  dbconn = std::make_shared<DBConn>(cct.get());
+  EXPECT_EQ(dbconn->get_storage().pragma.user_version(), SFS_METADATA_VERSION);
+
+  const auto uut = make_uut();
+  std::vector<rgw_bucket_dir_entry> results;
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_TRUE(results[0].key.name.starts_with("a"));
+  EXPECT_EQ(dbconn->get_storage().get_all<DBLatestVersion>().size(), 2);
+
+  // and the triggers are back
+  add_obj_single_ver("d");
+  results.clear();
+  ASSERT_TRUE(uut.objects("testbucket", "", "", 1000, results));
+  EXPECT_EQ(results.size(), 2);
+}
+
+/*
+  Lists a bucket with many versions per object. "latest_versions" is
+  SQLiteList::objects(), reading the latest_versions table. "group_by"
+  is the query it replaced, grouping all the versions of each object to
+  find out whether its latest one is a delete marker, and is the
+  baseline.
+*/
+
+class TestSFSListVersionsPerf
+    : public TestSFSList,
+      public testing::WithParamInterface<std::string> {
+ protected:
+  static constexpr int NUM_OBJECTS = 2000;
+  static constexpr int VERSIONS_PER_OBJECT = 20;
+  static constexpr size_t PAGE_SIZE = 1000;
+
+  void add_versions() {
+    dbconn->run_on_writer([&](Storage& storage) {
+      auto transaction = storage.transaction_guard();
+      for (int i = 0; i < NUM_OBJECTS; i++) {
+        const auto obj =
+            create_test_object("testbucket", fmt::format("obj{:06}", i));
+        storage.replace(obj);
+        for (int v = 0; v < VERSIONS_PER_OBJECT; v++) {
+          auto ver =
+              create_test_versionedobject(obj.uuid, fmt::format("v{}", v));
+          ver.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+          // every tenth object is deleted
+          if (v == VERSIONS_PER_OBJECT - 1 && i % 10 == 0) {
+            ver.version_type = rgw::sal::sfs::VersionType::DELETE_MARKER;
+          }
+          storage.insert(ver);
+        }
+      }
+      transaction.commit();
+    });
+  }
+
+  size_t list_page(const std::string& start_after) {
+    if (GetParam() == "latest_versions") {
+      std::vector<rgw_bucket_dir_entry> results;
+      EXPECT_TRUE(make_uut().objects(
+          "testbucket", "", start_after, PAGE_SIZE, results
+      ));
+      return results.size();
+    }
+    const auto sql = fmt::format(
+        "SELECT o.name, v.mtime, v.etag, SUM(v.size) FROM objects o "
+        "INNER JOIN versioned_objects v ON o.uuid = v.object_id "
+        "WHERE v.object_state = {} AND o.bucket_id = 'testbucket' "
+        "AND o.name > '{}' GROUP BY v.object_id "
+        "HAVING MAX(v.version_type) = {} ORDER BY o.name LIMIT {}",
+        static_cast<int>(rgw::sal::sfs::ObjectState::COMMITTED), start_after,
+        static_cast<int>(rgw::sal::sfs::VersionType::REGULAR), PAGE_SIZE + 1
+    );
+    size_t rows = 0;
+    EXPECT_EQ(
+        sqlite3_exec(
+            dbconn->first_sqlite_conn, sql.c_str(),
+            [](void* arg, int, char**, char**) {
+              (*static_cast<size_t*>(arg))++;
+              return 0;
+            },
+            &rows, nullptr
+        ),
+        SQLITE_OK
+    );
+    return std::min(rows, PAGE_SIZE);
+  }
+};
+
+TEST_P(TestSFSListVersionsPerf, list_objects_with_many_versions) {
+  add_versions();
+
+  int listings = 0;
+  size_t entries = 0;
+  const auto start = ceph::mono_clock::now();
+  for (int round = 0; round < 10; round++) {
+    entries += list_page("");
+    entries += list_page("obj001000");
+    listings += 2;
+  }
+  const auto elapsed = ceph::mono_clock::now() - start;
+  EXPECT_EQ(entries, 10 * (1000 + 900));
+
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} objects with {} versions each: {} listings "
+                          "of up to {} entries in {}ms ({:.0f}us/listing)",
+                          GetParam(), NUM_OBJECTS, VERSIONS_PER_OBJECT,
+                          listings, PAGE_SIZE,
+                          std::chrono::duration_cast<std::chrono::milliseconds>(
+                              elapsed
+                          )
+                              .count(),
+                          std::chrono::duration<double, std::micro>(elapsed)
+                                  .count() /
+                              listings
+                      )
+                   << dendl;
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ListObjects, TestSFSListVersionsPerf,
+    testing::Values("latest_versions", "group_by"),
+    [](const testing::TestParamInfo<TestSFSListVersionsPerf::ParamType>& info) {
+      return info.param;
+    }
+);
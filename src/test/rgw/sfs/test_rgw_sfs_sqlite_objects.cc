@@ -256,7 +256,6 @@ TEST_F(TestSFSSQLiteObjects, CreateObjectForNonExistingBucket) {
   createBucket("usertest", "test_bucket", conn);
 
   SQLiteObjects db_objects(conn);
-  auto storage = conn->get_storage();
 
   DBObject db_object;
 
@@ -268,8 +267,9 @@ TEST_F(TestSFSSQLiteObjects, CreateObjectForNonExistingBucket) {
   EXPECT_THROW(
       {
         try {
-          storage.replace(db_object);
-          ;
+          conn->run_on_writer([&](Storage& writer) {
+            writer.replace(db_object);
+          });
         } catch (const std::system_error& e) {
           EXPECT_STREQ(
               "FOREIGN KEY constraint failed: constraint failed", e.what()
@@ -0,0 +1,405 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+#include <sqlite3.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_buckets.h"
+#include "rgw/driver/sfs/sqlite/sqlite_stats.h"
+#include "rgw/driver/sfs/sqlite/sqlite_users.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+
+/*
+  HINT
+  s3gw.db will create here: /tmp/rgw_sfs_tests
+*/
+
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+const static std::string TEST_DIR = "rgw_sfs_tests";
+const static std::string TEST_USERNAME = "test_user";
+const static std::string TEST_BUCKET = "test_bucket";
+const static std::string TEST_BUCKET_2 = "test_bucket_2";
+
+class TestSFSSQLiteStats : public ::testing::Test {
+ protected:
+  const std::unique_ptr<CephContext> cct =
+      std::unique_ptr<CephContext>(new CephContext(CEPH_ENTITY_TYPE_ANY));
+  std::unique_ptr<rgw::sal::SFStore> store;
+  std::unique_ptr<NoDoutPrefix> ndp;
+
+  void SetUp() override {
+    fs::current_path(fs::temp_directory_path());
+    fs::create_directory(TEST_DIR);
+    cct->_conf.set_val("rgw_sfs_data_path", getTestDir());
+    cct->_log->start();
+    rgw_perf_start(cct.get());
+    ndp = std::make_unique<NoDoutPrefix>(cct.get(), 1);
+    openStore();
+
+    SQLiteUsers users(store->db_conn);
+    DBOPUserInfo user;
+    user.uinfo.user_id.id = TEST_USERNAME;
+    users.store_user(user);
+
+    createBucket(TEST_BUCKET);
+    createBucket(TEST_BUCKET_2);
+    store->_refresh_buckets();
+  }
+
+  void TearDown() override {
+    store.reset();
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(TEST_DIR);
+  }
+
+  std::string getTestDir() const {
+    auto test_dir = fs::temp_directory_path() / TEST_DIR;
+    return test_dir.string();
+  }
+
+  void openStore() {
+    store.reset();
+    store.reset(new rgw::sal::SFStore(cct.get(), getTestDir()));
+    store->gc->suspend();
+  }
+
+  void createBucket(const std::string& name) {
+    SQLiteBuckets db_buckets(store->db_conn);
+    DBOPBucketInfo bucket;
+    bucket.binfo.bucket.name = name;
+    bucket.binfo.bucket.bucket_id = name;
+    bucket.binfo.owner.id = TEST_USERNAME;
+    bucket.deleted = false;
+    db_buckets.store_bucket(bucket);
+  }
+
+  rgw::sal::sfs::ObjectRef putObject(
+      const std::string& bucket, const std::string& name, size_t size,
+      bool commit = true
+  ) {
+    auto bucketref = store->get_bucket_ref(bucket);
+    auto objref = bucketref->create_version(rgw_obj_key(name));
+    EXPECT_NE(objref, nullptr);
+    auto meta = objref->get_meta();
+    meta.size = size;
+    objref->update_meta(meta);
+    if (commit) {
+      EXPECT_TRUE(objref->metadata_finish(store.get(), false));
+    }
+    return objref;
+  }
+
+  SQLiteStats::Stats bucketStats(const std::string& bucket) {
+    SQLiteStats stats(store->db_conn);
+    return stats.get_bucket_stats(bucket);
+  }
+
+  SQLiteStats::Stats userStats() {
+    SQLiteStats stats(store->db_conn);
+    return stats.get_user_stats(TEST_USERNAME);
+  }
+
+  std::unique_ptr<rgw::sal::Bucket> getBucket(const std::string& name) {
+    rgw_user arg_user("", TEST_USERNAME, "");
+    auto user = store->get_user(arg_user);
+    std::unique_ptr<rgw::sal::Bucket> bucket;
+    EXPECT_EQ(
+        store->get_bucket(
+            ndp.get(), user.get(), rgw_bucket("", name, name), &bucket,
+            null_yield
+        ),
+        0
+    );
+    return bucket;
+  }
+};
+
+TEST_F(TestSFSSQLiteStats, empty_bucket_and_user) {
+  auto stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.size_rounded, 0);
+  EXPECT_EQ(stats.obj_count, 0);
+  stats = userStats();
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.obj_count, 0);
+}
+
+TEST_F(TestSFSSQLiteStats, counters_follow_commits) {
+  putObject(TEST_BUCKET, "obj1", 100);
+  putObject(TEST_BUCKET, "obj2", 5000);
+  putObject(TEST_BUCKET_2, "obj1", 4096);
+
+  auto stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 5100);
+  EXPECT_EQ(stats.size_rounded, 4096 + 8192);
+  EXPECT_EQ(stats.obj_count, 2);
+  stats = bucketStats(TEST_BUCKET_2);
+  EXPECT_EQ(stats.size, 4096);
+  EXPECT_EQ(stats.size_rounded, 4096);
+  EXPECT_EQ(stats.obj_count, 1);
+  stats = userStats();
+  EXPECT_EQ(stats.size, 9196);
+  EXPECT_EQ(stats.size_rounded, 4096 + 8192 + 4096);
+  EXPECT_EQ(stats.obj_count, 3);
+
+  // versions still being written are not accounted
+  putObject(TEST_BUCKET, "open", 1000, false);
+  EXPECT_EQ(bucketStats(TEST_BUCKET).obj_count, 2);
+  EXPECT_EQ(userStats().obj_count, 3);
+}
+
+TEST_F(TestSFSSQLiteStats, overwrite_replaces_the_old_version) {
+  putObject(TEST_BUCKET, "obj", 100);
+  putObject(TEST_BUCKET, "obj", 300);
+
+  // unversioned: committing the new version deletes the old one
+  const auto stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 300);
+  EXPECT_EQ(stats.obj_count, 1);
+  EXPECT_EQ(userStats().size, 300);
+}
+
+TEST_F(TestSFSSQLiteStats, counters_follow_deletes_and_gc) {
+  auto objref = putObject(TEST_BUCKET, "obj1", 100);
+  putObject(TEST_BUCKET, "obj2", 200);
+
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  std::string delete_marker;
+  ASSERT_TRUE(bucketref->delete_object(
+      *objref, rgw_obj_key("obj1"), false, delete_marker
+  ));
+  auto stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 200);
+  EXPECT_EQ(stats.obj_count, 1);
+
+  // removing the deleted version does not change the counters again
+  store->gc->process();
+  SQLiteVersionedObjects db_versions(store->db_conn);
+  EXPECT_FALSE(db_versions.get_versioned_object(objref->version_id, false)
+                   .has_value());
+  stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 200);
+  EXPECT_EQ(stats.obj_count, 1);
+
+  // removing a committed version directly is accounted as well
+  auto obj2 = bucketref->get(rgw_obj_key("obj2"));
+  db_versions.remove_versioned_object(obj2->version_id);
+  stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.obj_count, 0);
+  stats = userStats();
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.obj_count, 0);
+}
+
+TEST_F(TestSFSSQLiteStats, versioned_deletes_keep_the_counters) {
+  auto objref = putObject(TEST_BUCKET, "obj1", 100);
+  putObject(TEST_BUCKET, "obj2", 200);
+
+  // the delete markers hide the versions, which still use the space
+  auto bucketref = store->get_bucket_ref(TEST_BUCKET);
+  std::string delete_marker;
+  ASSERT_TRUE(bucketref->delete_object(
+      *objref, rgw_obj_key("obj1"), true, delete_marker
+  ));
+  EXPECT_FALSE(delete_marker.empty());
+  std::vector<DBDeleteObjectKey> results;
+  ASSERT_TRUE(bucketref->delete_objects({rgw_obj_key("obj2")}, true, results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_TRUE(results[0].delete_marker_added);
+
+  auto stats = bucketStats(TEST_BUCKET);
+  EXPECT_EQ(stats.size, 300);
+  EXPECT_EQ(stats.size_rounded, 2 * 4096);
+  EXPECT_EQ(stats.obj_count, 2);
+  stats = userStats();
+  EXPECT_EQ(stats.size, 300);
+  EXPECT_EQ(stats.obj_count, 2);
+
+  // and a rebuild agrees
+  SQLiteStats db_stats(store->db_conn);
+  EXPECT_EQ(db_stats.rebuild().buckets_fixed, 0);
+}
+
+TEST_F(TestSFSSQLiteStats, rebuild_fixes_wrong_counters) {
+  putObject(TEST_BUCKET, "obj1", 100);
+  putObject(TEST_BUCKET_2, "obj1", 200);
+
+  SQLiteStats stats(store->db_conn);
+  auto result = stats.rebuild();
+  EXPECT_EQ(result.buckets, 2);
+  EXPECT_EQ(result.users, 1);
+  EXPECT_EQ(result.buckets_fixed, 0);
+  EXPECT_EQ(result.users_fixed, 0);
+
+  // break the counters behind the triggers' back
+  store->db_conn->run_on_writer([](Storage& storage) {
+    storage.replace(DBBucketStats{TEST_BUCKET, 1, 1, 1});
+    storage.replace(DBBucketStats{"no_such_bucket", 5, 5, 5});
+    storage.remove<DBUserStats>(TEST_USERNAME);
+  });
+  EXPECT_EQ(userStats().obj_count, 0);
+
+  result = stats.rebuild();
+  EXPECT_EQ(result.buckets, 2);
+  EXPECT_EQ(result.buckets_fixed, 2);
+  EXPECT_EQ(result.users, 1);
+  EXPECT_EQ(result.users_fixed, 1);
+
+  EXPECT_EQ(bucketStats(TEST_BUCKET).size, 100);
+  EXPECT_EQ(bucketStats(TEST_BUCKET).obj_count, 1);
+  EXPECT_EQ(bucketStats("no_such_bucket").obj_count, 0);
+  EXPECT_EQ(userStats().size, 300);
+  EXPECT_EQ(userStats().obj_count, 2);
+}
+
+TEST_F(TestSFSSQLiteStats, upgrade_fills_the_counters) {
+  putObject(TEST_BUCKET, "obj1", 100);
+  putObject(TEST_BUCKET_2, "obj1", 200);
+
+  // make it look like a database written before the stats existed
+  auto db = store->db_conn->first_sqlite_conn;
+  ASSERT_EQ(
+      sqlite3_exec(
+          db,
+          "DROP TRIGGER sfs_stats_version_insert;"
+          "DROP TRIGGER sfs_stats_version_delete;"
+          "DROP TRIGGER sfs_stats_version_update;"
+          "DROP TRIGGER sfs_stats_bucket_delete;"
+          "DROP TRIGGER sfs_stats_user_delete;"
+          "DROP TABLE bucket_stats;"
+          "DROP TABLE user_stats;"
+          "DROP TRIGGER sfs_latest_version_insert;"
+          "DROP TRIGGER sfs_latest_version_delete;"
+          "DROP TRIGGER sfs_latest_version_update;"
+          "DROP TRIGGER sfs_latest_version_object_insert;"
+          "DROP TRIGGER sfs_latest_version_object_update;"
+          "DROP TRIGGER sfs_latest_version_object_delete;"
+          "DROP TABLE latest_versions;"
+          "DROP TRIGGER sfs_packed_segment_insert;"
+          "DROP TRIGGER sfs_packed_segment_delete;"
+          "DROP TRIGGER sfs_packed_segment_update;"
+          "DROP TABLE packed_objects;"
+          "DROP TABLE packed_segments;"
+          "PRAGMA user_version = 5;",
+          nullptr, nullptr, nullptr
+      ),
+      SQLITE_OK
+  );
+  openStore();
+
+  EXPECT_EQ(
+      store->db_conn->get_storage().pragma.user_version(), SFS_METADATA_VERSION
+  );
+  EXPECT_EQ(bucketStats(TEST_BUCKET).size, 100);
+  EXPECT_EQ(bucketStats(TEST_BUCKET_2).size, 200);
+  EXPECT_EQ(userStats().size, 300);
+  EXPECT_EQ(userStats().obj_count, 2);
+
+  // and the triggers are back
+  putObject(TEST_BUCKET, "obj2", 50);
+  EXPECT_EQ(bucketStats(TEST_BUCKET).size, 150);
+  EXPECT_EQ(userStats().obj_count, 3);
+}
+
+TEST_F(TestSFSSQLiteStats, removed_bucket_drops_its_stats) {
+  SQLiteBuckets db_buckets(store->db_conn);
+  createBucket("empty");
+  ASSERT_EQ(store->db_conn->get_storage().count<DBBucketStats>(), 0);
+  store->db_conn->run_on_writer([](Storage& storage) {
+    storage.replace(DBBucketStats{"empty", 0, 0, 0});
+  });
+  db_buckets.remove_bucket("empty");
+  EXPECT_EQ(store->db_conn->get_storage().count<DBBucketStats>(), 0);
+
+  // updating a bucket (REPLACE) must keep its stats
+  putObject(TEST_BUCKET, "obj", 100);
+  auto info = db_buckets.get_bucket(TEST_BUCKET);
+  ASSERT_TRUE(info.has_value());
+  db_buckets.store_bucket(*info);
+  EXPECT_EQ(bucketStats(TEST_BUCKET).size, 100);
+}
+
+TEST_F(TestSFSSQLiteStats, bucket_quota) {
+  putObject(TEST_BUCKET, "obj1", 1000);
+  putObject(TEST_BUCKET, "obj2", 1000);
+  auto bucket = getBucket(TEST_BUCKET);
+
+  RGWQuota quota;
+  EXPECT_EQ(bucket->check_quota(ndp.get(), quota, 1 << 30, null_yield), 0);
+
+  quota.bucket_quota.enabled = true;
+  quota.bucket_quota.max_objects = 3;
+  EXPECT_EQ(bucket->check_quota(ndp.get(), quota, 1000, null_yield), 0);
+  putObject(TEST_BUCKET, "obj3", 1000);
+  EXPECT_EQ(
+      bucket->check_quota(ndp.get(), quota, 1000, null_yield),
+      -ERR_QUOTA_EXCEEDED
+  );
+  // overwriting an object only checks the size
+  EXPECT_EQ(bucket->check_quota(ndp.get(), quota, 1000, null_yield, true), 0);
+
+  // sizes are rounded to 4KiB unless checking on the raw size
+  quota.bucket_quota.max_objects = -1;
+  quota.bucket_quota.max_size = 4 * 4096;
+  EXPECT_EQ(bucket->check_quota(ndp.get(), quota, 4096, null_yield), 0);
+  EXPECT_EQ(
+      bucket->check_quota(ndp.get(), quota, 4097, null_yield),
+      -ERR_QUOTA_EXCEEDED
+  );
+  quota.bucket_quota.check_on_raw = true;
+  EXPECT_EQ(
+      bucket->check_quota(ndp.get(), quota, 4 * 4096 - 3000, null_yield), 0
+  );
+  EXPECT_EQ(
+      bucket->check_quota(ndp.get(), quota, 4 * 4096 - 2999, null_yield),
+      -ERR_QUOTA_EXCEEDED
+  );
+
+  // the other bucket is empty
+  auto bucket2 = getBucket(TEST_BUCKET_2);
+  EXPECT_EQ(bucket2->check_quota(ndp.get(), quota, 4 * 4096, null_yield), 0);
+}
+
+TEST_F(TestSFSSQLiteStats, user_quota_spans_buckets) {
+  putObject(TEST_BUCKET, "obj1", 1000);
+  putObject(TEST_BUCKET_2, "obj1", 1000);
+
+  RGWQuota quota;
+  quota.user_quota.enabled = true;
+  quota.user_quota.max_objects = 2;
+  auto bucket = getBucket(TEST_BUCKET);
+  auto bucket2 = getBucket(TEST_BUCKET_2);
+  EXPECT_EQ(
+      bucket->check_quota(ndp.get(), quota, 1, null_yield), -ERR_QUOTA_EXCEEDED
+  );
+  EXPECT_EQ(
+      bucket2->check_quota(ndp.get(), quota, 1, null_yield),
+      -ERR_QUOTA_EXCEEDED
+  );
+
+  quota.user_quota.max_objects = 3;
+  EXPECT_EQ(bucket->check_quota(ndp.get(), quota, 1, null_yield), 0);
+
+  // the stats reported for the user are the same counters
+  rgw_user arg_user("", TEST_USERNAME, "");
+  auto user = store->get_user(arg_user);
+  RGWStorageStats stats;
+  ASSERT_EQ(
+      user->read_stats(ndp.get(), null_yield, &stats, nullptr, nullptr), 0
+  );
+  EXPECT_EQ(stats.size, 2000);
+  EXPECT_EQ(stats.size_rounded, 2 * 4096);
+  EXPECT_EQ(stats.num_objects, 2);
+}
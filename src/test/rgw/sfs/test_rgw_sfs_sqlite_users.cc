@@ -329,13 +329,13 @@ TEST_F(TestSFSSQLiteUsers, UseStorage) {
 
   DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
   SQLiteUsers db_users(conn);
-  auto storage = conn->get_storage();
+  auto& storage = conn->get_storage();
 
   DBUser db_user;
   db_user.user_id = "test_storage";
 
   // we have to use replace because the primary key of rgw_user is a string
-  storage.replace(db_user);
+  conn->run_on_writer([&](Storage& writer) { writer.replace(db_user); });
 
   auto user = storage.get_pointer<DBUser>("test_storage");
 
@@ -353,7 +353,7 @@ TEST_F(TestSFSSQLiteUsers, UseStorage) {
   auto db_user_2 = get_db_user(rgw_user_2);
 
   // we have to use replace because the primary key of rgw_user is a string
-  storage.replace(db_user_2);
+  conn->run_on_writer([&](Storage& writer) { writer.replace(db_user_2); });
 
   // now use the SqliteUsers method, so user is already converted
   auto ret_user = db_users.get_user("test1");
@@ -700,3 +700,59 @@ TEST_F(TestSFSSQLiteUsers, GetByAccessKeyMultipleKeys) {
   ASSERT_TRUE(ret_user.has_value());
   compareUsers(user, *ret_user);
 }
+
+TEST_F(TestSFSSQLiteUsers, GetByAccessKeyAfterKeysChanged) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_log->start();
+
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+
+  auto db_users = std::make_shared<SQLiteUsers>(conn);
+  auto user = createTestUser("1");
+  db_users->store_user(user);
+
+  // cache the user by its keys
+  ASSERT_TRUE(db_users->get_user_by_access_key("key1_1").has_value());
+  ASSERT_TRUE(db_users->get_user_by_access_key("key2_1").has_value());
+  ASSERT_TRUE(db_users->get_user_by_access_key("key1_1").has_value());
+
+  // rotate one key and update the user
+  user.uinfo.access_keys.erase("key1_1");
+  user.uinfo.access_keys["key3"] = RGWAccessKey("key3", "secret3");
+  user.uinfo.display_name = "renamed";
+  db_users->store_user(user);
+
+  EXPECT_FALSE(db_users->get_user_by_access_key("key1_1").has_value());
+  auto ret_user = db_users->get_user_by_access_key("key2_1");
+  ASSERT_TRUE(ret_user.has_value());
+  compareUsers(user, *ret_user);
+  ret_user = db_users->get_user_by_access_key("key3");
+  ASSERT_TRUE(ret_user.has_value());
+  compareUsers(user, *ret_user);
+
+  db_users->remove_user(user.uinfo.user_id.id);
+  EXPECT_FALSE(db_users->get_user_by_access_key("key2_1").has_value());
+  EXPECT_FALSE(db_users->get_user_by_access_key("key3").has_value());
+}
+
+TEST_F(TestSFSSQLiteUsers, GetByAccessKeyWithoutCache) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_conf.set_val("rgw_sfs_user_cache_size", "0");
+  ceph_context->_log->start();
+
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+
+  auto db_users = std::make_shared<SQLiteUsers>(conn);
+  auto user = createTestUser("1");
+  db_users->store_user(user);
+
+  for (int i = 0; i < 2; i++) {
+    auto ret_user = db_users->get_user_by_access_key("key1_1");
+    ASSERT_TRUE(ret_user.has_value());
+    compareUsers(user, *ret_user);
+  }
+  db_users->remove_user(user.uinfo.user_id.id);
+  EXPECT_FALSE(db_users->get_user_by_access_key("key1_1").has_value());
+}
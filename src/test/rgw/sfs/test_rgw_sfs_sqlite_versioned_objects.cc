@@ -457,7 +457,6 @@ TEST_F(TestSFSSQLiteVersionedObjects, CreateObjectForNonExistingBucket) {
   );
 
   SQLiteVersionedObjects db_objects(conn);
-  auto storage = conn->get_storage();
 
   DBVersionedObject db_object;
 
@@ -471,8 +470,9 @@ TEST_F(TestSFSSQLiteVersionedObjects, CreateObjectForNonExistingBucket) {
   EXPECT_THROW(
       {
         try {
-          storage.replace(db_object);
-          ;
+          conn->run_on_writer([&](Storage& writer) {
+            writer.replace(db_object);
+          });
         } catch (const std::system_error& e) {
           EXPECT_STREQ(
               "FOREIGN KEY constraint failed: constraint failed", e.what()
@@ -749,7 +749,6 @@ TEST_F(TestSFSSQLiteVersionedObjects, StoreUnsupportedTimestamp) {
   );
 
   SQLiteVersionedObjects db_versions(conn);
-  auto storage = conn->get_storage();
 
   DBVersionedObject db_version;
 
@@ -769,8 +768,9 @@ TEST_F(TestSFSSQLiteVersionedObjects, StoreUnsupportedTimestamp) {
   EXPECT_THROW(
       {
         try {
-          storage.replace(db_version);
-          ;
+          conn->run_on_writer([&](Storage& writer) {
+            writer.replace(db_version);
+          });
         } catch (const std::system_error& e) {
           EXPECT_STREQ(
               "Error converting ceph::real_time to int64. Nanoseconds "
@@ -1723,6 +1723,47 @@ TEST_F(TestSFSSQLiteVersionedObjects, TestRemovedDeletedVersionsLimitMax) {
   EXPECT_TRUE(bucket_fully_deleted);
 }
 
+TEST_F(TestSFSSQLiteVersionedObjects, TestRemovedDeletedVersionsEqualSizes) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_log->start();
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+  auto db_versioned_objects = std::make_shared<SQLiteVersionedObjects>(conn);
+  createObject(
+      TEST_USERNAME, TEST_BUCKET, TEST_OBJECT_ID, ceph_context.get(), conn
+  );
+
+  // 10 deleted versions of the same size, and one to keep the object
+  for (uint id = 1; id <= 11; ++id) {
+    auto version =
+        createTestVersionedObject(id, TEST_OBJECT_ID, std::to_string(id));
+    version.object_state = id <= 10 ? rgw::sal::sfs::ObjectState::DELETED
+                                    : rgw::sal::sfs::ObjectState::COMMITTED;
+    version.version_type = rgw::sal::sfs::VersionType::REGULAR;
+    version.size = 100;
+    EXPECT_EQ(id, db_versioned_objects->insert_versioned_object(version));
+  }
+
+  // the versions removed are the ones returned, whichever the ties pick
+  size_t removed = 0;
+  while (removed < 10) {
+    auto deleted_objs =
+        db_versioned_objects->remove_deleted_versions_transact(3);
+    ASSERT_TRUE(deleted_objs.has_value());
+    ASSERT_EQ(std::min<size_t>(3, 10 - removed), deleted_objs->size());
+    for (const auto& obj : *deleted_objs) {
+      EXPECT_FALSE(
+          db_versioned_objects->get_versioned_object(get_version_id(obj), false)
+              .has_value()
+      );
+    }
+    removed += deleted_objs->size();
+    const auto versions = db_versioned_objects->get_versioned_object_ids(false);
+    EXPECT_EQ(11 - removed, versions.size());
+  }
+  EXPECT_TRUE(db_versioned_objects->get_versioned_object(11).has_value());
+}
+
 TEST_F(TestSFSSQLiteVersionedObjects, TestDeleteMarkerNotAlwaysOnTop) {
   // The scenario we test here could be recreated in a race condition situation
   // in which a delete_marker had a lower commit time than an alive version
@@ -1882,3 +1923,99 @@ TEST_F(TestSFSSQLiteVersionedObjects, TestSetAllOpenVersionsToDeleted) {
   EXPECT_EQ(1, committed);
   EXPECT_EQ(2, deleted);
 }
+
+TEST_F(TestSFSSQLiteVersionedObjects, TestStoreAndRemoveParts) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_log->start();
+
+  EXPECT_FALSE(fs::exists(getDBFullPath()));
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+
+  auto db_versioned_objects = std::make_shared<SQLiteVersionedObjects>(conn);
+
+  // Create the object, we need it because of foreign key constrains
+  createObject(
+      TEST_USERNAME, TEST_BUCKET, TEST_OBJECT_ID, ceph_context.get(), conn
+  );
+
+  auto object = createTestVersionedObject(1, TEST_OBJECT_ID, "1");
+  const auto id = db_versioned_objects->insert_versioned_object(object);
+  object.version_id = "test_version_id_2";
+  const auto other_id = db_versioned_objects->insert_versioned_object(object);
+
+  // a version without parts keeps its data in a single file
+  EXPECT_TRUE(db_versioned_objects->get_versioned_object_parts(id).empty());
+
+  // stored in reverse order, returned sorted by offset
+  std::vector<DBVersionedObjectPart> parts;
+  for (uint32_t i = 3; i > 0; --i) {
+    parts.push_back(
+        {.versioned_object_id = id,
+         .part_num = i - 1,
+         .object_offset = (i - 1) * 100ULL,
+         .size = 100}
+    );
+  }
+  db_versioned_objects->store_versioned_object_parts(parts);
+  db_versioned_objects->store_versioned_object_parts(
+      {{.versioned_object_id = other_id,
+        .part_num = 0,
+        .object_offset = 0,
+        .size = 42}}
+  );
+
+  auto stored = db_versioned_objects->get_versioned_object_parts(id);
+  ASSERT_EQ(3, stored.size());
+  for (uint32_t i = 0; i < stored.size(); ++i) {
+    EXPECT_EQ(id, stored[i].versioned_object_id);
+    EXPECT_EQ(i, stored[i].part_num);
+    EXPECT_EQ(i * 100, stored[i].object_offset);
+    EXPECT_EQ(100, stored[i].size);
+  }
+
+  // removing a version removes its parts, and only those
+  db_versioned_objects->remove_versioned_object(id);
+  EXPECT_TRUE(db_versioned_objects->get_versioned_object_parts(id).empty());
+  EXPECT_EQ(
+      1, db_versioned_objects->get_versioned_object_parts(other_id).size()
+  );
+}
+
+TEST_F(TestSFSSQLiteVersionedObjects, TestPartsAreStoredWithTheVersion) {
+  auto ceph_context = std::make_shared<CephContext>(CEPH_ENTITY_TYPE_CLIENT);
+  ceph_context->_conf.set_val("rgw_sfs_data_path", getTestDir());
+  ceph_context->_log->start();
+
+  DBConnRef conn = std::make_shared<DBConn>(ceph_context.get());
+  auto db_versioned_objects = std::make_shared<SQLiteVersionedObjects>(conn);
+  createObject(
+      TEST_USERNAME, TEST_BUCKET, TEST_OBJECT_ID, ceph_context.get(), conn
+  );
+
+  auto object = createTestVersionedObject(1, TEST_OBJECT_ID, "1");
+  object.id = db_versioned_objects->insert_versioned_object(object);
+  DBVersionData data;
+  data.parts.push_back(
+      {.versioned_object_id = object.id,
+       .part_num = 0,
+       .object_offset = 0,
+       .size = 100}
+  );
+
+  // not stored unless the version is
+  object.object_state = rgw::sal::sfs::ObjectState::COMMITTED;
+  EXPECT_FALSE(db_versioned_objects->store_versioned_object_if_state(
+      object, {rgw::sal::sfs::ObjectState::DELETED}, nullptr, &data
+  ));
+  EXPECT_TRUE(
+      db_versioned_objects->get_versioned_object_parts(object.id).empty()
+  );
+
+  EXPECT_TRUE(db_versioned_objects->store_versioned_object_if_state(
+      object, {rgw::sal::sfs::ObjectState::OPEN}, nullptr, &data
+  ));
+  EXPECT_EQ(
+      1, db_versioned_objects->get_versioned_object_parts(object.id).size()
+  );
+}
@@ -0,0 +1,224 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <sqlite3.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/sqlite/dbconn.h"
+#include "rgw/driver/sfs/sqlite/sqlite_versioned_objects.h"
+#include "rgw/driver/sfs/sfs_gc.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+/*
+  Checks what starting the store on an existing database leaves for
+  later: the versions left open by the previous run, deleted by the GC,
+  and the buckets, loaded on their first lookup. Also measures startup
+  on a large database against copying it, which the schema check used
+  to do. The size of that database is set with
+  SFS_STARTUP_BENCH_OBJECTS (e.g. 10000000).
+*/
+
+using namespace rgw::sal::sfs;
+using namespace rgw::sal::sfs::sqlite;
+
+namespace fs = std::filesystem;
+
+class TestSFSStartup : public SFSStoreFixture {
+ protected:
+  void restart() {
+    stopStore();
+    store.reset(new rgw::sal::SFStore(cct.get(), data_path));
+  }
+
+  DBVersionedObject openVersion(
+      const std::string& name, const std::string& version_id
+  ) {
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    auto version = db_versions.create_new_versioned_object_transact(
+        TEST_BUCKET, name, version_id
+    );
+    EXPECT_TRUE(version.has_value());
+    return *version;
+  }
+
+  DBVersionedObject commitVersion(
+      const std::string& name, const std::string& version_id
+  ) {
+    auto version = openVersion(name, version_id);
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    version.object_state = ObjectState::COMMITTED;
+    version.commit_time = ceph::real_clock::now();
+    EXPECT_TRUE(
+        db_versions.store_versioned_object_if_state(version, {ObjectState::OPEN})
+    );
+    return version;
+  }
+
+  /// The state of version `id`, DELETED if the GC removed it already
+  ObjectState versionState(uint id) {
+    SQLiteVersionedObjects db_versions(store->db_conn);
+    auto version = db_versions.get_versioned_object(id, false);
+    return version.has_value() ? version->object_state : ObjectState::DELETED;
+  }
+
+  static size_t benchObjects() {
+    const char* env = std::getenv("SFS_STARTUP_BENCH_OBJECTS");
+    return env ? std::strtoull(env, nullptr, 10) : 200000;
+  }
+};
+
+TEST_F(TestSFSStartup, stale_open_versions_are_deleted_by_the_gc) {
+  const auto stale = openVersion("stale", "v1");
+  const auto committed = commitVersion("committed", "v2");
+  restart();
+
+  // left for the gc rather than deleted on startup
+  EXPECT_EQ(versionState(stale.id), ObjectState::OPEN);
+  const auto fresh = openVersion("fresh", "v3");
+
+  store->gc->process();
+  EXPECT_EQ(versionState(stale.id), ObjectState::DELETED);
+  EXPECT_EQ(versionState(committed.id), ObjectState::COMMITTED);
+  // opened after the restart, by a writer still running
+  EXPECT_EQ(versionState(fresh.id), ObjectState::OPEN);
+}
+
+TEST_F(TestSFSStartup, buckets_are_loaded_on_first_lookup) {
+  storeBucket("other_bucket");
+  storeBucket("deleted_bucket", true);
+  restart();
+
+  auto bucket = store->get_bucket_ref(TEST_BUCKET);
+  ASSERT_TRUE(bucket);
+  EXPECT_EQ(bucket->get_owner().user_id.id, TEST_USERNAME);
+  // looked up again from the map
+  EXPECT_EQ(store->get_bucket_ref(TEST_BUCKET), bucket);
+  EXPECT_FALSE(store->get_bucket_ref("deleted_bucket"));
+  EXPECT_FALSE(store->get_bucket_ref("missing"));
+  EXPECT_TRUE(store->bucket_exists(rgw_bucket("", "other_bucket", "")));
+
+  // listing loads the buckets not looked up yet
+  restart();
+  bucket = store->get_bucket_ref(TEST_BUCKET);
+  const auto buckets = store->bucket_list();
+  ASSERT_EQ(buckets.size(), 2);
+  for (const auto& b : buckets) {
+    if (b->get_name() == TEST_BUCKET) {
+      EXPECT_EQ(b, bucket);
+    } else {
+      EXPECT_EQ(b->get_name(), "other_bucket");
+    }
+  }
+}
+
+TEST_F(TestSFSStartup, buckets_removed_while_listing_leave_the_others) {
+  const size_t num_buckets = 200;
+  for (size_t i = 0; i < num_buckets; ++i) {
+    storeBucket(fmt::format("kept_{}", i));
+    storeBucket(fmt::format("removed_{}", i));
+  }
+  restart();
+
+  // removals share shards with buckets the first listing is loading
+  std::thread remover([&]() {
+    for (size_t i = 0; i < num_buckets; ++i) {
+      const auto name = fmt::format("removed_{}", i);
+      storeBucket(name, true);
+      store->_delete_bucket(name);
+    }
+  });
+  store->bucket_list();
+  remover.join();
+
+  for (size_t i = 0; i < num_buckets; ++i) {
+    EXPECT_TRUE(store->get_bucket_ref(fmt::format("kept_{}", i))) << i;
+    EXPECT_FALSE(store->get_bucket_ref(fmt::format("removed_{}", i))) << i;
+  }
+  EXPECT_EQ(store->bucket_list().size(), num_buckets + 1);
+}
+
+TEST_F(TestSFSStartup, schema_check_does_not_copy_the_database) {
+  const auto copy_path =
+      data_path / (std::string(SCHEMA_DB_NAME) + std::string("_tmp"));
+  // as left behind by an interrupted check of older versions
+  std::ofstream(copy_path) << "stale";
+  restart();
+  EXPECT_FALSE(fs::exists(copy_path));
+  EXPECT_TRUE(store->get_bucket_ref(TEST_BUCKET));
+}
+
+TEST_F(TestSFSStartup, performance_startup) {
+  const size_t num_objects = benchObjects();
+  store->db_conn->run_on_writer([&](Storage& storage) {
+    auto transaction = storage.transaction_guard();
+    for (size_t i = 0; i < num_objects; i++) {
+      DBObject object;
+      object.uuid.generate_random();
+      object.bucket_id = TEST_BUCKET;
+      object.name = fmt::format("obj{:09}", i);
+      storage.replace(object);
+      DBVersionedObject version{};
+      version.object_id = object.uuid;
+      version.size = 10;
+      version.create_time = version.commit_time = version.mtime =
+          ceph::real_clock::now();
+      // a version in a hundred left open by writers of this run
+      version.object_state =
+          i % 100 ? ObjectState::COMMITTED : ObjectState::OPEN;
+      version.version_id = fmt::format("v{}", i);
+      storage.insert(version);
+    }
+    transaction.commit();
+  });
+  stopStore();
+
+  auto start = ceph::mono_clock::now();
+  store.reset(new rgw::sal::SFStore(cct.get(), data_path));
+  ASSERT_TRUE(store->get_bucket_ref(TEST_BUCKET));
+  const auto startup_elapsed = ceph::mono_clock::now() - start;
+
+  // what startup used to do before checking the schema
+  const auto db_path = data_path / std::string(SCHEMA_DB_NAME);
+  const auto copy_path = data_path / "startup_bench_copy.db";
+  start = ceph::mono_clock::now();
+  sqlite3* src = nullptr;
+  sqlite3* dst = nullptr;
+  ASSERT_EQ(sqlite3_open(db_path.c_str(), &src), SQLITE_OK);
+  ASSERT_EQ(sqlite3_open(copy_path.c_str(), &dst), SQLITE_OK);
+  auto backup = sqlite3_backup_init(dst, "main", src, "main");
+  ASSERT_NE(backup, nullptr);
+  sqlite3_backup_step(backup, -1);
+  sqlite3_backup_finish(backup);
+  sqlite3_close(dst);
+  sqlite3_close(src);
+  const auto copy_elapsed = ceph::mono_clock::now() - start;
+  fs::remove(copy_path);
+
+  lderr(cct.get()) << fmt::format(
+                          "startup with {} objects: {:.1f}ms, full database "
+                          "copy {:.1f}ms",
+                          num_objects,
+                          std::chrono::duration<double, std::milli>(
+                              startup_elapsed
+                          )
+                              .count(),
+                          std::chrono::duration<double, std::milli>(
+                              copy_elapsed
+                          )
+                              .count()
+                      )
+                   << dendl;
+}
@@ -0,0 +1,174 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "common/ceph_context.h"
+#include "common/ceph_crypto.h"
+#include "common/ceph_time.h"
+#include "rgw/driver/sfs/write_pipeline.h"
+#include "rgw/driver/sfs/writer.h"
+#include "rgw/rgw_common.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "rgw_sfs_store_fixture.h"
+
+using namespace rgw::sal::sfs;
+
+namespace fs = std::filesystem;
+
+class TestSFSWritePipeline : public SFSStoreFixture {
+ protected:
+  static bufferlist make_data(size_t size, char seed) {
+    bufferlist bl;
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<char>('a' + (i + seed) % 26);
+    }
+    bl.append(data);
+    return bl;
+  }
+
+  static std::string read_file(const fs::path& path) {
+    std::ifstream ifs(path, std::ifstream::binary);
+    return {std::istreambuf_iterator<char>(ifs), {}};
+  }
+};
+
+TEST_F(TestSFSWritePipeline, writes_synchronously_without_queue) {
+  const auto path = data_path / "file";
+  const int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+  ASSERT_GE(fd, 0);
+  WritePipeline pipeline(nullptr, 4);
+  ASSERT_EQ(pipeline.write(fd, make_data(100, 0), 0, null_yield), 0);
+  // written already
+  EXPECT_EQ(read_file(path), make_data(100, 0).to_str());
+  EXPECT_EQ(pipeline.drain(null_yield), 0);
+  ::close(fd);
+}
+
+TEST_F(TestSFSWritePipeline, writes_all_pieces_in_place) {
+  const auto path = data_path / "file";
+  const int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+  ASSERT_GE(fd, 0);
+  DataIOQueue queue(4, "sfs_data_write");
+  WritePipeline pipeline(&queue, 3);
+
+  const size_t piece_size = 64 * 1024;
+  std::string expected;
+  for (size_t i = 0; i < 32; i++) {
+    auto piece = make_data(piece_size, static_cast<char>(i));
+    expected += piece.to_str();
+    ASSERT_EQ(
+        pipeline.write(fd, std::move(piece), i * piece_size, null_yield), 0
+    );
+  }
+  ASSERT_EQ(pipeline.drain(null_yield), 0);
+  ::close(fd);
+  EXPECT_EQ(read_file(path), expected);
+}
+
+TEST_F(TestSFSWritePipeline, reports_failed_writes) {
+  const auto path = data_path / "file";
+  std::ofstream(path) << "data";
+  // not open for writing
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  ASSERT_GE(fd, 0);
+  DataIOQueue queue(1, "sfs_data_write");
+  WritePipeline pipeline(&queue, 2);
+
+  // queued, the error shows up later
+  EXPECT_EQ(pipeline.write(fd, make_data(100, 0), 0, null_yield), 0);
+  EXPECT_EQ(pipeline.drain(null_yield), -EBADF);
+  // and stays
+  EXPECT_EQ(pipeline.write(fd, make_data(100, 0), 100, null_yield), -EBADF);
+  EXPECT_EQ(pipeline.drain(null_yield), -EBADF);
+  ::close(fd);
+}
+
+/*
+  Measures a single stream PUT of a large object through SFSAtomicWriter:
+  every piece is hashed for its ETag, as RGWPutObj does, before it is
+  handed to the writer. "sync" writes each piece before hashing the next
+  one, "pipelined" writes it in the background while the next one is
+  hashed.
+*/
+
+class TestSFSWritePipelinePerf : public TestSFSWritePipeline,
+                                 public ::testing::WithParamInterface<size_t> {
+ protected:
+  void SetUp() override {
+    cct->_conf.set_val(
+        "rgw_sfs_write_pipeline_depth", std::to_string(GetParam())
+    );
+    TestSFSWritePipeline::SetUp();
+  }
+};
+
+TEST_P(TestSFSWritePipelinePerf, put_large_object) {
+  const size_t piece_size = 4 * 1024 * 1024;
+  const size_t object_size = 512 * 1024 * 1024;
+
+  auto object = bucket->get_object(rgw_obj_key("large"));
+  const rgw_placement_rule placement;
+  const std::string unique_tag = "tag";
+  auto writer = store->get_atomic_writer(
+      ndp.get(), null_yield, object.get(), user->get_id(), &placement, 0,
+      unique_tag
+  );
+  ASSERT_EQ(writer->prepare(null_yield), 0);
+
+  const auto piece = make_data(piece_size, 0);
+  ceph::crypto::MD5 md5;
+  md5.SetFlags(EVP_MD_CTX_FLAG_NON_FIPS_ALLOW);
+  const auto start = ceph::mono_clock::now();
+  for (uint64_t offset = 0; offset < object_size; offset += piece_size) {
+    bufferlist data;
+    data.append(piece.front().c_str(), piece_size);
+    hash_update(md5, data);
+    ASSERT_EQ(writer->process(std::move(data), offset), 0);
+  }
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  md5.Final(digest);
+  char etag[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
+  buf_to_hex(digest, CEPH_CRYPTO_MD5_DIGESTSIZE, etag);
+  std::map<std::string, bufferlist> attrs;
+  ASSERT_EQ(
+      writer->complete(
+          object_size, etag, nullptr, ceph::real_time(), attrs,
+          ceph::real_time(), nullptr, nullptr, nullptr, nullptr, nullptr,
+          null_yield
+      ),
+      0
+  );
+  const std::chrono::duration<double> elapsed =
+      ceph::mono_clock::now() - start;
+
+  lderr(cct.get()) << fmt::format(
+                          "{}: {} MiB in pieces of {} MiB in {:.3f}s: "
+                          "{:.2f} GiB/s",
+                          GetParam() == 0 ? "sync" : "pipelined",
+                          object_size >> 20, piece_size >> 20,
+                          elapsed.count(),
+                          (object_size / elapsed.count()) / (1 << 30)
+                      )
+                   << dendl;
+  writer.reset();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    LargeObjects, TestSFSWritePipelinePerf,
+    testing::Values(size_t{0}, size_t{2}),
+    [](const testing::TestParamInfo<TestSFSWritePipelinePerf::ParamType>& info
+    ) { return info.param == 0 ? "sync" : "pipelined"; }
+);
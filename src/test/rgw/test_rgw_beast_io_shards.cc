@@ -0,0 +1,121 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/ceph_context.h"
+#include "common/perf_counters_collection.h"
+#include "global/global_context.h"
+#include "rgw/rgw_asio_frontend.h"
+#include "rgw/rgw_dmclock_scheduler_ctx.h"
+#include "rgw/rgw_process_env.h"
+#include "sfs/rgw_sfs_store_fixture.h"
+
+/*
+  Starts the beast frontend with rgw_beast_io_shards and checks that the
+  SO_REUSEPORT listener of every shard accepts connections. The frontend
+  only needs a driver for its CephContext, an SFStore provides it.
+*/
+
+using boost::asio::ip::tcp;
+using namespace std::chrono_literals;
+
+class TestBeastIOShards : public SFSStoreFixture {
+ protected:
+  static constexpr size_t NUM_SHARDS = 4;
+  RGWProcessEnv env;
+
+  void SetUp() override {
+    cct->_conf.set_val("rgw_beast_io_shards", std::to_string(NUM_SHARDS));
+    SFSStoreFixture::SetUp();
+    // RGWFrontendConfig logs to it
+    g_ceph_context = cct.get();
+    env.driver = store.get();
+  }
+
+  void TearDown() override {
+    g_ceph_context = nullptr;
+    SFSStoreFixture::TearDown();
+  }
+
+  /// A port nothing listens on
+  static unsigned short freePort() {
+    boost::asio::io_context context;
+    tcp::acceptor acceptor(
+        context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)
+    );
+    return acceptor.local_endpoint().port();
+  }
+
+  /// The connections accepted by each shard so far
+  std::vector<uint64_t> shardConnections() {
+    std::vector<uint64_t> result(NUM_SHARDS, 0);
+    cct->get_perfcounters_collection()->with_counters(
+        [&](const PerfCountersCollectionImpl::CounterMap& by_path) {
+          for (size_t shard = 0; shard < NUM_SHARDS; shard++) {
+            const auto i =
+                by_path.find(fmt::format("beast_shard.{}.connections", shard));
+            if (i != by_path.end()) {
+              result[shard] = i->second.data->u64;
+            }
+          }
+        }
+    );
+    return result;
+  }
+};
+
+TEST_F(TestBeastIOShards, every_shard_accepts_connections) {
+  const size_t num_connections = 200;
+  const auto port = freePort();
+  RGWFrontendConfig config(fmt::format("beast endpoint=127.0.0.1:{}", port));
+  ASSERT_EQ(config.init(), 0);
+  rgw::dmclock::SchedulerCtx sched_ctx(cct.get());
+  RGWAsioFrontend frontend(env, &config, sched_ctx);
+  ASSERT_EQ(frontend.init(), 0);
+  ASSERT_EQ(frontend.run(), 0);
+
+  // the kernel spreads them over the listeners of the shards by their
+  // source ports
+  boost::asio::io_context context;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  for (size_t i = 0; i < num_connections; i++) {
+    tcp::socket socket(context);
+    boost::system::error_code ec;
+    socket.connect(endpoint, ec);
+    ASSERT_FALSE(ec) << ec.message();
+    socket.close();
+  }
+
+  // counted once the shard spawned the coroutine serving the connection
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  std::vector<uint64_t> accepted;
+  do {
+    accepted = shardConnections();
+    if (std::accumulate(accepted.begin(), accepted.end(), uint64_t{0}) ==
+        num_connections) {
+      break;
+    }
+    std::this_thread::sleep_for(10ms);
+  } while (std::chrono::steady_clock::now() < deadline);
+  frontend.stop();
+  frontend.join();
+
+  EXPECT_EQ(
+      std::accumulate(accepted.begin(), accepted.end(), uint64_t{0}),
+      num_connections
+  );
+  for (size_t shard = 0; shard < NUM_SHARDS; shard++) {
+    EXPECT_GT(accepted[shard], 0u) << "shard " << shard;
+  }
+}
@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "common/ceph_context.h"
+#include "rgw/rgw_bucket_policy_cache.h"
+#include "rgw/rgw_perf_counters.h"
+#include "rgw/rgw_sal_sfs.h"
+#include "sfs/rgw_sfs_store_fixture.h"
+
+static bufferlist make_policy(const std::string& bucket) {
+  bufferlist bl;
+  bl.append(
+      R"({"Version": "2012-10-17", "Statement": [{"Effect": "Allow", )"
+      R"("Principal": {"AWS": ["arn:aws:iam:::user/)" +
+      TEST_USERNAME + R"("]}, "Action": "s3:GetObject", )"
+      R"("Resource": "arn:aws:s3:::)" +
+      bucket + R"(/*"}]})"
+  );
+  return bl;
+}
+
+class TestBucketPolicyCache : public SFSStoreFixture {
+ protected:
+  RGWBucketPolicyCache& cache() {
+    return RGWBucketPolicyCache::get(cct.get());
+  }
+
+  uint64_t hits() { return perfcounter->get(l_rgw_bucket_policy_cache_hit); }
+  uint64_t misses() {
+    return perfcounter->get(l_rgw_bucket_policy_cache_miss);
+  }
+};
+
+TEST_F(TestBucketPolicyCache, policies_are_parsed_once) {
+  const auto raw = make_policy(TEST_BUCKET);
+  const auto hits_before = hits();
+  const auto misses_before = misses();
+  const auto policy = cache().get_policy(cct.get(), TEST_BUCKET, "", raw);
+  ASSERT_TRUE(policy);
+  EXPECT_EQ(policy->statements.size(), 1);
+  // a copy of the same attr, as the next request reads it
+  const auto same = make_policy(TEST_BUCKET);
+  EXPECT_EQ(cache().get_policy(cct.get(), TEST_BUCKET, "", same), policy);
+  EXPECT_EQ(hits(), hits_before + 1);
+  EXPECT_EQ(misses(), misses_before + 1);
+
+  // a different policy, or tenant, parses again
+  const auto other = make_policy("other");
+  EXPECT_NE(cache().get_policy(cct.get(), TEST_BUCKET, "", other), policy);
+  EXPECT_NE(
+      cache().get_policy(cct.get(), TEST_BUCKET, "tenant", other), policy
+  );
+  EXPECT_EQ(misses(), misses_before + 3);
+
+  bufferlist broken;
+  broken.append("{");
+  EXPECT_THROW(
+      cache().get_policy(cct.get(), TEST_BUCKET, "", broken),
+      rgw::IAM::PolicyParseException
+  );
+}
+
+TEST_F(TestBucketPolicyCache, acls_are_decoded_once) {
+  RGWAccessControlPolicy acl(cct.get());
+  std::string display_name = "display name";
+  acl.create_default(rgw_user(TEST_USERNAME), display_name);
+  bufferlist raw;
+  acl.encode(raw);
+
+  std::shared_ptr<const RGWAccessControlPolicy> first, second;
+  ASSERT_EQ(cache().get_acl(ndp.get(), cct.get(), TEST_BUCKET, raw, first), 0);
+  const auto hits_before = hits();
+  ASSERT_EQ(cache().get_acl(ndp.get(), cct.get(), TEST_BUCKET, raw, second), 0);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(hits(), hits_before + 1);
+  // requests share it, and can still copy it
+  RGWAccessControlPolicy copy = *second;
+  EXPECT_EQ(copy.get_owner().get_id(), rgw_user(TEST_USERNAME));
+
+  bufferlist broken;
+  broken.append("broken");
+  EXPECT_EQ(
+      cache().get_acl(ndp.get(), cct.get(), TEST_BUCKET, broken, second), -EIO
+  );
+}
+
+TEST_F(TestBucketPolicyCache, disabled_cache_parses_every_time) {
+  cct->_conf.set_val("rgw_bucket_policy_cache_size", "0");
+  const auto raw = make_policy(TEST_BUCKET);
+  const auto misses_before = misses();
+  EXPECT_NE(
+      cache().get_policy(cct.get(), TEST_BUCKET, "", raw),
+      cache().get_policy(cct.get(), TEST_BUCKET, "", raw)
+  );
+  EXPECT_EQ(misses(), misses_before + 2);
+}
+
+TEST_F(TestBucketPolicyCache, bucket_changes_invalidate) {
+  const auto raw = make_policy(TEST_BUCKET);
+  const auto policy =
+      cache().get_policy(cct.get(), bucket->get_bucket_id(), "", raw);
+  ASSERT_EQ(
+      cache().get_policy(cct.get(), bucket->get_bucket_id(), "", raw), policy
+  );
+
+  rgw::sal::Attrs attrs = bucket->get_attrs();
+  attrs[RGW_ATTR_IAM_POLICY] = make_policy("other");
+  ASSERT_EQ(bucket->merge_and_store_attrs(ndp.get(), attrs, null_yield), 0);
+  // dropped, even though the old attr would still match it
+  EXPECT_NE(
+      cache().get_policy(cct.get(), bucket->get_bucket_id(), "", raw), policy
+  );
+
+  RGWAccessControlPolicy acl(cct.get());
+  std::string display_name = "display name";
+  acl.create_default(rgw_user(TEST_USERNAME), display_name);
+  bufferlist acl_raw;
+  acl.encode(acl_raw);
+  std::shared_ptr<const RGWAccessControlPolicy> cached;
+  ASSERT_EQ(
+      cache().get_acl(
+          ndp.get(), cct.get(), bucket->get_bucket_id(), acl_raw, cached
+      ),
+      0
+  );
+  ASSERT_EQ(bucket->set_acl(ndp.get(), acl, null_yield), 0);
+  std::shared_ptr<const RGWAccessControlPolicy> after;
+  ASSERT_EQ(
+      cache().get_acl(
+          ndp.get(), cct.get(), bucket->get_bucket_id(), acl_raw, after
+      ),
+      0
+  );
+  EXPECT_NE(after, cached);
+}
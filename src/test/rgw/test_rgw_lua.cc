@@ -589,9 +589,10 @@ TEST(TestRGWLua, UseFunction)
   s.user_acl.reset(new RGWAccessControlPolicy());
   s.user_acl->get_owner().set_name("user three");
   s.user_acl->get_owner().set_id(rgw_user("tenant3", "user3"));
-  s.bucket_acl.reset(new RGWAccessControlPolicy());
-  s.bucket_acl->get_owner().set_name("user four");
-  s.bucket_acl->get_owner().set_id(rgw_user("tenant4", "user4"));
+  auto bucket_acl = std::make_shared<RGWAccessControlPolicy>();
+  bucket_acl->get_owner().set_name("user four");
+  bucket_acl->get_owner().set_id(rgw_user("tenant4", "user4"));
+  s.bucket_acl = bucket_acl;
   s.object_acl.reset(new RGWAccessControlPolicy());
   s.object_acl->get_owner().set_name("user five");
   s.object_acl->get_owner().set_id(rgw_user("tenant5", "user5"));
@@ -2,6 +2,8 @@
 // vim: ts=8 sw=2 smarttab ft=cpp
 
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
 #include "rgw_ratelimit.h"
 
 
@@ -188,6 +190,111 @@ TEST(RGWRateLimit, allow_unlimited_access)
   EXPECT_EQ(false, success);
 }
 
+TEST(RGWRateLimit, concurrent_requests_share_tokens)
+{
+  // requests of a key from many threads get exactly its tokens
+  std::atomic_bool replacing;
+  std::condition_variable cv;
+  RateLimiter ratelimit(replacing, cv);
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  info.max_read_ops = 1000;
+  const auto time = ceph::coarse_real_clock::now();
+  const RGWRateLimitKey key("uuser123");
+  std::atomic_int accepted = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; i++) {
+        if (!ratelimit.should_rate_limit("GET", key, time, &info)) {
+          accepted++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1000, accepted);
+}
+TEST(RGWRateLimit, idle_entries_expire)
+{
+  // entries unused for long enough are forgotten as new ones are added
+  std::atomic_bool replacing;
+  std::condition_variable cv;
+  RateLimiter ratelimit(replacing, cv);
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  auto time = ceph::coarse_real_clock::now();
+  for (int i = 0; i < 200000; i++) {
+    ratelimit.should_rate_limit("GET", "uold" + std::to_string(i), time, &info);
+  }
+  EXPECT_EQ(200000u, ratelimit.size());
+  time += RateLimiterEntry::idle_expiry;
+  for (int i = 0; i < 200000; i++) {
+    ratelimit.should_rate_limit("GET", "unew" + std::to_string(i), time, &info);
+  }
+  EXPECT_LT(ratelimit.size(), 400000u);
+  EXPECT_FALSE(replacing);
+}
+TEST(RGWRateLimit, recent_entries_do_not_expire)
+{
+  // entries that may not have refilled their tokens yet are kept
+  std::atomic_bool replacing;
+  std::condition_variable cv;
+  RateLimiter ratelimit(replacing, cv);
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  auto time = ceph::coarse_real_clock::now();
+  for (int i = 0; i < 200000; i++) {
+    ratelimit.should_rate_limit("GET", "uold" + std::to_string(i), time, &info);
+  }
+  time += 2min;
+  for (int i = 0; i < 200000; i++) {
+    ratelimit.should_rate_limit("GET", "unew" + std::to_string(i), time, &info);
+  }
+  EXPECT_EQ(400000u, ratelimit.size());
+}
+TEST(RGWRateLimit, keys_of_users_and_buckets_are_distinct)
+{
+  // the kind, tenant and id of a key all tell entries apart
+  std::atomic_bool replacing;
+  std::condition_variable cv;
+  RateLimiter ratelimit(replacing, cv);
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  info.max_read_ops = 1;
+  auto time = ceph::coarse_real_clock::now();
+  const rgw_user user("tenant", "user123");
+  const rgw_user other_tenant("other", "user123");
+  const rgw_user no_tenant("user123");
+  const std::string marker = "user123";
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", RGWRateLimitKey(user), time, &info));
+  EXPECT_TRUE(ratelimit.should_rate_limit("GET", RGWRateLimitKey(user), time, &info));
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", RGWRateLimitKey(other_tenant), time, &info));
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", RGWRateLimitKey(no_tenant), time, &info));
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", RGWRateLimitKey('b', marker), time, &info));
+  EXPECT_EQ(4u, ratelimit.size());
+}
+TEST(RGWRateLimit, entries_outlive_clear)
+{
+  // an entry found for a request stays usable after the RateLimiter forgets it
+  std::atomic_bool replacing;
+  std::condition_variable cv;
+  RateLimiter ratelimit(replacing, cv);
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  info.max_read_bytes = 1;
+  auto time = ceph::coarse_real_clock::now();
+  RateLimiter::entry_ref entry;
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", "uuser123", time, &info, &entry));
+  ASSERT_TRUE(entry);
+  ratelimit.clear();
+  ratelimit.decrease_bytes("GET", entry, 1000, &info);
+  EXPECT_TRUE(entry->should_rate_limit(true, &info, time.time_since_epoch()));
+  EXPECT_FALSE(ratelimit.should_rate_limit("GET", "uuser123", time, &info));
+}
+
 TEST(RGWRateLimitGC, NO_GC_AHEAD_OF_TIME)
 {
   // Test if GC is not starting the replace before getting to map_size * 0.9
@@ -374,3 +481,37 @@ TEST(RGWRateLimitEntry, allow_unlimited_access)
   bool success = entry.should_rate_limit(true,  &info, time);
   EXPECT_EQ(false, success);
 }
+TEST(RGWRateLimitEntry, concurrent_refill_adds_tokens_first)
+{
+  // requests racing on a refill see its tokens, none of them is rejected
+  RateLimiterEntry entry;
+  RGWRateLimitInfo info;
+  info.enabled = true;
+  info.max_read_ops = 64;
+  auto time = ceph::coarse_real_clock::now().time_since_epoch();
+  for (int i = 0; i < 64; i++) {
+    EXPECT_FALSE(entry.should_rate_limit(true, &info, time));
+  }
+  EXPECT_TRUE(entry.should_rate_limit(true, &info, time));
+  time += 61s;
+  std::atomic_bool start = false;
+  std::atomic_int rejected = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&]() {
+      while (!start) {
+      }
+      for (int i = 0; i < 8; i++) {
+        if (entry.should_rate_limit(true, &info, time)) {
+          rejected++;
+        }
+      }
+    });
+  }
+  start = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, rejected);
+  EXPECT_TRUE(entry.should_rate_limit(true, &info, time));
+}
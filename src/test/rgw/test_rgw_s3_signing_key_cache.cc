@@ -0,0 +1,105 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "common/ceph_context.h"
+#include "rgw/rgw_auth_s3.h"
+#include "rgw/rgw_perf_counters.h"
+
+using rgw::auth::s3::get_v4_signature;
+
+static const std::string SCOPE = "20230101/us-east-1/s3/aws4_request";
+static const std::string NEXT_DAY_SCOPE =
+    "20230102/us-east-1/s3/aws4_request";
+static const std::string SECRET = "secret";
+static const std::string STRING_TO_SIGN = "AWS4-HMAC-SHA256\nstring to sign";
+
+class TestSigningKeyCache : public ::testing::Test {
+ protected:
+  const std::unique_ptr<CephContext> cct{
+      new CephContext(CEPH_ENTITY_TYPE_ANY)};
+  std::unique_ptr<NoDoutPrefix> ndp;
+
+  void SetUp() override {
+    rgw_perf_start(cct.get());
+    ndp = std::make_unique<NoDoutPrefix>(cct.get(), 1);
+  }
+
+  uint64_t hits() { return perfcounter->get(l_rgw_s3_signing_key_cache_hit); }
+  uint64_t misses() {
+    return perfcounter->get(l_rgw_s3_signing_key_cache_miss);
+  }
+
+  std::string sign(
+      CephContext* context, const std::string& scope,
+      const std::string& secret
+  ) {
+    return get_v4_signature(scope, context, secret, STRING_TO_SIGN, ndp.get());
+  }
+
+  /// The signature computed without the cache
+  std::string uncachedSignature(
+      const std::string& scope, const std::string& secret
+  ) {
+    std::unique_ptr<CephContext> uncached{
+        new CephContext(CEPH_ENTITY_TYPE_ANY)};
+    uncached->_conf.set_val("rgw_s3_signing_key_cache_size", "0");
+    return sign(uncached.get(), scope, secret);
+  }
+};
+
+TEST_F(TestSigningKeyCache, signing_keys_are_derived_once) {
+  const auto hits_before = hits();
+  const auto misses_before = misses();
+  const auto signature = sign(cct.get(), SCOPE, SECRET);
+  EXPECT_EQ(misses(), misses_before + 1);
+  EXPECT_EQ(sign(cct.get(), SCOPE, SECRET), signature);
+  EXPECT_EQ(hits(), hits_before + 1);
+  EXPECT_EQ(misses(), misses_before + 1);
+  EXPECT_EQ(signature, uncachedSignature(SCOPE, SECRET));
+}
+
+TEST_F(TestSigningKeyCache, new_secret_or_date_derives_again) {
+  const auto signature = sign(cct.get(), SCOPE, SECRET);
+  const auto hits_before = hits();
+  const auto misses_before = misses();
+
+  const auto other_secret = sign(cct.get(), SCOPE, "other secret");
+  EXPECT_NE(other_secret, signature);
+  EXPECT_EQ(other_secret, uncachedSignature(SCOPE, "other secret"));
+  const auto next_day = sign(cct.get(), NEXT_DAY_SCOPE, SECRET);
+  EXPECT_NE(next_day, signature);
+  EXPECT_EQ(next_day, uncachedSignature(NEXT_DAY_SCOPE, SECRET));
+  EXPECT_EQ(hits(), hits_before);
+  EXPECT_EQ(misses(), misses_before + 2);
+
+  // the previous key is still cached
+  EXPECT_EQ(sign(cct.get(), SCOPE, SECRET), signature);
+  EXPECT_EQ(hits(), hits_before + 1);
+}
+
+TEST_F(TestSigningKeyCache, caches_are_per_ceph_context) {
+  const auto signature = sign(cct.get(), SCOPE, SECRET);
+  const std::unique_ptr<CephContext> other{
+      new CephContext(CEPH_ENTITY_TYPE_ANY)};
+  const auto hits_before = hits();
+  const auto misses_before = misses();
+  EXPECT_EQ(sign(other.get(), SCOPE, SECRET), signature);
+  EXPECT_EQ(hits(), hits_before);
+  EXPECT_EQ(misses(), misses_before + 1);
+  EXPECT_EQ(sign(other.get(), SCOPE, SECRET), signature);
+  EXPECT_EQ(hits(), hits_before + 1);
+}
+
+TEST_F(TestSigningKeyCache, disabled_cache_derives_every_time) {
+  cct->_conf.set_val("rgw_s3_signing_key_cache_size", "0");
+  const auto hits_before = hits();
+  const auto misses_before = misses();
+  EXPECT_EQ(sign(cct.get(), SCOPE, SECRET), sign(cct.get(), SCOPE, SECRET));
+  EXPECT_EQ(hits(), hits_before);
+  EXPECT_EQ(misses(), misses_before);
+}